@@ -0,0 +1,288 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/sample_common.h"
+#include "rkmedia_api.h"
+#include "rkmedia_venc.h"
+
+// One thread gets the packets of two encoders, H264 and MJPEG, from one VI:
+// it waits on the fd of RK_MPI_SYS_CreateChnWaitFd and gets the buffers of
+// the ready channels with RK_MPI_SYS_GetMediaBuffers.
+
+#define VENC_CHN_NUM 2
+#define MB_BATCH_NUM 8
+
+static bool quit = false;
+static void sigterm_handler(int sig) {
+  fprintf(stderr, "signal %d\n", sig);
+  quit = true;
+}
+
+static RK_CHAR optstr[] = "?::a::w:h:c:o:d:I:";
+static const struct option long_options[] = {
+    {"aiq", optional_argument, NULL, 'a'},
+    {"device_name", required_argument, NULL, 'd'},
+    {"width", required_argument, NULL, 'w'},
+    {"height", required_argument, NULL, 'h'},
+    {"frame_cnt", required_argument, NULL, 'c'},
+    {"output_dir", required_argument, NULL, 'o'},
+    {"camid", required_argument, NULL, 'I'},
+    {"help", optional_argument, NULL, '?'},
+    {NULL, 0, NULL, 0},
+};
+
+static void print_usage(const RK_CHAR *name) {
+  printf("usage example:\n");
+#ifdef RKAIQ
+  printf("\t%s [-a [iqfiles_dir]] [-w 1920] [-h 1080] [-c 150] "
+         "[-d rkispp_scale0] [-I 0] [-o /tmp] \n",
+         name);
+  printf("\t-a | --aiq: enable aiq with dirpath provided, eg:-a "
+         "/oem/etc/iqfiles/, "
+         "set dirpath emtpty to using path by default, without this option aiq "
+         "should run in other application\n");
+#else
+  printf("\t%s [-w 1920] [-h 1080] [-c 150] [-d rkispp_scale0] [-I 0] "
+         "[-o /tmp] \n",
+         name);
+#endif
+  printf("\t-w | --width: VI width, Default:1920\n");
+  printf("\t-h | --heght: VI height, Default:1080\n");
+  printf("\t-c | --frame_cnt: h264 packets to get, Default:150\n");
+  printf("\t-I | --camid: camera ctx id, Default 0\n");
+  printf("\t-d | --device_name set pcDeviceName, Default:rkispp_scale0, "
+         "Option:[rkispp_scale0, rkispp_scale1, rkispp_scale2]\n");
+  printf("\t-o | --output_dir: write main.h264 and main.mjpeg there, "
+         "Default:NULL\n");
+}
+
+static int create_venc(VENC_CHN VeChn, CODEC_TYPE_E enCodecType,
+                       RK_U32 u32Width, RK_U32 u32Height, RK_U32 u32Fps) {
+  VENC_CHN_ATTR_S venc_chn_attr;
+  memset(&venc_chn_attr, 0, sizeof(venc_chn_attr));
+  if (enCodecType == RK_CODEC_TYPE_MJPEG) {
+    venc_chn_attr.stVencAttr.enType = RK_CODEC_TYPE_MJPEG;
+    venc_chn_attr.stRcAttr.enRcMode = VENC_RC_MODE_MJPEGCBR;
+    venc_chn_attr.stRcAttr.stMjpegCbr.fr32DstFrameRateDen = 1;
+    venc_chn_attr.stRcAttr.stMjpegCbr.fr32DstFrameRateNum = u32Fps;
+    venc_chn_attr.stRcAttr.stMjpegCbr.u32SrcFrameRateDen = 1;
+    venc_chn_attr.stRcAttr.stMjpegCbr.u32SrcFrameRateNum = 30;
+    venc_chn_attr.stRcAttr.stMjpegCbr.u32BitRate = u32Width * u32Height * 8;
+  } else {
+    venc_chn_attr.stVencAttr.enType = RK_CODEC_TYPE_H264;
+    venc_chn_attr.stRcAttr.enRcMode = VENC_RC_MODE_H264CBR;
+    venc_chn_attr.stRcAttr.stH264Cbr.u32Gop = 30;
+    venc_chn_attr.stRcAttr.stH264Cbr.u32BitRate = u32Width * u32Height;
+    venc_chn_attr.stRcAttr.stH264Cbr.fr32DstFrameRateDen = 1;
+    venc_chn_attr.stRcAttr.stH264Cbr.fr32DstFrameRateNum = u32Fps;
+    venc_chn_attr.stRcAttr.stH264Cbr.u32SrcFrameRateDen = 1;
+    venc_chn_attr.stRcAttr.stH264Cbr.u32SrcFrameRateNum = 30;
+    venc_chn_attr.stVencAttr.u32Profile = 77;
+  }
+  venc_chn_attr.stVencAttr.imageType = IMAGE_TYPE_NV12;
+  venc_chn_attr.stVencAttr.u32PicWidth = u32Width;
+  venc_chn_attr.stVencAttr.u32PicHeight = u32Height;
+  venc_chn_attr.stVencAttr.u32VirWidth = u32Width;
+  venc_chn_attr.stVencAttr.u32VirHeight = u32Height;
+  return RK_MPI_VENC_CreateChn(VeChn, &venc_chn_attr);
+}
+
+int main(int argc, char *argv[]) {
+  RK_U32 u32Width = 1920;
+  RK_U32 u32Height = 1080;
+  RK_CHAR *pDeviceName = "rkispp_scale0";
+  RK_CHAR *pOutDir = NULL;
+  RK_CHAR *pIqfilesPath = NULL;
+  RK_S32 s32CamId = 0;
+  RK_S32 s32FrameCnt = 150;
+  FILE *output_files[VENC_CHN_NUM] = {NULL, NULL};
+  RK_U32 packet_cnt[VENC_CHN_NUM] = {0, 0};
+  RK_U32 wakeup_cnt = 0;
+  int ret = 0;
+  int c;
+
+  while ((c = getopt_long(argc, argv, optstr, long_options, NULL)) != -1) {
+    const char *tmp_optarg = optarg;
+    switch (c) {
+    case 'a':
+      if (!optarg && NULL != argv[optind] && '-' != argv[optind][0]) {
+        tmp_optarg = argv[optind++];
+      }
+      if (tmp_optarg) {
+        pIqfilesPath = (char *)tmp_optarg;
+      } else {
+        pIqfilesPath = "/oem/etc/iqfiles";
+      }
+      break;
+    case 'w':
+      u32Width = atoi(optarg);
+      break;
+    case 'h':
+      u32Height = atoi(optarg);
+      break;
+    case 'c':
+      s32FrameCnt = atoi(optarg);
+      break;
+    case 'o':
+      pOutDir = optarg;
+      break;
+    case 'd':
+      pDeviceName = optarg;
+      break;
+    case 'I':
+      s32CamId = atoi(optarg);
+      break;
+    case '?':
+    default:
+      print_usage(argv[0]);
+      return 0;
+    }
+  }
+
+  printf("#Device: %s\n", pDeviceName);
+  printf("#Resolution: %dx%d\n", u32Width, u32Height);
+  printf("#Frame Count to get: %d\n", s32FrameCnt);
+  printf("#Output Dir: %s\n", pOutDir);
+  printf("#CameraIdx: %d\n\n", s32CamId);
+
+  if (pIqfilesPath) {
+#ifdef RKAIQ
+    SAMPLE_COMM_ISP_Init(s32CamId, RK_AIQ_WORKING_MODE_NORMAL, RK_FALSE,
+                         pIqfilesPath);
+    SAMPLE_COMM_ISP_Run(s32CamId);
+    SAMPLE_COMM_ISP_SetFrameRate(s32CamId, 30);
+#endif
+  }
+
+  if (pOutDir) {
+    static const char *names[VENC_CHN_NUM] = {"main.h264", "main.mjpeg"};
+    char path[256];
+    for (int i = 0; i < VENC_CHN_NUM; i++) {
+      snprintf(path, sizeof(path), "%s/%s", pOutDir, names[i]);
+      output_files[i] = fopen(path, "w");
+      if (!output_files[i]) {
+        printf("ERROR: open file: %s fail, exit\n", path);
+        return 0;
+      }
+    }
+  }
+
+  RK_MPI_SYS_Init();
+  VI_CHN_ATTR_S vi_chn_attr;
+  vi_chn_attr.pcVideoNode = pDeviceName;
+  vi_chn_attr.u32BufCnt = 3;
+  vi_chn_attr.u32Width = u32Width;
+  vi_chn_attr.u32Height = u32Height;
+  vi_chn_attr.enPixFmt = IMAGE_TYPE_NV12;
+  vi_chn_attr.enBufType = VI_CHN_BUF_TYPE_MMAP;
+  vi_chn_attr.enWorkMode = VI_WORK_MODE_NORMAL;
+  ret = RK_MPI_VI_SetChnAttr(s32CamId, 0, &vi_chn_attr);
+  ret |= RK_MPI_VI_EnableChn(s32CamId, 0);
+  if (ret) {
+    printf("ERROR: create VI[0] error! ret=%d\n", ret);
+    return 0;
+  }
+
+  // h264 at 30fps, one jpeg a second
+  ret = create_venc(0, RK_CODEC_TYPE_H264, u32Width, u32Height, 30);
+  ret |= create_venc(1, RK_CODEC_TYPE_MJPEG, u32Width, u32Height, 1);
+  if (ret) {
+    printf("ERROR: create VENC error! ret=%d\n", ret);
+    return 0;
+  }
+
+  MPP_CHN_S stSrcChn;
+  stSrcChn.enModId = RK_ID_VI;
+  stSrcChn.s32DevId = 0;
+  stSrcChn.s32ChnId = 0;
+  MPP_CHN_S stEncChns[VENC_CHN_NUM];
+  for (int i = 0; i < VENC_CHN_NUM; i++) {
+    stEncChns[i].enModId = RK_ID_VENC;
+    stEncChns[i].s32DevId = 0;
+    stEncChns[i].s32ChnId = i;
+    ret = RK_MPI_SYS_Bind(&stSrcChn, &stEncChns[i]);
+    if (ret) {
+      printf("ERROR: Bind VI[0] and VENC[%d] error! ret=%d\n", i, ret);
+      return 0;
+    }
+    // queue the packets for RK_MPI_SYS_GetMediaBuffers
+    RK_MPI_SYS_StartGetMediaBuffer(RK_ID_VENC, i);
+  }
+
+  RK_S32 s32WaitFd = RK_MPI_SYS_CreateChnWaitFd(stEncChns, VENC_CHN_NUM);
+  if (s32WaitFd < 0) {
+    printf("ERROR: create wait fd error! ret=%d\n", s32WaitFd);
+    return 0;
+  }
+
+  printf("%s initial finish\n", __func__);
+  signal(SIGINT, sigterm_handler);
+
+  MPP_CHN_S stReadyChns[VENC_CHN_NUM];
+  MEDIA_BUFFER mbs[MB_BATCH_NUM];
+  while (!quit) {
+    RK_S32 s32ReadyCnt =
+        RK_MPI_SYS_WaitChnReady(s32WaitFd, stReadyChns, VENC_CHN_NUM, 1000);
+    if (s32ReadyCnt < 0) {
+      printf("ERROR: wait channels error! ret=%d\n", s32ReadyCnt);
+      break;
+    } else if (s32ReadyCnt == 0) {
+      printf("#No packet in 1s\n");
+      continue;
+    }
+    wakeup_cnt++;
+    for (int i = 0; i < s32ReadyCnt; i++) {
+      RK_S32 s32ChnId = stReadyChns[i].s32ChnId;
+      // never blocks, all the packets queued so far in one call
+      RK_S32 s32MbCnt = RK_MPI_SYS_GetMediaBuffers(
+          stReadyChns[i].enModId, s32ChnId, mbs, MB_BATCH_NUM, 0);
+      for (int j = 0; j < s32MbCnt; j++) {
+        if (output_files[s32ChnId])
+          fwrite(RK_MPI_MB_GetPtr(mbs[j]), 1, RK_MPI_MB_GetSize(mbs[j]),
+                 output_files[s32ChnId]);
+        RK_MPI_MB_ReleaseBuffer(mbs[j]);
+      }
+      packet_cnt[s32ChnId] += s32MbCnt;
+    }
+    if (s32FrameCnt >= 0 && packet_cnt[0] >= (RK_U32)s32FrameCnt)
+      quit = true;
+  }
+  printf("#Got %u h264 and %u mjpeg packets in %u wakeups\n", packet_cnt[0],
+         packet_cnt[1], wakeup_cnt);
+
+  // the wait fd does not follow the channels, close it before destroy
+  RK_MPI_SYS_DestroyChnWaitFd(s32WaitFd);
+  for (int i = 0; i < VENC_CHN_NUM; i++) {
+    if (output_files[i])
+      fclose(output_files[i]);
+  }
+
+  printf("%s exit!\n", __func__);
+  for (int i = 0; i < VENC_CHN_NUM; i++) {
+    ret = RK_MPI_SYS_UnBind(&stSrcChn, &stEncChns[i]);
+    if (ret)
+      printf("ERROR: UnBind VI[0] and VENC[%d] error! ret=%d\n", i, ret);
+    ret = RK_MPI_VENC_DestroyChn(i);
+    if (ret)
+      printf("ERROR: Destroy VENC[%d] error! ret=%d\n", i, ret);
+  }
+  ret = RK_MPI_VI_DisableChn(s32CamId, 0);
+  if (ret)
+    printf("ERROR: Destroy VI[0] error! ret=%d\n", ret);
+
+  if (pIqfilesPath) {
+#ifdef RKAIQ
+    SAMPLE_COMM_ISP_Stop(s32CamId);
+#endif
+  }
+  return 0;
+}
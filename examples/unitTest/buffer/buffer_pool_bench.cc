@@ -0,0 +1,162 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Several threads, each one standing for a flow, share one BufferPool. Every
+// thread keeps up to 'depth' buffers in flight (like a flow queue) and
+// releases the oldest one once the window is full. Reports the get/put
+// throughput, the heap allocations per get and the pool water marks.
+// '-m heap' runs the same pattern with MediaBuffer::Alloc for comparison.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <deque>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer.h"
+#include "utils.h"
+
+static std::atomic<uint64_t> g_new_cnt(0);
+
+void *operator new(size_t size) {
+  g_new_cnt.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+static std::atomic<uint64_t> g_get_cnt(0);
+static std::atomic<uint64_t> g_fail_cnt(0);
+
+static void pool_worker(easymedia::BufferPool *pool, int loops, int depth,
+                        int timeout_ms) {
+  std::deque<std::shared_ptr<easymedia::MediaBuffer>> window;
+  for (int i = 0; i < loops; i++) {
+    auto mb = pool->GetBufferTimeout(timeout_ms);
+    if (!mb) {
+      g_fail_cnt++;
+      if (!window.empty())
+        window.pop_front();
+      continue;
+    }
+    *(volatile char *)mb->GetPtr() = (char)i;
+    mb->SetValidSize(1);
+    g_get_cnt++;
+    window.push_back(std::move(mb));
+    if ((int)window.size() >= depth)
+      window.pop_front();
+  }
+}
+
+static void heap_worker(int loops, int depth, int size) {
+  std::deque<std::shared_ptr<easymedia::MediaBuffer>> window;
+  for (int i = 0; i < loops; i++) {
+    auto mb = easymedia::MediaBuffer::Alloc(size);
+    if (!mb) {
+      g_fail_cnt++;
+      continue;
+    }
+    *(volatile char *)mb->GetPtr() = (char)i;
+    mb->SetValidSize(1);
+    g_get_cnt++;
+    window.push_back(std::move(mb));
+    if ((int)window.size() >= depth)
+      window.pop_front();
+  }
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-t threads] [-n loops] [-c buf_cnt] [-s buf_size] "
+         "[-d depth] [-w timeout_ms] [-m pool|heap]\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  int threads = 4;
+  int loops = 200000;
+  int buf_cnt = 16;
+  int buf_size = 4096;
+  int depth = 4;
+  int timeout_ms = 10;
+  std::string mode = "pool";
+  int c;
+
+  while ((c = getopt(argc, argv, "t:n:c:s:d:w:m:h")) != -1) {
+    switch (c) {
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'n':
+      loops = atoi(optarg);
+      break;
+    case 'c':
+      buf_cnt = atoi(optarg);
+      break;
+    case 's':
+      buf_size = atoi(optarg);
+      break;
+    case 'd':
+      depth = atoi(optarg);
+      break;
+    case 'w':
+      timeout_ms = atoi(optarg);
+      break;
+    case 'm':
+      mode = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 0;
+    }
+  }
+  if (threads <= 0 || loops <= 0 || depth <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  LOG_INIT();
+  easymedia::BufferPool pool(buf_cnt, buf_size,
+                             easymedia::MediaBuffer::MemType::MEM_COMMON);
+  std::vector<std::thread *> ths;
+  uint64_t new_start = g_new_cnt;
+  easymedia::AutoDuration ad;
+  for (int i = 0; i < threads; i++) {
+    if (mode == "heap")
+      ths.push_back(new std::thread(heap_worker, loops, depth, buf_size));
+    else
+      ths.push_back(
+          new std::thread(pool_worker, &pool, loops, depth, timeout_ms));
+  }
+  for (auto th : ths) {
+    th->join();
+    delete th;
+  }
+  int64_t cost_us = ad.Get();
+  // thread objects and deques are counted too, they are negligible
+  uint64_t news = g_new_cnt - new_start;
+  uint64_t gets = g_get_cnt;
+
+  printf("%s threads:%d loops:%d cnt:%d size:%d depth:%d | %.0f get/s, "
+         "fail:%llu, heap allocs per get:%.3f\n",
+         mode.c_str(), threads, loops, buf_cnt, buf_size, depth,
+         gets * 1000000.0 / cost_us, (unsigned long long)g_fail_cnt.load(),
+         gets ? (double)news / gets : 0.0);
+  if (mode != "heap") {
+    easymedia::BufferPool::Stats stats;
+    pool.GetStats(stats);
+    printf("pool: busy:%d high water:%d low water:%d get:%llu fail:%llu\n",
+           stats.busy, stats.high_water, stats.low_water,
+           (unsigned long long)stats.get_cnt,
+           (unsigned long long)stats.fail_cnt);
+  }
+  return 0;
+}
@@ -0,0 +1,215 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// The start code scanner against a byte by byte reference on random data at
+// every alignment, the nal units NaluIndex finds in h264/h265 frames, and
+// the index cached in a MediaBuffer while other threads copy the buffer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "buffer.h"
+#include "codec.h"
+#include "utils.h"
+
+using namespace easymedia;
+
+static int failed = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      RKMEDIA_LOGE("check failed at line %d: %s\n", __LINE__, #cond);          \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// First 00 00 01 followed by at least one byte, from its leading zero if
+// it is a 4-byte start code. n if none.
+static size_t ref_startcode(const uint8_t *d, size_t n) {
+  for (size_t i = 0; i + 3 < n; i++) {
+    if (d[i] == 0 && d[i + 1] == 0 && d[i + 2] == 1)
+      return (i > 0 && d[i - 1] == 0) ? i - 1 : i;
+  }
+  return n;
+}
+
+static void test_scanner() {
+  // zeros are frequent, so the vector blocks hit every path
+  std::vector<uint8_t> buf(4096 + 64);
+  int mismatch = 0, found = 0;
+  srand(0);
+  for (int round = 0; round < 2000; round++) {
+    for (auto &b : buf) {
+      int r = rand() % 16;
+      b = r < 4 ? 0 : (r == 4 ? 1 : (uint8_t)rand());
+    }
+    size_t align = rand() % 16;
+    size_t len = round < 200 ? round : rand() % 4096;
+    const uint8_t *p = buf.data() + align;
+    size_t pos = 0;
+    // every start code of the buffer, as NaluIndex walks them
+    while (pos < len) {
+      const uint8_t *out = find_nalu_startcode(p + pos, p + len);
+      size_t expect = pos + ref_startcode(p + pos, len - pos);
+      if ((size_t)(out - p) != expect) {
+        mismatch++;
+        break;
+      }
+      if (expect == len)
+        break;
+      found++;
+      pos = expect + 3;
+    }
+  }
+  CHECK(mismatch == 0);
+  RKMEDIA_LOGI("scanner: %d start codes, %d mismatches\n", found, mismatch);
+
+  // no room for a payload byte: not a start code
+  static const uint8_t tail[] = {0x55, 0x00, 0x00, 0x01};
+  CHECK(find_nalu_startcode(tail, tail + 4) == tail + 4);
+  CHECK(find_nalu_startcode(tail, tail) == tail);
+
+  // large buffer without zero bytes, then one at the very end
+  std::vector<uint8_t> big(1 << 20, 0x5a);
+  big[big.size() - 5] = 0;
+  big[big.size() - 4] = 0;
+  big[big.size() - 3] = 1;
+  const uint8_t *b = big.data();
+  CHECK(find_nalu_startcode(b, b + big.size()) == b + big.size() - 5);
+}
+
+struct TestNalu {
+  int start_len;
+  uint8_t header;
+  size_t payload;
+};
+
+static std::vector<uint8_t> make_frame(const std::vector<TestNalu> &nalus) {
+  std::vector<uint8_t> data;
+  for (auto &n : nalus) {
+    if (n.start_len == 4)
+      data.push_back(0);
+    data.push_back(0);
+    data.push_back(0);
+    data.push_back(1);
+    data.push_back(n.header);
+    for (size_t i = 0; i < n.payload; i++)
+      data.push_back(0x80 | (i & 0x7f));
+  }
+  return data;
+}
+
+static void check_index(const NaluIndex &index,
+                        const std::vector<TestNalu> &nalus, bool h265) {
+  auto &found = index.GetNalus();
+  CHECK(found.size() == nalus.size());
+  if (found.size() != nalus.size())
+    return;
+  uint32_t offset = 0;
+  for (size_t i = 0; i < nalus.size(); i++) {
+    int type = h265 ? (nalus[i].header & 0x7e) >> 1 : nalus[i].header & 0x1f;
+    uint32_t size = nalus[i].start_len + 1 + nalus[i].payload;
+    CHECK(found[i].offset == offset);
+    CHECK(found[i].size == size);
+    CHECK(found[i].start_len == nalus[i].start_len);
+    CHECK(found[i].type == type);
+    offset += size;
+  }
+}
+
+static void test_index() {
+  // sps, pps, sei, idr
+  std::vector<TestNalu> h264 = {
+      {4, 0x67, 12}, {4, 0x68, 4}, {3, 0x06, 20}, {3, 0x65, 300}};
+  auto data = make_frame(h264);
+  NaluIndex index(data.data(), data.size(), CODEC_TYPE_H264);
+  check_index(index, h264, false);
+  CHECK(index.Find(7) == &index.GetNalus()[0]);
+  CHECK(index.Find(5) == &index.GetNalus()[3]);
+  CHECK(index.Find(1) == nullptr);
+  CHECK(index.Find(-1) == nullptr);
+  CHECK(index.Find(NaluIndex::kMaxType) == nullptr);
+  CHECK(index.Match(data.data(), data.size(), CODEC_TYPE_H264));
+  CHECK(!index.Match(data.data(), data.size() - 1, CODEC_TYPE_H264));
+
+  // vps, sps, pps, idr_w_radl
+  std::vector<TestNalu> h265 = {
+      {4, 32 << 1, 20}, {4, 33 << 1, 30}, {4, 34 << 1, 6}, {4, 19 << 1, 500}};
+  data = make_frame(h265);
+  NaluIndex index265(data.data(), data.size(), CODEC_TYPE_H265);
+  check_index(index265, h265, true);
+  CHECK(index265.Find(32) == &index265.GetNalus()[0]);
+  CHECK(index265.Find(19) == &index265.GetNalus()[3]);
+
+  // leading garbage, and no start code at all
+  std::vector<uint8_t> junk = {0x12, 0x34, 0x00, 0x00, 0x01, 0x41, 0x99};
+  NaluIndex junk_index(junk.data(), junk.size(), CODEC_TYPE_H264);
+  CHECK(junk_index.GetNalus().size() == 1);
+  CHECK(junk_index.GetNalus()[0].offset == 2);
+  NaluIndex none(junk.data(), 2, CODEC_TYPE_H264);
+  CHECK(none.GetNalus().empty());
+}
+
+static void test_cached() {
+  std::vector<TestNalu> h264 = {{4, 0x67, 12}, {4, 0x68, 4}, {4, 0x65, 1000}};
+  auto data = make_frame(h264);
+  auto mb = MediaBuffer::Alloc(data.size());
+  CHECK(mb != nullptr);
+  if (!mb)
+    return;
+  memcpy(mb->GetPtr(), data.data(), data.size());
+  mb->SetValidSize(data.size());
+
+  auto index = GetNaluIndex(mb, CODEC_TYPE_H264);
+  CHECK(index && index->GetNalus().size() == 3);
+  CHECK(GetNaluIndex(mb, CODEC_TYPE_H264) == index);
+  int size = 0;
+  void *sps = GetSpsFromBuffer(mb, size, CODEC_TYPE_H264);
+  CHECK(sps == (uint8_t *)mb->GetPtr() && size == 4 + 1 + 12);
+  // valid size changed: rebuilt
+  mb->SetValidSize(data.size() - 1000);
+  auto index2 = GetNaluIndex(mb, CODEC_TYPE_H264);
+  CHECK(index2 != index && index2->GetNalus().size() == 3);
+  mb->SetValidSize(data.size());
+
+  // consumers build the index while others copy the buffer, as the muxer
+  // and the rtsp server do with the same encoder output
+  std::atomic<bool> quit(false);
+  std::atomic<int> copies(0), bad(0);
+  std::thread copier([&] {
+    while (!quit) {
+      MediaBuffer copy(*mb);
+      auto cached = copy.GetNaluIndex();
+      if (cached && cached->GetNalus().size() != 3)
+        bad++;
+      copies++;
+    }
+  });
+  for (int i = 0; i < 20000; i++) {
+    mb->SetNaluIndex(nullptr);
+    auto built = GetNaluIndex(mb, CODEC_TYPE_H264);
+    if (!built || built->GetNalus().size() != 3)
+      bad++;
+  }
+  quit = true;
+  copier.join();
+  CHECK(bad == 0);
+  RKMEDIA_LOGI("cached: %d copies while the index was rebuilt\n",
+               copies.load());
+}
+
+int main() {
+  LOG_INIT();
+  test_scanner();
+  test_index();
+  test_cached();
+  RKMEDIA_LOGI("%s\n", failed ? "FAILED" : "PASSED");
+  return failed ? -1 : 0;
+}
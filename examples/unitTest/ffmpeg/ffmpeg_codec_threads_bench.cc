@@ -0,0 +1,234 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Software codec throughput of the ffmpeg backends over thread counts:
+// synthetic yuv420p frames are encoded by ffmpeg_vid (libx264) and the
+// stream is decoded by ffmpeg_vid again, at 1080p and 4K by default.
+// The decoded timestamps are checked to come out in order.
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "decoder.h"
+#include "encoder.h"
+#include "key_string.h"
+#include "media_config.h"
+#include "utils.h"
+
+static void fill_frame(uint8_t *p, int w, int h, int n) {
+  // moving gradient, something for the motion search to do
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+      p[y * w + x] = (uint8_t)(x + y + n * 4);
+  memset(p + w * h, 128, w * h / 2);
+}
+
+static std::shared_ptr<easymedia::VideoEncoder>
+create_encoder(int w, int h, const std::string &threads) {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_OUTPUTDATATYPE, VIDEO_H264);
+  PARAM_STRING_APPEND(param, KEY_NAME, "libx264");
+  auto enc = easymedia::REFLECTOR(Encoder)::Create<easymedia::VideoEncoder>(
+      "ffmpeg_vid", param.c_str());
+  if (!enc)
+    return nullptr;
+  MediaConfig cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  VideoConfig &vid_cfg = cfg.vid_cfg;
+  vid_cfg.image_cfg.image_info = {PIX_FMT_YUV420P, w, h, w, h};
+  vid_cfg.qp_init = 24;
+  vid_cfg.qp_step = 4;
+  vid_cfg.qp_min = 12;
+  vid_cfg.qp_max = 48;
+  vid_cfg.bit_rate = w * h * 4;
+  vid_cfg.frame_rate = 30;
+  vid_cfg.level = 52;
+  vid_cfg.gop_size = 30;
+  vid_cfg.profile = 100;
+  vid_cfg.rc_quality = KEY_HIGHEST;
+  vid_cfg.rc_mode = KEY_CBR;
+  vid_cfg.codec_threads = ParseCodecThreads(threads);
+  if (!enc->InitConfig(cfg))
+    return nullptr;
+  return enc;
+}
+
+static std::shared_ptr<easymedia::VideoDecoder>
+create_decoder(const std::string &threads) {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_INPUTDATATYPE, VIDEO_H264);
+  PARAM_STRING_APPEND(param, KEY_CODEC_THREADS, threads);
+  return easymedia::REFLECTOR(Decoder)::Create<easymedia::VideoDecoder>(
+      "ffmpeg_vid", param.c_str());
+}
+
+static bool
+fetch_packets(std::shared_ptr<easymedia::VideoEncoder> &enc,
+              std::vector<std::shared_ptr<easymedia::MediaBuffer>> &pkts) {
+  while (true) {
+    auto out = enc->FetchOutput();
+    if (!out)
+      return errno == EAGAIN;
+    if (out->IsEOF() || out->GetValidSize() == 0)
+      return true;
+    pkts.push_back(out);
+  }
+}
+
+// Returns the encoding fps, the packets are kept for the decoding.
+static double
+bench_encode(int w, int h, int frames, const std::string &threads,
+             std::vector<std::shared_ptr<easymedia::MediaBuffer>> &pkts) {
+  auto enc = create_encoder(w, h, threads);
+  if (!enc) {
+    fprintf(stderr, "create ffmpeg_vid encoder failed\n");
+    return -1;
+  }
+  ImageInfo info = {PIX_FMT_YUV420P, w, h, w, h};
+  size_t len = CalPixFmtSize(info);
+  // a few different frames, generated outside of the timing
+  std::vector<std::shared_ptr<easymedia::MediaBuffer>> srcs;
+  for (int i = 0; i < 8; i++) {
+    auto mb = easymedia::MediaBuffer::Alloc(len);
+    if (!mb)
+      return -1;
+    fill_frame((uint8_t *)mb->GetPtr(), w, h, i);
+    mb->SetValidSize(len);
+    srcs.push_back(mb);
+  }
+
+  pkts.clear();
+  easymedia::AutoDuration ad;
+  for (int i = 0; i < frames; i++) {
+    auto img = std::make_shared<easymedia::ImageBuffer>(
+        *srcs[i % srcs.size()], info);
+    img->SetUSTimeStamp((int64_t)i * 33333);
+    if (enc->SendInput(img) < 0 || !fetch_packets(enc, pkts)) {
+      fprintf(stderr, "encode frame %d failed\n", i);
+      return -1;
+    }
+  }
+  // flush the frames held by the threads
+  auto eof = std::make_shared<easymedia::ImageBuffer>();
+  eof->SetEOF(true);
+  enc->SendInput(eof);
+  fetch_packets(enc, pkts);
+  int64_t us = ad.Get();
+  if ((int)pkts.size() != frames)
+    fprintf(stderr, "encoded %zu packets of %d frames\n", pkts.size(),
+            frames);
+  return us > 0 ? frames * 1000000.0 / us : 0;
+}
+
+static bool fetch_frames(std::shared_ptr<easymedia::VideoDecoder> &dec,
+                         int &count, int64_t &last_ts) {
+  while (true) {
+    auto out = dec->FetchOutput();
+    if (!out)
+      return true;
+    if (out->IsEOF())
+      return true;
+    if (out->GetUSTimeStamp() <= last_ts) {
+      fprintf(stderr, "frame %d out of order: %lld after %lld\n", count,
+              (long long)out->GetUSTimeStamp(), (long long)last_ts);
+      return false;
+    }
+    last_ts = out->GetUSTimeStamp();
+    count++;
+  }
+}
+
+static double
+bench_decode(const std::vector<std::shared_ptr<easymedia::MediaBuffer>> &pkts,
+             const std::string &threads) {
+  auto dec = create_decoder(threads);
+  if (!dec) {
+    fprintf(stderr, "create ffmpeg_vid decoder failed\n");
+    return -1;
+  }
+  int count = 0;
+  int64_t last_ts = -1;
+  easymedia::AutoDuration ad;
+  for (auto &pkt : pkts) {
+    auto in = std::make_shared<easymedia::MediaBuffer>(*pkt);
+    if (dec->SendInput(in) < 0 || !fetch_frames(dec, count, last_ts))
+      return -1;
+  }
+  // an empty packet drains the frame threads
+  auto eof = std::make_shared<easymedia::MediaBuffer>();
+  eof->SetEOF(true);
+  dec->SendInput(eof);
+  if (!fetch_frames(dec, count, last_ts))
+    return -1;
+  int64_t us = ad.Get();
+  if (count != (int)pkts.size())
+    fprintf(stderr, "decoded %d frames of %zu packets\n", count, pkts.size());
+  return us > 0 ? count * 1000000.0 / us : 0;
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-w width -h height] [-n frames] [-t 1,2,4,auto]\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  int width = 0;
+  int height = 0;
+  int frames = 60;
+  std::string thread_list = "1,2,4,8,auto";
+  int c;
+
+  while ((c = getopt(argc, argv, "w:h:n:t:")) != -1) {
+    switch (c) {
+    case 'w':
+      width = atoi(optarg);
+      break;
+    case 'h':
+      height = atoi(optarg);
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 't':
+      thread_list = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  std::vector<std::pair<int, int>> sizes;
+  if (width > 0 && height > 0)
+    sizes.push_back(std::make_pair(width, height));
+  else
+    sizes = {{1920, 1080}, {3840, 2160}};
+  std::vector<std::string> threads;
+  std::string token;
+  std::istringstream ts(thread_list);
+  while (std::getline(ts, token, ','))
+    threads.push_back(token);
+
+  printf("%-10s %-8s %12s %12s\n", "size", "threads", "enc fps", "dec fps");
+  for (auto &s : sizes) {
+    for (auto &t : threads) {
+      std::vector<std::shared_ptr<easymedia::MediaBuffer>> pkts;
+      double enc_fps = bench_encode(s.first, s.second, frames, t, pkts);
+      double dec_fps = enc_fps > 0 ? bench_decode(pkts, t) : -1;
+      if (enc_fps < 0 || dec_fps < 0)
+        return EXIT_FAILURE;
+      printf("%4dx%-5d %-8s %12.1f %12.1f\n", s.first, s.second, t.c_str(),
+             enc_fps, dec_fps);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,213 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Damage tracking of a periodic multi-input filter flow, as the video mixer
+// builds it, with a filter that fills its tile with the first byte of the
+// input on the cpu instead of rga.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mutex>
+#include <string>
+
+#include "buffer.h"
+#include "control.h"
+#include "filter.h"
+#include "flow.h"
+#include "key_string.h"
+#include "utils.h"
+
+namespace easymedia {
+
+static int g_process_cnt[2];
+
+class DamageTestFillFilter : public Filter {
+public:
+  DamageTestFillFilter(const char *param);
+  virtual ~DamageTestFillFilter() = default;
+  static const char *GetFilterName() { return "damage_test_fill"; }
+  virtual int Process(std::shared_ptr<MediaBuffer> input,
+                      std::shared_ptr<MediaBuffer> &output) override;
+  virtual int IoCtrl(unsigned long int request _UNUSED, ...) override {
+    return 0;
+  }
+
+private:
+  int chn;
+  ImageRect dst_rect;
+};
+
+DamageTestFillFilter::DamageTestFillFilter(const char *param) : chn(0) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  auto &&rects = StringToTwoImageRect(params[KEY_BUFFER_RECT]);
+  if (rects.size() < 2) {
+    SetError(-EINVAL);
+    return;
+  }
+  dst_rect = rects[1];
+  chn = dst_rect.x ? 1 : 0;
+}
+
+int DamageTestFillFilter::Process(std::shared_ptr<MediaBuffer> input,
+                                  std::shared_ptr<MediaBuffer> &output) {
+  auto dst = std::static_pointer_cast<ImageBuffer>(output);
+  if (!input->GetPtr() || !dst->GetPtr())
+    return -EINVAL;
+  uint8_t v = *(uint8_t *)input->GetPtr();
+  uint8_t *p = (uint8_t *)dst->GetPtr();
+  for (int y = dst_rect.y; y < dst_rect.y + dst_rect.h; y++)
+    memset(p + y * dst->GetVirWidth() + dst_rect.x, v, dst_rect.w);
+  dst->SetValidSize(CalPixFmtSize(dst->GetPixelFormat(), dst->GetVirWidth(),
+                                  dst->GetVirHeight(), 0));
+  if (input->GetUSTimeStamp() > dst->GetUSTimeStamp())
+    dst->SetUSTimeStamp(input->GetUSTimeStamp());
+  g_process_cnt[chn]++;
+  return 0;
+}
+
+DEFINE_COMMON_FILTER_FACTORY(DamageTestFillFilter)
+const char *FACTORY(DamageTestFillFilter)::ExpectedInputDataType() {
+  return TYPENEAR(IMAGE_NV12);
+}
+const char *FACTORY(DamageTestFillFilter)::OutPutDataType() {
+  return TYPENEAR(IMAGE_NV12);
+}
+
+} // namespace easymedia
+
+using namespace easymedia;
+
+static const int kWidth = 64;
+static const int kHeight = 32;
+static const int kTickMs = 10;
+
+static int failed = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      RKMEDIA_LOGE("check failed at line %d: %s\n", __LINE__, #cond);          \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static std::mutex out_mtx;
+static std::shared_ptr<MediaBuffer> last_out;
+static int out_cnt = 0;
+
+static void output_cb(void *handler _UNUSED, std::shared_ptr<MediaBuffer> mb) {
+  std::lock_guard<std::mutex> _lg(out_mtx);
+  last_out = mb;
+  out_cnt++;
+}
+
+static int get_out_cnt() {
+  std::lock_guard<std::mutex> _lg(out_mtx);
+  return out_cnt;
+}
+
+// the value of the tiles in the last output, -1 if there is none
+static int tile_value(int chn) {
+  std::lock_guard<std::mutex> _lg(out_mtx);
+  if (!last_out || !last_out->GetPtr())
+    return -1;
+  return ((uint8_t *)last_out->GetPtr())[chn * kWidth / 2];
+}
+
+static std::shared_ptr<MediaBuffer> new_input(uint8_t v, int64_t ts) {
+  ImageInfo info = {PIX_FMT_NV12, kWidth / 2, kHeight, kWidth / 2, kHeight};
+  auto mb = MediaBuffer::Alloc(CalPixFmtSize(info));
+  if (!mb)
+    return nullptr;
+  memset(mb->GetPtr(), v, mb->GetSize());
+  auto ib = std::make_shared<ImageBuffer>(*mb, info);
+  ib->SetUSTimeStamp(ts);
+  return ib;
+}
+
+static void wait_ticks(int n) { msleep(n * kTickMs); }
+
+int main() {
+  LOG_INIT();
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_NAME, "damage_test_fill");
+  PARAM_STRING_APPEND(param, KEK_THREAD_SYNC_MODEL, KEY_ASYNCATOMIC);
+  PARAM_STRING_APPEND_TO(param, KEY_FPS, 1000 / kTickMs);
+  PARAM_STRING_APPEND(param, KEY_INPUTDATATYPE, IMAGE_NV12);
+  PARAM_STRING_APPEND(param, KEY_OUTPUTDATATYPE, IMAGE_NV12);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_WIDTH, kWidth);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_HEIGHT, kHeight);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_VIR_WIDTH, kWidth);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_VIR_HEIGHT, kHeight);
+  PARAM_STRING_APPEND(param, KEY_MEM_TYPE, KEY_MEM_HARDWARE);
+  PARAM_STRING_APPEND_TO(param, KEY_MEM_CNT, 4);
+  for (int i = 0; i < 2; i++) {
+    char rect_str[64];
+    snprintf(rect_str, sizeof(rect_str), "(0,0,%d,%d)->(%d,0,%d,%d)",
+             kWidth / 2, kHeight, i * kWidth / 2, kWidth / 2, kHeight);
+    param.append(" ");
+    PARAM_STRING_APPEND(param, KEY_BUFFER_RECT, rect_str);
+  }
+  auto flow = REFLECTOR(Flow)::Create<Flow>("filter", param.c_str());
+  if (!flow) {
+    RKMEDIA_LOGE("Create filter flow failed\n");
+    return -1;
+  }
+  flow->SetOutputCallBack(nullptr, output_cb);
+
+  // both tiles drawn once, whether they come in one tick or two
+  auto in0 = new_input(1, 1000);
+  auto in1 = new_input(2, 1000);
+  flow->SendInput(in0, 0);
+  flow->SendInput(in1, 1);
+  wait_ticks(10);
+  CHECK(g_process_cnt[0] == 1 && g_process_cnt[1] == 1);
+  CHECK(get_out_cnt() >= 1 && get_out_cnt() <= 2);
+  CHECK(tile_value(0) == 1 && tile_value(1) == 2);
+
+  // a new frame on one channel: the other tile is copied forward
+  int cnt = get_out_cnt();
+  in1 = new_input(3, 2000);
+  flow->SendInput(in1, 1);
+  wait_ticks(10);
+  CHECK(g_process_cnt[0] == 1 && g_process_cnt[1] == 2);
+  CHECK(get_out_cnt() == cnt + 1);
+  CHECK(tile_value(0) == 1 && tile_value(1) == 3);
+
+  // the same buffer with a new timestamp was refilled in place
+  cnt = get_out_cnt();
+  memset(in0->GetPtr(), 4, in0->GetSize());
+  in0->SetUSTimeStamp(3000);
+  flow->SendInput(in0, 0);
+  wait_ticks(10);
+  CHECK(g_process_cnt[0] == 2 && g_process_cnt[1] == 2);
+  CHECK(get_out_cnt() == cnt + 1);
+  CHECK(tile_value(0) == 4 && tile_value(1) == 3);
+
+  // a control redraws its channel without a new input, twice if a tick
+  // comes in the middle of it
+  cnt = get_out_cnt();
+  int chn = 1;
+  flow->Control(S_RGA_SHOW, &chn);
+  wait_ticks(10);
+  CHECK(g_process_cnt[0] == 2);
+  CHECK(g_process_cnt[1] == 3 || g_process_cnt[1] == 4);
+  CHECK(get_out_cnt() == cnt + g_process_cnt[1] - 2);
+
+  std::string json;
+  flow->DumpStats(json);
+  CHECK(json.find("\"damage\":{\"composed\":") != std::string::npos);
+  RKMEDIA_LOGI("%s\n", json.c_str());
+
+  last_out.reset();
+  flow.reset();
+  RKMEDIA_LOGI("%s\n", failed ? "FAILED" : "PASSED");
+  return failed ? -1 : 0;
+}
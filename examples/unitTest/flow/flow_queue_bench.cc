@@ -0,0 +1,290 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compare the hop latency and throughput of the flow input queues:
+//   main thread -> hop0 -> hop1 -> ... -> sink
+// Every hop and the sink use the same thread_model (asynccommon or
+// asynclockfree) and the same executor (a thread per flow, or the shared
+// pool). Latency is measured with the atomic clock of each buffer.
+// '-b burst' makes hop0 output each buffer several times in one run and
+// '-f fanout' ends the pipe with several sinks, both to measure the cost
+// of the downstream delivery.
+
+#include <assert.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "flow.h"
+#include "key_string.h"
+#include "media_reflector.h"
+#include "utils.h"
+
+namespace easymedia {
+
+static std::atomic<int64_t> g_recv_cnt(0);
+static std::atomic<int64_t> g_latency_sum(0);
+static std::atomic<int64_t> g_latency_max(0);
+static int g_burst = 1;
+
+static void reset_stats() {
+  g_recv_cnt = 0;
+  g_latency_sum = 0;
+  g_latency_max = 0;
+}
+
+static bool do_hop(Flow *f, MediaBufferVector &input_vector);
+static bool do_sink(Flow *f, MediaBufferVector &input_vector);
+
+class BenchFlow : public Flow {
+protected:
+  bool InstallBenchSlotMap(const char *param, bool has_output,
+                           FunctionProcess process);
+};
+
+class BenchHopFlow : public BenchFlow {
+public:
+  BenchHopFlow(const char *param);
+  virtual ~BenchHopFlow() { StopAllThread(); }
+  static const char *GetFlowName() { return "bench_hop_flow"; }
+
+private:
+  friend bool do_hop(Flow *f, MediaBufferVector &input_vector) {
+    auto &in = input_vector[0];
+    if (!in)
+      return false;
+    auto hop = static_cast<BenchHopFlow *>(f);
+    int burst = hop->first ? g_burst : 1;
+    for (int i = 0; i < burst; i++)
+      hop->SetOutput(in, 0);
+    return true;
+  }
+  bool first;
+};
+
+class BenchSinkFlow : public BenchFlow {
+public:
+  BenchSinkFlow(const char *param);
+  virtual ~BenchSinkFlow() { StopAllThread(); }
+  static const char *GetFlowName() { return "bench_sink_flow"; }
+
+private:
+  friend bool do_sink(Flow *f _UNUSED, MediaBufferVector &input_vector) {
+    auto &in = input_vector[0];
+    if (!in)
+      return false;
+    int64_t delay = gettimeofday() - in->GetAtomicClock();
+    g_latency_sum += delay;
+    int64_t max = g_latency_max;
+    while (delay > max && !g_latency_max.compare_exchange_weak(max, delay))
+      ;
+    g_recv_cnt++;
+    return true;
+  }
+};
+
+bool BenchFlow::InstallBenchSlotMap(const char *param, bool has_output,
+                                    FunctionProcess process) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params))
+    return false;
+  SlotMap sm;
+  int input_maxcachenum = 8;
+  ParseParamToSlotMap(params, sm, input_maxcachenum);
+  if (sm.thread_model == Model::NONE)
+    sm.thread_model = Model::ASYNCCOMMON;
+  if (sm.mode_when_full == InputMode::NONE)
+    sm.mode_when_full = InputMode::BLOCKING;
+  sm.input_slots.push_back(0);
+  sm.input_maxcachenum.push_back(input_maxcachenum);
+  if (has_output)
+    sm.output_slots.push_back(0);
+  sm.process = process;
+  return InstallSlotMap(sm, params[KEY_NAME], -1);
+}
+
+BenchHopFlow::BenchHopFlow(const char *param) {
+  first = strstr(param, "name=hop0") != nullptr;
+  if (!InstallBenchSlotMap(param, true, do_hop))
+    SetError(-EINVAL);
+}
+
+BenchSinkFlow::BenchSinkFlow(const char *param) {
+  if (!InstallBenchSlotMap(param, false, do_sink))
+    SetError(-EINVAL);
+}
+
+DEFINE_FLOW_FACTORY(BenchHopFlow, Flow)
+const char *FACTORY(BenchHopFlow)::ExpectedInputDataType() { return nullptr; }
+const char *FACTORY(BenchHopFlow)::OutPutDataType() { return ""; }
+
+DEFINE_FLOW_FACTORY(BenchSinkFlow, Flow)
+const char *FACTORY(BenchSinkFlow)::ExpectedInputDataType() { return nullptr; }
+const char *FACTORY(BenchSinkFlow)::OutPutDataType() { return ""; }
+
+} // namespace easymedia
+
+using easymedia::Flow;
+using easymedia::MediaBuffer;
+
+static std::string g_executor = KEY_EXECUTOR_THREAD;
+static bool g_dump_stats = false;
+static int g_fanout = 1;
+
+// hop0 -> ... -> hop(n-1) -> sink0..sink(fanout-1)
+static std::vector<std::shared_ptr<Flow>> create_pipe(const std::string &mode,
+                                                      int hops) {
+  std::vector<std::shared_ptr<Flow>> flows;
+  for (int i = 0; i < hops + g_fanout; i++) {
+    std::string param;
+    bool sink = (i >= hops);
+    PARAM_STRING_APPEND(param, KEY_NAME,
+                        sink ? std::string("sink") + std::to_string(i - hops)
+                             : std::string("hop") + std::to_string(i));
+    PARAM_STRING_APPEND(param, KEK_THREAD_SYNC_MODEL, mode);
+    PARAM_STRING_APPEND(param, KEY_FLOW_EXECUTOR, g_executor);
+    if (g_executor == KEY_EXECUTOR_POOL) {
+      // blocking inputs are not allowed on the pool, use a deep queue
+      PARAM_STRING_APPEND(param, KEK_INPUT_MODEL, KEY_DROPFRONT);
+      PARAM_STRING_APPEND_TO(param, KEY_INPUT_CACHE_NUM, 1024);
+    } else {
+      PARAM_STRING_APPEND(param, KEK_INPUT_MODEL, KEY_BLOCKING);
+      PARAM_STRING_APPEND_TO(param, KEY_INPUT_CACHE_NUM, 8);
+    }
+    auto f = easymedia::REFLECTOR(Flow)::Create<Flow>(
+        sink ? "bench_sink_flow" : "bench_hop_flow", param.c_str());
+    assert(f);
+    if (i > 0)
+      flows[i < hops ? i - 1 : hops - 1]->AddDownFlow(f, 0, 0);
+    flows.push_back(f);
+  }
+  return flows;
+}
+
+static void destroy_pipe(std::vector<std::shared_ptr<Flow>> &flows,
+                         int hops) {
+  for (size_t i = 1; i < flows.size(); i++)
+    flows[(int)i < hops ? i - 1 : hops - 1]->RemoveDownFlow(flows[i]);
+  flows.clear();
+}
+
+// Wait until everything arrived, or until the pipe is drained (dropped).
+static void wait_recv(int64_t cnt) {
+  int64_t last = -1;
+  int idle_ms = 0;
+  while (easymedia::g_recv_cnt < cnt && idle_ms < 200) {
+    easymedia::msleep(1);
+    int64_t now = easymedia::g_recv_cnt;
+    idle_ms = (now == last) ? idle_ms + 1 : 0;
+    last = now;
+  }
+}
+
+static void run_case(const std::string &mode, int hops, int count,
+                     int interval_us) {
+  auto flows = create_pipe(mode, hops);
+  easymedia::reset_stats();
+
+  easymedia::AutoDuration ad;
+  for (int i = 0; i < count; i++) {
+    auto mb = std::make_shared<MediaBuffer>();
+    mb->SetAtomicClock(easymedia::gettimeofday());
+    flows[0]->SendInput(mb, 0);
+    if (interval_us > 0)
+      easymedia::usleep(interval_us);
+  }
+  int64_t expect = (int64_t)count * easymedia::g_burst * g_fanout;
+  wait_recv(expect);
+  int64_t cost_us = ad.Get();
+  int64_t recv = easymedia::g_recv_cnt;
+
+  printf("%-14s %-6s hops:%d burst:%d fanout:%d sent:%d recv:%lld "
+         "interval:%dus | throughput:%.0f buf/s, avg hop latency:%.1fus, "
+         "max e2e:%lldus\n",
+         mode.c_str(), g_executor.c_str(), hops, easymedia::g_burst,
+         g_fanout, count, (long long)recv, interval_us,
+         recv * 1000000.0 / cost_us,
+         recv ? (double)easymedia::g_latency_sum / recv / hops : 0.0,
+         (long long)easymedia::g_latency_max.load());
+  if (g_dump_stats)
+    printf("%s\n", easymedia::DumpFlowGraphStats().c_str());
+  destroy_pipe(flows, hops);
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-n hops] [-c count] [-i interval_us] [-m mode] "
+         "[-e executor] [-b burst] [-f fanout] [-s]\n",
+         name);
+  printf("  mode: asynccommon, asynclockfree or all (default)\n");
+  printf("  executor: thread (default) or pool\n");
+  printf("  interval_us: 0 pushes as fast as possible (throughput)\n");
+  printf("  -s: print the json statistics of the flows after each case\n");
+}
+
+int main(int argc, char **argv) {
+  int hops = 4;
+  int count = 20000;
+  int interval_us = -1;
+  std::string mode = "all";
+  int c;
+
+  while ((c = getopt(argc, argv, "n:c:i:m:e:b:f:sh")) != -1) {
+    switch (c) {
+    case 'n':
+      hops = atoi(optarg);
+      break;
+    case 'c':
+      count = atoi(optarg);
+      break;
+    case 'i':
+      interval_us = atoi(optarg);
+      break;
+    case 'm':
+      mode = optarg;
+      break;
+    case 'e':
+      g_executor = optarg;
+      break;
+    case 'b':
+      easymedia::g_burst = atoi(optarg);
+      break;
+    case 'f':
+      g_fanout = atoi(optarg);
+      break;
+    case 's':
+      g_dump_stats = true;
+      break;
+    default:
+      usage(argv[0]);
+      return 0;
+    }
+  }
+  if (hops <= 0 || count <= 0 || easymedia::g_burst <= 0 || g_fanout <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  LOG_INIT();
+  std::vector<std::string> modes;
+  if (mode == "all")
+    modes = {KEY_ASYNCCOMMON, KEY_ASYNCLOCKFREE};
+  else
+    modes = {mode};
+
+  for (auto &m : modes) {
+    if (interval_us < 0) {
+      run_case(m, hops, count, 0);
+      run_case(m, hops, count / 10, 1000);
+    } else {
+      run_case(m, hops, count, interval_us);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,171 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Run several periodic (asyncatomic) flows at the same framerate, each on
+// its own thread or all on the shared timer, and report the jitter of the
+// period they actually ran at, plus the deadline statistics of the flows.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "flow.h"
+#include "histogram.h"
+#include "key_string.h"
+#include "media_reflector.h"
+#include "utils.h"
+
+namespace easymedia {
+
+static int g_busy_us = 0;
+
+static bool do_tick(Flow *f, MediaBufferVector &input_vector);
+
+class BenchTickFlow : public Flow {
+public:
+  BenchTickFlow(const char *param);
+  virtual ~BenchTickFlow() { StopAllThread(); }
+  static const char *GetFlowName() { return "bench_tick_flow"; }
+
+  std::string name;
+  float interval;
+  int64_t last_us;
+  LatencyHistogram jitter; // us, |actual period - interval|
+
+private:
+  friend bool do_tick(Flow *f, MediaBufferVector &input_vector _UNUSED) {
+    BenchTickFlow *t = static_cast<BenchTickFlow *>(f);
+    int64_t now = gettimeofday();
+    if (t->last_us > 0) {
+      int64_t d = now - t->last_us - (int64_t)(t->interval * 1000);
+      t->jitter.Record(d < 0 ? -d : d);
+    }
+    t->last_us = now;
+    if (g_busy_us > 0) {
+      AutoDuration ad;
+      while (ad.Get() < g_busy_us)
+        ;
+    }
+    return true;
+  }
+};
+
+BenchTickFlow::BenchTickFlow(const char *param) : interval(0), last_us(0) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  SlotMap sm;
+  int input_maxcachenum = 0;
+  ParseParamToSlotMap(params, sm, input_maxcachenum);
+  sm.thread_model = Model::ASYNCATOMIC;
+  sm.input_slots.push_back(0);
+  sm.input_maxcachenum.push_back(0);
+  sm.process = do_tick;
+  interval = sm.interval;
+  name = params[KEY_NAME];
+  if (!InstallSlotMap(sm, params[KEY_NAME], -1))
+    SetError(-EINVAL);
+}
+
+DEFINE_FLOW_FACTORY(BenchTickFlow, Flow)
+const char *FACTORY(BenchTickFlow)::ExpectedInputDataType() { return nullptr; }
+const char *FACTORY(BenchTickFlow)::OutPutDataType() { return ""; }
+
+} // namespace easymedia
+
+static void usage(const char *name) {
+  printf("Usage: %s [-n flows] [-f fps] [-t seconds] [-b busy_us] "
+         "[-e executor] [-p policy] [-s]\n",
+         name);
+  printf("  executor: thread or timer, both by default\n");
+  printf("  policy: skip (default) or catchup\n");
+  printf("  -s: print the json statistics of the flows\n");
+}
+
+int main(int argc, char **argv) {
+  int flow_num = 4;
+  int fps = 30;
+  int seconds = 3;
+  std::string executor = "all";
+  std::string policy = KEY_MISS_SKIP;
+  bool dump_stats = false;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:f:t:b:e:p:sh")) != -1) {
+    switch (c) {
+    case 'n':
+      flow_num = atoi(optarg);
+      break;
+    case 'f':
+      fps = atoi(optarg);
+      break;
+    case 't':
+      seconds = atoi(optarg);
+      break;
+    case 'b':
+      easymedia::g_busy_us = atoi(optarg);
+      break;
+    case 'e':
+      executor = optarg;
+      break;
+    case 'p':
+      policy = optarg;
+      break;
+    case 's':
+      dump_stats = true;
+      break;
+    default:
+      usage(argv[0]);
+      return 0;
+    }
+  }
+  if (flow_num <= 0 || fps <= 0 || seconds <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  LOG_INIT();
+  std::vector<std::string> executors;
+  if (executor == "all")
+    executors = {KEY_EXECUTOR_THREAD, KEY_EXECUTOR_TIMER};
+  else
+    executors = {executor};
+
+  for (auto &e : executors) {
+    std::vector<std::shared_ptr<easymedia::BenchTickFlow>> flows;
+    for (int i = 0; i < flow_num; i++) {
+      std::string param;
+      PARAM_STRING_APPEND(param, KEY_NAME, std::string("tick") +
+                                               std::to_string(i));
+      PARAM_STRING_APPEND_TO(param, KEY_FPS, fps);
+      PARAM_STRING_APPEND(param, KEY_FLOW_EXECUTOR, e);
+      PARAM_STRING_APPEND(param, KEY_FLOW_MISS_POLICY, policy);
+      auto f = easymedia::REFLECTOR(Flow)::Create<easymedia::BenchTickFlow>(
+          "bench_tick_flow", param.c_str());
+      if (!f) {
+        fprintf(stderr, "fail to create flow\n");
+        return -1;
+      }
+      flows.push_back(f);
+    }
+    easymedia::msleep(seconds * 1000);
+    if (dump_stats)
+      printf("%s\n", easymedia::DumpFlowGraphStats().c_str());
+    for (auto &f : flows) {
+      printf("%-6s %s fps:%d busy:%dus | runs:%llu jitter us: mean:%.1f "
+             "p50:%lld p99:%lld max:%lld\n",
+             e.c_str(), f->name.c_str(), fps, easymedia::g_busy_us,
+             (unsigned long long)f->jitter.GetCount(), f->jitter.GetMean(),
+             (long long)f->jitter.GetPercentile(50),
+             (long long)f->jitter.GetPercentile(99),
+             (long long)f->jitter.GetMax());
+    }
+  }
+  return 0;
+}
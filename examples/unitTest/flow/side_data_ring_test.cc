@@ -0,0 +1,185 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// SideDataRing, the results of move detection and nn kept by atomic clock:
+// nearest lookups against a linear scan of the same results, the time of a
+// lookup against the locked list scan LookForMdResult did, and how long a
+// consumer blocked in WaitFor takes to wake up once its result is pushed.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "side_data_ring.h"
+#include "utils.h"
+
+using namespace easymedia;
+
+static int failed = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      RKMEDIA_LOGE("check failed at line %d: %s\n", __LINE__, #cond);          \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+typedef std::pair<int64_t, std::shared_ptr<int>> Ref;
+
+// first of the nearest, as the ring breaks ties
+static std::shared_ptr<int> linear_find(const std::vector<Ref> &ref,
+                                        int64_t clock, int64_t tolerance) {
+  std::shared_ptr<int> found;
+  int64_t min_delta = INT64_MAX;
+  for (auto &r : ref) {
+    int64_t d = std::llabs(r.first - clock);
+    if (d < min_delta) {
+      min_delta = d;
+      found = r.second;
+    }
+  }
+  return min_delta <= tolerance ? found : nullptr;
+}
+
+static bool by_clock(const Ref &a, const Ref &b) { return a.first < b.first; }
+
+// 30fps results with jitter, some late, and lookups around them
+static void test_accuracy() {
+  const size_t capacity = 16;
+  const int64_t tolerance = 1000;
+  SideDataRing<int> ring(capacity);
+  std::vector<Ref> ref;
+  int64_t clock = 1000000;
+  int mismatch = 0;
+  srand(0);
+  for (int i = 0; i < 2000; i++) {
+    clock += 33333 + rand() % 2001 - 1000;
+    int64_t push_clock = clock;
+    if (rand() % 8 == 0)
+      push_clock -= rand() % 200000; // late, or dropped when too old
+    auto value = std::make_shared<int>(i);
+    ring.Push(push_clock, value);
+    Ref r(push_clock, value);
+    ref.insert(std::upper_bound(ref.begin(), ref.end(), r, by_clock), r);
+    if (ref.size() > capacity)
+      ref.erase(ref.begin());
+    for (int k = 0; k < 8; k++) {
+      int64_t target = clock - rand() % 600000 + 10000;
+      int64_t tol = (k & 1) ? tolerance : INT64_MAX;
+      int64_t delta = 0;
+      auto found = ring.Find(target, tol, &delta);
+      if (found != linear_find(ref, target, tol))
+        mismatch++;
+      else if (found && std::llabs(delta) > tol)
+        mismatch++;
+    }
+  }
+  CHECK(ring.Size() == capacity);
+  CHECK(mismatch == 0);
+  RKMEDIA_LOGI("accuracy: %d mismatches in 16000 lookups\n", mismatch);
+
+  // results are handed out, not copied
+  auto value = std::make_shared<int>(-1);
+  ring.Push(clock + 33333, value);
+  CHECK(ring.Find(clock + 33333, 0) == value);
+  CHECK(value.use_count() == 2);
+  ring.Clear();
+  CHECK(value.use_count() == 1);
+  CHECK(!ring.Find(clock, INT64_MAX));
+}
+
+static void test_lookup_time() {
+  static const size_t sizes[] = {10, 64, 1024};
+  const int loops = 100000;
+  for (size_t n : sizes) {
+    SideDataRing<int> ring(n);
+    std::list<Ref> list;
+    std::mutex list_mtx;
+    for (size_t i = 0; i < n; i++) {
+      auto value = std::make_shared<int>(i);
+      ring.Push(i * 33333, value);
+      list.push_back(Ref(i * 33333, value));
+    }
+    int64_t last = (n - 1) * 33333;
+    int hits = 0;
+    AutoDuration ad;
+    for (int i = 0; i < loops; i++)
+      hits += !!ring.Find(last - (i % n) * 33333 + 500, 1000);
+    int64_t ring_us = ad.Get();
+    ad.Reset();
+    for (int i = 0; i < loops; i++) {
+      int64_t target = last - (i % n) * 33333 + 500;
+      std::lock_guard<std::mutex> _lg(list_mtx);
+      for (auto &r : list) {
+        if (std::llabs(r.first - target) <= 1000) {
+          hits++;
+          break;
+        }
+      }
+    }
+    int64_t list_us = ad.Get();
+    CHECK(hits == loops * 2);
+    RKMEDIA_LOGI("lookup in %4zu results: ring %6.1fns, list scan %8.1fns\n",
+                 n, ring_us * 1000.0 / loops, list_us * 1000.0 / loops);
+  }
+}
+
+// A consumer waits for frame i, the producer pushes its result a few ms
+// later, as the encoder flow waits on the move detection flow.
+static void test_wait_latency() {
+  const int frames = 50;
+  const int64_t delay_us = 3000;
+  SideDataRing<int> ring(8);
+  std::atomic<int64_t> pushed_at(0);
+  std::thread producer([&] {
+    for (int i = 0; i < frames; i++) {
+      usleep(delay_us);
+      pushed_at = gettimeofday();
+      ring.Push(i * 33333, std::make_shared<int>(i));
+      usleep(delay_us);
+    }
+  });
+  int64_t total_us = 0, max_us = 0;
+  int found = 0;
+  for (int i = 0; i < frames; i++) {
+    if (!ring.WaitFor(i * 33333, 1000, 1000000))
+      continue;
+    int64_t latency = gettimeofday() - pushed_at;
+    auto result = ring.Find(i * 33333, 1000);
+    if (result && *result == i)
+      found++;
+    total_us += latency;
+    max_us = std::max(max_us, latency);
+  }
+  producer.join();
+  CHECK(found == frames);
+  RKMEDIA_LOGI("wake up after push: avg %.1fus, max %lldus\n",
+               found ? (double)total_us / found : 0.0, (long long)max_us);
+
+  // nothing at or after the clock: times out, the closest is still there
+  AutoDuration ad;
+  CHECK(!ring.WaitFor(frames * 33333, 1000, 20000));
+  int64_t waited = ad.Get();
+  CHECK(waited >= 20000);
+  CHECK(ring.Find(frames * 33333, INT64_MAX) != nullptr);
+  // a result past the clock ends the wait at once
+  CHECK(ring.WaitFor((frames - 2) * 33333, 1000, 1000000));
+}
+
+int main() {
+  LOG_INIT();
+  test_accuracy();
+  test_lookup_time();
+  test_wait_latency();
+  RKMEDIA_LOGI("%s\n", failed ? "FAILED" : "PASSED");
+  return failed ? -1 : 0;
+}
@@ -0,0 +1,136 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Region luma of a random Y plane: the per-region scalar double loop that
+// VI and RGA used before, against CalculateRegionLuma doing all the regions
+// in one pass. The regions are a rows x cols grid covering the image, the
+// results of both are compared. '-s step' also times a subsampled grid.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "luma.h"
+#include "utils.h"
+
+static uint64_t scalar_region_luma(const uint8_t *plane, int stride,
+                                   const ImageRect &r) {
+  uint64_t sum = 0;
+  const uint8_t *rect_start = plane + r.y * stride + r.x;
+  for (int i = 0; i < r.h; i++) {
+    const uint8_t *line_start = rect_start + i * stride;
+    for (int j = 0; j < r.w; j++)
+      sum += *(line_start + j);
+  }
+  return sum;
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-w width] [-h height] [-r rows] [-c cols] [-n loops] "
+         "[-s step]\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  int width = 3840;
+  int height = 2160;
+  int rows = 4;
+  int cols = 4;
+  int loops = 50;
+  int step = 4;
+  int c;
+
+  while ((c = getopt(argc, argv, "w:h:r:c:n:s:")) != -1) {
+    switch (c) {
+    case 'w':
+      width = atoi(optarg);
+      break;
+    case 'h':
+      height = atoi(optarg);
+      break;
+    case 'r':
+      rows = atoi(optarg);
+      break;
+    case 'c':
+      cols = atoi(optarg);
+      break;
+    case 'n':
+      loops = atoi(optarg);
+      break;
+    case 's':
+      step = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 0;
+    }
+  }
+  if (width <= 0 || height <= 0 || rows <= 0 || cols <= 0 || loops <= 0 ||
+      rows * cols > REGION_LUMA_MAX || step <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  LOG_INIT();
+  int stride = UPALIGNTO16(width);
+  std::vector<uint8_t> plane((size_t)stride * height);
+  srand(0);
+  for (auto &v : plane)
+    v = (uint8_t)rand();
+
+  std::vector<ImageRect> rects;
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      ImageRect r;
+      r.x = width * j / cols;
+      r.y = height * i / rows;
+      r.w = width * (j + 1) / cols - r.x;
+      r.h = height * (i + 1) / rows - r.y;
+      rects.push_back(r);
+    }
+  }
+  int num = rects.size();
+  std::vector<uint64_t> ref(num);
+  std::vector<easymedia::LumaStat> stats(num);
+  for (auto &s : stats)
+    s.hist = nullptr;
+
+  easymedia::AutoDuration ad;
+  for (int n = 0; n < loops; n++) {
+    for (int i = 0; i < num; i++)
+      ref[i] = scalar_region_luma(plane.data(), stride, rects[i]);
+  }
+  int64_t scalar_us = ad.Get();
+
+  ad.Reset();
+  for (int n = 0; n < loops; n++)
+    easymedia::CalculateRegionLuma(plane.data(), stride, width, height,
+                                   rects.data(), num, stats.data());
+  int64_t simd_us = ad.Get();
+  int mismatch = 0;
+  for (int i = 0; i < num; i++)
+    mismatch += (stats[i].sum != ref[i]);
+
+  ad.Reset();
+  for (int n = 0; n < loops; n++)
+    easymedia::CalculateRegionLuma(plane.data(), stride, width, height,
+                                   rects.data(), num, stats.data(),
+                                   LUMA_STAT_MINMAX);
+  int64_t minmax_us = ad.Get();
+
+  ad.Reset();
+  for (int n = 0; n < loops; n++)
+    easymedia::CalculateRegionLuma(plane.data(), stride, width, height,
+                                   rects.data(), num, stats.data(), 0, step);
+  int64_t step_us = ad.Get();
+
+  printf("%dx%d regions:%d loops:%d | scalar:%.0fus sum:%.0fus (%.1fx) "
+         "sum+minmax:%.0fus step%d:%.0fus | mismatch:%d\n",
+         width, height, num, loops, (double)scalar_us / loops,
+         (double)simd_us / loops, simd_us ? (double)scalar_us / simd_us : 0.0,
+         (double)minmax_us / loops, step, (double)step_us / loops, mismatch);
+  return mismatch ? -1 : 0;
+}
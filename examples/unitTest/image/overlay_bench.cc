@@ -0,0 +1,154 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Detection boxes drawn the way DrawFilter did it, every pixel of every box
+// tested for being on the border, against OverlayDrawBoxes writing the
+// border spans of all the boxes in one pass over the lines. 1, 10 and 100
+// random boxes on NV12, ARGB8888 and a palette plane at 1080p and 4K, the
+// images drawn by both are compared.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "overlay.h"
+#include "utils.h"
+
+using namespace easymedia;
+
+static inline bool on_border(int x, int y, const ImageRect &r, int thick) {
+  return x < r.x + thick || x >= r.x + r.w - thick || y < r.y + thick ||
+         y >= r.y + r.h - thick;
+}
+
+// boxes are inside the image
+static void pixel_loop_draw(const OverlayImage &image,
+                            const std::vector<OverlayBox> &boxes) {
+  for (auto &box : boxes) {
+    const ImageRect &r = box.rect;
+    uint32_t c = box.color;
+    for (int y = r.y; y < r.y + r.h; y++) {
+      for (int x = r.x; x < r.x + r.w; x++) {
+        if (!on_border(x, y, r, box.thick))
+          continue;
+        if (image.pix_fmt == PIX_FMT_NV12) {
+          image.planes[0][y * image.strides[0] + x] = c >> 16;
+          uint8_t *uv = image.planes[1] + (y >> 1) * image.strides[1] +
+                        (x & ~1);
+          uv[0] = c >> 8;
+          uv[1] = c;
+        } else if (image.pix_fmt == PIX_FMT_ARGB8888) {
+          uint8_t *p = image.planes[0] + y * image.strides[0] + x * 4;
+          for (int k = 0; k < 4; k++)
+            p[k] = c >> (k * 8);
+        } else {
+          image.planes[0][y * image.strides[0] + x] = c;
+        }
+      }
+    }
+  }
+}
+
+static void random_boxes(int width, int height, int num, int thick,
+                         uint32_t color, std::vector<OverlayBox> &boxes) {
+  boxes.clear();
+  for (int i = 0; i < num; i++) {
+    OverlayBox box;
+    if (num == 1) {
+      // a face close to the camera
+      box.rect.w = width / 2;
+      box.rect.h = height * 3 / 4;
+    } else {
+      box.rect.w = 32 + rand() % (width / 4);
+      box.rect.h = 32 + rand() % (height / 4);
+    }
+    box.rect.x = rand() % (width - box.rect.w);
+    box.rect.y = rand() % (height - box.rect.h);
+    box.thick = thick;
+    box.color = color;
+    boxes.push_back(box);
+  }
+}
+
+static int bench(PixelFormat fmt, const char *name, int width, int height,
+                 int num, int thick, int loops) {
+  int vir_width = UPALIGNTO16(width);
+  int vir_height = UPALIGNTO16(height);
+  size_t size = (size_t)vir_width * vir_height;
+  if (fmt == PIX_FMT_NV12)
+    size = size * 3 / 2;
+  else if (fmt == PIX_FMT_ARGB8888)
+    size *= 4;
+  std::vector<uint8_t> ref(size, 0x10), out(size, 0x10);
+  OverlayImage ref_image, out_image;
+  OverlayInitImage(ref_image, fmt, ref.data(), width, height, vir_width,
+                   vir_height);
+  OverlayInitImage(out_image, fmt, out.data(), width, height, vir_width,
+                   vir_height);
+  uint32_t color = fmt == PIX_FMT_NONE ? 0x23 : OverlayColor(fmt, 0xFF, 0, 0);
+  std::vector<OverlayBox> boxes;
+  random_boxes(width, height, num, thick, color, boxes);
+
+  AutoDuration ad;
+  for (int n = 0; n < loops; n++)
+    pixel_loop_draw(ref_image, boxes);
+  int64_t loop_us = ad.Get();
+
+  ad.Reset();
+  for (int n = 0; n < loops; n++)
+    OverlayDrawBoxes(out_image, boxes.data(), boxes.size());
+  int64_t span_us = ad.Get();
+
+  int mismatch = memcmp(ref.data(), out.data(), size) != 0;
+  printf("%-8s %4dx%-4d boxes:%-3d | pixel loop:%8.0fus spans:%6.0fus "
+         "(%.0fx) | mismatch:%d\n",
+         name, width, height, num, (double)loop_us / loops,
+         (double)span_us / loops, span_us ? (double)loop_us / span_us : 0.0,
+         mismatch);
+  return mismatch;
+}
+
+int main(int argc, char **argv) {
+  int thick = 2;
+  int loops = 10;
+  int c;
+
+  while ((c = getopt(argc, argv, "t:n:")) != -1) {
+    switch (c) {
+    case 't':
+      thick = atoi(optarg);
+      break;
+    case 'n':
+      loops = atoi(optarg);
+      break;
+    default:
+      printf("Usage: %s [-t thick] [-n loops]\n", argv[0]);
+      return 0;
+    }
+  }
+  if (thick <= 0 || loops <= 0) {
+    printf("Usage: %s [-t thick] [-n loops]\n", argv[0]);
+    return -1;
+  }
+
+  LOG_INIT();
+  static const struct {
+    PixelFormat fmt;
+    const char *name;
+  } formats[] = {{PIX_FMT_NV12, "nv12"},
+                 {PIX_FMT_ARGB8888, "argb8888"},
+                 {PIX_FMT_NONE, "palette"}};
+  static const int sizes[][2] = {{1920, 1080}, {3840, 2160}};
+  static const int nums[] = {1, 10, 100};
+  int mismatch = 0;
+  srand(0);
+  for (auto &f : formats)
+    for (auto &s : sizes)
+      for (int num : nums)
+        mismatch += bench(f.fmt, f.name, s[0], s[1], num, thick, loops);
+  return mismatch ? -1 : 0;
+}
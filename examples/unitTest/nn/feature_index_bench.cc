@@ -0,0 +1,165 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// FeatureIndex against the per-row scan FaceDBManager used to do: copy all
+// the features out, then one distance per row. Random features of dim
+// floats, queries are noisy copies of stored features so that the best
+// match is known. Also times building the index and loading its snapshot.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "feature_index.h"
+#include "utils.h"
+
+static float frand() { return (float)rand() / RAND_MAX - 0.5f; }
+
+static float l2_distance(const float *a, const float *b, int dim) {
+  float sum = 0;
+  for (int i = 0; i < dim; i++)
+    sum += (a[i] - b[i]) * (a[i] - b[i]);
+  return sqrtf(sum);
+}
+
+static void normalize(float *v, int dim) {
+  float sum = 0;
+  for (int i = 0; i < dim; i++)
+    sum += v[i] * v[i];
+  float scale = 1.0f / sqrtf(sum);
+  for (int i = 0; i < dim; i++)
+    v[i] *= scale;
+}
+
+static int bench(int entries, int dim, int queries, int k,
+                 const char *snapshot) {
+  std::vector<float> db((size_t)entries * dim);
+  for (auto &v : db)
+    v = frand();
+  for (int n = 0; n < entries; n++)
+    normalize(&db[(size_t)n * dim], dim);
+
+  easymedia::FeatureIndex index;
+  index.Reset(dim);
+  easymedia::AutoDuration ad;
+  for (int n = 0; n < entries; n++)
+    index.Add(n, &db[(size_t)n * dim]);
+  int64_t build_us = ad.Get();
+
+  std::vector<std::vector<float>> qs(queries, std::vector<float>(dim));
+  std::vector<int> expect(queries);
+  for (int q = 0; q < queries; q++) {
+    expect[q] = rand() % entries;
+    for (int i = 0; i < dim; i++)
+      qs[q][i] = db[(size_t)expect[q] * dim + i] + frand() * 0.02f;
+    normalize(qs[q].data(), dim);
+  }
+
+  int mismatch = 0;
+  ad.Reset();
+  for (int q = 0; q < queries; q++) {
+    std::vector<float> copy(db);
+    int best = -1;
+    float best_distance = 99.9f;
+    for (int n = 0; n < entries; n++) {
+      float d = l2_distance(qs[q].data(), &copy[(size_t)n * dim], dim);
+      if (d < best_distance) {
+        best_distance = d;
+        best = n;
+      }
+    }
+    mismatch += best != expect[q];
+  }
+  int64_t scan_us = ad.Get();
+
+  std::vector<easymedia::FeatureMatch> matches(k);
+  ad.Reset();
+  for (int q = 0; q < queries; q++) {
+    int found = index.Search(qs[q].data(), k, 0.0f, matches.data());
+    mismatch += found < 1 || matches[0].id != expect[q];
+  }
+  int64_t search_us = ad.Get();
+
+  ad.Reset();
+  int ret = index.SaveSnapshot(snapshot, entries);
+  int64_t save_us = ad.Get();
+  easymedia::FeatureIndex loaded;
+  ad.Reset();
+  ret |= loaded.LoadSnapshot(snapshot, entries, dim);
+  int64_t load_us = ad.Get();
+  unlink(snapshot);
+  if (ret || loaded.GetCount() != entries) {
+    printf("snapshot of %d entries failed\n", entries);
+    mismatch++;
+  } else {
+    for (int q = 0; q < queries; q++) {
+      int found = loaded.Search(qs[q].data(), k, 0.0f, matches.data());
+      mismatch += found < 1 || matches[0].id != expect[q];
+    }
+  }
+
+  printf("%6d entries | scan:%9.1fus search:%8.1fus (%.1fx) | build:%8.1fms "
+         "save:%7.1fms load:%6.2fms | mismatch:%d\n",
+         entries, (double)scan_us / queries, (double)search_us / queries,
+         search_us ? (double)scan_us / search_us : 0.0, build_us / 1000.0,
+         save_us / 1000.0, load_us / 1000.0, mismatch);
+  return mismatch;
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-d dim] [-q queries] [-k top k] [-p snapshot path] "
+         "[entries...]\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  int dim = 512;
+  int queries = 20;
+  int k = 3;
+  const char *snapshot = "/tmp/feature_index_bench.idx";
+  int c;
+
+  while ((c = getopt(argc, argv, "d:q:k:p:")) != -1) {
+    switch (c) {
+    case 'd':
+      dim = atoi(optarg);
+      break;
+    case 'q':
+      queries = atoi(optarg);
+      break;
+    case 'k':
+      k = atoi(optarg);
+      break;
+    case 'p':
+      snapshot = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 0;
+    }
+  }
+  if (dim <= 0 || queries <= 0 || k <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  LOG_INIT();
+  std::vector<int> sizes;
+  for (int i = optind; i < argc; i++)
+    sizes.push_back(atoi(argv[i]));
+  if (sizes.empty())
+    sizes = {1000, 10000, 100000};
+
+  srand(0);
+  int mismatch = 0;
+  for (int entries : sizes) {
+    if (entries > 0)
+      mismatch += bench(entries, dim, queries, k, snapshot);
+  }
+  return mismatch ? -1 : 0;
+}
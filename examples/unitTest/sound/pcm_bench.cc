@@ -0,0 +1,216 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// PCM kernels of pcm.h against plain scalar loops, on random periods of
+// 16-bit samples. Every kernel is timed over the same period and its output
+// is compared with the scalar one (float to S16 may differ by 1 on ties).
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "pcm.h"
+#include "utils.h"
+
+static int16_t clip(int32_t v) {
+  return v < -32768 ? -32768 : (v > 32767 ? 32767 : v);
+}
+
+static int64_t time_loops(int loops, const std::function<void()> &fn) {
+  easymedia::AutoDuration ad;
+  for (int n = 0; n < loops; n++)
+    fn();
+  return ad.Get();
+}
+
+static int mismatch_count(const int16_t *a, const int16_t *b, int n,
+                          int tolerance = 0) {
+  int mismatch = 0;
+  for (int i = 0; i < n; i++)
+    mismatch += abs(a[i] - b[i]) > tolerance;
+  return mismatch;
+}
+
+static int report(const char *name, int loops, int64_t scalar_us,
+                  int64_t simd_us, int mismatch) {
+  printf("%-12s scalar:%7.2fus simd:%7.2fus (%.1fx) mismatch:%d\n", name,
+         (double)scalar_us / loops, (double)simd_us / loops,
+         simd_us ? (double)scalar_us / simd_us : 0.0, mismatch);
+  return mismatch;
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-f frames] [-c channels] [-m mix inputs] [-n loops]\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  int frames = 1024;
+  int channels = 2;
+  int mix_num = 4;
+  int loops = 10000;
+  int c;
+
+  while ((c = getopt(argc, argv, "f:c:m:n:")) != -1) {
+    switch (c) {
+    case 'f':
+      frames = atoi(optarg);
+      break;
+    case 'c':
+      channels = atoi(optarg);
+      break;
+    case 'm':
+      mix_num = atoi(optarg);
+      break;
+    case 'n':
+      loops = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 0;
+    }
+  }
+  if (frames <= 0 || channels <= 0 || mix_num <= 0 || loops <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  LOG_INIT();
+  int n = frames * channels;
+  std::vector<int16_t> src(n);
+  srand(0);
+  for (auto &v : src)
+    v = (int16_t)rand();
+  std::vector<int16_t> ref(n), out(n);
+  std::vector<int16_t> ref_planes(n), out_planes(n);
+  std::vector<void *> ref_ptrs(channels), out_ptrs(channels);
+  for (int ch = 0; ch < channels; ch++) {
+    ref_ptrs[ch] = ref_planes.data() + ch * frames;
+    out_ptrs[ch] = out_planes.data() + ch * frames;
+  }
+  int mismatch = 0;
+  int64_t scalar_us, simd_us;
+
+  // the loop AlsaCaptureStream used for AI_LAYOUT_MIC_REF
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < frames; i++)
+      ref[i] = src[i * channels];
+  });
+  simd_us = time_loops(loops, [&] {
+    easymedia::PcmPickChannelS16(out.data(), src.data(), channels, 0, frames);
+  });
+  mismatch += report("pick", loops, scalar_us, simd_us,
+                     mismatch_count(ref.data(), out.data(), frames));
+
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < frames; i++)
+      for (int ch = 0; ch < channels; ch++)
+        ((int16_t *)ref_ptrs[ch])[i] = src[i * channels + ch];
+  });
+  simd_us = time_loops(loops, [&] {
+    easymedia::PcmDeinterleave(out_ptrs.data(), src.data(), 2, channels,
+                               frames);
+  });
+  mismatch += report("deinterleave", loops, scalar_us, simd_us,
+                     mismatch_count(ref_planes.data(), out_planes.data(), n));
+
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < frames; i++)
+      for (int ch = 0; ch < channels; ch++)
+        ref[i * channels + ch] = ((int16_t *)ref_ptrs[ch])[i];
+  });
+  simd_us = time_loops(loops, [&] {
+    easymedia::PcmInterleave(out.data(), (const void *const *)out_ptrs.data(),
+                             2, channels, frames);
+  });
+  mismatch += report("interleave", loops, scalar_us, simd_us,
+                     mismatch_count(src.data(), out.data(), n) +
+                         mismatch_count(src.data(), ref.data(), n));
+
+  std::vector<float> flt(n);
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < n; i++)
+      flt[i] = src[i] * (1.0f / (1 << 15));
+  });
+  std::vector<float> flt_out(n);
+  simd_us = time_loops(
+      loops, [&] { easymedia::PcmS16ToFlt(flt_out.data(), src.data(), n); });
+  int flt_mismatch = 0;
+  for (int i = 0; i < n; i++)
+    flt_mismatch += flt[i] != flt_out[i];
+  mismatch += report("s16->flt", loops, scalar_us, simd_us, flt_mismatch);
+
+  // a bit of gain, so that the float to S16 conversion saturates too
+  for (auto &v : flt)
+    v *= 1.25f;
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < n; i++)
+      ref[i] = clip(lrintf(flt[i] * (1 << 15)));
+  });
+  simd_us = time_loops(
+      loops, [&] { easymedia::PcmFltToS16(out.data(), flt.data(), n); });
+  mismatch += report("flt->s16", loops, scalar_us, simd_us,
+                     mismatch_count(ref.data(), out.data(), n, 1));
+
+  std::vector<int32_t> s32(n);
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < n; i++)
+      s32[i] = src[i] * 65536;
+  });
+  simd_us = time_loops(
+      loops, [&] { easymedia::PcmS16ToS32(s32.data(), src.data(), n); });
+  int s32_mismatch = 0;
+  for (int i = 0; i < n; i++)
+    s32_mismatch += s32[i] != src[i] * 65536;
+  mismatch += report("s16->s32", loops, scalar_us, simd_us, s32_mismatch);
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < n; i++)
+      ref[i] = s32[i] >> 16;
+  });
+  simd_us = time_loops(
+      loops, [&] { easymedia::PcmS32ToS16(out.data(), s32.data(), n); });
+  mismatch += report("s32->s16", loops, scalar_us, simd_us,
+                     mismatch_count(src.data(), out.data(), n));
+
+  const float gain = 1.5f;
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < n; i++)
+      ref[i] = clip(lrintf(src[i] * gain));
+  });
+  simd_us = time_loops(loops, [&] {
+    easymedia::PcmGainS16(out.data(), src.data(), n, gain);
+  });
+  mismatch += report("gain", loops, scalar_us, simd_us,
+                     mismatch_count(ref.data(), out.data(), n, 1));
+
+  std::vector<std::vector<int16_t>> inputs(mix_num, src);
+  std::vector<const int16_t *> input_ptrs;
+  for (int k = 0; k < mix_num; k++) {
+    // differently shifted copies, some sums saturate
+    std::rotate(inputs[k].begin(), inputs[k].begin() + k, inputs[k].end());
+    input_ptrs.push_back(inputs[k].data());
+  }
+  scalar_us = time_loops(loops, [&] {
+    for (int i = 0; i < n; i++) {
+      int32_t sum = 0;
+      for (int k = 0; k < mix_num; k++)
+        sum += input_ptrs[k][i];
+      ref[i] = clip(sum);
+    }
+  });
+  simd_us = time_loops(loops, [&] {
+    easymedia::PcmMixS16(out.data(), input_ptrs.data(), mix_num, n);
+  });
+  mismatch += report("mix", loops, scalar_us, simd_us,
+                     mismatch_count(ref.data(), out.data(), n));
+
+  printf("frames:%d channels:%d mix:%d loops:%d | mismatch:%d\n", frames,
+         channels, mix_num, loops, mismatch);
+  return mismatch ? -1 : 0;
+}
@@ -0,0 +1,249 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// DisplayFBCache and DisplayFlipQueue on the NullDisplayBackend, so no
+// display is needed. Files in /tmp stand in for the dma-bufs, each one has
+// its own inode as a dma-buf has since linux 5.3, and test_shared_inode
+// shares one between buffers as older kernels do.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+
+#include "buffer.h"
+#include "display_backend.h"
+#include "utils.h"
+
+using namespace easymedia;
+
+static int failed = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      RKMEDIA_LOGE("check failed at line %d: %s\n", __LINE__, #cond);          \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static int new_fake_dmabuf() {
+  char path[] = "/tmp/display_flip_queue_test_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd >= 0)
+    unlink(path);
+  return fd;
+}
+
+static DisplayFBInfo fb_info(int fd, uint32_t w, uint32_t h) {
+  DisplayFBInfo info;
+  memset(&info, 0, sizeof(info));
+  info.fd = fd;
+  info.format = 0x34325241; // AR24
+  info.width = w;
+  info.height = h;
+  info.pitches[0] = w * 4;
+  return info;
+}
+
+static std::shared_ptr<MediaBuffer> wrap_fd(int fd) {
+  return std::make_shared<MediaBuffer>(nullptr, 0, fd);
+}
+
+// More frames than vblanks: the fbs of the pool are added once, Push never
+// waits for a vblank and the frames that miss one are dropped.
+static void test_flip_queue(int period_us, int frame_us, int frames) {
+  auto backend = std::make_shared<NullDisplayBackend>(period_us);
+  auto cache = std::make_shared<DisplayFBCache>(backend);
+  auto queue = std::make_shared<DisplayFlipQueue>(backend, cache);
+  const int pool_num = 3;
+  std::vector<std::shared_ptr<MediaBuffer>> pool;
+  for (int i = 0; i < pool_num; i++)
+    pool.push_back(wrap_fd(new_fake_dmabuf()));
+  ImageRect rect = {0, 0, 640, 480};
+
+  int64_t max_push_us = 0;
+  AutoDuration total;
+  for (int i = 0; i < frames; i++) {
+    auto &mb = pool[i % pool_num];
+    AutoDuration ad;
+    // a dup'ed fd of the same buffer still hits the cache
+    int fd = (i & 1) ? dup(mb->GetFD()) : mb->GetFD();
+    CHECK(queue->Push(mb, fb_info(fd, 640, 480), rect, rect));
+    if (fd != mb->GetFD())
+      close(fd);
+    max_push_us = std::max(max_push_us, ad.Get());
+    easymedia::usleep(frame_us);
+  }
+  easymedia::msleep(3 * period_us / 1000 + 1);
+  int64_t total_us = total.Get();
+
+  CHECK(backend->GetAddCount() == pool_num);
+  CHECK(cache->GetMissCount() == pool_num);
+  CHECK(queue->GetFlipCount() + queue->GetDropCount() == frames);
+  CHECK(queue->GetFlipCount() <= total_us / period_us + 1);
+  CHECK(max_push_us < period_us / 2);
+  // the last frame is on screen, its buffer held by the queue
+  uint32_t screen_fb = backend->GetScreenFB();
+  CHECK(screen_fb != 0);
+  CHECK(pool[(frames - 1) % pool_num].use_count() > 1);
+  RKMEDIA_LOGI("flip queue: %d frames in %dms, %d flips, %d dropped, fbs "
+               "added %d, max push %dus\n",
+               frames, (int)(total_us / 1000), queue->GetFlipCount(),
+               queue->GetDropCount(), backend->GetAddCount(),
+               (int)max_push_us);
+
+  queue.reset();
+  for (auto &mb : pool)
+    CHECK(mb.use_count() == 1);
+  cache.reset();
+  CHECK(backend->GetFBCount() == 0);
+  for (auto &mb : pool)
+    close(mb->GetFD());
+}
+
+// More buffers than the cache keeps: fbs out of use are removed, least
+// recently used first, and a new geometry of a buffer is a new fb.
+static void test_fb_cache() {
+  auto backend = std::make_shared<NullDisplayBackend>();
+  const int max_num = 4;
+  DisplayFBCache cache(backend, max_num);
+  std::vector<int> fds;
+  for (int i = 0; i < 2 * max_num; i++)
+    fds.push_back(new_fake_dmabuf());
+
+  uint32_t held = cache.Get(fb_info(fds[0], 640, 480));
+  CHECK(held != 0);
+  for (int i = 1; i < (int)fds.size(); i++) {
+    uint32_t fb = cache.Get(fb_info(fds[i], 640, 480));
+    CHECK(fb != 0);
+    cache.Put(fb);
+  }
+  CHECK(backend->GetFBCount() == max_num);
+  // fds[0] is in use, so it survived
+  CHECK(cache.Get(fb_info(fds[0], 640, 480)) == held);
+  cache.Put(held);
+  cache.Put(held);
+  CHECK(backend->GetRemoveCount() == max_num);
+
+  uint32_t fb = cache.Get(fb_info(fds[0], 320, 240));
+  CHECK(fb != 0 && fb != held);
+  cache.Put(fb);
+  CHECK(cache.Get(fb_info(-1, 640, 480)) == 0);
+
+  for (int fd : fds)
+    close(fd);
+}
+
+// Dma-bufs as on a kernel before 5.3, where they all share one inode. The
+// key is the handle the fd was imported as, as with drmPrimeFDToHandle.
+class SharedInodeBackend : public NullDisplayBackend {
+public:
+  SharedInodeBackend(int period_us) : NullDisplayBackend(period_us) {}
+  void Import(int fd, uint32_t handle) { handles[fd] = handle; }
+  virtual int GetBufferKey(int fd, uint64_t &key) override {
+    auto it = handles.find(fd);
+    if (it == handles.end())
+      return -EBADF;
+    key = it->second;
+    return 0;
+  }
+
+private:
+  std::map<int, uint32_t> handles;
+};
+
+// Two buffers with the same inode are two fbs, and flipping between them
+// changes the screen.
+static void test_shared_inode() {
+  char path[] = "/tmp/display_flip_queue_test_XXXXXX";
+  int fd_a = mkstemp(path);
+  CHECK(fd_a >= 0);
+  if (fd_a < 0)
+    return;
+  int fd_b = open(path, O_RDWR);
+  unlink(path);
+  int fd_a2 = dup(fd_a);
+  struct stat st_a, st_b;
+  CHECK(!fstat(fd_a, &st_a) && !fstat(fd_b, &st_b));
+  CHECK(st_a.st_ino == st_b.st_ino);
+
+  // keyed by the inode, the second buffer would show the first one
+  auto null_backend = std::make_shared<NullDisplayBackend>();
+  DisplayFBCache null_cache(null_backend);
+  uint32_t fb = null_cache.Get(fb_info(fd_a, 640, 480));
+  CHECK(fb != 0 && null_cache.Get(fb_info(fd_b, 640, 480)) == fb);
+  null_cache.Put(fb);
+  null_cache.Put(fb);
+
+  const int period_us = 5000;
+  auto backend = std::make_shared<SharedInodeBackend>(period_us);
+  backend->Import(fd_a, 1);
+  backend->Import(fd_a2, 1);
+  backend->Import(fd_b, 2);
+  auto cache = std::make_shared<DisplayFBCache>(backend);
+  auto queue = std::make_shared<DisplayFlipQueue>(backend, cache);
+  auto mb_a = wrap_fd(fd_a);
+  auto mb_b = wrap_fd(fd_b);
+  ImageRect rect = {0, 0, 640, 480};
+  uint32_t screen[3];
+  int fds[3] = {fd_a, fd_b, fd_a2};
+  for (int i = 0; i < 3; i++) {
+    CHECK(queue->Push(i == 1 ? mb_b : mb_a, fb_info(fds[i], 640, 480), rect,
+                      rect));
+    easymedia::msleep(3 * period_us / 1000);
+    screen[i] = backend->GetScreenFB();
+  }
+  CHECK(screen[0] != 0 && screen[1] != 0);
+  CHECK(screen[0] != screen[1]);
+  CHECK(screen[2] == screen[0]);
+  CHECK(backend->GetAddCount() == 2);
+  CHECK(cache->GetMissCount() == 2 && cache->GetHitCount() == 1);
+
+  queue.reset();
+  cache.reset();
+  CHECK(backend->GetFBCount() == 0);
+  close(fd_a);
+  close(fd_a2);
+  close(fd_b);
+}
+
+int main(int argc, char **argv) {
+  int period_us = 16667;
+  int frame_us = 10000;
+  int frames = 120;
+  int c;
+
+  while ((c = getopt(argc, argv, "p:f:n:")) != -1) {
+    switch (c) {
+    case 'p':
+      period_us = atoi(optarg);
+      break;
+    case 'f':
+      frame_us = atoi(optarg);
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    default:
+      printf("Usage: %s [-p vblank period us] [-f frame interval us] "
+             "[-n frames]\n",
+             argv[0]);
+      return 0;
+    }
+  }
+
+  LOG_INIT();
+  test_fb_cache();
+  test_shared_inode();
+  test_flip_queue(period_us, frame_us, frames);
+  RKMEDIA_LOGI("%s\n", failed ? "FAILED" : "PASSED");
+  return failed ? -1 : 0;
+}
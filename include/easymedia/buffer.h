@@ -9,6 +9,7 @@
 #include <string.h>
 #include <sys/time.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -23,6 +24,8 @@ typedef int (*DeleteFun)(void *arg);
 
 namespace easymedia {
 
+class NaluIndex;
+
 /* memory type definitions. */
 enum drm_rockchip_gem_mem_type {
   /* Physically Continuous memory. */
@@ -188,6 +191,14 @@ public:
   void SetUserData(std::shared_ptr<void> user_data) { userdata = user_data; }
   std::shared_ptr<void> GetUserData() { return userdata; }
 
+  // Cached nal unit index, see GetNaluIndex() in codec.h
+  std::shared_ptr<NaluIndex> GetNaluIndex() const {
+    return std::atomic_load(&nalu_index.ptr);
+  }
+  void SetNaluIndex(std::shared_ptr<NaluIndex> index) {
+    std::atomic_store(&nalu_index.ptr, index);
+  }
+
   void SetRelatedSPtr(const std::shared_ptr<void> &rdata, int index = -1) {
     if (index < 0) {
       related_sptrs.push_back(rdata);
@@ -252,6 +263,18 @@ private:
   size_t dbg_info_size; // Debug info size.
   std::shared_ptr<void> userdata;
   std::vector<std::shared_ptr<void>> related_sptrs;
+  // Set by any consumer thread, so a copy of the buffer loads it atomically.
+  struct NaluIndexRef {
+    NaluIndexRef() = default;
+    NaluIndexRef(const NaluIndexRef &other)
+        : ptr(std::atomic_load(&other.ptr)) {}
+    NaluIndexRef &operator=(const NaluIndexRef &other) {
+      std::atomic_store(&ptr, std::atomic_load(&other.ptr));
+      return *this;
+    }
+    std::shared_ptr<NaluIndex> ptr;
+  };
+  NaluIndexRef nalu_index;
 };
 
 MediaBuffer::MemType StringToMemType(const char *s);
@@ -373,21 +396,43 @@ private:
   std::shared_ptr<void> userdata;
 };
 
+class BufferPoolSlots;
+
+// A fixed set of buffers allocated once. Get and release are O(1) and do not
+// touch the heap: every slot carries the storage of its MediaBuffer object
+// and of the shared_ptr control blocks.
 class _API BufferPool {
 public:
   BufferPool(int cnt, int size, MediaBuffer::MemType type);
   BufferPool(int cnt, int size, MediaBuffer::MemType type, unsigned int flag);
+  // Buffers of info.nb_samples samples, for the audio periods.
+  BufferPool(int cnt, const SampleInfo &info,
+             MediaBuffer::MemType type = MediaBuffer::MemType::MEM_COMMON);
   ~BufferPool();
 
   std::shared_ptr<MediaBuffer> GetBuffer(bool block = true);
-  int PutBuffer(MediaGroupBuffer *mgb);
+  // timeout_ms < 0: wait until a buffer is released, 0: do not wait.
+  std::shared_ptr<MediaBuffer> GetBufferTimeout(int timeout_ms);
+  // As GetBufferTimeout, the SampleBuffer object lives in the slot too.
+  std::shared_ptr<SampleBuffer> GetSampleBuffer(const SampleInfo &info,
+                                                int timeout_ms = 0);
+  int GetBufferSize() const { return buf_size; }
+
+  struct Stats {
+    int cnt;
+    int busy;
+    int high_water; // max busy buffers since created or ResetWaterMark
+    int low_water;  // min ready buffers since created or ResetWaterMark
+    uint64_t get_cnt;
+    uint64_t fail_cnt; // GetBuffer returns nullptr, no buffer in time
+  };
+  void GetStats(Stats &stats);
+  void ResetWaterMark();
 
   void DumpInfo();
 
 private:
-  std::list<MediaGroupBuffer *> ready_buffers;
-  std::list<MediaGroupBuffer *> busy_buffers;
-  ConditionLockMutex mtx;
+  BufferPoolSlots *slots;
   int buf_cnt;
   int buf_size;
 };
@@ -5,8 +5,11 @@
 #ifndef EASYMEDIA_CODEC_H_
 #define EASYMEDIA_CODEC_H_
 
+#include <stdint.h>
+
 #include <list>
 #include <memory>
+#include <vector>
 
 #include "media_config.h"
 
@@ -44,6 +47,44 @@ private:
 };
 
 _API const uint8_t *find_nalu_startcode(const uint8_t *p, const uint8_t *end);
+
+// All the nal units of an encoded h264/h265 buffer, found in a single scan.
+class _API NaluIndex {
+public:
+  struct Nalu {
+    uint32_t offset; // of the start code
+    uint32_t size;   // including the start code
+    uint8_t start_len;
+    uint8_t type;
+  };
+  static const int kMaxType = 64;
+
+  NaluIndex(const uint8_t *data, size_t length, CodecType c_type);
+  bool Match(const void *data, size_t length, CodecType c_type) const {
+    return data == base && length == len && c_type == codec_type;
+  }
+  // First nal unit of this type, nullptr if none. O(1).
+  const Nalu *Find(int type) const {
+    if (type < 0 || type >= kMaxType || first[type] < 0)
+      return nullptr;
+    return &nalus[first[type]];
+  }
+  const std::vector<Nalu> &GetNalus() const { return nalus; }
+
+private:
+  const void *base;
+  size_t len;
+  CodecType codec_type;
+  std::vector<Nalu> nalus;
+  int16_t first[kMaxType];
+};
+
+// Index of the valid data of mb, built on the first call and cached in mb.
+_API std::shared_ptr<NaluIndex> GetNaluIndex(std::shared_ptr<MediaBuffer> &mb,
+                                             CodecType c_type);
+// The leading vps/sps/pps of mb as views: no copy, each one holds mb.
+_API std::list<std::shared_ptr<MediaBuffer>>
+split_h26x_separate(std::shared_ptr<MediaBuffer> &mb, CodecType c_type);
 // must be h264 data
 _API std::list<std::shared_ptr<MediaBuffer>>
 split_h264_separate(const uint8_t *buffer, size_t length, int64_t timestamp);
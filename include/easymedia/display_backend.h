@@ -0,0 +1,180 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_DISPLAY_BACKEND_H_
+#define EASYMEDIA_DISPLAY_BACKEND_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "image.h"
+#include "utils.h"
+
+namespace easymedia {
+
+class MediaBuffer;
+
+// A dma-buf as a framebuffer: format is a drm fourcc, planes share fd.
+typedef struct {
+  int fd;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t pitches[4];
+  uint32_t offsets[4];
+} DisplayFBInfo;
+
+typedef struct {
+  uint32_t fb_id;
+  ImageRect src;
+  ImageRect dst;
+} DisplayPlaneState;
+
+// cookie of the flip and the time it was on screen, in us
+typedef std::function<void(uint32_t cookie, int64_t us)> DisplayFlipCallback;
+
+// What an output plane needs from the display: DRM for a real one, or the
+// NullDisplayBackend below. Commit never waits for vblank, and only one flip
+// can be pending at a time.
+class _API DisplayBackend {
+public:
+  virtual ~DisplayBackend() = default;
+  // Sets key to a value unique to the buffer behind the dma-buf fd, the same
+  // for all its fds. Returns 0 on success, < 0 on error.
+  virtual int GetBufferKey(int fd, uint64_t &key) = 0;
+  // Returns the fb id, 0 on failure.
+  virtual uint32_t AddFB(const DisplayFBInfo &info) = 0;
+  virtual void RemoveFB(uint32_t fb_id) = 0;
+  // Queues state for the next vblank, -EBUSY while a flip is pending.
+  virtual int Commit(const DisplayPlaneState &state, uint32_t cookie) = 0;
+  // Waits up to timeout_ms for a flip to complete and calls done for it.
+  // Returns the number of completed flips, < 0 on error.
+  virtual int HandleEvents(int timeout_ms,
+                           const DisplayFlipCallback &done) = 0;
+};
+
+// In-memory sink with a vblank every period_us, for tests and for running a
+// display flow without a screen.
+class _API NullDisplayBackend : public DisplayBackend {
+public:
+  NullDisplayBackend(int period_us = 16667);
+  virtual ~NullDisplayBackend() = default;
+  // the inode of fd
+  virtual int GetBufferKey(int fd, uint64_t &key) override;
+  virtual uint32_t AddFB(const DisplayFBInfo &info) override;
+  virtual void RemoveFB(uint32_t fb_id) override;
+  virtual int Commit(const DisplayPlaneState &state, uint32_t cookie) override;
+  virtual int HandleEvents(int timeout_ms,
+                           const DisplayFlipCallback &done) override;
+
+  int GetAddCount() const { return add_count; }
+  int GetRemoveCount() const { return remove_count; }
+  int GetFlipCount() const { return flip_count; }
+  int GetFBCount();
+  // fb on screen, 0 if none
+  uint32_t GetScreenFB();
+
+private:
+  int64_t NextVBlank(int64_t now) const;
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  const int period_us;
+  const int64_t start_us;
+  uint32_t next_fb_id;
+  std::list<uint32_t> fbs;
+  bool pending;
+  uint32_t pending_cookie;
+  uint32_t pending_fb;
+  int64_t pending_vblank;
+  uint32_t screen_fb;
+  int add_count;
+  int remove_count;
+  int flip_count;
+};
+
+// Framebuffers of the dma-bufs seen recently, keyed by the buffer key of
+// the backend (fds get dup'ed and reused, the key stays with the buffer) and
+// the geometry. Not the inode: before linux 5.3 all dma-bufs share one. An
+// fb is only removed when it is not in use and the cache is full, or with
+// the cache.
+class _API DisplayFBCache {
+public:
+  DisplayFBCache(const std::shared_ptr<DisplayBackend> &backend,
+                 int max_num = 16);
+  ~DisplayFBCache();
+  // fb id of info, which is in use until Put. 0 on failure.
+  uint32_t Get(const DisplayFBInfo &info);
+  void Put(uint32_t fb_id);
+
+  int GetHitCount() const { return hit_count; }
+  int GetMissCount() const { return miss_count; }
+
+private:
+  struct Entry {
+    uint64_t key;
+    DisplayFBInfo info;
+    uint32_t fb_id;
+    int refs;
+  };
+
+  std::mutex mtx;
+  std::shared_ptr<DisplayBackend> backend;
+  const size_t max_num;
+  std::list<Entry> entries; // most recently used first
+  int hit_count;
+  int miss_count;
+};
+
+// Shows frames without blocking the caller. A frame pushed while a flip is
+// pending waits for its completion, and is replaced if a newer one comes
+// first. The buffers and fbs of the frames on screen, pending and queued
+// are held until they are replaced.
+class _API DisplayFlipQueue {
+public:
+  DisplayFlipQueue(const std::shared_ptr<DisplayBackend> &backend,
+                   const std::shared_ptr<DisplayFBCache> &cache);
+  ~DisplayFlipQueue();
+  bool Push(const std::shared_ptr<MediaBuffer> &buffer,
+            const DisplayFBInfo &info, const ImageRect &src,
+            const ImageRect &dst);
+
+  int GetFlipCount() const { return flip_count; }
+  int GetDropCount() const { return drop_count; }
+
+private:
+  struct Frame {
+    std::shared_ptr<MediaBuffer> buffer;
+    DisplayPlaneState state;
+  };
+
+  void EventLoop();
+  void OnFlipDone(uint32_t cookie);
+  bool CommitLocked(Frame &frame);
+  void ReleaseLocked(Frame &frame);
+
+  std::mutex mtx;
+  std::shared_ptr<DisplayBackend> backend;
+  std::shared_ptr<DisplayFBCache> cache;
+  Frame screen;
+  Frame pending;
+  Frame queued;
+  uint32_t pending_cookie;
+  int64_t pending_us;
+  uint32_t cookie;
+  int flip_count;
+  int drop_count;
+  volatile bool running;
+  std::thread thread;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_DISPLAY_BACKEND_H_
@@ -0,0 +1,84 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_FEATURE_INDEX_H_
+#define EASYMEDIA_FEATURE_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "utils.h"
+
+namespace easymedia {
+
+typedef struct {
+  int id;
+  int row;
+  float score; // cosine similarity, in [-1.0, 1.0]
+} FeatureMatch;
+
+// In-memory index of float feature vectors (face features and so on).
+// The vectors are L2 normalized and kept in one contiguous 64-byte aligned
+// matrix, each row padded to a multiple of 4 floats so that every row is
+// 16-byte aligned. A search scores every row against the query with
+// NEON/SSE and keeps the best k. Rows are added and removed one by one, the
+// matrix can be saved to a snapshot file and mapped back at startup instead
+// of being rebuilt vector by vector. Not thread safe, callers lock.
+class _API FeatureIndex {
+public:
+  FeatureIndex();
+  ~FeatureIndex();
+  FeatureIndex(const FeatureIndex &) = delete;
+  FeatureIndex &operator=(const FeatureIndex &) = delete;
+
+  // Drops all rows. dim > 0 also changes the feature dimension.
+  void Reset(int dim = 0);
+  int GetDim() const { return dim; }
+  int GetCount() const { return count; }
+
+  // Returns the row of the new vector, or -1 on failure.
+  int Add(int id, const float *feature);
+  // Removes all the rows of id, the last rows fill the holes. Returns the
+  // number of rows removed.
+  int Remove(int id);
+  // The vector of row, as it was added (not normalized).
+  bool GetFeature(int row, float *feature) const;
+  int GetId(int row) const { return ids[row]; }
+
+  // Writes the best k rows with a score >= min_score to out, best first,
+  // returns how many were written.
+  int Search(const float *query, int k, float min_score,
+             FeatureMatch *out) const;
+
+  // tag is opaque to the index, a snapshot is only loaded if it has the
+  // same tag (and dim, if dim > 0) as given. The loaded matrix is mapped
+  // copy-on-write. Both return 0 on success.
+  int SaveSnapshot(const char *path, uint64_t tag) const;
+  int LoadSnapshot(const char *path, uint64_t tag, int dim = 0);
+
+  // Dot products of query with num rows of stride floats, the kernel used
+  // by Search. stride must be a multiple of 4 and rows 16-byte aligned.
+  static void DotRows(const float *query, const float *rows, size_t stride,
+                      int num, float *scores);
+
+private:
+  bool Reserve(int cnt);
+  void Release();
+
+  int dim;
+  size_t stride; // floats per row, dim rounded up to 4
+  int count;
+  int capacity;
+  float *rows;
+  void *map_addr; // rows points into this mapping after LoadSnapshot
+  size_t map_size;
+  std::vector<int> ids;
+  std::vector<float> norms;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_FEATURE_INDEX_H_
@@ -5,7 +5,9 @@
 #ifndef EASYMEDIA_FLOW_H_
 #define EASYMEDIA_FLOW_H_
 
+#include "histogram.h"
 #include "lock.h"
+#include "lock_free_queue.h"
 #include "message.h"
 #include "reflector.h"
 #include "utils.h"
@@ -34,10 +36,21 @@ DECLARE_REFLECTOR(Flow)
                               GetError() < 0)
 
 class MediaBuffer;
-enum class Model { NONE, ASYNCCOMMON, ASYNCATOMIC, SYNC };
+// ASYNCLOCKFREE: same as ASYNCCOMMON, but the input queue is a bounded
+// lock-free ring and the flow thread is only woken when it is parked.
+enum class Model { NONE, ASYNCCOMMON, ASYNCATOMIC, SYNC, ASYNCLOCKFREE };
 // PushMode
 enum class InputMode { NONE, BLOCKING, DROPFRONT, DROPCURRENT };
 enum class HoldInputMode { NONE, HOLD_INPUT, INHERIT_FORM_INPUT };
+// DEFAULT follows env RKMEDIA_FLOW_EXECUTOR ("thread", "pool" or "timer").
+// Only ASYNCCOMMON/ASYNCLOCKFREE without BLOCKING inputs can run on the pool.
+// Only ASYNCATOMIC can run on the timer, which shares one thread between
+// all the periodic flows.
+enum class Executor { DEFAULT, THREAD, POOL, TIMER };
+// What a periodic (ASYNCATOMIC) flow does when it is late by several
+// periods: run once for the latest one, or run the missed ones back to
+// back (at most a few).
+enum class MissPolicy { SKIP, CATCHUP };
 using MediaBufferVector = std::vector<std::shared_ptr<MediaBuffer>>;
 // TODO: outputs ret, outslot index, outslot queue model
 using FunctionProcess =
@@ -66,17 +79,22 @@ class _API SlotMap {
 public:
   SlotMap()
       : thread_model(Model::SYNC), mode_when_full(InputMode::DROPFRONT),
-        process(nullptr), interval(16.66f) {}
+        process(nullptr), interval(16.66f), executor(Executor::DEFAULT),
+        priority(0), cpu_affinity(-1), miss_policy(MissPolicy::SKIP) {}
   std::vector<int> input_slots;
   Model thread_model;
   InputMode mode_when_full;
-  std::vector<bool> fetch_block; // if ASYNCCOMMON
+  std::vector<bool> fetch_block; // if ASYNCCOMMON or ASYNCLOCKFREE
   std::vector<int> input_maxcachenum;
   std::vector<int> output_slots;
   // std::vector<DataSetModel> output_ds_model;
   std::vector<HoldInputMode> hold_input;
   FunctionProcess process;
   float interval;
+  Executor executor;
+  int priority;     // if Executor::POOL
+  int cpu_affinity; // if Executor::POOL
+  MissPolicy miss_policy; // if ASYNCATOMIC
 };
 
 class FlowCoroutine;
@@ -100,6 +118,9 @@ public:
   void RemoveDownFlow(std::shared_ptr<Flow> down);
 
   void SendInput(std::shared_ptr<MediaBuffer> &input, int in_slot_index);
+  // Same as calling SendInput for each buffer in order, but an async input
+  // takes its lock and wakes its coroutine only once for the whole batch.
+  void SendInputBatch(MediaBufferVector &inputs, int in_slot_index);
   void SetDisable() { enable = false; }
 
   // The Control must be called in the same thread to that create flow
@@ -195,12 +216,20 @@ public:
   bool IsAllBuffEmpty();
   void DumpBase(std::string &dump_info);
   virtual void Dump(std::string &dump_info) { DumpBase(dump_info); }
+  // Always-on runtime statistics of this flow as a json object: per input
+  // counters and queue wait histogram, per coroutine process time
+  // histogram, fps in/out since the previous call, the down flows and the
+  // statistics of the flow type.
+  void DumpStats(std::string &json);
 
   void StartStream();
   int GetCachedBufferNum(unsigned int &total, unsigned int &used);
   void ClearCachedBuffers();
 
 protected:
+  // Appends the ,"key":value members a flow type adds to DumpStats.
+  virtual void DumpPrivateStats(std::string &json _UNUSED) {}
+
   class FlowInputMap {
   public:
     FlowInputMap(std::shared_ptr<Flow> &f, int i) : flow(f), index_of_in(i) {}
@@ -210,13 +239,16 @@ protected:
       return flow == f;
     }
   };
+  using FlowList = std::vector<FlowInputMap>;
   class FlowMap {
   private:
     void SetOutputBehavior(const std::shared_ptr<MediaBuffer> &output);
     void SetOutputToQueueBehavior(const std::shared_ptr<MediaBuffer> &output);
 
   public:
-    FlowMap() : valid(false), hold_input(HoldInputMode::NONE) {
+    FlowMap()
+        : valid(false), hold_input(HoldInputMode::NONE),
+          flows(std::make_shared<const FlowList>()) {
       assert(list_mtx.valid);
     }
     FlowMap(FlowMap &&);
@@ -226,9 +258,14 @@ protected:
     // down flow
     void AddFlow(std::shared_ptr<Flow> flow, int index);
     void RemoveFlow(std::shared_ptr<Flow> flow);
-    std::list<FlowInputMap> flows;
-    ReadWriteLockMutex list_mtx;
-    std::deque<std::shared_ptr<MediaBuffer>> cached_buffers; // never drop
+    // The down flow list is immutable once published, AddFlow/RemoveFlow
+    // replace it by a new copy. Readers hold a snapshot without any lock.
+    std::shared_ptr<const FlowList> GetFlows() const {
+      return std::atomic_load(&flows);
+    }
+    std::shared_ptr<const FlowList> flows;
+    ReadWriteLockMutex list_mtx; // serializes AddFlow/RemoveFlow
+    MediaBufferVector cached_buffers; // never drop
     std::shared_ptr<MediaBuffer> cached_buffer;
     decltype(&FlowMap::SetOutputBehavior) set_output_behavior;
   };
@@ -237,16 +274,25 @@ protected:
     void SyncSendInputBehavior(std::shared_ptr<MediaBuffer> &input);
     void ASyncSendInputCommonBehavior(std::shared_ptr<MediaBuffer> &input);
     void ASyncSendInputAtomicBehavior(std::shared_ptr<MediaBuffer> &input);
+    void ASyncSendInputLockFreeBehavior(std::shared_ptr<MediaBuffer> &input);
+    bool ASyncPushCommon(std::shared_ptr<MediaBuffer> &input, int64_t ts);
+    bool ASyncPushLockFree(std::shared_ptr<MediaBuffer> &input, int64_t ts);
+    void ASyncWakeup();
     // behavior when input list exceed max_cache_num
     bool ASyncFullBlockingBehavior(volatile bool &pred);
     bool ASyncFullDropFrontBehavior(volatile bool &pred);
     bool ASyncFullDropCurrentBehavior(volatile bool &pred);
 
   public:
-    Input() : valid(false), flow(nullptr), fetch_block(true) {}
+    Input()
+        : valid(false), flow(nullptr), fetch_block(true),
+          pool_coroutine(nullptr), blocked_time(0), blocked_cnt(0),
+          enqueue_cnt(0), drop_cnt(0) {}
     Input(Input &&);
     void Init(Flow *f, Model m, int mcn, InputMode im, bool f_block,
               std::shared_ptr<FlowCoroutine> fc);
+    size_t CachedBufferSize();
+    void SendBatch(MediaBufferVector &inputs);
     bool valid;
     Flow *flow;
     Model thread_model;
@@ -260,6 +306,21 @@ protected:
     decltype(&Input::SyncSendInputBehavior) send_input_behavior;
     decltype(&Input::ASyncFullBlockingBehavior) async_full_behavior;
     std::shared_ptr<FlowCoroutine> coroutine;
+    // if Executor::POOL, scheduled on every new input
+    FlowCoroutine *pool_coroutine;
+    // enqueue time of cached_buffers, for queue wait statistics
+    std::deque<int64_t> cached_ts;
+    // if ASYNCLOCKFREE, buffer and its enqueue time
+    typedef std::pair<std::shared_ptr<MediaBuffer>, int64_t> TimedBuffer;
+    std::shared_ptr<LockFreeQueue<TimedBuffer>> ring;
+    EventCount space_event; // signaled by consumer after pop
+    // if BLOCKING, time(us) and times that the producer waited for room
+    std::atomic<int64_t> blocked_time;
+    std::atomic<int64_t> blocked_cnt;
+    // statistics
+    std::atomic<uint64_t> enqueue_cnt;
+    std::atomic<uint64_t> drop_cnt;
+    LatencyHistogram wait_hist; // us, from SendInput to fetched by coroutine
   };
 
   // Can not change the following values after initialize,
@@ -279,6 +340,8 @@ protected:
                    const std::string &mark);
   bool InstallSlotMap(SlotMap &map, const std::string &mark,
                       int exp_process_time);
+  bool UsePoolExecutor(const SlotMap &map);
+  bool UseTimerExecutor(const SlotMap &map);
   bool SetOutput(const std::shared_ptr<MediaBuffer> &output,
                  int out_slot_index);
   bool ParseWrapFlowParams(const char *param,
@@ -308,6 +371,7 @@ private:
   volatile bool enable;
   volatile bool quit;
   ConditionLockMutex cond_mtx;
+  EventCount input_event; // wake up ASYNCLOCKFREE coroutines
 
   // event handler
   std::unique_ptr<EventHandler> event_handler_;
@@ -333,12 +397,21 @@ private:
   // Control the number of executions of threads inside Flow
   int run_times;
 
+  // statistics
+  std::atomic<uint64_t> output_cnt;
+  ConditionLockMutex stats_mtx;
+  int64_t stats_last_time;
+  uint64_t stats_last_in;
+  uint64_t stats_last_out;
+
   DEFINE_ERR_GETSET()
   DECLARE_PART_FINAL_EXPOSE_PRODUCT(Flow)
 };
 
 std::string gen_datatype_rule(std::map<std::string, std::string> &params);
 Model GetModelByString(const std::string &model);
+Executor GetExecutorByString(const std::string &executor);
+MissPolicy GetMissPolicyByString(const std::string &policy);
 InputMode GetInputModelByString(const std::string &in_model);
 _API void ParseParamToSlotMap(std::map<std::string, std::string> &params,
                               SlotMap &sm, int &input_maxcachenum);
@@ -353,6 +426,9 @@ _API std::string JoinFlowParam(const std::string &flow_param, size_t num_elem,
                                ...);
 _API std::list<std::string> ParseFlowParamToList(const char *param);
 
+// Statistics of all the live flows as json: {"flows":[...]}
+_API std::string DumpFlowGraphStats();
+
 } // namespace easymedia
 
 #endif // #ifndef EASYMEDIA_FLOW_H_
@@ -0,0 +1,65 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_HISTOGRAM_H_
+#define EASYMEDIA_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "utils.h"
+
+namespace easymedia {
+
+// HDR-style log-linear histogram of microsecond values. Values below 16 have
+// an exact bucket, above that every power of two is split into 8 buckets,
+// so any percentile is reported with less than 12.5% relative error.
+// Record() is lock-free and cheap enough to stay always on; each recorder
+// (flow thread) owns its histograms, readers only take relaxed snapshots.
+class _API LatencyHistogram {
+public:
+  static const int kSubBits = 3;
+  static const int kLinearNum = 1 << (kSubBits + 1);
+  static const int kBucketNum =
+      kLinearNum + (32 - kSubBits - 1) * (1 << kSubBits);
+
+  LatencyHistogram();
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+  void Record(int64_t us) {
+    if (us < 0)
+      us = 0;
+    buckets[BucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(us, std::memory_order_relaxed);
+    int64_t old = max.load(std::memory_order_relaxed);
+    while (us > old &&
+           !max.compare_exchange_weak(old, us, std::memory_order_relaxed))
+      ;
+  }
+
+  uint64_t GetCount() const { return count.load(std::memory_order_relaxed); }
+  int64_t GetMax() const { return max.load(std::memory_order_relaxed); }
+  double GetMean() const;
+  // p in [0, 100], returns the upper bound of the matching bucket
+  int64_t GetPercentile(double p) const;
+  // {"count":N,"mean":N,"p50":N,"p90":N,"p99":N,"max":N}
+  std::string ToJson() const;
+
+  static int BucketIndex(uint64_t v);
+  static uint64_t BucketUpperBound(int index);
+
+private:
+  std::atomic<uint32_t> buckets[kBucketNum];
+  std::atomic<uint64_t> count;
+  std::atomic<int64_t> sum;
+  std::atomic<int64_t> max;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_HISTOGRAM_H_
@@ -80,6 +80,13 @@
 
 #define KEY_REF_FRM_CFG "reference_frame_config"
 
+// software codec threads
+#define KEY_CODEC_THREADS "codec_threads" // number or KEY_AUTO
+#define KEY_CODEC_THREAD_TYPE "codec_thread_type"
+#define KEY_AUTO "auto"
+#define KEY_THREAD_FRAME "frame"
+#define KEY_THREAD_SLICE "slice"
+
 // mpp special
 #define KEY_MPP_GROUP_MAX_FRAMES "fg_max_frames" // framegroup max frame num
 #define KEY_MPP_SPLIT_MODE "split_mode"
@@ -135,6 +142,9 @@
 #define KEY_USERNAME "username"
 #define KEY_USERPASSWORD "userpwd"
 #define KEY_CHANNEL_NAME "channel_name"
+// Max hardware buffers the rtsp sources may hold by reference, 0 (default)
+// copies every hardware buffer.
+#define KEY_HW_BUFFER_BUDGET "hw_buffer_budget"
 
 #define KEY_MEM_CNT "mem_cnt"
 #define KEY_MEM_TYPE "mem_type"
@@ -151,6 +161,21 @@
 #define KEY_ASYNCCOMMON "asynccommon"
 #define KEY_ASYNCATOMIC "asyncatomic"
 #define KEY_SYNC "sync"
+#define KEY_ASYNCLOCKFREE "asynclockfree"
+
+// run the flow on a dedicated thread (default), on the shared worker pool
+// or, for asyncatomic, on the shared timer thread
+#define KEY_FLOW_EXECUTOR "executor"
+#define KEY_EXECUTOR_THREAD "thread"
+#define KEY_EXECUTOR_POOL "pool"
+#define KEY_EXECUTOR_TIMER "timer"
+// asyncatomic late by several periods: skip to the latest or catch up
+#define KEY_FLOW_MISS_POLICY "miss_policy"
+#define KEY_MISS_SKIP "skip"
+#define KEY_MISS_CATCHUP "catchup"
+// pool hints: priority > 0 high, 0 normal, < 0 low; cpu index, -1 no hint
+#define KEY_FLOW_PRIORITY "flow_priority"
+#define KEY_FLOW_CPU_AFFINITY "cpu_affinity"
 
 #define KEK_INPUT_MODEL "input_model"
 #define KEY_BLOCKING "blocking"
@@ -170,6 +195,9 @@
 #define KEY_FILE_TIME "file_time"
 #define KEY_MUXER_FFMPEG_AVDICTIONARY "muxer_ffmpeg_avdictionary"
 #define KEY_ENABLE_STREAMING "enable_streaming"
+#define KEY_MUXER_WRITE_QUEUE "muxer_write_queue"
+#define KEY_MUXER_PRE_RECORD_TIME "pre_record_time"
+#define KEY_MUXER_PRE_RECORD_SIZE "pre_record_size"
 
 // drm
 #define KEY_CONNECTOR_ID "connector_id"
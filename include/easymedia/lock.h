@@ -7,6 +7,7 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <stdint.h>
 
 #include <atomic>
 #include <condition_variable>
@@ -44,6 +45,8 @@ public:
   virtual void unlock() override;
   virtual void wait() override;
   virtual void notify() override;
+  // Return false if timeout.
+  bool wait_for(int ms);
 
 private:
   std::mutex mtx;
@@ -78,6 +81,25 @@ private:
   std::atomic_flag flag;
 };
 
+// Lightweight event count built on futex. Waiters announce themselves with
+// PrepareWait(), re-check their condition, then Wait(). Notify() only enters
+// the kernel when someone is actually parked.
+class EventCount {
+public:
+  EventCount() : epoch(0), waiters(0) {}
+  EventCount(const EventCount &) = delete;
+  EventCount &operator=(const EventCount &) = delete;
+  uint32_t PrepareWait();
+  void CancelWait();
+  // timeout_ms < 0 means wait forever. Return false if timeout.
+  bool Wait(uint32_t key, int timeout_ms = -1);
+  void Notify();
+
+private:
+  std::atomic<uint32_t> epoch;
+  std::atomic<int> waiters;
+};
+
 class AutoLockMutex {
 public:
   AutoLockMutex(LockMutex &lm) : m_lm(lm) { m_lm.lock(); }
@@ -0,0 +1,112 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_LOCK_FREE_QUEUE_H_
+#define EASYMEDIA_LOCK_FREE_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace easymedia {
+
+// Bounded multi-producer multi-consumer queue (Dmitry Vyukov's algorithm).
+// Every cell carries a sequence number, so TryPush/TryPop only need one CAS
+// on the shared position and never take a lock. The capacity is rounded up
+// to a power of two. Waiting for room or for data is left to the caller.
+template <typename T> class LockFreeQueue {
+public:
+  explicit LockFreeQueue(size_t size)
+      : mask(RoundUpPowerOf2(size) - 1), cells(new Cell[mask + 1]),
+        enqueue_pos(0), dequeue_pos(0) {
+    for (size_t i = 0; i <= mask; i++)
+      cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+  LockFreeQueue(const LockFreeQueue &) = delete;
+  LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+
+  bool TryPush(const T &data) {
+    Cell *cell;
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells[pos & mask];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+      if (dif == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false; // full
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = data;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T &data) {
+    Cell *cell;
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells[pos & mask];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (dif == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false; // empty
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    data = std::move(cell->data);
+    cell->data = T();
+    cell->seq.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Only a snapshot, may be stale as soon as it returns.
+  size_t Size() const {
+    size_t tail = enqueue_pos.load(std::memory_order_acquire);
+    size_t head = dequeue_pos.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+  bool Empty() const { return Size() == 0; }
+  size_t Capacity() const { return mask + 1; }
+
+private:
+  static size_t RoundUpPowerOf2(size_t v) {
+    size_t r = 2;
+    while (r < v)
+      r <<= 1;
+    return r;
+  }
+
+  struct Cell {
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  // Keep producer and consumer positions on different cache lines.
+  static const size_t kCacheLine = 64;
+  const size_t mask;
+  std::unique_ptr<Cell[]> cells;
+  char pad0[kCacheLine];
+  std::atomic<size_t> enqueue_pos;
+  char pad1[kCacheLine - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> dequeue_pos;
+  char pad2[kCacheLine - sizeof(std::atomic<size_t>)];
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_LOCK_FREE_QUEUE_H_
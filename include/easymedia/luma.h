@@ -0,0 +1,40 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_LUMA_H_
+#define EASYMEDIA_LUMA_H_
+
+#include <stdint.h>
+
+#include "image.h"
+
+namespace easymedia {
+
+typedef struct {
+  uint64_t sum;   // sum of the sampled pixels
+  uint32_t count; // number of the sampled pixels, 0 if region is invalid
+  uint8_t min;    // only with LUMA_STAT_MINMAX
+  uint8_t max;
+  // 256 bins, only with LUMA_STAT_HISTOGRAM and a non-null hist
+  uint32_t *hist;
+} LumaStat;
+
+#define LUMA_STAT_MINMAX (1 << 0)
+#define LUMA_STAT_HISTOGRAM (1 << 1)
+
+// Statistics of several regions of one 8-bit plane (usually the Y plane),
+// all the regions are done in one top to bottom pass, so a line shared by
+// many regions is read into cache only once. Regions must be inside
+// width x height, otherwise their count stays 0.
+// step > 1 samples every step-th pixel of every step-th line.
+_API void CalculateRegionLuma(const uint8_t *plane, int stride, int width,
+                              int height, const ImageRect *regions, int num,
+                              LumaStat *stats, int flags = 0, int step = 1);
+
+// Sum of n bytes, the kernel used by CalculateRegionLuma.
+_API uint64_t LumaSumLine(const uint8_t *p, int n);
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_LUMA_H_
@@ -55,8 +55,17 @@ typedef struct {
   // rc_mode - rate control mode
   // "vbr", "cbr", "fixqp"
   const char *rc_mode;
+  // threads of the software codecs, 0 (unset): 1, CODEC_THREADS_AUTO: one
+  // per cpu core.
+  int codec_threads;
+  // CODEC_THREAD_FRAME and/or CODEC_THREAD_SLICE, 0: both.
+  int codec_thread_type;
 } VideoConfig;
 
+#define CODEC_THREADS_AUTO (-1)
+#define CODEC_THREAD_FRAME (1 << 0)
+#define CODEC_THREAD_SLICE (1 << 1)
+
 typedef struct {
   SampleInfo sample_info;
   CodecType codec_type;
@@ -195,6 +204,13 @@ const char *ConvertRcQuality(const std::string &s);
 const char *ConvertRcMode(const std::string &s);
 bool ParseMediaConfigFromMap(std::map<std::string, std::string> &params,
                              MediaConfig &mc);
+// KEY_CODEC_THREADS: KEY_AUTO is CODEC_THREADS_AUTO, empty is 0 (unset).
+_API int ParseCodecThreads(const std::string &s);
+// KEY_CODEC_THREAD_TYPE: "frame", "slice" or "frame_slice".
+int ParseCodecThreadType(const std::string &s);
+// The thread count to use for codec_threads: 1 if unset, the number of cpu
+// cores for CODEC_THREADS_AUTO.
+int GetCodecThreads(int codec_threads);
 _API std::vector<EncROIRegion>
 StringToRoiRegions(const std::string &str_regions);
 _API std::string to_param_string(const ImageConfig &img_cfg);
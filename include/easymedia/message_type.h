@@ -60,10 +60,19 @@ typedef enum {
   MUX_EVENT_BUTT
 } MuxerEventType;
 
+typedef struct {
+  unsigned int write_count;  // packets written into the file
+  unsigned int write_avg_us; // average time of one packet write
+  unsigned int write_max_us;
+  unsigned int queue_max;  // max depth of the write-behind queue
+  unsigned int queue_full; // times the flow thread waited for queue room
+} MuxerWriteStat;
+
 typedef struct {
   MuxerEventType type;
   char file_name[256];
-  int value; // "duration" or "error code".
+  int value;           // "duration" or "error code".
+  MuxerWriteStat stat; // statistics of the file, on MUX_EVENT_FILE_END
 } MuxerEvent;
 
 typedef enum {
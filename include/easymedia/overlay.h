@@ -0,0 +1,54 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_OVERLAY_H_
+#define EASYMEDIA_OVERLAY_H_
+
+#include <stdint.h>
+
+#include "image.h"
+
+namespace easymedia {
+
+// An image to draw on. pix_fmt is one of NV12, NV21, YUV420P, RGB565,
+// BGR565, RGB888, BGR888, ARGB8888, ABGR8888, or PIX_FMT_NONE for an 8-bit
+// plane of palette indexes (an osd region bitmap). Strides are in bytes.
+typedef struct {
+  PixelFormat pix_fmt;
+  uint8_t *planes[3];
+  int strides[3];
+  int width;
+  int height;
+} OverlayImage;
+
+typedef struct {
+  ImageRect rect;
+  int thick;      // width of the border, <= 0 fills the rect
+  uint32_t color; // from OverlayColor, the index for a palette plane
+} OverlayBox;
+
+// Planes of a contiguous buffer of vir_width x vir_height.
+// Returns -EINVAL if pix_fmt can not be drawn on.
+_API int OverlayInitImage(OverlayImage &image, PixelFormat pix_fmt,
+                          uint8_t *data, int width, int height, int vir_width,
+                          int vir_height);
+
+// Color of r, g, b in pix_fmt: 0xYYUUVV (bt.601 full range) for the yuv
+// formats, 0xAARRGGBB for the rgb ones.
+_API uint32_t OverlayColor(PixelFormat pix_fmt, uint8_t r, uint8_t g,
+                           uint8_t b, uint8_t a = 0xFF);
+
+// Draws all the boxes in one top to bottom pass, each line is written as
+// the spans of the boxes on it. Boxes are clipped to the image, where they
+// overlap the later one wins. Returns the number of boxes drawn.
+_API int OverlayDrawBoxes(const OverlayImage &image, const OverlayBox *boxes,
+                          int num);
+
+// Fills n pixels of bpp (1 to 4) bytes with pixel, its bytes in memory
+// order from the lowest. The kernel used by OverlayDrawBoxes.
+_API void OverlayFillSpan(uint8_t *dst, int n, uint32_t pixel, int bpp);
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_OVERLAY_H_
@@ -0,0 +1,47 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_PCM_H_
+#define EASYMEDIA_PCM_H_
+
+#include <stdint.h>
+
+#include "utils.h"
+
+namespace easymedia {
+
+// PCM kernels for the audio streams and filters. 16-bit stereo (and 32-bit
+// stereo for the layout changes) has NEON/SSE2 code, the other cases use
+// the scalar loops. n is a number of samples, frames a number of frames of
+// channels samples each.
+
+// Interleaved frames to channels planes of frames samples, and back.
+// sample_bytes is 1, 2 or 4.
+_API void PcmDeinterleave(void *const *planes, const void *src,
+                          int sample_bytes, int channels, int frames);
+_API void PcmInterleave(void *dst, const void *const *planes,
+                        int sample_bytes, int channels, int frames);
+
+// dst[i] = src[i * channels + ch], dst may be src.
+_API void PcmPickChannelS16(int16_t *dst, const int16_t *src, int channels,
+                            int ch, int frames);
+
+// Float samples are in [-1.0, 1.0), to S16 they are rounded to nearest and
+// saturated. S32 to S16 keeps the high 16 bits.
+_API void PcmS16ToFlt(float *dst, const int16_t *src, int n);
+_API void PcmFltToS16(int16_t *dst, const float *src, int n);
+_API void PcmS16ToS32(int32_t *dst, const int16_t *src, int n);
+_API void PcmS32ToS16(int16_t *dst, const int32_t *src, int n);
+
+// dst = src * gain, saturated. gain is applied in Q12, so it is in
+// (-8.0, 8.0) with a step of 1/4096. dst may be src.
+_API void PcmGainS16(int16_t *dst, const int16_t *src, int n, float gain);
+
+// dst = srcs[0] + ... + srcs[num - 1], saturated. dst may be one of srcs.
+_API void PcmMixS16(int16_t *dst, const int16_t *const *srcs, int num,
+                    int n);
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_PCM_H_
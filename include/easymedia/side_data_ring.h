@@ -0,0 +1,145 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_SIDE_DATA_RING_H_
+#define EASYMEDIA_SIDE_DATA_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace easymedia {
+
+// The last results of a side flow (move detection, nn), kept sorted by the
+// atomic clock of the frame they were computed on so that the one of a frame
+// is found by binary search. Results are shared, not copied. When full, a
+// push drops the oldest result.
+template <typename T> class SideDataRing {
+public:
+  explicit SideDataRing(size_t capacity = 0)
+      : slots(capacity), head(0), count(0) {}
+  SideDataRing(const SideDataRing &) = delete;
+  SideDataRing &operator=(const SideDataRing &) = delete;
+
+  // Drops the stored results.
+  void SetCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> _lg(mtx);
+    slots.assign(capacity, Slot());
+    head = count = 0;
+  }
+
+  // Results come in clock order, a late one is inserted at its place, or
+  // dropped if it is older than all the results of a full ring.
+  void Push(int64_t clock, std::shared_ptr<T> value) {
+    std::unique_lock<std::mutex> lck(mtx);
+    size_t cap = slots.size();
+    if (!cap)
+      return;
+    size_t pos = LowerBound(clock + 1);
+    if (count == cap) {
+      if (pos == 0)
+        return;
+      At(0) = Slot();
+      head = (head + 1) % cap;
+      count--;
+      pos--;
+    }
+    for (size_t i = count; i > pos; i--)
+      At(i) = std::move(At(i - 1));
+    At(pos).clock = clock;
+    At(pos).value = std::move(value);
+    count++;
+    lck.unlock();
+    cond.notify_all();
+  }
+
+  // The result nearest to clock, if it is at most tolerance us away.
+  // delta is set to its clock minus clock.
+  std::shared_ptr<T> Find(int64_t clock, int64_t tolerance,
+                          int64_t *delta = nullptr) {
+    std::lock_guard<std::mutex> _lg(mtx);
+    if (!count)
+      return nullptr;
+    size_t pos = LowerBound(clock);
+    if (pos == count ||
+        (pos > 0 && clock - At(pos - 1).clock <= At(pos).clock - clock))
+      pos--;
+    int64_t d = At(pos).clock - clock;
+    if (d > tolerance || -d > tolerance)
+      return nullptr;
+    if (delta)
+      *delta = d;
+    return At(pos).value;
+  }
+
+  // Blocks until a result at or after clock - tolerance is in, past which
+  // no later result can be nearer to clock than the ones stored, or until
+  // timeout_us passed. Returns false on timeout.
+  bool WaitFor(int64_t clock, int64_t tolerance, int64_t timeout_us) {
+    std::unique_lock<std::mutex> lck(mtx);
+    auto ready = [&] {
+      return count && At(count - 1).clock >= clock - tolerance;
+    };
+    if (timeout_us <= 0)
+      return ready();
+    return cond.wait_for(lck, std::chrono::microseconds(timeout_us), ready);
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> _lg(mtx);
+    for (auto &s : slots)
+      s = Slot();
+    head = count = 0;
+  }
+
+  size_t Size() {
+    std::lock_guard<std::mutex> _lg(mtx);
+    return count;
+  }
+  size_t Capacity() {
+    std::lock_guard<std::mutex> _lg(mtx);
+    return slots.size();
+  }
+
+private:
+  struct Slot {
+    Slot() : clock(0) {}
+    int64_t clock;
+    std::shared_ptr<T> value;
+  };
+
+  // i-th result from the oldest, i < capacity
+  Slot &At(size_t i) {
+    size_t n = head + i;
+    return slots[n < slots.size() ? n : n - slots.size()];
+  }
+
+  // Index of the first result at or after clock.
+  size_t LowerBound(int64_t clock) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (At(mid).clock < clock)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::vector<Slot> slots;
+  size_t head;
+  size_t count;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_SIDE_DATA_RING_H_
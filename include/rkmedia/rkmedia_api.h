@@ -77,6 +77,10 @@ typedef MPP_RECV_PIC_PARAM_S VENC_RECV_PIC_PARAM_S;
  ********************************************************************/
 _CAPI RK_S32 RK_MPI_SYS_Init();
 _CAPI RK_VOID RK_MPI_SYS_DumpChn(MOD_ID_E enModId);
+// Dump runtime statistics of all the flows as json. With pcBuf NULL return
+// the size needed (including the terminating NUL), otherwise the length
+// written, or -RK_ERR_SYS_NOMEM if u32Size is not enough.
+_CAPI RK_S32 RK_MPI_SYS_DumpFlowStats(RK_CHAR *pcBuf, RK_U32 u32Size);
 _CAPI RK_S32 RK_MPI_SYS_Bind(const MPP_CHN_S *pstSrcChn,
                              const MPP_CHN_S *pstDestChn);
 _CAPI RK_S32 RK_MPI_SYS_UnBind(const MPP_CHN_S *pstSrcChn,
@@ -93,6 +97,21 @@ _CAPI RK_S32 RK_MPI_SYS_StartGetMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID);
 _CAPI RK_S32 RK_MPI_SYS_StopGetMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID);
 _CAPI MEDIA_BUFFER RK_MPI_SYS_GetMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID,
                                              RK_S32 s32MilliSec);
+// Get up to u32Num buffers of one channel at once, waits as
+// RK_MPI_SYS_GetMediaBuffer only if there is none. Return the number got.
+_CAPI RK_S32 RK_MPI_SYS_GetMediaBuffers(MOD_ID_E enModID, RK_S32 s32ChnID,
+                                        MEDIA_BUFFER *pMbs, RK_U32 u32Num,
+                                        RK_S32 s32MilliSec);
+// Return one fd which is readable while any of the channels has buffers to
+// get, it can be polled by the caller or passed to RK_MPI_SYS_WaitChnReady.
+// Create it again after one of the channels is destroyed.
+_CAPI RK_S32 RK_MPI_SYS_CreateChnWaitFd(const MPP_CHN_S *pstChns,
+                                        RK_U32 u32Cnt);
+// Wait for the channels of s32WaitFd, fill the ready ones in pstReadyChns.
+// Return the number of ready channels, 0 on timeout.
+_CAPI RK_S32 RK_MPI_SYS_WaitChnReady(RK_S32 s32WaitFd, MPP_CHN_S *pstReadyChns,
+                                     RK_U32 u32MaxCnt, RK_S32 s32MilliSec);
+_CAPI RK_S32 RK_MPI_SYS_DestroyChnWaitFd(RK_S32 s32WaitFd);
 _CAPI RK_S32 RK_MPI_SYS_SetFrameRate(MOD_ID_E enModID, RK_S32 s32ChnID,
                                      MPP_FPS_ATTR_S *pstFpsAttr);
 _CAPI RK_S32 RK_MPI_SYS_StartRecvFrame(MOD_ID_E enModID, RK_S32 s32ChnID,
@@ -184,6 +203,12 @@ _CAPI RK_S32 RK_MPI_VENC_RGN_SetPaletteId(
 _CAPI RK_S32 RK_MPI_VENC_StartRecvFrame(
     VENC_CHN VencChn, const VENC_RECV_PIC_PARAM_S *pstRecvParam);
 _CAPI RK_S32 RK_MPI_VENC_DestroyChn(VENC_CHN VencChn);
+// Return an eventfd which is readable while the channel has buffers to get,
+// for poll/select. It is reset when the buffers are got, so there is no
+// need to read it. Unlike the pipe it replaces, which took one 4-byte read
+// per buffer, a read(2) of it must be 8 bytes (EINVAL otherwise) and does
+// not block. Such a read clears the readable state even if buffers are left,
+// get all of them before polling again.
 _CAPI RK_S32 RK_MPI_VENC_GetFd(VENC_CHN VencChn);
 _CAPI RK_S32 RK_MPI_VENC_QueryStatus(VENC_CHN VencChn,
                                      VENC_CHN_STATUS_S *pstStatus);
@@ -234,6 +259,7 @@ _CAPI RK_S32 RK_MPI_AO_ClearChnBuf(AO_CHN AoChn);
 _CAPI RK_S32 RK_MPI_AENC_CreateChn(AENC_CHN AencChn,
                                    const AENC_CHN_ATTR_S *pstAttr);
 _CAPI RK_S32 RK_MPI_AENC_DestroyChn(AENC_CHN AencChn);
+// Same as RK_MPI_VENC_GetFd.
 _CAPI RK_S32 RK_MPI_AENC_GetFd(AENC_CHN AencChn);
 /********************************************************************
  * Algorithm::Move Detection api
@@ -319,6 +345,10 @@ _CAPI RK_S32 RK_MPI_VMIX_RGN_SetCover(VMIX_DEV VmDev, VMIX_CHN VmChn,
  * MUXER api
  ********************************************************************/
 _CAPI RK_S32 RK_MPI_MUXER_EnableChn(MUXER_CHN VmChn, MUXER_CHN_ATTR_S *pstAttr);
+// pstAttrEx may be NULL, same as RK_MPI_MUXER_EnableChn.
+_CAPI RK_S32 RK_MPI_MUXER_EnableChnEx(MUXER_CHN VmChn,
+                                      MUXER_CHN_ATTR_S *pstAttr,
+                                      MUXER_CHN_ATTR_EX_S *pstAttrEx);
 _CAPI RK_S32 RK_MPI_MUXER_DisableChn(MUXER_CHN VmChn);
 _CAPI RK_S32 RK_MPI_MUXER_Bind(const MPP_CHN_S *pstSrcChn,
                                const MUXER_CHN_S *pstDestChn);
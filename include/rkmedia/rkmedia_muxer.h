@@ -37,9 +37,21 @@ typedef enum rkMUXER_EVENT_E {
   MUXER_EVENT_BUTT
 } MUXER_EVENT_E;
 
+/* Write statistics of one file, valid with MUXER_EVENT_FILE_END */
+typedef struct rkMUXER_WRITE_STAT_S {
+  RK_U32 u32WriteCnt;     /* packets written into the file */
+  RK_U32 u32WriteAvgUs;   /* average time of one packet write */
+  RK_U32 u32WriteMaxUs;   /* max time of one packet write */
+  RK_U32 u32QueueMaxCnt;  /* max depth of write queue, 0 without queue */
+  RK_U32 u32QueueFullCnt; /* times the input waited for write queue room */
+} MUXER_WRITE_STAT_S;
+
 typedef struct rkMUXER_FILE_EVENT_INFO_S {
   RK_CHAR asFileName[MUXER_FILE_NAME_LEN];
   RK_U32 u32Duration;
+  /* Appended: the event is filled by the library, callbacks built against
+   * older headers only read the fields before it. */
+  MUXER_WRITE_STAT_S stWriteStat;
 } MUXER_FILE_EVENT_INFO_S;
 
 typedef struct rkMUXER_ERROR_EVENT_INFO_S {
@@ -144,6 +156,22 @@ typedef struct rkMUXER_CHN_ATTR_S {
   MUXER_AUDIO_STREAM_PARAM_S stAudioStreamParam;
 } MUXER_CHN_ATTR_S;
 
+// Optional attributes of RK_MPI_MUXER_EnableChnEx, kept out of
+// MUXER_CHN_ATTR_S so that its layout does not change for applications
+// built against older headers.
+typedef struct rkMUXER_CHN_ATTR_EX_S {
+  // Write behind queue length in packets. 0: write file in the input thread.
+  // Otherwise packets are written and files are split by an io thread, and
+  // the next file of auto split mode is opened ahead of the split.
+  RK_U32 u32WriteQueueLen;
+  // Pre-record time in seconds. 0: disable. While the stream is stopped,
+  // the last GOPs are kept in memory and written at the head of the file
+  // of the next RK_MPI_MUXER_StreamStart.
+  RK_U32 u32PreRecTimeSec;
+  // Memory limit of the pre-record, in bytes. 0: 8MB.
+  RK_U32 u32PreRecCacheSize;
+} MUXER_CHN_ATTR_EX_S;
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,10 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <cstddef>
+#include <new>
+
 #include "key_string.h"
 #include "utils.h"
 
@@ -495,182 +499,285 @@ MediaGroupBuffer *MediaGroupBuffer::Alloc(size_t size,
   }
 }
 
-BufferPool::BufferPool(int cnt, int size, MediaBuffer::MemType type) {
-  bool sucess = true;
+// Room for a shared_ptr control block with our deleter and allocator.
+#define POOL_SLOT_CTRL_SIZE 96
 
-  if (cnt <= 0) {
-    RKMEDIA_LOGE("BufferPool: cnt:%d is invalid!\n", cnt);
-    return;
+class BufferPoolSlots {
+public:
+  struct Slot {
+    BufferPoolSlots *owner;
+    MediaGroupBuffer *mgb;
+    int next; // free list link, -1 for the end
+    bool busy;
+    // MediaBuffer and its userdata each free a control block, the slot is
+    // back to the free list after both.
+    std::atomic<int> pending;
+    // the MediaBuffer or SampleBuffer handed out
+    alignas(SampleBuffer) char mb_storage[sizeof(SampleBuffer)];
+    alignas(std::max_align_t) char ctrl_storage[2][POOL_SLOT_CTRL_SIZE];
+  };
+
+  BufferPoolSlots(int cnt)
+      : slots(new Slot[cnt]()), slot_num(cnt), free_head(-1), busy_num(0),
+        high_water(0), get_cnt(0), fail_cnt(0), orphan(false) {}
+  ~BufferPoolSlots() {
+    for (int i = 0; i < slot_num; i++)
+      delete slots[i].mgb;
+    delete[] slots;
+  }
+
+  Slot *Acquire(int timeout_ms);
+  void Release(Slot *s);
+
+  ConditionLockMutex mtx;
+  Slot *slots;
+  int slot_num;
+  int free_head;
+  int busy_num;
+  int high_water;
+  uint64_t get_cnt;
+  uint64_t fail_cnt;
+  // BufferPool destroyed with buffers in use, the last release deletes us
+  bool orphan;
+};
+
+// Serves the control block from the slot storage, fallback to the heap if
+// the implementation needs more room.
+template <typename T> class PoolSlotAllocator {
+public:
+  typedef T value_type;
+  PoolSlotAllocator(BufferPoolSlots::Slot *s, int i) : slot(s), part(i) {}
+  template <typename U>
+  PoolSlotAllocator(const PoolSlotAllocator<U> &other)
+      : slot(other.slot), part(other.part) {}
+
+  T *allocate(size_t n) {
+    if (n * sizeof(T) <= POOL_SLOT_CTRL_SIZE)
+      return reinterpret_cast<T *>(slot->ctrl_storage[part]);
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n _UNUSED) {
+    if (reinterpret_cast<char *>(p) != slot->ctrl_storage[part])
+      ::operator delete(p);
+    slot->owner->Release(slot);
   }
 
-  for (int i = 0; i < cnt; i++) {
-    auto mgb = MediaGroupBuffer::Alloc(size, type);
-    if (!mgb) {
-      sucess = false;
-      break;
+  BufferPoolSlots::Slot *slot;
+  int part;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolSlotAllocator<T> &a, const PoolSlotAllocator<U> &b) {
+  return a.slot == b.slot && a.part == b.part;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolSlotAllocator<T> &a, const PoolSlotAllocator<U> &b) {
+  return !(a == b);
+}
+
+BufferPoolSlots::Slot *BufferPoolSlots::Acquire(int timeout_ms) {
+  AutoLockMutex _alm(mtx);
+  if (free_head < 0 && timeout_ms != 0) {
+    AutoDuration ad;
+    while (free_head < 0) {
+      if (timeout_ms < 0) {
+        mtx.wait();
+        continue;
+      }
+      int remain = timeout_ms - (int)(ad.Get() / 1000);
+      if (remain <= 0)
+        break;
+      mtx.wait_for(remain);
     }
-    mgb->SetBufferPool(this);
-    RKMEDIA_LOGD("Create: pool:%p, mgb:%p, ptr:%p, fd:%d, size:%zu\n", this,
-                 mgb, mgb->GetPtr(), mgb->GetFD(), mgb->GetSize());
-    ready_buffers.push_back(mgb);
   }
+  get_cnt++;
+  if (free_head < 0) {
+    fail_cnt++;
+    return nullptr;
+  }
+  Slot *s = &slots[free_head];
+  free_head = s->next;
+  s->busy = true;
+  if (++busy_num > high_water)
+    high_water = busy_num;
+  return s;
+}
 
-  if (!sucess) {
-    while (ready_buffers.size() > 0)
-      ready_buffers.pop_front();
-    RKMEDIA_LOGE("BufferPool: Create buffer pool failed! Please check space is "
-                 "enough!\n");
+void BufferPoolSlots::Release(Slot *s) {
+  if (s->pending.fetch_sub(1) != 1)
     return;
-  }
-  buf_cnt = cnt;
-  buf_size = size;
-  RKMEDIA_LOGD("BufferPool: Create buffer pool:%p, size:%d, cnt:%d\n", this,
-               size, cnt);
+  mtx.lock();
+  s->busy = false;
+  s->next = free_head;
+  free_head = s - slots;
+  busy_num--;
+  mtx.notify();
+  bool destroy = orphan && busy_num == 0;
+  mtx.unlock();
+  if (destroy)
+    delete this;
 }
 
-BufferPool::BufferPool(int cnt, int size, MediaBuffer::MemType type,
-                       unsigned int flag) {
-  bool sucess = true;
+BufferPool::BufferPool(int cnt, int size, MediaBuffer::MemType type)
+    : BufferPool(cnt, size, type, ROCKCHIP_BO_CACHABLE) {}
 
+BufferPool::BufferPool(int cnt, int size, MediaBuffer::MemType type,
+                       unsigned int flag)
+    : slots(nullptr), buf_cnt(0), buf_size(0) {
   if (cnt <= 0) {
     RKMEDIA_LOGE("BufferPool: cnt:%d is invalid!\n", cnt);
     return;
   }
 
+  auto bps = new BufferPoolSlots(cnt);
   for (int i = 0; i < cnt; i++) {
-    auto mgb = MediaGroupBuffer::Alloc(size, type, flag);
-    if (!mgb) {
-      sucess = false;
-      break;
+    auto &s = bps->slots[i];
+    s.owner = bps;
+    s.busy = false;
+    s.mgb = MediaGroupBuffer::Alloc(size, type, flag);
+    if (!s.mgb) {
+      delete bps;
+      RKMEDIA_LOGE("BufferPool: Create buffer pool failed! Please check space "
+                   "is enough!\n");
+      return;
     }
-    mgb->SetBufferPool(this);
+    s.mgb->SetBufferPool(this);
     RKMEDIA_LOGD("Create: pool:%p, mgb:%p, ptr:%p, fd:%d, size:%zu\n", this,
-                 mgb, mgb->GetPtr(), mgb->GetFD(), mgb->GetSize());
-    ready_buffers.push_back(mgb);
+                 s.mgb, s.mgb->GetPtr(), s.mgb->GetFD(), s.mgb->GetSize());
   }
-
-  if (!sucess) {
-    while (ready_buffers.size() > 0)
-      ready_buffers.pop_front();
-    RKMEDIA_LOGE("BufferPool: Create buffer pool failed! Please check space is "
-                 "enough!\n");
-    return;
+  // LIFO: the most recently released buffer is the hottest in cache
+  for (int i = cnt - 1; i >= 0; i--) {
+    bps->slots[i].next = bps->free_head;
+    bps->free_head = i;
   }
+  slots = bps;
   buf_cnt = cnt;
   buf_size = size;
   RKMEDIA_LOGD("BufferPool: Create buffer pool:%p, size:%d, cnt:%d\n", this,
                size, cnt);
 }
 
+BufferPool::BufferPool(int cnt, const SampleInfo &info,
+                       MediaBuffer::MemType type)
+    : BufferPool(cnt, GetSampleSize(info) * info.nb_samples, type) {}
+
 BufferPool::~BufferPool() {
-  int cnt = 0;
-  int wait_times = 30;
+  if (!slots)
+    return;
 
-  while (busy_buffers.size() > 0) {
-    if (wait_times-- <= 0) {
-      RKMEDIA_LOGE("BufferPool: waiting bufferpool free for 900ms, TimeOut!\n");
+  AutoDuration ad;
+  slots->mtx.lock();
+  while (slots->busy_num > 0) {
+    int remain = 900 - (int)(ad.Get() / 1000);
+    if (remain <= 0)
       break;
-    }
-    easymedia::usleep(30000); // wait 30ms
-  }
-
-  MediaGroupBuffer *mgb = NULL;
-  while (ready_buffers.size() > 0) {
-    mgb = ready_buffers.front();
-    ready_buffers.pop_front();
-    RKMEDIA_LOGD("BufferPool: #%02d Destroy buffer pool(ready):[%p,%p]\n", cnt,
-                 this, mgb);
-    delete mgb;
-    cnt++;
-  }
-
-  while (busy_buffers.size() > 0) {
-    mgb = busy_buffers.front();
-    busy_buffers.pop_front();
-    RKMEDIA_LOGW("BufferPool: #%02d Destroy buffer pool(busy):[%p,%p]\n", cnt,
-                 this, mgb);
-    delete mgb;
-    cnt++;
-  }
+    slots->mtx.wait_for(remain);
+  }
+  bool destroy = (slots->busy_num == 0);
+  if (!destroy) {
+    RKMEDIA_LOGW("BufferPool: %p destroyed with %d buffers in use, free them "
+                 "when they are released\n",
+                 this, slots->busy_num);
+    slots->orphan = true;
+    // the buffers in use may outlive this pool
+    for (int i = 0; i < slots->slot_num; i++)
+      slots->slots[i].mgb->SetBufferPool(nullptr);
+  }
+  slots->mtx.unlock();
+  if (destroy)
+    delete slots;
 }
 
-static int __groupe_buffer_free(void *data) {
-  assert(data);
-  if (data == NULL) {
-    RKMEDIA_LOGE("BufferPool: free ptr is null!\n");
-    return 0;
-  }
-  MediaGroupBuffer *mgb = (MediaGroupBuffer *)data;
-  if (mgb->pool == NULL) {
-    RKMEDIA_LOGE("BufferPool: free pool ptr is null!\n");
-    return 0;
-  }
-
-  BufferPool *bp = (BufferPool *)mgb->pool;
-
-  return bp->PutBuffer(mgb);
-}
+namespace {
+struct PoolMediaBufferDeleter {
+  void operator()(MediaBuffer *mb) { mb->~MediaBuffer(); }
+};
+struct PoolUserDataDeleter {
+  void operator()(void *) {}
+};
+} // namespace
 
 std::shared_ptr<MediaBuffer> BufferPool::GetBuffer(bool block) {
-  AutoLockMutex _alm(mtx);
-
-  while (1) {
-    if (!ready_buffers.size()) {
-      if (block)
-        mtx.wait();
-      else
-        return nullptr;
-    }
-    // mtx.notify wake up all mtx.wait.
-    if (ready_buffers.size() > 0)
-      break;
-  }
-
-  auto mgb = ready_buffers.front();
-  ready_buffers.pop_front();
-  busy_buffers.push_back(mgb);
+  return GetBufferTimeout(block ? -1 : 0);
+}
 
-  auto &&mb = std::make_shared<MediaBuffer>(
-      mgb->GetPtr(), mgb->GetSize(), mgb->GetFD(), mgb, __groupe_buffer_free);
-  return mb;
+// Constructs the buffer of s in the slot storage, a SampleBuffer if info
+// is given.
+static std::shared_ptr<MediaBuffer>
+new_slot_buffer(BufferPoolSlots::Slot *s, const SampleInfo *info) {
+  s->pending = 2;
+  auto mgb = s->mgb;
+  MediaBuffer *mb;
+  if (info)
+    mb = new (s->mb_storage) SampleBuffer(
+        MediaBuffer(mgb->GetPtr(), mgb->GetSize(), mgb->GetFD()), *info);
+  else
+    mb = new (s->mb_storage)
+        MediaBuffer(mgb->GetPtr(), mgb->GetSize(), mgb->GetFD());
+  // Copies of the userdata (e.g. by ImageBuffer) keep the slot busy too.
+  mb->SetUserData(std::shared_ptr<void>(mgb, PoolUserDataDeleter(),
+                                        PoolSlotAllocator<char>(s, 1)));
+  return std::shared_ptr<MediaBuffer>(mb, PoolMediaBufferDeleter(),
+                                      PoolSlotAllocator<char>(s, 0));
 }
 
-int BufferPool::PutBuffer(MediaGroupBuffer *mgb) {
-  std::list<MediaGroupBuffer *>::iterator it;
-  bool sucess = false;
-  AutoLockMutex _alm(mtx);
+std::shared_ptr<MediaBuffer> BufferPool::GetBufferTimeout(int timeout_ms) {
+  if (!slots)
+    return nullptr;
+  auto s = slots->Acquire(timeout_ms);
+  if (!s)
+    return nullptr;
+  return new_slot_buffer(s, nullptr);
+}
 
-  for (it = busy_buffers.begin(); it != busy_buffers.end();) {
-    if (*it == mgb) {
-      sucess = true;
-      it = busy_buffers.erase(it);
-      ready_buffers.push_back(mgb);
-      mtx.notify();
-      break;
-    }
-    it++;
-  }
+std::shared_ptr<SampleBuffer>
+BufferPool::GetSampleBuffer(const SampleInfo &info, int timeout_ms) {
+  if (!slots)
+    return nullptr;
+  auto s = slots->Acquire(timeout_ms);
+  if (!s)
+    return nullptr;
+  return std::static_pointer_cast<SampleBuffer>(new_slot_buffer(s, &info));
+}
 
-  if (!sucess)
-    RKMEDIA_LOGE("BufferPool: Unknow media group buffer:%p\n", mgb);
+void BufferPool::GetStats(Stats &stats) {
+  memset(&stats, 0, sizeof(stats));
+  if (!slots)
+    return;
+  AutoLockMutex _alm(slots->mtx);
+  stats.cnt = buf_cnt;
+  stats.busy = slots->busy_num;
+  stats.high_water = slots->high_water;
+  stats.low_water = buf_cnt - slots->high_water;
+  stats.get_cnt = slots->get_cnt;
+  stats.fail_cnt = slots->fail_cnt;
+}
 
-  return sucess ? 0 : -1;
+void BufferPool::ResetWaterMark() {
+  if (!slots)
+    return;
+  AutoLockMutex _alm(slots->mtx);
+  slots->high_water = slots->busy_num;
 }
 
 void BufferPool::DumpInfo() {
-  int id = 0;
   RKMEDIA_LOGI("##BufferPool DumpInfo:%p\n", this);
   RKMEDIA_LOGI("\tcnt:%d\n", buf_cnt);
   RKMEDIA_LOGI("\tsize:%d\n", buf_size);
-  RKMEDIA_LOGI("\tready buffers(%zu):\n", ready_buffers.size());
-  for (auto dev : ready_buffers)
-    RKMEDIA_LOGI("\t  #%02d Pool:%p, mgb:%p, ptr:%p\n", id++, dev->pool, dev,
-                 dev->GetPtr());
-  RKMEDIA_LOGI("\tbusy buffers(%zu):\n", busy_buffers.size());
-  id = 0;
-  for (auto dev : busy_buffers)
-    RKMEDIA_LOGI("\t  #%02d Pool:%p, mgb:%p, ptr:%p\n", id++, dev->pool, dev,
-                 dev->GetPtr());
+  if (!slots)
+    return;
+  AutoLockMutex _alm(slots->mtx);
+  RKMEDIA_LOGI("\tbusy:%d, high water:%d, low water:%d\n", slots->busy_num,
+               slots->high_water, buf_cnt - slots->high_water);
+  RKMEDIA_LOGI("\tget:%llu, fail:%llu\n", (unsigned long long)slots->get_cnt,
+               (unsigned long long)slots->fail_cnt);
+  for (int i = 0; i < slots->slot_num; i++) {
+    auto &s = slots->slots[i];
+    RKMEDIA_LOGI("\t  #%02d %s Pool:%p, mgb:%p, ptr:%p\n", i,
+                 s.busy ? "busy " : "ready", s.mgb->pool, s.mgb,
+                 s.mgb->GetPtr());
+  }
 }
 
 } // namespace easymedia
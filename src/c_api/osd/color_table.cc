@@ -4,6 +4,7 @@
 
 #include "color_table.h"
 #include <math.h>
+#include <string.h>
 
 RK_S32 color_tbl_argb_to_avuy(const RK_U32 *pu32RgbaTbl, RK_U32 *pu32AvuyTbl) {
   unsigned char r, g, b, a;
@@ -94,3 +95,42 @@ RK_U8 find_argb_color_tbl_by_dichotomy(const RK_U32 *pal, RK_U32 len,
 
   return mid;
 }
+
+PaletteCache::PaletteCache(const RK_U32 *pu32ArgbTbl, bool bDichotomy)
+    : dichotomy(bDichotomy) {
+  memcpy(u32ArgbTbl, pu32ArgbTbl, PALETTE_TABLE_LEN * sizeof(RK_U32));
+  u32ArgbTbl[PALETTE_TABLE_LEN] = u32ArgbTbl[PALETTE_TABLE_LEN - 1];
+  for (int i = 0; i < (1 << kSlotBits); i++)
+    slots[i].store(0, std::memory_order_relaxed);
+}
+
+RK_U8 PaletteCache::Find(RK_U32 u32ArgbColor) {
+  RK_U32 slot = (u32ArgbColor * 2654435761U) >> (32 - kSlotBits);
+  uint64_t entry = slots[slot].load(std::memory_order_relaxed);
+  if ((entry & 0x100) && (RK_U32)(entry >> 32) == u32ArgbColor)
+    return (RK_U8)(entry & 0xFF);
+
+  RK_U8 index;
+  if (dichotomy)
+    index = find_argb_color_tbl_by_dichotomy(u32ArgbTbl, PALETTE_TABLE_LEN,
+                                             u32ArgbColor);
+  else
+    index = find_argb_color_tbl_by_order(u32ArgbTbl, PALETTE_TABLE_LEN,
+                                         u32ArgbColor);
+  entry = ((uint64_t)u32ArgbColor << 32) | 0x100 | index;
+  slots[slot].store(entry, std::memory_order_relaxed);
+  return index;
+}
+
+void PaletteCache::ConvertLine(const RK_U32 *pu32Src, RK_U8 *pu8Dst,
+                               RK_U32 u32Len) {
+  RK_U32 i = 0;
+  while (i < u32Len) {
+    RK_U32 u32Color = pu32Src[i];
+    RK_U32 end = i + 1;
+    while (end < u32Len && pu32Src[end] == u32Color)
+      end++;
+    memset(pu8Dst + i, Find(u32Color), end - i);
+    i = end;
+  }
+}
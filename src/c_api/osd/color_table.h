@@ -5,6 +5,10 @@
 #ifndef _RK_COLOR_TABLES_H_
 #define _RK_COLOR_TABLES_H_
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "rkmedia_common.h"
 
 #define PALETTE_TABLE_LEN 256
@@ -62,4 +66,35 @@ RK_U8 find_argb_color_tbl_by_order(const RK_U32 *pal, RK_U32 len,
 RK_U8 find_argb_color_tbl_by_dichotomy(const RK_U32 *pal, RK_U32 len,
                                        RK_U32 u32ArgbColor);
 
+// ARGB -> palette index of one color table. Colors are cached by their
+// exact value, so the result is the same as the plain search, which only
+// runs the first time a color is seen.
+class PaletteCache {
+public:
+  PaletteCache(const RK_U32 *pu32ArgbTbl, bool bDichotomy);
+  RK_U8 Find(RK_U32 u32ArgbColor);
+  // A run of equal pixels, e.g. a transparent span, is looked up once.
+  void ConvertLine(const RK_U32 *pu32Src, RK_U8 *pu8Dst, RK_U32 u32Len);
+
+private:
+  static const int kSlotBits = 12;
+  // one more entry, the dichotomy search may read pal[len]
+  RK_U32 u32ArgbTbl[PALETTE_TABLE_LEN + 1];
+  bool dichotomy;
+  // argb << 32 | valid << 8 | index
+  std::atomic<uint64_t> slots[1 << kSlotBits];
+};
+
+// The last bitmap of one osd region and the region data converted from
+// it, only the lines differing from the last bitmap are converted again.
+typedef struct {
+  std::shared_ptr<PaletteCache> palette;
+  RK_U32 u32BitmapWidth;
+  RK_U32 u32BitmapHeight;
+  RK_U32 u32CanvasWidth;
+  RK_U32 u32CanvasHeight;
+  std::vector<RK_U32> bitmap;
+  std::vector<RK_U8> canvas;
+} OsdRegionCache;
+
 #endif // _RK_OSD_MIDDLEWARE_H_
@@ -8,11 +8,15 @@
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
+#include <vector>
 
 #include "encoder.h"
 #include "image.h"
 #include "key_string.h"
+#include "luma.h"
 #include "media_config.h"
 #include "media_type.h"
 #include "message.h"
@@ -118,8 +122,11 @@ typedef struct _RkmediaChannel {
   std::mutex buffer_list_mtx;
   std::condition_variable buffer_list_cond;
   bool buffer_list_quit;
-  int wake_fd[2];
+  // eventfd, readable while buffer_list is not empty.
+  int wake_fd;
   std::list<MEDIA_BUFFER> buffer_list;
+  // handles of the buffers output by this channel.
+  MediaBufferImpleSlab mb_slab;
   // protect by g_xxx_mtx.
   CHN_OUT_CB_STATUS rkmedia_out_cb_status;
 
@@ -130,6 +137,10 @@ typedef struct _RkmediaChannel {
   RK_BOOL bColorDichotomyEnable;
   // 256 color table
   RK_U32 u32ArgbColorTbl[256];
+  // lookup of u32ArgbColorTbl, replaced by RK_MPI_VENC_RGN_Init.
+  std::shared_ptr<PaletteCache> palette_cache;
+  std::mutex osd_cache_mtx;
+  OsdRegionCache osd_rgn_cache[REGION_ID_7 + 1];
 
   // used for region luma.
   std::mutex luma_buf_mtx;
@@ -190,21 +201,35 @@ std::mutex g_muxer_mtx;
 
 static unsigned char g_sys_init;
 
-static inline void RkmediaPushPipFd(int fd) {
-  int i = 0;
-  ssize_t count = write(fd, &i, sizeof(i));
+static inline void RkmediaSignalWakeFd(int fd) {
+  uint64_t cnt = 1;
+  ssize_t count = write(fd, &cnt, sizeof(cnt));
   if (count < 0)
     RKMEDIA_LOGE("%s: write(%d) failed: %s\n", __func__, fd, strerror(errno));
 }
 
-static inline void RkmediaPopPipFd(int fd) {
-  int i = 0;
-  ssize_t read_size = (ssize_t)sizeof(i);
-  ssize_t ret = read(fd, &i, sizeof(i));
-  if (ret != read_size)
+static inline void RkmediaResetWakeFd(int fd) {
+  uint64_t cnt = 0;
+  ssize_t ret = read(fd, &cnt, sizeof(cnt));
+  if (ret < 0 && errno != EAGAIN)
     RKMEDIA_LOGE("%s: Read(%d) failed: %s\n", __func__, fd, strerror(errno));
 }
 
+static void RkmediaChnOpenWakeFd(RkmediaChannel *ptrChn) {
+  ptrChn->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (ptrChn->wake_fd < 0) {
+    ptrChn->wake_fd = 0;
+    RKMEDIA_LOGW("Create eventfd failed!\n");
+  }
+}
+
+static void RkmediaChnCloseWakeFd(RkmediaChannel *ptrChn) {
+  if (ptrChn->wake_fd > 0) {
+    close(ptrChn->wake_fd);
+    ptrChn->wake_fd = 0;
+  }
+}
+
 static int RkmediaChnPushBuffer(RkmediaChannel *ptrChn, MEDIA_BUFFER buffer) {
   if (!ptrChn || !buffer)
     return -1;
@@ -218,28 +243,32 @@ static int RkmediaChnPushBuffer(RkmediaChannel *ptrChn, MEDIA_BUFFER buffer) {
     MEDIA_BUFFER mb = ptrChn->buffer_list.front();
     ptrChn->buffer_list.pop_front();
     RK_MPI_MB_ReleaseBuffer(mb);
-    if (ptrChn->wake_fd[0] > 0)
-      RkmediaPopPipFd(ptrChn->wake_fd[0]);
   }
-  if (!ptrChn->buffer_list_quit) {
-    ptrChn->buffer_list.push_back(buffer);
-    if (ptrChn->wake_fd[1] > 0)
-      RkmediaPushPipFd(ptrChn->wake_fd[1]);
-  } else {
+  if (ptrChn->buffer_list_quit) {
+    ptrChn->buffer_list_mtx.unlock();
     RK_MPI_MB_ReleaseBuffer(buffer);
+    return 0;
+  }
+  // Consumers only wait on an empty list, so wake them up only
+  // when the list turns non-empty.
+  bool was_empty = ptrChn->buffer_list.empty();
+  ptrChn->buffer_list.push_back(buffer);
+  if (was_empty) {
+    if (ptrChn->wake_fd > 0)
+      RkmediaSignalWakeFd(ptrChn->wake_fd);
+    ptrChn->buffer_list_cond.notify_all();
   }
-
-  ptrChn->buffer_list_cond.notify_all();
   ptrChn->buffer_list_mtx.unlock();
-  pthread_yield();
 
   return 0;
 }
 
-static MEDIA_BUFFER RkmediaChnPopBuffer(RkmediaChannel *ptrChn,
-                                        RK_S32 s32MilliSec) {
-  if (!ptrChn)
-    return NULL;
+// Pop up to num buffers in one lock, wait as RkmediaChnPopBuffer if the
+// list is empty. Return the number of buffers got.
+static int RkmediaChnPopBuffers(RkmediaChannel *ptrChn, MEDIA_BUFFER *mbs,
+                                int num, RK_S32 s32MilliSec) {
+  if (!ptrChn || !mbs || num <= 0)
+    return 0;
 
   std::unique_lock<std::mutex> lck(ptrChn->buffer_list_mtx);
   if (ptrChn->buffer_list.empty()) {
@@ -251,24 +280,42 @@ static MEDIA_BUFFER RkmediaChnPopBuffer(RkmediaChannel *ptrChn,
           std::cv_status::timeout) {
         RKMEDIA_LOGI("INFO: %s: Mode[%s]:Chn[%d] get mediabuffer timeout!\n",
                      __func__, ModIdToString(ptrChn->mode_id), ptrChn->chn_id);
-        return NULL;
+        return 0;
       }
     } else {
-      return NULL;
+      return 0;
     }
   }
 
-  MEDIA_BUFFER mb = NULL;
-  if (!ptrChn->buffer_list.empty()) {
-    if (ptrChn->wake_fd[0] > 0)
-      RkmediaPopPipFd(ptrChn->wake_fd[0]);
-    mb = ptrChn->buffer_list.front();
+  int cnt = 0;
+  while (cnt < num && !ptrChn->buffer_list.empty()) {
+    mbs[cnt++] = ptrChn->buffer_list.front();
     ptrChn->buffer_list.pop_front();
   }
+  if (cnt > 0 && ptrChn->buffer_list.empty() && ptrChn->wake_fd > 0)
+    RkmediaResetWakeFd(ptrChn->wake_fd);
 
+  return cnt;
+}
+
+static MEDIA_BUFFER RkmediaChnPopBuffer(RkmediaChannel *ptrChn,
+                                        RK_S32 s32MilliSec) {
+  MEDIA_BUFFER mb = NULL;
+  RkmediaChnPopBuffers(ptrChn, &mb, 1, s32MilliSec);
   return mb;
 }
 
+// The channels without a wake fd, open one when the fd is asked for.
+static int RkmediaChnGetWakeFd(RkmediaChannel *ptrChn) {
+  std::lock_guard<std::mutex> lck(ptrChn->buffer_list_mtx);
+  if (ptrChn->wake_fd <= 0) {
+    RkmediaChnOpenWakeFd(ptrChn);
+    if (ptrChn->wake_fd > 0 && !ptrChn->buffer_list.empty())
+      RkmediaSignalWakeFd(ptrChn->wake_fd);
+  }
+  return ptrChn->wake_fd;
+}
+
 static void RkmediaChnInitBuffer(RkmediaChannel *ptrChn) {
   if (!ptrChn)
     return;
@@ -291,6 +338,8 @@ static void RkmediaChnClearBuffer(RkmediaChannel *ptrChn) {
     ptrChn->buffer_list.pop_front();
     RK_MPI_MB_ReleaseBuffer(mb);
   }
+  if (ptrChn->wake_fd > 0)
+    RkmediaResetWakeFd(ptrChn->wake_fd);
   ptrChn->buffer_list_quit = true;
   ptrChn->buffer_list_cond.notify_all();
   ptrChn->buffer_list_mtx.unlock();
@@ -298,6 +347,17 @@ static void RkmediaChnClearBuffer(RkmediaChannel *ptrChn) {
                ModIdToString(ptrChn->mode_id), ptrChn->chn_id);
 }
 
+// On channel destroy: drop the buffers and close the wake fd, whether it was
+// opened with the channel or on demand by RkmediaChnGetWakeFd.
+static void RkmediaChnDestroyBuffer(RkmediaChannel *ptrChn) {
+  if (!ptrChn)
+    return;
+
+  RkmediaChnClearBuffer(ptrChn);
+  std::lock_guard<std::mutex> lck(ptrChn->buffer_list_mtx);
+  RkmediaChnCloseWakeFd(ptrChn);
+}
+
 /********************************************************************
  * SYS Ctrl api
  ********************************************************************/
@@ -399,6 +459,16 @@ RK_VOID RK_MPI_SYS_DumpChn(MOD_ID_E enModId) {
   }
 }
 
+RK_S32 RK_MPI_SYS_DumpFlowStats(RK_CHAR *pcBuf, RK_U32 u32Size) {
+  std::string stats = easymedia::DumpFlowGraphStats();
+  if (!pcBuf)
+    return (RK_S32)stats.size() + 1;
+  if (u32Size < stats.size() + 1)
+    return -RK_ERR_SYS_NOMEM;
+  memcpy(pcBuf, stats.c_str(), stats.size() + 1);
+  return (RK_S32)stats.size();
+}
+
 RK_S32 RK_MPI_SYS_Bind(const MPP_CHN_S *pstSrcChn,
                        const MPP_CHN_S *pstDestChn) {
   std::shared_ptr<easymedia::Flow> src;
@@ -860,7 +930,7 @@ FlowOutputCallback(void *handle,
       return;
   }
 
-  MEDIA_BUFFER_IMPLE *mb = new MEDIA_BUFFER_IMPLE;
+  MEDIA_BUFFER_IMPLE *mb = target_chn->mb_slab.Get();
   if (!mb) {
     RKMEDIA_LOGE("%s Mode[%s]:Chn[%d] no space left for new mb!\n", __func__,
                  ModIdToString(target_chn->mode_id), target_chn->chn_id);
@@ -890,8 +960,8 @@ FlowOutputCallback(void *handle,
     mb->stImageInfo.u32Height = rkmedia_ib->GetHeight();
     mb->stImageInfo.u32HorStride = rkmedia_ib->GetVirWidth();
     mb->stImageInfo.u32VerStride = rkmedia_ib->GetVirHeight();
-    std::string strPixFmt = PixFmtToString(rkmedia_ib->GetPixelFormat());
-    mb->stImageInfo.enImgType = StringToImageType(strPixFmt);
+    mb->stImageInfo.enImgType =
+        PixFmtToImageType(rkmedia_ib->GetPixelFormat());
   }
   // RK_MPI_SYS_GetMediaBuffer and output callback function,
   // can only choose one.
@@ -1026,6 +1096,15 @@ static void FlowEventCallback(void *handle, void *data) {
       stMuxerEvent.unEventInfo.stFileInfo.u32Duration =
           rkmedia_muxer_event->value;
     }
+    if (rkmedia_muxer_event->type == MUX_EVENT_FILE_END) {
+      MUXER_WRITE_STAT_S *pstStat =
+          &stMuxerEvent.unEventInfo.stFileInfo.stWriteStat;
+      pstStat->u32WriteCnt = rkmedia_muxer_event->stat.write_count;
+      pstStat->u32WriteAvgUs = rkmedia_muxer_event->stat.write_avg_us;
+      pstStat->u32WriteMaxUs = rkmedia_muxer_event->stat.write_max_us;
+      pstStat->u32QueueMaxCnt = rkmedia_muxer_event->stat.queue_max;
+      pstStat->u32QueueFullCnt = rkmedia_muxer_event->stat.queue_full;
+    }
     target_chn->event_cb(target_chn->event_handle, &stMuxerEvent);
   } break;
   default:
@@ -1242,8 +1321,8 @@ RK_S32 RK_MPI_SYS_StopGetMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID) {
   return RK_ERR_SYS_OK;
 }
 
-MEDIA_BUFFER RK_MPI_SYS_GetMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID,
-                                       RK_S32 s32MilliSec) {
+// Find the channel which RK_MPI_SYS_GetMediaBuffer(s) get buffers from.
+static RkmediaChannel *RkmediaGetOutputChn(MOD_ID_E enModID, RK_S32 s32ChnID) {
   RkmediaChannel *target_chn = NULL;
 
   switch (enModID) {
@@ -1311,6 +1390,15 @@ MEDIA_BUFFER RK_MPI_SYS_GetMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID,
     return NULL;
   }
 
+  return target_chn;
+}
+
+MEDIA_BUFFER RK_MPI_SYS_GetMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID,
+                                       RK_S32 s32MilliSec) {
+  RkmediaChannel *target_chn = RkmediaGetOutputChn(enModID, s32ChnID);
+  if (!target_chn)
+    return NULL;
+
   if (target_chn->status < CHN_STATUS_OPEN) {
     RKMEDIA_LOGE("%s Mode[%s]:Chn[%d] in status[%d], "
                  "this operation is not allowed!\n",
@@ -1328,6 +1416,121 @@ MEDIA_BUFFER RK_MPI_SYS_GetMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID,
   return RkmediaChnPopBuffer(target_chn, s32MilliSec);
 }
 
+RK_S32 RK_MPI_SYS_GetMediaBuffers(MOD_ID_E enModID, RK_S32 s32ChnID,
+                                  MEDIA_BUFFER *pMbs, RK_U32 u32Num,
+                                  RK_S32 s32MilliSec) {
+  if (!pMbs || !u32Num)
+    return -RK_ERR_SYS_ILLEGAL_PARAM;
+
+  RkmediaChannel *target_chn = RkmediaGetOutputChn(enModID, s32ChnID);
+  if (!target_chn)
+    return -RK_ERR_SYS_ILLEGAL_PARAM;
+
+  if (target_chn->status < CHN_STATUS_OPEN) {
+    RKMEDIA_LOGE("%s Mode[%s]:Chn[%d] in status[%d], "
+                 "this operation is not allowed!\n",
+                 __func__, ModIdToString(enModID), s32ChnID,
+                 target_chn->status);
+    return -RK_ERR_SYS_NOTREADY;
+  }
+
+  if (RK_MPI_SYS_StartGetMediaBuffer(enModID, s32ChnID)) {
+    RKMEDIA_LOGE("%s Mode[%s]:Chn[%d] start get mediabuffer failed!\n",
+                 __func__, ModIdToString(enModID), s32ChnID);
+    return -RK_ERR_SYS_NOT_PERM;
+  }
+
+  return RkmediaChnPopBuffers(target_chn, pMbs, (int)u32Num, s32MilliSec);
+}
+
+// epoll data of a channel in the wait fd: mode id, dev id and chn id.
+#define RKMEDIA_WAIT_CHN_DATA(mode, dev, chn)                                 \
+  (((uint64_t)(mode) << 32) | (((uint64_t)(dev)&0xFFFF) << 16) |              \
+   ((uint64_t)(chn)&0xFFFF))
+#define RKMEDIA_WAIT_CHN_MAX 64
+
+RK_S32 RK_MPI_SYS_CreateChnWaitFd(const MPP_CHN_S *pstChns, RK_U32 u32Cnt) {
+  if (!pstChns || !u32Cnt)
+    return -RK_ERR_SYS_ILLEGAL_PARAM;
+
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    RKMEDIA_LOGE("%s: epoll_create1 failed: %s\n", __func__, strerror(errno));
+    return -RK_ERR_SYS_NOMEM;
+  }
+  for (RK_U32 i = 0; i < u32Cnt; i++) {
+    const MPP_CHN_S *pstChn = &pstChns[i];
+    RkmediaChannel *target_chn =
+        RkmediaGetOutputChn(pstChn->enModId, pstChn->s32ChnId);
+    if (!target_chn) {
+      close(epfd);
+      return -RK_ERR_SYS_ILLEGAL_PARAM;
+    }
+    if (target_chn->status < CHN_STATUS_OPEN) {
+      RKMEDIA_LOGE("%s Mode[%s]:Chn[%d] in status[%d], "
+                   "this operation is not allowed!\n",
+                   __func__, ModIdToString(pstChn->enModId),
+                   pstChn->s32ChnId, target_chn->status);
+      close(epfd);
+      return -RK_ERR_SYS_NOTREADY;
+    }
+    int fd = RkmediaChnGetWakeFd(target_chn);
+    if (fd <= 0) {
+      close(epfd);
+      return -RK_ERR_SYS_NOMEM;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = RKMEDIA_WAIT_CHN_DATA(pstChn->enModId, pstChn->s32DevId,
+                                        pstChn->s32ChnId);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      RKMEDIA_LOGE("%s: Mode[%s]:Chn[%d] epoll_ctl failed: %s\n", __func__,
+                   ModIdToString(pstChn->enModId), pstChn->s32ChnId,
+                   strerror(errno));
+      close(epfd);
+      return -RK_ERR_SYS_ILLEGAL_PARAM;
+    }
+  }
+
+  return epfd;
+}
+
+RK_S32 RK_MPI_SYS_WaitChnReady(RK_S32 s32WaitFd, MPP_CHN_S *pstReadyChns,
+                               RK_U32 u32MaxCnt, RK_S32 s32MilliSec) {
+  struct epoll_event events[RKMEDIA_WAIT_CHN_MAX];
+
+  if (s32WaitFd < 0 || !pstReadyChns || !u32MaxCnt)
+    return -RK_ERR_SYS_ILLEGAL_PARAM;
+  if (u32MaxCnt > RKMEDIA_WAIT_CHN_MAX)
+    u32MaxCnt = RKMEDIA_WAIT_CHN_MAX;
+
+  int cnt;
+  do {
+    cnt = epoll_wait(s32WaitFd, events, (int)u32MaxCnt, s32MilliSec);
+  } while (cnt < 0 && errno == EINTR);
+  if (cnt < 0) {
+    RKMEDIA_LOGE("%s: epoll_wait(%d) failed: %s\n", __func__, s32WaitFd,
+                 strerror(errno));
+    return -RK_ERR_SYS_ILLEGAL_PARAM;
+  }
+  for (int i = 0; i < cnt; i++) {
+    uint64_t data = events[i].data.u64;
+    pstReadyChns[i].enModId = (MOD_ID_E)(data >> 32);
+    pstReadyChns[i].s32DevId = (RK_S32)((data >> 16) & 0xFFFF);
+    pstReadyChns[i].s32ChnId = (RK_S32)(data & 0xFFFF);
+  }
+
+  return cnt;
+}
+
+RK_S32 RK_MPI_SYS_DestroyChnWaitFd(RK_S32 s32WaitFd) {
+  if (s32WaitFd < 0)
+    return -RK_ERR_SYS_ILLEGAL_PARAM;
+  close(s32WaitFd);
+  return RK_ERR_SYS_OK;
+}
+
 RK_S32 RK_MPI_SYS_SendMediaBuffer(MOD_ID_E enModID, RK_S32 s32ChnID,
                                   MEDIA_BUFFER buffer) {
   RkmediaChannel *target_chn = NULL;
@@ -1781,7 +1984,7 @@ RK_S32 RK_MPI_VI_DisableChn(VI_PIPE ViPipe, VI_CHN ViChn) {
                ViChn, g_vi_chns[ViChn].vi_attr.attr.pcVideoNode,
                g_vi_chns[ViChn].vi_attr.attr.u32Width,
                g_vi_chns[ViChn].vi_attr.attr.u32Height);
-  RkmediaChnClearBuffer(&g_vi_chns[ViChn]);
+  RkmediaChnDestroyBuffer(&g_vi_chns[ViChn]);
   g_vi_chns[ViChn].status = CHN_STATUS_CLOSED;
   g_vi_chns[ViChn].luma_buf_mtx.lock();
   g_vi_chns[ViChn].luma_rkmedia_buf.reset();
@@ -1804,39 +2007,46 @@ RK_S32 RK_MPI_VI_DisableChn(VI_PIPE ViPipe, VI_CHN ViChn) {
   return RK_ERR_SYS_OK;
 }
 
-static RK_U64
+static void
 rkmediaCalculateRegionLuma(std::shared_ptr<easymedia::ImageBuffer> &rkmedia_mb,
-                           const RECT_S *ptrRect) {
-  RK_U64 sum = 0;
+                           const VIDEO_REGION_INFO_S *pstRegionInfo,
+                           RK_U64 *pu64LumaData) {
+  RK_U32 u32RegionNum = pstRegionInfo->u32RegionNum;
   ImageInfo &imgInfo = rkmedia_mb->GetImageInfo();
 
+  memset(pu64LumaData, 0, sizeof(RK_U64) * u32RegionNum);
   if ((imgInfo.pix_fmt != PIX_FMT_YUV420P) &&
       (imgInfo.pix_fmt != PIX_FMT_NV12) && (imgInfo.pix_fmt != PIX_FMT_NV21) &&
       (imgInfo.pix_fmt != PIX_FMT_YUV422P) &&
       (imgInfo.pix_fmt != PIX_FMT_NV16) && (imgInfo.pix_fmt != PIX_FMT_NV61)) {
     RKMEDIA_LOGE("%s not support image type!\n", __func__);
-    return 0;
-  }
-
-  if (((RK_S32)(ptrRect->s32X + ptrRect->u32Width) > imgInfo.width) ||
-      ((RK_S32)(ptrRect->s32Y + ptrRect->u32Height) > imgInfo.height)) {
-    RKMEDIA_LOGE("%s rect[%d,%d,%u,%u] out of image wxh[%d, %d]\n", __func__,
-                 ptrRect->s32X, ptrRect->s32Y, ptrRect->u32Width,
-                 ptrRect->u32Height, imgInfo.width, imgInfo.height);
-    return 0;
+    return;
   }
 
-  RK_U32 line_size = imgInfo.vir_width;
-  RK_U8 *rect_start =
-      (RK_U8 *)rkmedia_mb->GetPtr() + ptrRect->s32Y * line_size + ptrRect->s32X;
-  for (RK_U32 i = 0; i < ptrRect->u32Height; i++) {
-    RK_U8 *line_start = rect_start + i * line_size;
-    for (RK_U32 j = 0; j < ptrRect->u32Width; j++) {
-      sum += *(line_start + j);
+  std::vector<ImageRect> rects(u32RegionNum);
+  std::vector<easymedia::LumaStat> stats(u32RegionNum);
+  for (RK_U32 i = 0; i < u32RegionNum; i++) {
+    const RECT_S *ptrRect = pstRegionInfo->pstRegion + i;
+    if (((RK_S32)(ptrRect->s32X + ptrRect->u32Width) > imgInfo.width) ||
+        ((RK_S32)(ptrRect->s32Y + ptrRect->u32Height) > imgInfo.height)) {
+      RKMEDIA_LOGE("%s rect[%d,%d,%u,%u] out of image wxh[%d, %d]\n",
+                   __func__, ptrRect->s32X, ptrRect->s32Y, ptrRect->u32Width,
+                   ptrRect->u32Height, imgInfo.width, imgInfo.height);
     }
+    rects[i].x = ptrRect->s32X;
+    rects[i].y = ptrRect->s32Y;
+    rects[i].w = (int)ptrRect->u32Width;
+    rects[i].h = (int)ptrRect->u32Height;
+    stats[i].hist = NULL;
   }
 
-  return sum;
+  // All the regions in one pass over the Y plane.
+  easymedia::CalculateRegionLuma((const uint8_t *)rkmedia_mb->GetPtr(),
+                                 imgInfo.vir_width, imgInfo.width,
+                                 imgInfo.height, rects.data(), u32RegionNum,
+                                 stats.data());
+  for (RK_U32 i = 0; i < u32RegionNum; i++)
+    pu64LumaData[i] = stats[i].sum;
 }
 
 RK_S32 RK_MPI_VI_StartRegionLuma(VI_CHN ViChn) {
@@ -1961,9 +2171,7 @@ RK_S32 RK_MPI_VI_GetChnRegionLuma(VI_PIPE ViPipe, VI_CHN ViChn,
   if (!rkmedia_mb)
     return -RK_ERR_VI_BUF_EMPTY;
 
-  for (RK_U32 i = 0; i < pstRegionInfo->u32RegionNum; i++)
-    *(pu64LumaData + i) =
-        rkmediaCalculateRegionLuma(rkmedia_mb, (pstRegionInfo->pstRegion + i));
+  rkmediaCalculateRegionLuma(rkmedia_mb, pstRegionInfo, pu64LumaData);
 
   return RK_ERR_SYS_OK;
 }
@@ -2388,11 +2596,7 @@ static RK_S32 RkmediaCreateJpegSnapPipeline(RkmediaChannel *VenChn) {
   if (bEnableRga)
     VenChn->rkmedia_flow_list.push_back(video_rga_flow);
   VenChn->rkmedia_flow_list.push_back(video_jpeg_flow);
-  if (pipe2(VenChn->wake_fd, O_CLOEXEC) == -1) {
-    VenChn->wake_fd[0] = 0;
-    VenChn->wake_fd[1] = 0;
-    RKMEDIA_LOGW("Create pipe failed!\n");
-  }
+  RkmediaChnOpenWakeFd(VenChn);
   VenChn->status = CHN_STATUS_OPEN;
 
   VenChn->venc_attr.bFullFunc = RK_TRUE;
@@ -2524,11 +2728,7 @@ static RK_S32 RkmediaCreateJpegLight(RkmediaChannel *VenChn) {
 
   VenChn->rkmedia_flow = video_jpeg_flow;
   VenChn->rkmedia_flow_list.push_back(video_jpeg_flow);
-  if (pipe2(VenChn->wake_fd, O_CLOEXEC) == -1) {
-    VenChn->wake_fd[0] = 0;
-    VenChn->wake_fd[1] = 0;
-    RKMEDIA_LOGW("Create pipe failed!\n");
-  }
+  RkmediaChnOpenWakeFd(VenChn);
   VenChn->status = CHN_STATUS_OPEN;
 
   VenChn->venc_attr.bFullFunc = RK_FALSE;
@@ -2792,11 +2992,7 @@ RK_S32 RK_MPI_VENC_CreateChn(VENC_CHN VeChn, VENC_CHN_ATTR_S *stVencChnAttr) {
   RkmediaChnInitBuffer(&g_venc_chns[VeChn]);
   g_venc_chns[VeChn].rkmedia_flow->SetOutputCallBack(&g_venc_chns[VeChn],
                                                      FlowOutputCallback);
-  if (pipe2(g_venc_chns[VeChn].wake_fd, O_CLOEXEC) == -1) {
-    g_venc_chns[VeChn].wake_fd[0] = 0;
-    g_venc_chns[VeChn].wake_fd[1] = 0;
-    RKMEDIA_LOGW("Create pipe failed!\n");
-  }
+  RkmediaChnOpenWakeFd(&g_venc_chns[VeChn]);
   g_venc_chns[VeChn].status = CHN_STATUS_OPEN;
   g_venc_mtx.unlock();
   if (stVencChnAttr->stGopAttr.enGopMode > VENC_GOPMODE_NORMALP) {
@@ -2953,11 +3149,7 @@ RK_S32 RK_MPI_VENC_CreateJpegLightChn(VENC_CHN VeChn,
 
   g_venc_chns[VeChn].rkmedia_flow = video_jpeg_flow;
   g_venc_chns[VeChn].rkmedia_flow_list.push_back(video_jpeg_flow);
-  if (pipe2(g_venc_chns[VeChn].wake_fd, O_CLOEXEC) == -1) {
-    g_venc_chns[VeChn].wake_fd[0] = 0;
-    g_venc_chns[VeChn].wake_fd[1] = 0;
-    RKMEDIA_LOGW("Create pipe failed!\n");
-  }
+  RkmediaChnOpenWakeFd(&g_venc_chns[VeChn]);
   g_venc_chns[VeChn].status = CHN_STATUS_OPEN;
   g_venc_mtx.unlock();
 
@@ -3896,6 +4088,16 @@ RK_S32 RK_MPI_VENC_SetResolution(VENC_CHN VeChn,
   return RK_ERR_SYS_OK;
 }
 
+static RK_VOID OsdRegionCacheClear(OsdRegionCache *pstCache) {
+  pstCache->palette.reset();
+  pstCache->u32BitmapWidth = 0;
+  pstCache->u32BitmapHeight = 0;
+  pstCache->u32CanvasWidth = 0;
+  pstCache->u32CanvasHeight = 0;
+  std::vector<RK_U32>().swap(pstCache->bitmap);
+  std::vector<RK_U8>().swap(pstCache->canvas);
+}
+
 RK_S32 RK_MPI_VENC_DestroyChn(VENC_CHN VeChn) {
   if ((VeChn < 0) || (VeChn >= VENC_MAX_CHN_NUM))
     return -RK_ERR_VENC_INVALID_CHNID;
@@ -3926,16 +4128,16 @@ RK_S32 RK_MPI_VENC_DestroyChn(VENC_CHN VeChn) {
     }
     g_venc_chns[VeChn].rkmedia_flow.reset();
   }
-  RkmediaChnClearBuffer(&g_venc_chns[VeChn]);
+  RkmediaChnDestroyBuffer(&g_venc_chns[VeChn]);
+  // The palette went with the encoder, RK_MPI_VENC_RGN_Init sets it again.
+  g_venc_chns[VeChn].osd_cache_mtx.lock();
+  for (int i = 0; i <= REGION_ID_7; i++)
+    OsdRegionCacheClear(&g_venc_chns[VeChn].osd_rgn_cache[i]);
+  g_venc_chns[VeChn].osd_cache_mtx.unlock();
+  std::atomic_store(&g_venc_chns[VeChn].palette_cache,
+                    std::shared_ptr<PaletteCache>());
+  g_venc_chns[VeChn].bColorTblInit = RK_FALSE;
   g_venc_chns[VeChn].status = CHN_STATUS_CLOSED;
-  if (g_venc_chns[VeChn].wake_fd[0] > 0) {
-    close(g_venc_chns[VeChn].wake_fd[0]);
-    g_venc_chns[VeChn].wake_fd[0] = 0;
-  }
-  if (g_venc_chns[VeChn].wake_fd[1] > 0) {
-    close(g_venc_chns[VeChn].wake_fd[1]);
-    g_venc_chns[VeChn].wake_fd[1] = 0;
-  }
   g_venc_mtx.unlock();
   RKMEDIA_LOGI("%s: Disable VENC[%d] End...\n", __func__, VeChn);
 
@@ -3952,7 +4154,7 @@ RK_S32 RK_MPI_VENC_GetFd(VENC_CHN VeChn) {
     g_venc_mtx.unlock();
     return -RK_ERR_VENC_NOTREADY;
   }
-  rcv_fd = g_venc_chns[VeChn].wake_fd[0];
+  rcv_fd = g_venc_chns[VeChn].wake_fd;
   g_venc_mtx.unlock();
 
   return rcv_fd;
@@ -4086,20 +4288,33 @@ RK_S32 RK_MPI_VENC_RGN_Init(VENC_CHN VeChn, VENC_COLOR_TBL_S *stColorTbl) {
 
   memcpy(g_venc_chns[VeChn].u32ArgbColorTbl, pu32ArgbColorTbl,
          VENC_RGN_COLOR_NUM * 4);
+  // The region caches see the new palette and convert all again.
+  std::atomic_store(&g_venc_chns[VeChn].palette_cache,
+                    std::make_shared<PaletteCache>(
+                        pu32ArgbColorTbl,
+                        g_venc_chns[VeChn].bColorDichotomyEnable == RK_TRUE));
   g_venc_chns[VeChn].bColorTblInit = RK_TRUE;
   g_venc_mtx.unlock();
   return RK_ERR_SYS_OK;
 }
 
-static RK_VOID Argb8888_To_Region_Data(VENC_CHN VeChn,
-                                       const BITMAP_S *pstBitmap, RK_U8 *data,
-                                       RK_U32 canvasWidth,
-                                       RK_U32 canvasHeight) {
+// Called with osd_cache_mtx locked, return the region data kept in the
+// region cache.
+static RK_U8 *Argb8888_To_Region_Data(VENC_CHN VeChn,
+                                      const BITMAP_S *pstBitmap,
+                                      OsdRegionCache *pstCache,
+                                      RK_U32 canvasWidth,
+                                      RK_U32 canvasHeight) {
   RK_U32 TargetWidth, TargetHeight;
-  RK_U32 ColorValue;
   RK_U32 *BitmapLineStart;
+  RK_U32 *CachedLineStart;
   RK_U8 *CanvasLineStart;
 
+  std::shared_ptr<PaletteCache> palette =
+      std::atomic_load(&g_venc_chns[VeChn].palette_cache);
+  if (!palette)
+    return NULL;
+
   TargetWidth =
       (pstBitmap->u32Width > canvasWidth) ? canvasWidth : pstBitmap->u32Width;
   TargetHeight = (pstBitmap->u32Height > canvasHeight) ? canvasHeight
@@ -4109,29 +4324,41 @@ static RK_VOID Argb8888_To_Region_Data(VENC_CHN VeChn,
                __func__, pstBitmap->u32Width, pstBitmap->u32Height, canvasWidth,
                canvasHeight, TargetWidth, TargetHeight);
 
-  // Initialize all pixels to transparent color
-  if ((canvasWidth > pstBitmap->u32Width) ||
-      (canvasHeight > pstBitmap->u32Height)) {
-    RK_U8 TransColorId = find_argb_color_tbl_by_order(
-        g_venc_chns[VeChn].u32ArgbColorTbl, PALETTE_TABLE_LEN, 0x00000000);
-    memset(data, TransColorId, canvasWidth * canvasHeight);
+  // Same palette and geometry as last time: only the changed lines.
+  bool bFullUpdate = (pstCache->palette != palette) ||
+                     (pstCache->u32BitmapWidth != pstBitmap->u32Width) ||
+                     (pstCache->u32BitmapHeight != pstBitmap->u32Height) ||
+                     (pstCache->u32CanvasWidth != canvasWidth) ||
+                     (pstCache->u32CanvasHeight != canvasHeight);
+  if (bFullUpdate) {
+    pstCache->palette = palette;
+    pstCache->u32BitmapWidth = pstBitmap->u32Width;
+    pstCache->u32BitmapHeight = pstBitmap->u32Height;
+    pstCache->u32CanvasWidth = canvasWidth;
+    pstCache->u32CanvasHeight = canvasHeight;
+    pstCache->bitmap.resize(TargetWidth * TargetHeight);
+    pstCache->canvas.resize(canvasWidth * canvasHeight);
+    // Initialize all pixels to transparent color
+    if ((canvasWidth > pstBitmap->u32Width) ||
+        (canvasHeight > pstBitmap->u32Height)) {
+      RK_U8 TransColorId = find_argb_color_tbl_by_order(
+          g_venc_chns[VeChn].u32ArgbColorTbl, PALETTE_TABLE_LEN, 0x00000000);
+      memset(pstCache->canvas.data(), TransColorId, canvasWidth * canvasHeight);
+    }
   }
 
   for (RK_U32 i = 0; i < TargetHeight; i++) {
     BitmapLineStart = (RK_U32 *)pstBitmap->pData + i * pstBitmap->u32Width;
-    CanvasLineStart = data + i * canvasWidth;
-    for (RK_U32 j = 0; j < TargetWidth; j++) {
-      ColorValue = *(BitmapLineStart + j);
-
-      if (g_venc_chns[VeChn].bColorDichotomyEnable) {
-        *(CanvasLineStart + j) = find_argb_color_tbl_by_dichotomy(
-            g_venc_chns[VeChn].u32ArgbColorTbl, PALETTE_TABLE_LEN, ColorValue);
-      } else {
-        *(CanvasLineStart + j) = find_argb_color_tbl_by_order(
-            g_venc_chns[VeChn].u32ArgbColorTbl, PALETTE_TABLE_LEN, ColorValue);
-      }
-    }
+    CachedLineStart = pstCache->bitmap.data() + i * TargetWidth;
+    CanvasLineStart = pstCache->canvas.data() + i * canvasWidth;
+    if (!bFullUpdate &&
+        !memcmp(BitmapLineStart, CachedLineStart, TargetWidth * 4))
+      continue;
+    palette->ConvertLine(BitmapLineStart, CanvasLineStart, TargetWidth);
+    memcpy(CachedLineStart, BitmapLineStart, TargetWidth * 4);
   }
+
+  return pstCache->canvas.data();
 }
 
 RK_S32 RK_MPI_VENC_RGN_SetBitMap(VENC_CHN VeChn,
@@ -4162,6 +4389,10 @@ RK_S32 RK_MPI_VENC_RGN_SetBitMap(VENC_CHN VeChn,
     region_type = REGION_TYPE_OVERLAY_EX;
   }
 
+  if (pstRgnInfo && (pstRgnInfo->enRegionId < REGION_ID_0 ||
+                     pstRgnInfo->enRegionId > REGION_ID_7))
+    return -RK_ERR_VENC_ILLEGAL_PARAM;
+
   if (pstRgnInfo && !pstRgnInfo->u8Enable) {
     OsdRegionData rkmedia_osd_rgn;
     memset(&rkmedia_osd_rgn, 0, sizeof(rkmedia_osd_rgn));
@@ -4172,6 +4403,10 @@ RK_S32 RK_MPI_VENC_RGN_SetBitMap(VENC_CHN VeChn,
         g_venc_chns[VeChn].rkmedia_flow, &rkmedia_osd_rgn);
     if (ret)
       ret = -RK_ERR_VENC_NOT_PERM;
+    g_venc_chns[VeChn].osd_cache_mtx.lock();
+    OsdRegionCacheClear(
+        &g_venc_chns[VeChn].osd_rgn_cache[pstRgnInfo->enRegionId]);
+    g_venc_chns[VeChn].osd_cache_mtx.unlock();
     return ret;
   }
 
@@ -4190,24 +4425,24 @@ RK_S32 RK_MPI_VENC_RGN_SetBitMap(VENC_CHN VeChn,
     return -RK_ERR_VENC_ILLEGAL_PARAM;
   }
 
+  // The region data lives in the region cache, keep it locked until the
+  // encoder has copied it.
+  std::unique_lock<std::mutex> osd_lck(g_venc_chns[VeChn].osd_cache_mtx,
+                                       std::defer_lock);
   if (!bIsJpegLight) {
-    RK_U32 total_pix_num = pstRgnInfo->u32Width * pstRgnInfo->u32Height;
-    rkmedia_osd_data = (RK_U8 *)malloc(total_pix_num);
-    if (!rkmedia_osd_data) {
-      RKMEDIA_LOGE("No space left! RgnInfo pixels(%d)\n", total_pix_num);
-      return -RK_ERR_VENC_NOMEM;
-    }
-
-    switch (pstBitmap->enPixelFormat) {
-    case PIXEL_FORMAT_ARGB_8888:
-      Argb8888_To_Region_Data(VeChn, pstBitmap, rkmedia_osd_data,
-                              pstRgnInfo->u32Width, pstRgnInfo->u32Height);
-      break;
-    default:
+    if (pstBitmap->enPixelFormat != PIXEL_FORMAT_ARGB_8888) {
       RKMEDIA_LOGE("Not support bitmap pixel format:%d\n",
                    pstBitmap->enPixelFormat);
-      ret = -RK_ERR_VENC_NOT_SUPPORT;
-      break;
+      return -RK_ERR_VENC_NOT_SUPPORT;
+    }
+    osd_lck.lock();
+    rkmedia_osd_data = Argb8888_To_Region_Data(
+        VeChn, pstBitmap,
+        &g_venc_chns[VeChn].osd_rgn_cache[pstRgnInfo->enRegionId],
+        pstRgnInfo->u32Width, pstRgnInfo->u32Height);
+    if (!rkmedia_osd_data) {
+      RKMEDIA_LOGE("Venc[%d] color table is not ready!\n", VeChn);
+      return -RK_ERR_VENC_NOTREADY;
     }
   } else {
     if ((pstBitmap->u32Width != pstRgnInfo->u32Width) ||
@@ -4236,9 +4471,6 @@ RK_S32 RK_MPI_VENC_RGN_SetBitMap(VENC_CHN VeChn,
   if (ret)
     ret = -RK_ERR_VENC_NOT_PERM;
 
-  if (!bIsJpegLight && rkmedia_osd_data)
-    free(rkmedia_osd_data);
-
   return ret;
 }
 
@@ -4679,7 +4911,7 @@ RK_S32 RK_MPI_AI_DisableChn(AI_CHN AiChn) {
   }
 
   g_ai_chns[AiChn].rkmedia_flow.reset();
-  RkmediaChnClearBuffer(&g_ai_chns[AiChn]);
+  RkmediaChnDestroyBuffer(&g_ai_chns[AiChn]);
   g_ai_chns[AiChn].status = CHN_STATUS_CLOSED;
   g_ai_mtx.unlock();
   RKMEDIA_LOGI("%s: Disable AI[%d] End...\n", __func__, AiChn);
@@ -4914,7 +5146,7 @@ RK_S32 RK_MPI_AO_DisableChn(AO_CHN AoChn) {
   }
   RKMEDIA_LOGI("%s: Disable AO[%d] Start...\n", __func__, AoChn);
   g_ao_chns[AoChn].rkmedia_flow.reset();
-  RkmediaChnClearBuffer(&g_ao_chns[AoChn]);
+  RkmediaChnDestroyBuffer(&g_ao_chns[AoChn]);
   g_ao_chns[AoChn].status = CHN_STATUS_CLOSED;
   g_ao_mtx.unlock();
   RKMEDIA_LOGI("%s: Disable AO[%d] End...\n", __func__, AoChn);
@@ -5151,11 +5383,7 @@ RK_S32 RK_MPI_AENC_CreateChn(AENC_CHN AencChn, const AENC_CHN_ATTR_S *pstAttr) {
   g_aenc_chns[AencChn].rkmedia_flow->SetOutputCallBack(&g_aenc_chns[AencChn],
                                                        FlowOutputCallback);
 
-  if (pipe2(g_aenc_chns[AencChn].wake_fd, O_CLOEXEC) == -1) {
-    g_aenc_chns[AencChn].wake_fd[0] = 0;
-    g_aenc_chns[AencChn].wake_fd[1] = 0;
-    RKMEDIA_LOGW("Create pipe failed!\n");
-  }
+  RkmediaChnOpenWakeFd(&g_aenc_chns[AencChn]);
 
   g_aenc_chns[AencChn].status = CHN_STATUS_OPEN;
   g_aenc_mtx.unlock();
@@ -5173,16 +5401,8 @@ RK_S32 RK_MPI_AENC_DestroyChn(AENC_CHN AencChn) {
   }
 
   g_aenc_chns[AencChn].rkmedia_flow.reset();
-  RkmediaChnClearBuffer(&g_aenc_chns[AencChn]);
+  RkmediaChnDestroyBuffer(&g_aenc_chns[AencChn]);
   g_aenc_chns[AencChn].status = CHN_STATUS_CLOSED;
-  if (g_aenc_chns[AencChn].wake_fd[0] > 0) {
-    close(g_aenc_chns[AencChn].wake_fd[0]);
-    g_aenc_chns[AencChn].wake_fd[0] = 0;
-  }
-  if (g_aenc_chns[AencChn].wake_fd[1] > 0) {
-    close(g_aenc_chns[AencChn].wake_fd[1]);
-    g_aenc_chns[AencChn].wake_fd[1] = 0;
-  }
   g_aenc_mtx.unlock();
 
   return RK_ERR_SYS_OK;
@@ -5198,7 +5418,7 @@ RK_S32 RK_MPI_AENC_GetFd(AENC_CHN AencChn) {
     g_aenc_mtx.unlock();
     return -RK_ERR_AENC_NOTREADY;
   }
-  rcv_fd = g_aenc_chns[AencChn].wake_fd[0];
+  rcv_fd = g_aenc_chns[AencChn].wake_fd;
   g_aenc_mtx.unlock();
 
   return rcv_fd;
@@ -5536,7 +5756,7 @@ RK_S32 RK_MPI_RGA_DestroyChn(RGA_CHN RgaChn) {
     return -RK_ERR_RGA_BUSY;
   }
   RKMEDIA_LOGI("%s: Disable RGA[%d] Start...\n", __func__, RgaChn);
-  RkmediaChnClearBuffer(&g_rga_chns[RgaChn]);
+  RkmediaChnDestroyBuffer(&g_rga_chns[RgaChn]);
   g_rga_chns[RgaChn].rkmedia_flow.reset();
   g_rga_chns[RgaChn].status = CHN_STATUS_CLOSED;
   g_rga_mtx.unlock();
@@ -5844,7 +6064,7 @@ RK_S32 RK_MPI_ADEC_DestroyChn(ADEC_CHN AdecChn) {
   }
 
   g_adec_chns[AdecChn].rkmedia_flow.reset();
-  RkmediaChnClearBuffer(&g_adec_chns[AdecChn]);
+  RkmediaChnDestroyBuffer(&g_adec_chns[AdecChn]);
   g_adec_chns[AdecChn].status = CHN_STATUS_CLOSED;
   g_adec_mtx.unlock();
 
@@ -6178,7 +6398,7 @@ RK_S32 RK_MPI_VDEC_DestroyChn(VDEC_CHN VdChn) {
   }
 
   g_vdec_chns[VdChn].rkmedia_flow.reset();
-  RkmediaChnClearBuffer(&g_vdec_chns[VdChn]);
+  RkmediaChnDestroyBuffer(&g_vdec_chns[VdChn]);
   g_vdec_chns[VdChn].status = CHN_STATUS_CLOSED;
   g_vdec_mtx.unlock();
 
@@ -6266,6 +6486,8 @@ RK_S32 RK_MPI_VMIX_DestroyDev(VMIX_DEV VmDev) {
 
   if (g_vmix_dev[VmDev].rkmedia_flow)
     g_vmix_dev[VmDev].rkmedia_flow.reset();
+  // the output channel of the device
+  RkmediaChnDestroyBuffer(&g_vmix_dev[VmDev].VmChns[0]);
   g_vmix_dev[VmDev].bInit = RK_FALSE;
   g_vmix_dev[VmDev].VmMtx.unlock();
   return RK_ERR_SYS_OK;
@@ -6359,6 +6581,11 @@ RK_S32 RK_MPI_VMIX_SetLineInfo(VMIX_DEV VmDev, VMIX_CHN VmChn,
 }
 
 RK_S32 RK_MPI_MUXER_EnableChn(MUXER_CHN VmChn, MUXER_CHN_ATTR_S *pstAttr) {
+  return RK_MPI_MUXER_EnableChnEx(VmChn, pstAttr, NULL);
+}
+
+RK_S32 RK_MPI_MUXER_EnableChnEx(MUXER_CHN VmChn, MUXER_CHN_ATTR_S *pstAttr,
+                                MUXER_CHN_ATTR_EX_S *pstAttrEx) {
   if ((VmChn < 0) || (VmChn > MUXER_MAX_CHN_NUM))
     return -RK_ERR_MUXER_INVALID_CHNID;
 
@@ -6430,6 +6657,17 @@ RK_S32 RK_MPI_MUXER_EnableChn(MUXER_CHN VmChn, MUXER_CHN_ATTR_S *pstAttr) {
     return -RK_ERR_MUXER_ILLEGAL_PARAM;
   }
 
+  if (pstAttrEx && pstAttrEx->u32WriteQueueLen)
+    PARAM_STRING_APPEND_TO(MuxerParamStr, KEY_MUXER_WRITE_QUEUE,
+                           pstAttrEx->u32WriteQueueLen);
+  if (pstAttrEx && pstAttrEx->u32PreRecTimeSec) {
+    PARAM_STRING_APPEND_TO(MuxerParamStr, KEY_MUXER_PRE_RECORD_TIME,
+                           pstAttrEx->u32PreRecTimeSec);
+    if (pstAttrEx->u32PreRecCacheSize)
+      PARAM_STRING_APPEND_TO(MuxerParamStr, KEY_MUXER_PRE_RECORD_SIZE,
+                             pstAttrEx->u32PreRecCacheSize);
+  }
+
   // VideoParam check: ToDo....
   // AudioParam check: ToDo....
 
@@ -6539,7 +6777,7 @@ RK_S32 RK_MPI_MUXER_DisableChn(MUXER_CHN VmChn) {
   }
 
   g_muxer_chns[VmChn].rkmedia_flow.reset();
-  RkmediaChnClearBuffer(&g_muxer_chns[VmChn]);
+  RkmediaChnDestroyBuffer(&g_muxer_chns[VmChn]);
   g_muxer_chns[VmChn].status = CHN_STATUS_CLOSED;
   g_muxer_mtx.unlock();
 
@@ -66,6 +66,11 @@ RK_S32 RK_MPI_MB_ReleaseBuffer(MEDIA_BUFFER mb) {
   if (!mb)
     return -RK_ERR_SYS_ILLEGAL_PARAM;
 
+  if (mb_impl->slab) {
+    mb_impl->slab->Put(mb_impl);
+    return RK_ERR_SYS_OK;
+  }
+
   if (mb_impl->rkmedia_mb)
     mb_impl->rkmedia_mb.reset();
 
@@ -73,6 +78,41 @@ RK_S32 RK_MPI_MB_ReleaseBuffer(MEDIA_BUFFER mb) {
   return RK_ERR_SYS_OK;
 }
 
+MediaBufferImpleSlab::~MediaBufferImpleSlab() {
+  for (auto mb : free_mbs)
+    delete mb;
+  free_mbs.clear();
+}
+
+MEDIA_BUFFER_IMPLE *MediaBufferImpleSlab::Get() {
+  MEDIA_BUFFER_IMPLE *mb = NULL;
+  mtx.lock();
+  if (!free_mbs.empty()) {
+    mb = free_mbs.back();
+    free_mbs.pop_back();
+  }
+  mtx.unlock();
+  if (!mb) {
+    mb = new MEDIA_BUFFER_IMPLE;
+    if (!mb)
+      return NULL;
+    mb->slab = this;
+  }
+  return mb;
+}
+
+void MediaBufferImpleSlab::Put(MEDIA_BUFFER_IMPLE *mb) {
+  mb->rkmedia_mb.reset();
+  mtx.lock();
+  if (free_mbs.size() < kMaxFreeNum) {
+    free_mbs.push_back(mb);
+    mb = NULL;
+  }
+  mtx.unlock();
+  if (mb)
+    delete mb;
+}
+
 RK_S32 RK_MPI_MB_BeginCPUAccess(MEDIA_BUFFER mb, RK_BOOL bReadonly) {
   MEDIA_BUFFER_IMPLE *mb_impl = (MEDIA_BUFFER_IMPLE *)mb;
   if (!mb)
@@ -383,6 +423,7 @@ MEDIA_BUFFER RK_MPI_MB_Copy(MEDIA_BUFFER mb, RK_BOOL bZeroCopy) {
   }
   if (bZeroCopy) {
     *mb_new = *mb_old;
+    mb_new->slab = NULL;
   } else {
     RKMEDIA_LOGE("%s: not support DeepCopy\n", __func__);
     delete mb_new;
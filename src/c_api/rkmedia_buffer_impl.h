@@ -8,8 +8,13 @@
 #include "buffer.h"
 #include "flow.h"
 
+#include <mutex>
+#include <vector>
+
 #include "rkmedia_common.h"
 
+class MediaBufferImpleSlab;
+
 typedef struct _rkMEDIA_BUFFER_S {
   MB_TYPE_E type;
   void *ptr;         // Virtual address of buffer
@@ -24,9 +29,26 @@ typedef struct _rkMEDIA_BUFFER_S {
   union {
     MB_IMAGE_INFO_S stImageInfo;
   };
-
+  // Where RK_MPI_MB_ReleaseBuffer gives it back, NULL means delete.
+  MediaBufferImpleSlab *slab = NULL;
 } MEDIA_BUFFER_IMPLE;
 
+// Recycles the MEDIA_BUFFER_IMPLE handles of one channel, so that handing
+// out a frame does not cost a new/delete pair once the channel runs.
+class MediaBufferImpleSlab {
+public:
+  MediaBufferImpleSlab() { free_mbs.reserve(kMaxFreeNum); }
+  ~MediaBufferImpleSlab();
+  MEDIA_BUFFER_IMPLE *Get();
+  // Drop the held rkmedia buffer and keep the handle for the next Get.
+  void Put(MEDIA_BUFFER_IMPLE *mb);
+
+private:
+  static const size_t kMaxFreeNum = 16;
+  std::mutex mtx;
+  std::vector<MEDIA_BUFFER_IMPLE *> free_mbs;
+};
+
 typedef struct _rkMEDIA_BUFFER_POOL_S {
   MB_TYPE_E enType;
   RK_U32 u32Cnt;
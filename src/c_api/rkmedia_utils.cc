@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include "image.h"
 #include "media_type.h"
 #include "rkmedia_common.h"
 #include "rkmedia_venc.h"
@@ -109,6 +110,23 @@ IMAGE_TYPE_E StringToImageType(std::string type) {
   return IMAGE_TYPE_UNKNOW;
 }
 
+// Indexed by PixelFormat, must follow the order of image.h.
+static const IMAGE_TYPE_E pix_fmt_image_type_map[PIX_FMT_NB] = {
+    IMAGE_TYPE_YUV420P,  IMAGE_TYPE_NV12,     IMAGE_TYPE_NV21,
+    IMAGE_TYPE_YUV422P,  IMAGE_TYPE_NV16,     IMAGE_TYPE_NV61,
+    IMAGE_TYPE_YUYV422,  IMAGE_TYPE_UYVY422,  IMAGE_TYPE_RGB332,
+    IMAGE_TYPE_RGB565,   IMAGE_TYPE_BGR565,   IMAGE_TYPE_RGB888,
+    IMAGE_TYPE_BGR888,   IMAGE_TYPE_ARGB8888, IMAGE_TYPE_ABGR8888,
+    IMAGE_TYPE_FBC0,     IMAGE_TYPE_FBC2};
+
+IMAGE_TYPE_E PixFmtToImageType(PixelFormat fmt) {
+  if (fmt <= PIX_FMT_NONE || fmt >= PIX_FMT_NB) {
+    RKMEDIA_LOGE("%s: unknown pixel format:%d", __func__, fmt);
+    return IMAGE_TYPE_UNKNOW;
+  }
+  return pix_fmt_image_type_map[fmt];
+}
+
 std::string CodecToString(CODEC_TYPE_E type) {
   switch (type) {
   case RK_CODEC_TYPE_AAC:
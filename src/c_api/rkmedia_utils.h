@@ -7,6 +7,7 @@
 
 std::string ImageTypeToString(IMAGE_TYPE_E type);
 IMAGE_TYPE_E StringToImageType(std::string type);
+IMAGE_TYPE_E PixFmtToImageType(PixelFormat fmt);
 std::string CodecToString(CODEC_TYPE_E type);
 std::string SampleFormatToString(SAMPLE_FORMAT_E type);
 char *ModIdToString(MOD_ID_E mod_id);
@@ -6,6 +6,12 @@
 
 #include <sys/prctl.h>
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "buffer.h"
 #include "utils.h"
 
@@ -54,8 +60,8 @@ bool Codec::SetExtraData(void *data, size_t size, bool realloc) {
 bool Codec::Init() { return false; }
 
 // Copy from ffmpeg.
-static const uint8_t *find_startcode_internal(const uint8_t *p,
-                                              const uint8_t *end) {
+static const uint8_t *find_startcode_scalar(const uint8_t *p,
+                                            const uint8_t *end) {
   const uint8_t *a = p + 4 - ((intptr_t)p & 3);
 
   for (end -= 3; p < a && p < end; p++) {
@@ -91,6 +97,45 @@ static const uint8_t *find_startcode_internal(const uint8_t *p,
   return end + 3;
 }
 
+// Compare 16 positions at once against 00 00 01, the tail and the block
+// holding a hit are finished by the scalar version. Like it, a start code
+// must be followed by at least one byte. Encoded data rarely has a zero
+// byte, so a block without any is skipped with a single compare.
+static const uint8_t *find_startcode_internal(const uint8_t *p,
+                                              const uint8_t *end) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  const uint8x16_t zero = vdupq_n_u8(0);
+  const uint8x16_t one = vdupq_n_u8(1);
+  for (; end - p >= 19; p += 16) {
+    uint8x16_t z = vceqq_u8(vld1q_u8(p), zero);
+    uint64x2_t z64 = vreinterpretq_u64_u8(z);
+    if (!(vgetq_lane_u64(z64, 0) | vgetq_lane_u64(z64, 1)))
+      continue;
+    uint8x16_t m = vandq_u8(z, vceqq_u8(vld1q_u8(p + 1), zero));
+    m = vandq_u8(m, vceqq_u8(vld1q_u8(p + 2), one));
+    uint64x2_t m64 = vreinterpretq_u64_u8(m);
+    if (vgetq_lane_u64(m64, 0) | vgetq_lane_u64(m64, 1))
+      break;
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  for (; end - p >= 19; p += 16) {
+    __m128i z = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero);
+    if (!_mm_movemask_epi8(z))
+      continue;
+    __m128i m = _mm_and_si128(
+        z, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), zero));
+    m = _mm_and_si128(
+        m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), one));
+    int mask = _mm_movemask_epi8(m);
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+  return find_startcode_scalar(p, end);
+}
+
 const uint8_t *find_nalu_startcode(const uint8_t *p, const uint8_t *end) {
   const uint8_t *out = find_startcode_internal(p, end);
   if (p < out && out < end && !out[-1])
@@ -98,102 +143,112 @@ const uint8_t *find_nalu_startcode(const uint8_t *p, const uint8_t *end) {
   return out;
 }
 
-std::list<std::shared_ptr<MediaBuffer>>
-split_h264_separate(const uint8_t *buffer, size_t length, int64_t timestamp) {
-  std::list<std::shared_ptr<MediaBuffer>> l;
-  const uint8_t *p = buffer;
-  const uint8_t *end = p + length;
-  const uint8_t *nal_start = nullptr, *nal_end = nullptr;
-  nal_start = find_nalu_startcode(p, end);
-  // 00 00 01 or 00 00 00 01
-  size_t start_len = (nal_start[2] == 1 ? 3 : 4);
-  for (;;) {
-    if (nal_start == end)
-      break;
-    nal_start += start_len;
-    nal_end = find_nalu_startcode(nal_start, end);
-    size_t size = nal_end - nal_start + start_len;
-    uint8_t nal_type = (*nal_start) & 0x1F;
-    uint32_t flag;
-    switch (nal_type) {
-    case 7:
-    case 8:
-      flag = MediaBuffer::kExtraIntra;
+NaluIndex::NaluIndex(const uint8_t *data, size_t length, CodecType c_type)
+    : base(data), len(length), codec_type(c_type) {
+  for (int i = 0; i < kMaxType; i++)
+    first[i] = -1;
+  const uint8_t *end = data + length;
+  const uint8_t *nal_start = find_nalu_startcode(data, end);
+  while (nal_start < end) {
+    // 00 00 01 or 00 00 00 01
+    int start_len = (nal_start[2] == 1 ? 3 : 4);
+    const uint8_t *payload = nal_start + start_len;
+    if (payload >= end)
       break;
-    default:
-      flag = 0;
-    }
+    const uint8_t *nal_end = find_nalu_startcode(payload, end);
+    Nalu nalu;
+    nalu.offset = nal_start - data;
+    nalu.size = nal_end - nal_start;
+    nalu.start_len = start_len;
+    if (c_type == CODEC_TYPE_H265)
+      nalu.type = ((*payload) & 0x7E) >> 1;
+    else
+      nalu.type = (*payload) & 0x1F;
+    if (first[nalu.type] < 0 && nalus.size() < INT16_MAX)
+      first[nalu.type] = nalus.size();
+    nalus.push_back(nalu);
+    nal_start = nal_end;
+  }
+}
 
-    // not extraIntra?
-    if (!flag)
-      break;
+std::shared_ptr<NaluIndex> GetNaluIndex(std::shared_ptr<MediaBuffer> &mb,
+                                        CodecType c_type) {
+  if (!mb || (c_type != CODEC_TYPE_H264 && c_type != CODEC_TYPE_H265))
+    return nullptr;
+  // Consumers on other threads may race to build it, both results are equal.
+  auto index = mb->GetNaluIndex();
+  if (index && index->Match(mb->GetPtr(), mb->GetValidSize(), c_type))
+    return index;
+  index = std::make_shared<NaluIndex>((const uint8_t *)mb->GetPtr(),
+                                      mb->GetValidSize(), c_type);
+  mb->SetNaluIndex(index);
+  return index;
+}
 
-    auto sub_buffer = MediaBuffer::Alloc(size);
-    if (!sub_buffer) {
-      LOG_NO_MEMORY(); // fatal error
-      l.clear();
-      return l;
-    }
-    memcpy(sub_buffer->GetPtr(), nal_start - start_len, size);
-    sub_buffer->SetValidSize(size);
-    sub_buffer->SetUserFlag(flag);
-    sub_buffer->SetUSTimeStamp(timestamp);
+static bool is_parameter_set(uint8_t type, CodecType c_type) {
+  if (c_type == CODEC_TYPE_H265)
+    return type == 32 || type == 33 || type == 34;
+  return type == 7 || type == 8;
+}
+
+std::list<std::shared_ptr<MediaBuffer>>
+split_h26x_separate(std::shared_ptr<MediaBuffer> &mb, CodecType c_type) {
+  std::list<std::shared_ptr<MediaBuffer>> l;
+  auto index = GetNaluIndex(mb, c_type);
+  if (!index)
+    return l;
+  uint8_t *data = (uint8_t *)mb->GetPtr();
+  for (auto &nalu : index->GetNalus()) {
+    if (!is_parameter_set(nalu.type, c_type))
+      break;
+    auto sub_buffer =
+        std::make_shared<MediaBuffer>(data + nalu.offset, nalu.size);
+    sub_buffer->SetValidSize(nalu.size);
+    sub_buffer->SetUserFlag(MediaBuffer::kExtraIntra);
+    sub_buffer->SetUSTimeStamp(mb->GetUSTimeStamp());
     sub_buffer->SetType(Type::Video);
+    sub_buffer->SetRelatedSPtr(mb);
     l.push_back(sub_buffer);
-
-    nal_start = nal_end;
   }
   return l;
 }
 
-std::list<std::shared_ptr<MediaBuffer>>
-split_h265_separate(const uint8_t *buffer, size_t length, int64_t timestamp) {
+static std::list<std::shared_ptr<MediaBuffer>>
+split_separate(const uint8_t *buffer, size_t length, int64_t timestamp,
+               CodecType c_type) {
   std::list<std::shared_ptr<MediaBuffer>> l;
-  const uint8_t *p = buffer;
-  const uint8_t *end = p + length;
-  const uint8_t *nal_start = nullptr, *nal_end = nullptr;
-  nal_start = find_nalu_startcode(p, end);
-  // 00 00 01 or 00 00 00 01
-  size_t start_len = (nal_start[2] == 1 ? 3 : 4);
-  for (;;) {
-    if (nal_start == end)
-      break;
-    nal_start += start_len;
-    nal_end = find_nalu_startcode(nal_start, end);
-    size_t size = nal_end - nal_start + start_len;
-    uint8_t nal_type = ((*nal_start) & 0x7E) >> 1;
-    uint32_t flag;
-    switch (nal_type) {
-    case 32:
-    case 33:
-    case 34:
-      flag = MediaBuffer::kExtraIntra;
-      break;
-    default:
-      flag = 0;
-    }
-
+  NaluIndex index(buffer, length, c_type);
+  for (auto &nalu : index.GetNalus()) {
     // not extraIntra?
-    if (!flag)
+    if (!is_parameter_set(nalu.type, c_type))
       break;
 
-    auto sub_buffer = MediaBuffer::Alloc(size);
+    auto sub_buffer = MediaBuffer::Alloc(nalu.size);
     if (!sub_buffer) {
       LOG_NO_MEMORY(); // fatal error
       l.clear();
       return l;
     }
-    memcpy(sub_buffer->GetPtr(), nal_start - start_len, size);
-    sub_buffer->SetValidSize(size);
-    sub_buffer->SetUserFlag(flag);
+    memcpy(sub_buffer->GetPtr(), buffer + nalu.offset, nalu.size);
+    sub_buffer->SetValidSize(nalu.size);
+    sub_buffer->SetUserFlag(MediaBuffer::kExtraIntra);
     sub_buffer->SetUSTimeStamp(timestamp);
+    sub_buffer->SetType(Type::Video);
     l.push_back(sub_buffer);
-
-    nal_start = nal_end;
   }
   return l;
 }
 
+std::list<std::shared_ptr<MediaBuffer>>
+split_h264_separate(const uint8_t *buffer, size_t length, int64_t timestamp) {
+  return split_separate(buffer, length, timestamp, CODEC_TYPE_H264);
+}
+
+std::list<std::shared_ptr<MediaBuffer>>
+split_h265_separate(const uint8_t *buffer, size_t length, int64_t timestamp) {
+  return split_separate(buffer, length, timestamp, CODEC_TYPE_H265);
+}
+
 static void *FindNaluByType(std::shared_ptr<MediaBuffer> &mb, int nal_type,
                             int &size, CodecType c_type) {
   if ((c_type != CODEC_TYPE_H264) && (c_type != CODEC_TYPE_H265)) {
@@ -201,36 +256,12 @@ static void *FindNaluByType(std::shared_ptr<MediaBuffer> &mb, int nal_type,
     return NULL;
   }
 
-  void *target_nalu = NULL;
-  const uint8_t *start = (uint8_t *)mb->GetPtr();
-  const uint8_t *end = start + mb->GetValidSize();
-  const uint8_t *nal_start = nullptr, *nal_end = nullptr;
-  nal_start = nal_end = find_nalu_startcode(start, end);
-  // 00 00 01 or 00 00 00 01
-  int start_len = (nal_start[2] == 1 ? 3 : 4);
-  int nal_size = 0;
-  uint8_t type = 0;
-
-  for (;;) {
-    if (nal_start == end)
-      break;
-    nal_start = nal_end;
-    nal_end = find_nalu_startcode(nal_start + start_len, end);
-    nal_size = nal_end - nal_start;
-
-    if (c_type == CODEC_TYPE_H264)
-      type = *(nal_start + start_len) & 0x1F;
-    else
-      type = (*(nal_start + start_len) & 0x7E) >> 1;
-
-    if (type == nal_type) {
-      size = nal_size;
-      target_nalu = (void *)nal_start;
-      break;
-    }
-  }
-
-  return target_nalu;
+  auto index = GetNaluIndex(mb, c_type);
+  const NaluIndex::Nalu *nalu = index ? index->Find(nal_type) : nullptr;
+  if (!nalu)
+    return NULL;
+  size = nalu->size;
+  return (uint8_t *)mb->GetPtr() + nalu->offset;
 }
 
 void *GetVpsFromBuffer(std::shared_ptr<MediaBuffer> &mb, int &size,
@@ -0,0 +1,274 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "display_backend.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "buffer.h"
+
+namespace easymedia {
+
+NullDisplayBackend::NullDisplayBackend(int period)
+    : period_us(period > 0 ? period : 16667), start_us(gettimeofday()),
+      next_fb_id(1), pending(false), pending_cookie(0), pending_fb(0),
+      pending_vblank(0), screen_fb(0), add_count(0), remove_count(0),
+      flip_count(0) {}
+
+int NullDisplayBackend::GetBufferKey(int fd, uint64_t &key) {
+  struct stat st;
+  if (fstat(fd, &st))
+    return -errno;
+  key = st.st_ino;
+  return 0;
+}
+
+uint32_t NullDisplayBackend::AddFB(const DisplayFBInfo &info) {
+  struct stat st;
+  if (info.width == 0 || info.height == 0 || fstat(info.fd, &st))
+    return 0;
+  std::lock_guard<std::mutex> _lg(mtx);
+  fbs.push_back(next_fb_id);
+  add_count++;
+  return next_fb_id++;
+}
+
+void NullDisplayBackend::RemoveFB(uint32_t fb_id) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  fbs.remove(fb_id);
+  remove_count++;
+  // as with drm, removing the fb on screen turns the plane off
+  if (screen_fb == fb_id)
+    screen_fb = 0;
+}
+
+int NullDisplayBackend::GetFBCount() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  return fbs.size();
+}
+
+uint32_t NullDisplayBackend::GetScreenFB() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  return screen_fb;
+}
+
+int64_t NullDisplayBackend::NextVBlank(int64_t now) const {
+  return now + period_us - (now - start_us) % period_us;
+}
+
+int NullDisplayBackend::Commit(const DisplayPlaneState &state,
+                               uint32_t cookie) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (pending)
+    return -EBUSY;
+  if (std::find(fbs.begin(), fbs.end(), state.fb_id) == fbs.end())
+    return -EINVAL;
+  pending = true;
+  pending_cookie = cookie;
+  pending_fb = state.fb_id;
+  pending_vblank = NextVBlank(gettimeofday());
+  cond.notify_all();
+  return 0;
+}
+
+int NullDisplayBackend::HandleEvents(int timeout_ms,
+                                     const DisplayFlipCallback &done) {
+  std::unique_lock<std::mutex> lock(mtx);
+  int64_t deadline = gettimeofday() + timeout_ms * 1000LL;
+  while (true) {
+    int64_t now = gettimeofday();
+    if (pending && now >= pending_vblank)
+      break;
+    int64_t wake = pending ? std::min(pending_vblank, deadline) : deadline;
+    if (now >= deadline)
+      return 0;
+    cond.wait_for(lock, std::chrono::microseconds(wake - now));
+  }
+  uint32_t cookie = pending_cookie;
+  int64_t vblank = pending_vblank;
+  screen_fb = pending_fb;
+  pending = false;
+  flip_count++;
+  lock.unlock();
+  done(cookie, vblank);
+  return 1;
+}
+
+DisplayFBCache::DisplayFBCache(const std::shared_ptr<DisplayBackend> &b,
+                               int max)
+    : backend(b), max_num(max > 0 ? max : 1), hit_count(0), miss_count(0) {}
+
+DisplayFBCache::~DisplayFBCache() {
+  for (auto &e : entries)
+    backend->RemoveFB(e.fb_id);
+}
+
+static bool same_geometry(const DisplayFBInfo &a, const DisplayFBInfo &b) {
+  return a.format == b.format && a.width == b.width && a.height == b.height &&
+         !memcmp(a.pitches, b.pitches, sizeof(a.pitches)) &&
+         !memcmp(a.offsets, b.offsets, sizeof(a.offsets));
+}
+
+uint32_t DisplayFBCache::Get(const DisplayFBInfo &info) {
+  uint64_t key = 0;
+  if (info.fd < 0 || backend->GetBufferKey(info.fd, key)) {
+    RKMEDIA_LOGE("DisplayFBCache: bad dma-buf fd %d\n", info.fd);
+    return 0;
+  }
+  std::lock_guard<std::mutex> _lg(mtx);
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it->key != key || !same_geometry(it->info, info))
+      continue;
+    it->refs++;
+    hit_count++;
+    entries.splice(entries.begin(), entries, it);
+    return it->fb_id;
+  }
+  uint32_t fb_id = backend->AddFB(info);
+  if (!fb_id)
+    return 0;
+  miss_count++;
+  Entry e;
+  e.key = key;
+  e.info = info;
+  e.fb_id = fb_id;
+  e.refs = 1;
+  entries.push_front(e);
+  // the least recently used fbs out of use go first
+  auto it = entries.end();
+  while (entries.size() > max_num && it != entries.begin()) {
+    --it;
+    if (it->refs > 0)
+      continue;
+    backend->RemoveFB(it->fb_id);
+    it = entries.erase(it);
+  }
+  return fb_id;
+}
+
+void DisplayFBCache::Put(uint32_t fb_id) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  for (auto &e : entries) {
+    if (e.fb_id == fb_id) {
+      e.refs--;
+      break;
+    }
+  }
+}
+
+// The event thread wakes up at least this often to see if it should stop.
+static const int kFlipEventTimeoutMs = 50;
+// A flip not completed after this is given up, a stopped crtc sends none.
+static const int64_t kFlipTimeoutUs = 500 * 1000;
+
+DisplayFlipQueue::DisplayFlipQueue(
+    const std::shared_ptr<DisplayBackend> &b,
+    const std::shared_ptr<DisplayFBCache> &c)
+    : backend(b), cache(c), pending_cookie(0), pending_us(0), cookie(0),
+      flip_count(0), drop_count(0), running(true) {
+  memset(&screen.state, 0, sizeof(screen.state));
+  memset(&pending.state, 0, sizeof(pending.state));
+  memset(&queued.state, 0, sizeof(queued.state));
+  thread = std::thread(&DisplayFlipQueue::EventLoop, this);
+}
+
+DisplayFlipQueue::~DisplayFlipQueue() {
+  running = false;
+  if (thread.joinable())
+    thread.join();
+  std::lock_guard<std::mutex> _lg(mtx);
+  ReleaseLocked(queued);
+  ReleaseLocked(pending);
+  ReleaseLocked(screen);
+}
+
+void DisplayFlipQueue::ReleaseLocked(Frame &frame) {
+  if (frame.state.fb_id)
+    cache->Put(frame.state.fb_id);
+  frame.state.fb_id = 0;
+  frame.buffer.reset();
+}
+
+bool DisplayFlipQueue::CommitLocked(Frame &frame) {
+  int ret = backend->Commit(frame.state, ++cookie);
+  if (ret) {
+    RKMEDIA_LOGE("DisplayFlipQueue: commit fb %d failed, ret=%d\n",
+                 frame.state.fb_id, ret);
+    ReleaseLocked(frame);
+    return false;
+  }
+  pending = frame;
+  pending_cookie = cookie;
+  pending_us = gettimeofday();
+  frame.state.fb_id = 0;
+  frame.buffer.reset();
+  return true;
+}
+
+bool DisplayFlipQueue::Push(const std::shared_ptr<MediaBuffer> &buffer,
+                            const DisplayFBInfo &info, const ImageRect &src,
+                            const ImageRect &dst) {
+  Frame frame;
+  frame.buffer = buffer;
+  frame.state.fb_id = cache->Get(info);
+  frame.state.src = src;
+  frame.state.dst = dst;
+  if (!frame.state.fb_id)
+    return false;
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (!pending.state.fb_id)
+    return CommitLocked(frame);
+  if (queued.state.fb_id) {
+    ReleaseLocked(queued);
+    drop_count++;
+  }
+  queued = frame;
+  return true;
+}
+
+void DisplayFlipQueue::OnFlipDone(uint32_t done_cookie) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (!pending.state.fb_id || done_cookie != pending_cookie)
+    return;
+  ReleaseLocked(screen);
+  screen = pending;
+  pending.state.fb_id = 0;
+  pending.buffer.reset();
+  flip_count++;
+  if (queued.state.fb_id)
+    CommitLocked(queued);
+}
+
+void DisplayFlipQueue::EventLoop() {
+  prctl(PR_SET_NAME, "display_flip");
+  auto done = [this](uint32_t c, int64_t us _UNUSED) { OnFlipDone(c); };
+  while (running) {
+    int ret = backend->HandleEvents(kFlipEventTimeoutMs, done);
+    if (ret < 0) {
+      RKMEDIA_LOGE("DisplayFlipQueue: handle events failed, ret=%d\n", ret);
+      msleep(kFlipEventTimeoutMs);
+    }
+    if (ret > 0)
+      continue;
+    uint32_t lost_cookie = 0;
+    {
+      std::lock_guard<std::mutex> _lg(mtx);
+      if (pending.state.fb_id &&
+          gettimeofday() - pending_us > kFlipTimeoutUs)
+        lost_cookie = pending_cookie;
+    }
+    if (lost_cookie) {
+      RKMEDIA_LOGW("DisplayFlipQueue: no event of flip %u, given up\n",
+                   lost_cookie);
+      OnFlipDone(lost_cookie);
+    }
+  }
+}
+
+} // namespace easymedia
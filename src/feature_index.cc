@@ -0,0 +1,313 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "feature_index.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace easymedia {
+
+#define FEATURE_ROW_ALIGN 64
+#define FEATURE_SCORE_BLOCK 256
+
+// Snapshot file: this header, count rows of stride floats, count ids and
+// count norms. The header size keeps the rows aligned in the mapping.
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t dim;
+  uint32_t count;
+  uint64_t tag;
+  uint8_t reserved[40];
+} FeatureSnapshotHeader;
+
+static const char kSnapshotMagic[4] = {'R', 'K', 'F', 'I'};
+static const uint32_t kSnapshotVersion = 1;
+
+static size_t snapshot_size(uint32_t count, size_t stride) {
+  return sizeof(FeatureSnapshotHeader) + count * stride * sizeof(float) +
+         count * sizeof(int32_t) + count * sizeof(float);
+}
+
+FeatureIndex::FeatureIndex()
+    : dim(0), stride(0), count(0), capacity(0), rows(nullptr),
+      map_addr(nullptr), map_size(0) {}
+
+FeatureIndex::~FeatureIndex() { Release(); }
+
+void FeatureIndex::Release() {
+  if (map_addr)
+    munmap(map_addr, map_size);
+  else
+    free(rows);
+  map_addr = nullptr;
+  map_size = 0;
+  rows = nullptr;
+  capacity = 0;
+}
+
+void FeatureIndex::Reset(int d) {
+  Release();
+  count = 0;
+  ids.clear();
+  norms.clear();
+  if (d > 0) {
+    dim = d;
+    stride = (d + 3) & ~3;
+  }
+}
+
+bool FeatureIndex::Reserve(int cnt) {
+  if (cnt <= capacity)
+    return true;
+  int new_capacity = std::max(std::max(cnt, capacity * 2), 64);
+  void *ptr = nullptr;
+  if (posix_memalign(&ptr, FEATURE_ROW_ALIGN,
+                     new_capacity * stride * sizeof(float))) {
+    LOG_NO_MEMORY();
+    return false;
+  }
+  if (count > 0)
+    memcpy(ptr, rows, count * stride * sizeof(float));
+  // a mapped snapshot is left here, from now on the rows are on the heap
+  Release();
+  rows = (float *)ptr;
+  capacity = new_capacity;
+  return true;
+}
+
+int FeatureIndex::Add(int id, const float *feature) {
+  if (dim <= 0 || !Reserve(count + 1))
+    return -1;
+  double sum = 0;
+  for (int i = 0; i < dim; i++)
+    sum += (double)feature[i] * feature[i];
+  float norm = (float)sqrt(sum);
+  float scale = norm > 0 ? 1.0f / norm : 0.0f;
+  float *row = rows + count * stride;
+  for (int i = 0; i < dim; i++)
+    row[i] = feature[i] * scale;
+  for (size_t i = dim; i < stride; i++)
+    row[i] = 0;
+  ids.push_back(id);
+  norms.push_back(norm);
+  return count++;
+}
+
+int FeatureIndex::Remove(int id) {
+  int removed = 0;
+  int i = 0;
+  while (i < count) {
+    if (ids[i] != id) {
+      i++;
+      continue;
+    }
+    int last = count - 1;
+    if (i != last) {
+      memcpy(rows + i * stride, rows + last * stride, stride * sizeof(float));
+      ids[i] = ids[last];
+      norms[i] = norms[last];
+    }
+    ids.pop_back();
+    norms.pop_back();
+    count--;
+    removed++;
+  }
+  return removed;
+}
+
+bool FeatureIndex::GetFeature(int row, float *feature) const {
+  if (row < 0 || row >= count)
+    return false;
+  const float *r = rows + row * stride;
+  for (int i = 0; i < dim; i++)
+    feature[i] = r[i] * norms[row];
+  return true;
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static inline float32x4_t sum_lanes4(float32x4_t a, float32x4_t b,
+                                     float32x4_t c, float32x4_t d) {
+#if defined(__aarch64__)
+  return vpaddq_f32(vpaddq_f32(a, b), vpaddq_f32(c, d));
+#else
+  float32x2_t ab = vpadd_f32(vadd_f32(vget_low_f32(a), vget_high_f32(a)),
+                             vadd_f32(vget_low_f32(b), vget_high_f32(b)));
+  float32x2_t cd = vpadd_f32(vadd_f32(vget_low_f32(c), vget_high_f32(c)),
+                             vadd_f32(vget_low_f32(d), vget_high_f32(d)));
+  return vcombine_f32(ab, cd);
+#endif
+}
+#endif
+
+// Four rows at a time, so that every load of the query is used four times.
+void FeatureIndex::DotRows(const float *query, const float *rows,
+                           size_t stride, int num, float *scores) {
+  int r = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; num - r >= 4; r += 4) {
+    const float *r0 = rows + r * stride;
+    const float *r1 = r0 + stride;
+    const float *r2 = r1 + stride;
+    const float *r3 = r2 + stride;
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    float32x4_t acc2 = vdupq_n_f32(0), acc3 = vdupq_n_f32(0);
+    for (size_t i = 0; i < stride; i += 4) {
+      float32x4_t q = vld1q_f32(query + i);
+      acc0 = vmlaq_f32(acc0, vld1q_f32(r0 + i), q);
+      acc1 = vmlaq_f32(acc1, vld1q_f32(r1 + i), q);
+      acc2 = vmlaq_f32(acc2, vld1q_f32(r2 + i), q);
+      acc3 = vmlaq_f32(acc3, vld1q_f32(r3 + i), q);
+    }
+    vst1q_f32(scores + r, sum_lanes4(acc0, acc1, acc2, acc3));
+  }
+#elif defined(__SSE2__)
+  for (; num - r >= 4; r += 4) {
+    const float *r0 = rows + r * stride;
+    const float *r1 = r0 + stride;
+    const float *r2 = r1 + stride;
+    const float *r3 = r2 + stride;
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+    for (size_t i = 0; i < stride; i += 4) {
+      __m128 q = _mm_loadu_ps(query + i);
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(r0 + i), q));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(r1 + i), q));
+      acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_load_ps(r2 + i), q));
+      acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_load_ps(r3 + i), q));
+    }
+    _MM_TRANSPOSE4_PS(acc0, acc1, acc2, acc3);
+    _mm_storeu_ps(scores + r,
+                  _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+  }
+#endif
+  for (; r < num; r++) {
+    const float *row = rows + r * stride;
+    float sum = 0;
+    for (size_t i = 0; i < stride; i++)
+      sum += row[i] * query[i];
+    scores[r] = sum;
+  }
+}
+
+int FeatureIndex::Search(const float *query, int k, float min_score,
+                         FeatureMatch *out) const {
+  if (count <= 0 || k <= 0 || dim <= 0)
+    return 0;
+  std::vector<float> q(stride, 0.0f);
+  double sum = 0;
+  for (int i = 0; i < dim; i++)
+    sum += (double)query[i] * query[i];
+  if (sum <= 0)
+    return 0;
+  float scale = (float)(1.0 / sqrt(sum));
+  for (int i = 0; i < dim; i++)
+    q[i] = query[i] * scale;
+
+  // k is small, the best ones are kept sorted by insertion
+  int found = 0;
+  float scores[FEATURE_SCORE_BLOCK];
+  for (int base = 0; base < count; base += FEATURE_SCORE_BLOCK) {
+    int num = std::min(count - base, FEATURE_SCORE_BLOCK);
+    DotRows(q.data(), rows + base * stride, stride, num, scores);
+    for (int i = 0; i < num; i++) {
+      float score = scores[i];
+      if (score < min_score || (found == k && score <= out[k - 1].score))
+        continue;
+      int pos = found < k ? found++ : k - 1;
+      while (pos > 0 && out[pos - 1].score < score) {
+        out[pos] = out[pos - 1];
+        pos--;
+      }
+      out[pos].id = ids[base + i];
+      out[pos].row = base + i;
+      out[pos].score = score;
+    }
+  }
+  return found;
+}
+
+int FeatureIndex::SaveSnapshot(const char *path, uint64_t tag) const {
+  FeatureSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.dim = dim;
+  header.count = count;
+  header.tag = tag;
+
+  // written aside and renamed, a reader never maps half a snapshot
+  std::string tmp_path = std::string(path) + ".tmp";
+  FILE *f = fopen(tmp_path.c_str(), "wb");
+  if (!f) {
+    RKMEDIA_LOGE("open %s failed: %m\n", tmp_path.c_str());
+    return -1;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  if (ok && count > 0) {
+    ok = fwrite(rows, stride * sizeof(float), count, f) == (size_t)count &&
+         fwrite(ids.data(), sizeof(int32_t), count, f) == (size_t)count &&
+         fwrite(norms.data(), sizeof(float), count, f) == (size_t)count;
+  }
+  if (fclose(f))
+    ok = false;
+  if (!ok || rename(tmp_path.c_str(), path)) {
+    RKMEDIA_LOGE("write feature snapshot %s failed: %m\n", path);
+    unlink(tmp_path.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int FeatureIndex::LoadSnapshot(const char *path, uint64_t tag, int d) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  void *addr = MAP_FAILED;
+  if (!fstat(fd, &st) && (size_t)st.st_size >= sizeof(FeatureSnapshotHeader))
+    addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return -1;
+
+  const FeatureSnapshotHeader *header = (const FeatureSnapshotHeader *)addr;
+  size_t s = (header->dim + 3) & ~3;
+  if (memcmp(header->magic, kSnapshotMagic, sizeof(header->magic)) ||
+      header->version != kSnapshotVersion || header->tag != tag ||
+      header->dim == 0 || (d > 0 && header->dim != (uint32_t)d) ||
+      snapshot_size(header->count, s) != (size_t)st.st_size) {
+    RKMEDIA_LOGI("feature snapshot %s is stale, ignored\n", path);
+    munmap(addr, st.st_size);
+    return -1;
+  }
+  Reset(header->dim);
+  count = capacity = header->count;
+  map_addr = addr;
+  map_size = st.st_size;
+  rows = (float *)((uint8_t *)addr + sizeof(FeatureSnapshotHeader));
+  const int32_t *id_ptr = (const int32_t *)(rows + count * stride);
+  const float *norm_ptr = (const float *)(id_ptr + count);
+  ids.assign(id_ptr, id_ptr + count);
+  norms.assign(norm_ptr, norm_ptr + count);
+  return 0;
+}
+
+} // namespace easymedia
@@ -8,6 +8,7 @@
 #include "decoder.h"
 #include "ffmpeg_utils.h"
 #include "media_type.h"
+#include "pcm.h"
 
 #ifdef MOD_TAG
 #undef MOD_TAG
@@ -228,12 +229,9 @@ std::shared_ptr<MediaBuffer> FFMPEGAudioDecoder::FetchOutput() {
                       avctx->frame_size;
     std::shared_ptr<MediaBuffer> buffer_s16p =
         std::make_shared<MediaBuffer>(MediaBuffer::Alloc2(buffer_size));
-    uint8_t *pi = (uint8_t *)buffer->GetPtr();
-    uint8_t *po = (uint8_t *)buffer_s16p->GetPtr();
-    int os = av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
-    int is = av_get_bytes_per_sample(avctx->sample_fmt);
-    conv_AV_SAMPLE_FMT_FLT_to_AV_SAMPLE_FMT_S16(po, pi, is, os,
-                                                po + buffer_size);
+    PcmFltToS16((int16_t *)buffer_s16p->GetPtr(),
+                (const float *)buffer->GetPtr(),
+                avctx->channels * avctx->frame_size);
     // from S16P to S16
     if (avctx->channels > 1) {
       SampleInfo sampleinfo;
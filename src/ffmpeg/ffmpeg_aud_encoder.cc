@@ -8,6 +8,7 @@
 #include "encoder.h"
 #include "ffmpeg_utils.h"
 #include "media_type.h"
+#include "pcm.h"
 
 #ifdef MOD_TAG
 #undef MOD_TAG
@@ -39,13 +40,19 @@ private:
   AVCodec *av_codec;
   AVCodecContext *avctx;
   AVFrame *frame;
+  std::shared_ptr<FFMpegPacketPool> packet_pool;
+  // S16 to FLT(P) conversion for aac, reused for every frame since
+  // avcodec_send_frame copies the samples it keeps
+  std::shared_ptr<SampleBuffer> flt_buf;
+  std::shared_ptr<SampleBuffer> fltp_buf;
   enum AVSampleFormat input_fmt;
   std::string output_data_type;
   std::string ff_codec_name;
 };
 
 FFMPEGAudioEncoder::FFMPEGAudioEncoder(const char *param)
-    : av_codec(nullptr), avctx(nullptr), input_fmt(AV_SAMPLE_FMT_NONE) {
+    : av_codec(nullptr), avctx(nullptr), frame(nullptr),
+      input_fmt(AV_SAMPLE_FMT_NONE) {
   std::map<std::string, std::string> params;
   std::list<std::pair<const std::string, std::string &>> req_list;
   req_list.push_back(std::pair<const std::string, std::string &>(
@@ -169,6 +176,7 @@ bool FFMPEGAudioEncoder::InitConfig(const MediaConfig &cfg) {
   frame->channels = info.channels;
   frame->channel_layout = av_get_default_channel_layout(info.channels);
   frame->format = input_fmt;
+  packet_pool = std::make_shared<FFMpegPacketPool>();
 
   return AudioEncoder::InitConfig(mc);
 }
@@ -193,20 +201,19 @@ int FFMPEGAudioEncoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
       int buffer_size = avctx->channels *
                         av_get_bytes_per_sample(avctx->sample_fmt) *
                         avctx->frame_size;
-      auto buffer = std::make_shared<easymedia::SampleBuffer>(
-          MediaBuffer::Alloc2(buffer_size), sampleinfo);
-      uint8_t *po = (uint8_t *)buffer->GetPtr();
-      uint8_t *pi = (uint8_t *)in->GetPtr();
-      int is = av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
-      int os = av_get_bytes_per_sample(avctx->sample_fmt);
-
-      conv_AV_SAMPLE_FMT_S16_to_AV_SAMPLE_FMT_FLT(po, pi, is, os,
-                                                  po + buffer_size);
+      if (!flt_buf || (int)flt_buf->GetSize() < buffer_size) {
+        flt_buf = std::make_shared<easymedia::SampleBuffer>(
+            MediaBuffer::Alloc2(buffer_size), sampleinfo);
+        if (avctx->channels > 1)
+          fltp_buf = std::make_shared<easymedia::SampleBuffer>(
+              MediaBuffer::Alloc2(buffer_size), sampleinfo);
+      }
+      auto buffer = flt_buf;
+      PcmS16ToFlt((float *)buffer->GetPtr(), (const int16_t *)in->GetPtr(),
+                  avctx->channels * avctx->frame_size);
 
       if (avctx->channels > 1) {
         // from FLT to FLTP
-        auto fltp_buf = std::make_shared<easymedia::SampleBuffer>(
-            MediaBuffer::Alloc2(buffer_size), sampleinfo);
         conv_package_to_planar((uint8_t *)fltp_buf->GetPtr(),
                                (uint8_t *)buffer->GetPtr(), sampleinfo);
         buffer = fltp_buf;
@@ -242,25 +249,19 @@ int FFMPEGAudioEncoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
   return 0;
 }
 
-static int __ffmpeg_packet_free(void *arg) {
-  auto pkt = (AVPacket *)arg;
-  av_packet_free(&pkt);
-  return 0;
-}
-
 std::shared_ptr<MediaBuffer> FFMPEGAudioEncoder::FetchOutput() {
-  auto pkt = av_packet_alloc();
+  auto pkt = packet_pool->Get();
   if (!pkt)
     return nullptr;
-  std::shared_ptr<MediaBuffer> buffer = std::make_shared<MediaBuffer>(
-      pkt->data, 0, -1, pkt, __ffmpeg_packet_free);
 
   int ret = avcodec_receive_packet(avctx, pkt);
   if (ret < 0) {
+    packet_pool->Put(pkt);
     if (ret == AVERROR(EAGAIN)) {
       errno = EAGAIN;
       return nullptr;
     } else if (ret == AVERROR_EOF) {
+      auto buffer = std::make_shared<MediaBuffer>();
       buffer->SetEOF(true);
       return buffer;
     }
@@ -268,8 +269,8 @@ std::shared_ptr<MediaBuffer> FFMPEGAudioEncoder::FetchOutput() {
     PrintAVError(ret, "Fail to receiver from encoder", av_codec->long_name);
     return nullptr;
   }
-  buffer->SetPtr(pkt->data);
-  buffer->SetValidSize(pkt->size);
+  // the buffer holds pkt, which goes back to the pool when it is released
+  auto buffer = WrapAVPacket(packet_pool, pkt);
   buffer->SetUSTimeStamp(pkt->pts);
   buffer->SetType(Type::Audio);
   return buffer;
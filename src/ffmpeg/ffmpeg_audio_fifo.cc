@@ -29,12 +29,14 @@ static int add_samples_to_fifo(AVAudioFifo *fifo, uint8_t **new_samples,
                                const int frame_size) {
   int error;
 
-  /* Make the FIFO as large as it needs to be to hold both,
-   * the old and the new samples. */
-  if ((error = av_audio_fifo_realloc(fifo, av_audio_fifo_size(fifo) +
-                                               frame_size)) < 0) {
-    fprintf(stderr, "Could not reallocate FIFO\n");
-    return error;
+  /* The FIFO is pre-sized, grow it only if the reader falls behind. */
+  if (av_audio_fifo_space(fifo) < frame_size) {
+    int size = av_audio_fifo_size(fifo) + frame_size;
+    RKMEDIA_LOGW("AudioFifo: grow to %d samples\n", size * 2);
+    if ((error = av_audio_fifo_realloc(fifo, size * 2)) < 0) {
+      fprintf(stderr, "Could not reallocate FIFO\n");
+      return error;
+    }
   }
 
   /* Store the new samples in the FIFO buffer. */
@@ -46,6 +48,11 @@ static int add_samples_to_fifo(AVAudioFifo *fifo, uint8_t **new_samples,
   return 0;
 };
 
+// Output periods recycled by the fifo, and the input periods the fifo holds
+// before it has to grow.
+static const int kFifoBufferNum = 8;
+static const int kFifoPeriods = 4;
+
 class AudioFifo : public Filter {
 public:
   AudioFifo(const char *param);
@@ -64,6 +71,7 @@ private:
   int64_t in_pts;       // timebase 1/samplerate
   int64_t out_pts;      // timebase 1/samplerate
   int finished;
+  std::shared_ptr<BufferPool> buffer_pool;
 
 #if DEBUG_FILE
   std::ofstream infile;
@@ -106,8 +114,10 @@ AudioFifo::AudioFifo(const char *param)
   assert(nb_samples > 0);
 
   /* Create the FIFO buffer based on the specified sample format. */
-  fifo = av_audio_fifo_alloc(SampleFmtToAVSamFmt(format), channels, 1);
+  fifo = av_audio_fifo_alloc(SampleFmtToAVSamFmt(format), channels,
+                             nb_samples * kFifoPeriods);
   assert(fifo);
+  buffer_pool = std::make_shared<BufferPool>(kFifoBufferNum, info);
 
 #if DEBUG_FILE
   static int id = 0;
@@ -179,8 +189,10 @@ std::shared_ptr<MediaBuffer> AudioFifo::FetchOutput() {
     assert(size > 0);
 
     SampleInfo dst_info = {format, channels, sample_rate, dst_nb_samples};
-    auto dst = std::make_shared<easymedia::SampleBuffer>(
-        MediaBuffer::Alloc2(size), dst_info);
+    auto dst = buffer_pool->GetSampleBuffer(dst_info);
+    if (!dst)
+      dst = std::make_shared<easymedia::SampleBuffer>(
+          MediaBuffer::Alloc2(size), dst_info);
     assert(dst);
 
     av_samples_fill_arrays(dst_data, &linesize, (const uint8_t *)dst->GetPtr(),
@@ -23,6 +23,9 @@ extern "C" {
 
 namespace easymedia {
 
+// Output periods recycled by the resampler.
+static const int kResampleBufferNum = 8;
+
 class ResampleFilter : public Filter {
 public:
   ResampleFilter(const char *param);
@@ -38,6 +41,8 @@ private:
   int sample_rate;
   SampleFormat format;
   SwrContext *swr_ctx;
+  // sized by the first output, with room for the resampler delay
+  std::shared_ptr<BufferPool> buffer_pool;
 
 #if DEBUG_FILE
   std::ofstream infile;
@@ -187,8 +192,16 @@ int ResampleFilter::Resample(std::shared_ptr<SampleBuffer> src,
   if (size < 0)
     return size;
 
-  dst = std::make_shared<easymedia::SampleBuffer>(MediaBuffer::Alloc2(size),
-                                                  dst_info);
+  if (!buffer_pool) {
+    SampleInfo pool_info = dst_info;
+    pool_info.nb_samples = dst_nb_samples * 2;
+    buffer_pool = std::make_shared<BufferPool>(kResampleBufferNum, pool_info);
+  }
+  if (buffer_pool->GetBufferSize() >= size)
+    dst = buffer_pool->GetSampleBuffer(dst_info);
+  if (!dst)
+    dst = std::make_shared<easymedia::SampleBuffer>(MediaBuffer::Alloc2(size),
+                                                    dst_info);
   if (!dst) {
     RKMEDIA_LOGI("Alloc audio frame buffer failed:%d!\n", size);
     return -1;
@@ -4,6 +4,9 @@
 
 #include "ffmpeg_utils.h"
 
+#include "media_config.h"
+#include "pcm.h"
+
 namespace easymedia {
 
 enum AVPixelFormat PixFmtToAVPixFmt(PixelFormat fmt) {
@@ -148,9 +151,21 @@ CONV_FUNC(AV_SAMPLE_FMT_S16, int16_t, AV_SAMPLE_FMT_FLT,
 CONV_FUNC(AV_SAMPLE_FMT_FLT, float, AV_SAMPLE_FMT_S16,
           *(const int16_t *)pi *(1.0f / (1 << 15)))
 
+// Planes on the stack for PcmInterleave/PcmDeinterleave, which take samples
+// of up to 4 bytes. Other layouts use the loops below.
+#define PCM_KERNEL_MAX_CHANNELS 32
+
 void conv_planar_to_package(uint8_t *po, uint8_t *pi, SampleInfo sampleInfo) {
   int sample_size =
       av_get_bytes_per_sample(SampleFmtToAVSamFmt(sampleInfo.fmt));
+  if (sample_size <= 4 && sampleInfo.channels <= PCM_KERNEL_MAX_CHANNELS) {
+    const void *planes[PCM_KERNEL_MAX_CHANNELS];
+    for (int j = 0; j < sampleInfo.channels; j++)
+      planes[j] = pi + sampleInfo.nb_samples * j * sample_size;
+    PcmInterleave(po, planes, sample_size, sampleInfo.channels,
+                  sampleInfo.nb_samples);
+    return;
+  }
   for (int i = 0; i < sampleInfo.nb_samples; i++) {
     for (int j = 0; j < sampleInfo.channels; j++) {
       memcpy(po, pi + (i + sampleInfo.nb_samples * j) * sample_size,
@@ -163,6 +178,14 @@ void conv_planar_to_package(uint8_t *po, uint8_t *pi, SampleInfo sampleInfo) {
 void conv_package_to_planar(uint8_t *po, uint8_t *pi, SampleInfo sampleInfo) {
   int sample_size =
       av_get_bytes_per_sample(SampleFmtToAVSamFmt(sampleInfo.fmt));
+  if (sample_size <= 4 && sampleInfo.channels <= PCM_KERNEL_MAX_CHANNELS) {
+    void *planes[PCM_KERNEL_MAX_CHANNELS];
+    for (int j = 0; j < sampleInfo.channels; j++)
+      planes[j] = po + sampleInfo.nb_samples * j * sample_size;
+    PcmDeinterleave(planes, pi, sample_size, sampleInfo.channels,
+                    sampleInfo.nb_samples);
+    return;
+  }
   for (int i = 0; i < sampleInfo.nb_samples; i++) {
     for (int j = 0; j < sampleInfo.channels; j++) {
       memcpy(po + (i + sampleInfo.nb_samples * j) * sample_size, pi,
@@ -172,4 +195,57 @@ void conv_package_to_planar(uint8_t *po, uint8_t *pi, SampleInfo sampleInfo) {
   }
 }
 
+template <typename T, typename Pool> struct PooledRef {
+  std::shared_ptr<Pool> pool;
+  T *obj;
+};
+
+template <typename T, typename Pool> static int put_pooled_ref(void *arg) {
+  PooledRef<T, Pool> *ref = (PooledRef<T, Pool> *)arg;
+  ref->pool->Put(ref->obj);
+  delete ref;
+  return 0;
+}
+
+std::shared_ptr<MediaBuffer>
+WrapAVPacket(const std::shared_ptr<FFMpegPacketPool> &pool, AVPacket *pkt) {
+  auto ref = new PooledRef<AVPacket, FFMpegPacketPool>{pool, pkt};
+  auto mb = std::make_shared<MediaBuffer>(
+      pkt->data, pkt->size, -1, ref,
+      put_pooled_ref<AVPacket, FFMpegPacketPool>);
+  mb->SetValidSize(pkt->size);
+  return mb;
+}
+
+MediaBuffer WrapAVFrame(const std::shared_ptr<FFMpegFramePool> &pool,
+                        AVFrame *frame, size_t size, int fd) {
+  auto ref = new PooledRef<AVFrame, FFMpegFramePool>{pool, frame};
+  return MediaBuffer(frame->data[0], size, fd, ref,
+                     put_pooled_ref<AVFrame, FFMpegFramePool>);
+}
+
+void SetCodecThreads(AVCodecContext *ctx, int codec_threads,
+                     int codec_thread_type) {
+  ctx->thread_count = GetCodecThreads(codec_threads);
+  ctx->thread_type = 0;
+  if (!codec_thread_type || (codec_thread_type & CODEC_THREAD_FRAME))
+    ctx->thread_type |= FF_THREAD_FRAME;
+  if (!codec_thread_type || (codec_thread_type & CODEC_THREAD_SLICE))
+    ctx->thread_type |= FF_THREAD_SLICE;
+}
+
+static void release_media_buffer(void *opaque, uint8_t *data _UNUSED) {
+  delete (std::shared_ptr<MediaBuffer> *)opaque;
+}
+
+AVBufferRef *WrapMediaBuffer(const std::shared_ptr<MediaBuffer> &mb,
+                             uint8_t *data, int size, int flags) {
+  auto holder = new std::shared_ptr<MediaBuffer>(mb);
+  AVBufferRef *ref =
+      av_buffer_create(data, size, release_media_buffer, holder, flags);
+  if (!ref)
+    delete holder;
+  return ref;
+}
+
 } // namespace easymedia
@@ -14,6 +14,11 @@ extern "C" {
 #include <libavutil/samplefmt.h>
 }
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "buffer.h"
 #include "image.h"
 #include "media_type.h"
 #include "sound.h"
@@ -36,6 +41,64 @@ void conv_AV_SAMPLE_FMT_S16_to_AV_SAMPLE_FMT_FLT(uint8_t *po, const uint8_t *pi,
 void conv_planar_to_package(uint8_t *po, uint8_t *pi, SampleInfo sampleInfo);
 void conv_package_to_planar(uint8_t *po, uint8_t *pi, SampleInfo sampleInfo);
 
+// Recycles the AVFrame/AVPacket shells, so that a codec does not allocate
+// one per frame. Shared by the codec and the MediaBuffers still holding its
+// outputs, it may outlive the codec.
+template <typename T, T *(*Alloc)(), void (*Unref)(T *), void (*Free)(T **)>
+class FFMpegObjectPool {
+public:
+  FFMpegObjectPool(size_t max_num = 8) : max_free(max_num) {}
+  ~FFMpegObjectPool() {
+    for (auto obj : free_list)
+      Free(&obj);
+  }
+  T *Get() {
+    std::lock_guard<std::mutex> _lg(mtx);
+    if (free_list.empty())
+      return Alloc();
+    T *obj = free_list.back();
+    free_list.pop_back();
+    return obj;
+  }
+  void Put(T *obj) {
+    Unref(obj);
+    std::lock_guard<std::mutex> _lg(mtx);
+    if (free_list.size() < max_free)
+      free_list.push_back(obj);
+    else
+      Free(&obj);
+  }
+
+private:
+  std::mutex mtx;
+  std::vector<T *> free_list;
+  size_t max_free;
+};
+
+typedef FFMpegObjectPool<AVFrame, av_frame_alloc, av_frame_unref,
+                         av_frame_free>
+    FFMpegFramePool;
+typedef FFMpegObjectPool<AVPacket, av_packet_alloc, av_packet_unref,
+                         av_packet_free>
+    FFMpegPacketPool;
+
+// MediaBuffer over the data of pkt/frame->data[0] without copy, pkt/frame
+// goes back to pool when the last copy of the MediaBuffer is released.
+std::shared_ptr<MediaBuffer>
+WrapAVPacket(const std::shared_ptr<FFMpegPacketPool> &pool, AVPacket *pkt);
+MediaBuffer WrapAVFrame(const std::shared_ptr<FFMpegFramePool> &pool,
+                        AVFrame *frame, size_t size, int fd = -1);
+
+// Threads of ctx before avcodec_open2, see VideoConfig::codec_threads and
+// VideoConfig::codec_thread_type.
+void SetCodecThreads(AVCodecContext *ctx, int codec_threads,
+                     int codec_thread_type);
+
+// AVBufferRef over [data, data + size) which lies in mb, holding a
+// reference of mb until libav* releases it.
+AVBufferRef *WrapMediaBuffer(const std::shared_ptr<MediaBuffer> &mb,
+                             uint8_t *data, int size, int flags = 0);
+
 } // namespace easymedia
 
 #endif // #ifndef EASYMEDIA_FFMPEG_UTILS_H_
@@ -1,20 +1,155 @@
 #include "ffmpeg_vid_decoder.h"
 #include "buffer.h"
+
+#include <unordered_set>
+
 namespace easymedia {
+
+class FrameBufferAllocator;
+
+struct FrameBufferRef {
+  std::shared_ptr<FrameBufferAllocator> allocator;
+  std::shared_ptr<MediaBuffer> mb;
+  int vir_width;
+  int vir_height;
+};
+
+// The frame memory handed to libavcodec by get_buffer2, one MediaBuffer per
+// frame, recycled while the frame size does not change.
+class FrameBufferAllocator {
+public:
+  FrameBufferAllocator()
+      : buf_size(0), mem_type(MediaBuffer::MemType::MEM_HARD_WARE) {}
+  std::shared_ptr<MediaBuffer> Get(size_t size) {
+    std::lock_guard<std::mutex> _lg(mtx);
+    if (size != buf_size) {
+      free_list.clear();
+      buf_size = size;
+    }
+    if (!free_list.empty()) {
+      auto mb = free_list.back();
+      free_list.pop_back();
+      return mb;
+    }
+    auto mb = MediaBuffer::Alloc(size, mem_type);
+    if (!mb && mem_type != MediaBuffer::MemType::MEM_COMMON) {
+      // no hardware buffer on this platform
+      mem_type = MediaBuffer::MemType::MEM_COMMON;
+      mb = MediaBuffer::Alloc(size, mem_type);
+    }
+    return mb;
+  }
+  void Put(const std::shared_ptr<MediaBuffer> &mb) {
+    std::lock_guard<std::mutex> _lg(mtx);
+    if (mb->GetSize() == buf_size && free_list.size() < kMaxFreeNum)
+      free_list.push_back(mb);
+  }
+  // The frames in our buffers. The opaque of a frame buffer from the default
+  // allocator or a hwaccel is not a FrameBufferRef, look it up before use.
+  void Track(FrameBufferRef *ref) {
+    std::lock_guard<std::mutex> _lg(mtx);
+    refs.insert(ref);
+  }
+  void Untrack(FrameBufferRef *ref) {
+    std::lock_guard<std::mutex> _lg(mtx);
+    refs.erase(ref);
+  }
+  FrameBufferRef *Lookup(void *opaque) {
+    std::lock_guard<std::mutex> _lg(mtx);
+    auto it = refs.find((FrameBufferRef *)opaque);
+    return it != refs.end() ? *it : nullptr;
+  }
+  MediaBuffer::MemType GetMemType() { return mem_type; }
+
+private:
+  static const size_t kMaxFreeNum = 8;
+  std::mutex mtx;
+  std::vector<std::shared_ptr<MediaBuffer>> free_list;
+  std::unordered_set<FrameBufferRef *> refs;
+  size_t buf_size;
+  MediaBuffer::MemType mem_type;
+};
+
+static void release_frame_buffer(void *opaque, uint8_t *data _UNUSED) {
+  FrameBufferRef *ref = (FrameBufferRef *)opaque;
+  ref->allocator->Untrack(ref);
+  ref->allocator->Put(ref->mb);
+  delete ref;
+}
+
+// Decode into our own contiguous buffers only for the layouts an ImageBuffer
+// can describe, everything else goes to the default allocator and is copied.
+bool FFMpegDecoder::UseOwnBuffer(AVCodecContext *ctx, int format) {
+  if (!(ctx->codec->capabilities & AV_CODEC_CAP_DR1))
+    return false;
+  switch (format) {
+  case AV_PIX_FMT_YUV420P:
+  case AV_PIX_FMT_NV12:
+  case AV_PIX_FMT_NV21:
+  case AV_PIX_FMT_NV16:
+    return true;
+  default:
+    return false;
+  }
+}
+
+int FFMpegDecoder::GetBuffer2(AVCodecContext *ctx, AVFrame *frame,
+                              int flags) {
+  FFMpegDecoder *dec = (FFMpegDecoder *)ctx->opaque;
+  if (!UseOwnBuffer(ctx, frame->format))
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+
+  enum AVPixelFormat fmt = (enum AVPixelFormat)frame->format;
+  int w = frame->width;
+  int h = frame->height;
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(ctx, &w, &h, linesize_align);
+  // half of it is the chroma stride, which must be simd aligned too
+  int vir_width = FFALIGN(w, 128);
+  int vir_height = h;
+  int size = av_image_get_buffer_size(fmt, vir_width, vir_height, 1);
+  if (size < 0)
+    return size;
+  // room to align the start and for the overread of the simd code
+  auto mb = dec->allocator->Get(size + 64 + AV_INPUT_BUFFER_PADDING_SIZE);
+  if (!mb)
+    return AVERROR(ENOMEM);
+  uint8_t *data = (uint8_t *)FFALIGN((uintptr_t)mb->GetPtr(), 64);
+  av_image_fill_arrays(frame->data, frame->linesize, data, fmt, vir_width,
+                       vir_height, 1);
+  FrameBufferRef *ref =
+      new FrameBufferRef{dec->allocator, mb, vir_width, vir_height};
+  frame->buf[0] = av_buffer_create(data, size, release_frame_buffer, ref, 0);
+  if (!frame->buf[0]) {
+    delete ref;
+    return AVERROR(ENOMEM);
+  }
+  dec->allocator->Track(ref);
+  frame->extended_data = frame->data;
+  return 0;
+}
+
 FFMpegDecoder::FFMpegDecoder(const char *param)
-    : pkt(nullptr), codec(nullptr), ffmpeg_context(nullptr) {
+    : need_split(0), pkt(nullptr), codec(nullptr), ffmpeg_context(nullptr),
+      parser(nullptr), codec_threads(0), codec_thread_type(0) {
   std::map<std::string, std::string> params;
   std::list<std::pair<const std::string, std::string &>> req_list;
 
   std::string input_data_type;
   std::string output_data_type;
   std::string split_mode;
+  std::string threads;
+  std::string thread_type;
   req_list.push_back(std::pair<const std::string, std::string &>(
       KEY_INPUTDATATYPE, input_data_type));
   req_list.push_back(std::pair<const std::string, std::string &>(
       KEY_OUTPUTDATATYPE, output_data_type));
   req_list.push_back(std::pair<const std::string, std::string &>(
       KEY_MPP_SPLIT_MODE, split_mode));
+  req_list.push_back(std::pair<const std::string, std::string &>(
+      KEY_CODEC_THREADS, threads));
+  req_list.push_back(std::pair<const std::string, std::string &>(
+      KEY_CODEC_THREAD_TYPE, thread_type));
 
   int ret = parse_media_param_match(param, params, req_list);
   if (ret == 0 || input_data_type.empty()) {
@@ -23,6 +158,8 @@ FFMpegDecoder::FFMpegDecoder(const char *param)
   }
   if (!split_mode.empty())
     need_split = std::stoi(split_mode);
+  codec_threads = ParseCodecThreads(threads);
+  codec_thread_type = ParseCodecThreadType(thread_type);
   if (!input_data_type.empty()) {
     codec_id = CodecTypeToAVCodecID(StringToCodecType(input_data_type.c_str()));
   }
@@ -31,7 +168,9 @@ FFMpegDecoder::FFMpegDecoder(const char *param)
 
 bool FFMpegDecoder::Init() {
   pkt = av_packet_alloc();
-  if (!pkt) {
+  allocator = std::make_shared<FrameBufferAllocator>();
+  frame_pool = std::make_shared<FFMpegFramePool>();
+  if (!pkt || !allocator || !frame_pool) {
     return false;
   }
   codec = avcodec_find_decoder(codec_id);
@@ -58,11 +197,22 @@ bool FFMpegDecoder::Init() {
     MUST be initialized there because this information is not
   available in the bitstream. */
 
+  ffmpeg_context->opaque = this;
+  ffmpeg_context->get_buffer2 = GetBuffer2;
+  SetCodecThreads(ffmpeg_context, codec_threads, codec_thread_type);
+#if LIBAVCODEC_VERSION_MAJOR < 59
+  // GetBuffer2 is thread safe, let the frame threads call it directly
+  ffmpeg_context->thread_safe_callbacks = 1;
+#endif
+
   /* open it */
   if (avcodec_open2(ffmpeg_context, codec, NULL) < 0) {
     RKMEDIA_LOGI("Could not open codec\n");
     return false;
   }
+  RKMEDIA_LOGI("ffmpeg_vid decoder: %d threads, thread type %d\n",
+               ffmpeg_context->thread_count,
+               ffmpeg_context->active_thread_type);
   return true;
 }
 
@@ -87,9 +237,9 @@ int FFMpegDecoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
   data_size = input->GetValidSize();
   if (need_split) {
     while (data_size > 0) {
-      ret =
-          av_parser_parse2(parser, ffmpeg_context, &pkt->data, &pkt->size, data,
-                           data_size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+      ret = av_parser_parse2(parser, ffmpeg_context, &pkt->data, &pkt->size,
+                             data, data_size, input->GetUSTimeStamp(),
+                             AV_NOPTS_VALUE, 0);
       if (ret < 0) {
         fprintf(stderr, "Error while parsing\n");
         return -1;
@@ -99,7 +249,8 @@ int FFMpegDecoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
       input->SetValidSize(data_size);
       input->SetPtr(data);
       if (pkt->size) {
-        ret = avcodec_send_packet(ffmpeg_context, pkt);
+        pkt->pts = parser->pts;
+        ret = SendPacket(pkt);
         if (ret < 0) {
           RKMEDIA_LOGI("%d: Error sending a packet for decoding\n", __LINE__);
           return ret;
@@ -111,7 +262,9 @@ int FFMpegDecoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
   } else {
     pkt->data = data;
     pkt->size = data_size;
-    ret = avcodec_send_packet(ffmpeg_context, pkt);
+    // frames come out in presentation order, the pts goes with its frame
+    pkt->pts = input->GetUSTimeStamp();
+    ret = SendPacket(pkt);
     if (ret < 0) {
       RKMEDIA_LOGI("Error sending a packet for decoding\n");
       return ret;
@@ -124,42 +277,89 @@ int FFMpegDecoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
     return ret;
 }
 
+int FFMpegDecoder::SendPacket(AVPacket *packet) {
+  int ret = avcodec_send_packet(ffmpeg_context, packet);
+  while (ret == AVERROR(EAGAIN)) {
+    // full of decoded frames, keep them in order for FetchOutput
+    auto frame = ReceiveFrame();
+    if (!frame)
+      break;
+    pending.push_back(frame);
+    ret = avcodec_send_packet(ffmpeg_context, packet);
+  }
+  return ret;
+}
+
 std::shared_ptr<MediaBuffer> FFMpegDecoder::FetchOutput() {
+  if (!pending.empty()) {
+    auto buffer = pending.front();
+    pending.pop_front();
+    return buffer;
+  }
+  return ReceiveFrame();
+}
+
+std::shared_ptr<MediaBuffer> FFMpegDecoder::ReceiveFrame() {
   int ret, size;
-  auto frame = av_frame_alloc();
+  auto frame = frame_pool->Get();
   if (!frame) {
     RKMEDIA_LOGI("create frame failed .\n");
     return nullptr;
   }
   ret = avcodec_receive_frame(ffmpeg_context, frame);
+  if (ret < 0)
+    frame_pool->Put(frame);
   if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-    RKMEDIA_LOGI("Error during decoding %d\n", ret);
+    // frame threading delays the output by up to thread_count frames
+    errno = EAGAIN;
     return nullptr;
   } else if (ret < 0) {
     RKMEDIA_LOGI("Error during decoding\n");
     return nullptr;
   }
 
-  size = av_image_get_buffer_size((enum AVPixelFormat)frame->format,
-                                  frame->width, frame->height, 1);
-  auto &&buffer =
-      MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_HARD_WARE, 0);
   ImageInfo image_info;
   image_info.width = frame->width;
   image_info.height = frame->height;
-  image_info.vir_width = frame->width;
-  image_info.vir_height = frame->height;
   image_info.pix_fmt = AVPixFmtToPixFmt((enum AVPixelFormat)frame->format);
-  auto buffer_out =
-      std::make_shared<easymedia::ImageBuffer>(buffer, image_info);
-  av_image_copy_to_buffer(
-      (uint8_t *)buffer_out->GetPtr(), size,
-      (const uint8_t *const *)frame->data, (const int *)frame->linesize,
-      (enum AVPixelFormat)frame->format, frame->width, frame->height, 1);
+  int64_t pts = frame->pts != AV_NOPTS_VALUE ? frame->pts
+                                              : frame->best_effort_timestamp;
+
+  FrameBufferRef *ref = nullptr;
+  if (UseOwnBuffer(ffmpeg_context, frame->format) && frame->buf[0] &&
+      !frame->buf[1])
+    ref = allocator->Lookup(av_buffer_get_opaque(frame->buf[0]));
+  std::shared_ptr<ImageBuffer> buffer_out;
+  if (ref && frame->data[0] == frame->buf[0]->data) {
+    // Decoded into a MediaBuffer of ours and not cropped at top or left: the
+    // output holds the frame, no copy.
+    image_info.vir_width = ref->vir_width;
+    image_info.vir_height = ref->vir_height;
+    int fd = frame->data[0] == ref->mb->GetPtr() ? ref->mb->GetFD() : -1;
+    size = frame->buf[0]->size;
+    buffer_out = std::make_shared<ImageBuffer>(
+        WrapAVFrame(frame_pool, frame, size, fd), image_info);
+  } else {
+    size = av_image_get_buffer_size((enum AVPixelFormat)frame->format,
+                                    frame->width, frame->height, 1);
+    image_info.vir_width = frame->width;
+    image_info.vir_height = frame->height;
+    auto &&buffer = MediaBuffer::Alloc2(size, allocator->GetMemType(), 0);
+    if (buffer.GetSize() == 0) {
+      LOG_NO_MEMORY();
+      frame_pool->Put(frame);
+      return nullptr;
+    }
+    buffer_out = std::make_shared<ImageBuffer>(buffer, image_info);
+    av_image_copy_to_buffer(
+        (uint8_t *)buffer_out->GetPtr(), size,
+        (const uint8_t *const *)frame->data, (const int *)frame->linesize,
+        (enum AVPixelFormat)frame->format, frame->width, frame->height, 1);
+    frame_pool->Put(frame);
+  }
   buffer_out->SetValidSize(size);
-  buffer_out->SetUSTimeStamp(frame->pts);
+  buffer_out->SetUSTimeStamp(pts);
   buffer_out->SetType(Type::Image);
-  av_frame_free(&frame);
   return buffer_out;
 }
 
@@ -3,9 +3,12 @@
 // found in the LICENSE file.
 #ifndef __FFMPEG_VID_DECODER_
 #define __FFMPEG_VID_DECODER_
+#include <deque>
+
 #include "decoder.h"
 #include "ffmpeg_utils.h"
 namespace easymedia {
+class FrameBufferAllocator;
 class FFMpegDecoder : public VideoDecoder {
 public:
   FFMpegDecoder(const char *param);
@@ -20,6 +23,11 @@ public:
   virtual std::shared_ptr<MediaBuffer> FetchOutput() override;
 
 private:
+  static int GetBuffer2(AVCodecContext *ctx, AVFrame *frame, int flags);
+  static bool UseOwnBuffer(AVCodecContext *ctx, int format);
+  int SendPacket(AVPacket *packet);
+  std::shared_ptr<MediaBuffer> ReceiveFrame();
+
   int need_split;
   AVCodecID codec_id;
   bool support_sync;
@@ -28,6 +36,12 @@ private:
   AVCodec *codec;
   AVCodecContext *ffmpeg_context;
   AVCodecParserContext *parser;
+  std::shared_ptr<FrameBufferAllocator> allocator;
+  std::shared_ptr<FFMpegFramePool> frame_pool;
+  int codec_threads;
+  int codec_thread_type;
+  // received while SendInput waits for room, in output order
+  std::deque<std::shared_ptr<MediaBuffer>> pending;
 };
 } // namespace easymedia
 #endif // #ifndef __FFMPEG_VID_DECODER_
@@ -23,7 +23,8 @@ extern "C" {
 
 namespace easymedia {
 
-FFMpegVideoEncoder::FFMpegVideoEncoder(const char *param) {
+FFMpegVideoEncoder::FFMpegVideoEncoder(const char *param)
+    : Codec_(nullptr), Context_(nullptr), frame(nullptr) {
   std::map<std::string, std::string> params;
   std::list<std::pair<const std::string, std::string &>> req_list;
   req_list.push_back(std::pair<const std::string, std::string &>(
@@ -36,7 +37,6 @@ FFMpegVideoEncoder::FFMpegVideoEncoder(const char *param) {
 FFMpegVideoEncoder::~FFMpegVideoEncoder() {
   avcodec_free_context(&Context_);
   av_frame_free(&frame);
-  av_packet_free(&pkt);
 }
 
 bool FFMpegVideoEncoder::InitConfig(const MediaConfig &cfg) {
@@ -65,18 +65,22 @@ bool FFMpegVideoEncoder::InitConfig(const MediaConfig &cfg) {
   Context_->qmin = cfg.vid_cfg.qp_min;
   Context_->max_qdiff = cfg.vid_cfg.qp_step;
   // Context_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  SetCodecThreads(Context_, cfg.vid_cfg.codec_threads,
+                  cfg.vid_cfg.codec_thread_type);
 
   if (avcodec_open2(Context_, Codec_, NULL) < 0) {
     fprintf(stderr, "Codec cannot found\n");
     return false;
   }
+  RKMEDIA_LOGI("ffmpeg_vid encoder: %d threads, thread type %d\n",
+               Context_->thread_count, Context_->active_thread_type);
 
   frame = av_frame_alloc();
-  pkt = av_packet_alloc();
-
-  frame->format = Context_->pix_fmt;
-  frame->width = Context_->width;
-  frame->height = Context_->height;
+  packet_pool = std::make_shared<FFMpegPacketPool>();
+  if (!frame || !packet_pool) {
+    LOG_NO_MEMORY();
+    return false;
+  }
 
   return true;
 }
@@ -124,37 +128,35 @@ int FFMpegVideoEncoder::Process(const std::shared_ptr<MediaBuffer> &input,
 
 int FFMpegVideoEncoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
   int ret = 0;
-#if 0
-  ret = av_frame_make_writable(frame);
-  if (ret < 0) {
-    fprintf(stderr, "Could not mark the video frame data writable\n");
-    return -1;
-  }
-#endif
 
   if (input->GetValidSize() > 0) {
-#if 1
-    frame->data[0] = (uint8_t *)input->GetPtr();
-    frame->data[1] =
-        (uint8_t *)(input->GetPtr()) + frame->width * frame->height;
-    frame->data[2] = (uint8_t *)(input->GetPtr()) +
-                     frame->width * frame->height +
-                     frame->width * frame->height / 4;
-#else
-    memcpy(frame->data[0], (uint8_t *)input->GetPtr(),
-           frame->width * frame->height);
-    memcpy(frame->data[1],
-           (uint8_t *)(input->GetPtr()) + frame->width * frame->height,
-           frame->width * frame->height / 4);
-    memcpy(frame->data[2],
-           (uint8_t *)(input->GetPtr()) + frame->width * frame->height +
-               frame->width * frame->height / 4,
-           frame->width * frame->height / 4);
-#endif
-    // On ffmpeg 4.1.3, linesizes need to be manual configured.
-    frame->linesize[0] = frame->width;
-    frame->linesize[1] = frame->width / 2;
-    frame->linesize[2] = frame->width / 2;
+    int vir_width = Context_->width;
+    int vir_height = Context_->height;
+    if (input->GetType() == Type::Image) {
+      auto img = std::static_pointer_cast<ImageBuffer>(input);
+      if (img->GetVirWidth() >= vir_width &&
+          img->GetVirHeight() >= vir_height) {
+        vir_width = img->GetVirWidth();
+        vir_height = img->GetVirHeight();
+      }
+    }
+    int size = av_image_fill_arrays(
+        frame->data, frame->linesize, (const uint8_t *)input->GetPtr(),
+        (enum AVPixelFormat)Context_->pix_fmt, vir_width, vir_height, 1);
+    if (size < 0 || (size_t)size > input->GetValidSize()) {
+      RKMEDIA_LOGE("input size %d is less than %dx%d image\n",
+                   (int)input->GetValidSize(), vir_width, vir_height);
+      return -1;
+    }
+    // A refcounted frame is referenced by libavcodec instead of copied, the
+    // input stays alive until the encoder drops the frame.
+    frame->buf[0] = WrapMediaBuffer(input, frame->data[0], size,
+                                    AV_BUFFER_FLAG_READONLY);
+    if (!frame->buf[0]) {
+      LOG_NO_MEMORY();
+      return -1;
+    }
+    frame->extended_data = frame->data;
     frame->pts = input->GetUSTimeStamp();
 
     frame->format = Context_->pix_fmt;
@@ -162,6 +164,15 @@ int FFMpegVideoEncoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
     frame->height = Context_->height;
 
     ret = avcodec_send_frame(Context_, frame);
+    while (ret == AVERROR(EAGAIN)) {
+      // full of encoded packets, keep them in order for FetchOutput
+      auto out = ReceivePacket();
+      if (!out)
+        break;
+      pending.push_back(out);
+      ret = avcodec_send_frame(Context_, frame);
+    }
+    av_frame_unref(frame);
   } else {
     ret = avcodec_send_frame(Context_, NULL);
   }
@@ -174,8 +185,24 @@ int FFMpegVideoEncoder::SendInput(const std::shared_ptr<MediaBuffer> &input) {
 }
 
 std::shared_ptr<MediaBuffer> FFMpegVideoEncoder::FetchOutput() {
+  if (!pending.empty()) {
+    auto buffer = pending.front();
+    pending.pop_front();
+    return buffer;
+  }
+  return ReceivePacket();
+}
+
+std::shared_ptr<MediaBuffer> FFMpegVideoEncoder::ReceivePacket() {
   int ret = 0;
+  AVPacket *pkt = packet_pool->Get();
+  if (!pkt) {
+    LOG_NO_MEMORY();
+    return nullptr;
+  }
   ret = avcodec_receive_packet(Context_, pkt);
+  if (ret < 0)
+    packet_pool->Put(pkt);
   if (ret == AVERROR(EAGAIN)) {
     errno = EAGAIN;
     return nullptr;
@@ -199,13 +226,11 @@ std::shared_ptr<MediaBuffer> FFMpegVideoEncoder::FetchOutput() {
   fwrite(pkt->data, 1, pkt->size, f);
   fclose(f);
 #endif
-  auto buffer = MediaBuffer::Alloc(pkt->size);
-  buffer->SetValidSize(pkt->size);
-  memcpy(buffer->GetPtr(), pkt->data, pkt->size);
+  // the buffer holds pkt, which goes back to the pool when it is released
+  auto buffer = WrapAVPacket(packet_pool, pkt);
   buffer->SetUSTimeStamp(pkt->pts);
   buffer->SetUserFlag((pkt->flags & AV_PKT_FLAG_KEY) ? MediaBuffer::kIntra
                                                      : MediaBuffer::kPredicted);
-  av_packet_unref(pkt);
   return buffer;
 }
 
@@ -5,7 +5,10 @@
 #ifndef EASYMEDIA_FFMPEG_VIDEO_ENCODER_H
 #define EASYMEDIA_FFMPEG_VIDEO_ENCODER_H
 
+#include <deque>
+
 #include "encoder.h"
+#include "ffmpeg_utils.h"
 extern "C" {
 #define __STDC_CONSTANT_MACROS
 #include <libavformat/avformat.h>
@@ -28,6 +31,7 @@ public:
   virtual std::shared_ptr<MediaBuffer> FetchOutput() override;
 
 protected:
+  std::shared_ptr<MediaBuffer> ReceivePacket();
   bool CheckConfigChange(std::pair<uint32_t, std::shared_ptr<ParameterBuffer>>);
   int EncodeControl(int cmd, void *param);
 
@@ -36,7 +40,9 @@ private:
   AVCodec *Codec_;
   AVCodecContext *Context_;
   AVFrame *frame;
-  AVPacket *pkt;
+  std::shared_ptr<FFMpegPacketPool> packet_pool;
+  // received while SendInput waits for room, in output order
+  std::deque<std::shared_ptr<MediaBuffer>> pending;
   std::string OutputType_;
   std::string CodecName_;
 };
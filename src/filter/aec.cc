@@ -4,6 +4,7 @@
 
 #include "buffer.h"
 #include "filter.h"
+#include "pcm.h"
 #include <assert.h>
 extern "C" {
 #include <RKAP_3A.h>
@@ -140,10 +141,8 @@ int AECFilter::Process(std::shared_ptr<MediaBuffer> input,
     sigin = prebuf;
     sigref = prebuf + nb_samples;
     sigout = (short *)dst->GetPtr();
-    for (int i = 0; i < nb_samples; i++) {
-      sigin[i] = *((short *)input->GetPtr() + i * 2);
-      sigref[i] = *((short *)input->GetPtr() + i * 2 + 1);
-    }
+    void *planes[2] = {sigin, sigref};
+    PcmDeinterleave(planes, input->GetPtr(), sizeof(short), 2, nb_samples);
   } else { // AUDIO_PCM_S16P
     sigin = (short *)input->GetPtr();
     sigref = (short *)input->GetPtr() + nb_samples,
@@ -6,14 +6,27 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <stdlib.h>
 #include <sys/prctl.h>
+#include <time.h>
+
+#include <list>
+#include <mutex>
 
 #include "buffer.h"
+#include "flow_executor.h"
+#include "flow_timer.h"
 #include "key_string.h"
 #include "utils.h"
 
 namespace easymedia {
 
+// All the flows which installed a slot map, for DumpFlowGraphStats().
+// The lock is also held while a flow resizes its inputs/outputs, so that
+// a stats reader never walks a vector being reallocated.
+static std::mutex g_flow_list_mtx;
+static std::list<Flow *> g_flow_list;
+
 class FlowCoroutine {
 public:
   FlowCoroutine(Flow *f, Model sync_model, FunctionProcess func, float inter);
@@ -25,6 +38,13 @@ public:
   int GetCachedBufferCnt();
   bool IsProcessing();
   void ClearCachedBuffers();
+  // Executor::POOL
+  void SetPoolExecutor(int prio, int cpu);
+  bool IsPooled() { return pooled; }
+  void Schedule();
+  // Model::ASYNCATOMIC
+  void SetMissPolicy(MissPolicy policy) { miss_policy = policy; }
+  void SetTimerExecutor() { timed = true; }
 
 private:
   void WhileRun();
@@ -32,14 +52,19 @@ private:
   void SyncFetchInput(MediaBufferVector &in);
   void ASyncFetchInputCommon(MediaBufferVector &in);
   void ASyncFetchInputAtomic(MediaBufferVector &in);
+  void ASyncFetchInputLockFree(MediaBufferVector &in);
+  bool HasLockFreeInput();
+  bool HasCommonInput();
+  static void PoolRun(void *arg);
+  static void TimerRun(void *arg, int64_t late_us, uint32_t missed);
+  void RecordDeadline(int64_t late_us, uint32_t missed);
 
   void SendNullBufferDown(Flow::FlowMap &fm, const MediaBufferVector &in,
-                          std::list<Flow::FlowInputMap> &flows);
+                          const Flow::FlowList &flows);
   void SendBufferDown(Flow::FlowMap &fm, const MediaBufferVector &in,
-                      std::list<Flow::FlowInputMap> &flows, bool process_ret);
+                      const Flow::FlowList &flows, bool process_ret);
   void SendBufferDownFromDeque(Flow::FlowMap &fm, const MediaBufferVector &in,
-                               std::list<Flow::FlowInputMap> &flows,
-                               bool process_ret);
+                               const Flow::FlowList &flows, bool process_ret);
   size_t OutputHoldRelated(Flow::FlowMap &fm,
                            std::shared_ptr<MediaBuffer> &out_buffer,
                            const MediaBufferVector &input_vector);
@@ -59,21 +84,56 @@ private:
   decltype(&FlowCoroutine::SyncFetchInput) fetch_input_func;
   decltype(&FlowCoroutine::SendBufferDown) send_down_func;
 
+  enum { POOL_IDLE, POOL_SCHEDULED, POOL_RUNNING, POOL_RERUN, POOL_DEAD };
+  bool pooled;
+  bool fetch_wait; // false if pooled, fetch must not block a pool worker
+  int pool_priority;
+  int pool_cpu;
+  std::atomic<int> pool_state;
+  EventCount pool_idle_event;
+
+  MissPolicy miss_policy;
+  bool timed;   // run by FlowTimer
+  int timer_id; // 0 if not added
+
 public:
   void SetMarkName(std::string s) { name = s; }
   void SetExpectProcessTime(int time) { expect_process_time = time; }
+  void DumpStats(std::string &json);
 
   std::string name;
   int expect_process_time; // ms
+  // statistics
+  std::atomic<uint64_t> run_cnt;
+  LatencyHistogram process_hist; // us, time spent in th_run
+  // ASYNCATOMIC only
+  std::atomic<uint64_t> miss_cnt; // periods given up
+  LatencyHistogram late_hist;     // us, run start minus deadline
 };
 
 FlowCoroutine::FlowCoroutine(Flow *f, Model sync_model, FunctionProcess func,
                              float inter)
     : flow(f), model(sync_model), interval(inter), th(nullptr), th_run(func),
-      is_processing(false), clear_buffers_enable(false),
-      expect_process_time(0) {}
+      is_processing(false), clear_buffers_enable(false), pooled(false),
+      fetch_wait(true), pool_priority(0), pool_cpu(-1), pool_state(POOL_IDLE),
+      miss_policy(MissPolicy::SKIP), timed(false), timer_id(0),
+      expect_process_time(0), run_cnt(0), miss_cnt(0) {}
 
 FlowCoroutine::~FlowCoroutine() {
+  // Wait for the queued or running pool task, then forbid new ones. The
+  // task notifies just before going idle, a wake up that still finds it
+  // running only re-checks, the timeout covers the gap in between.
+  while (pooled) {
+    int s = POOL_IDLE;
+    uint32_t key = pool_idle_event.PrepareWait();
+    if (pool_state.compare_exchange_strong(s, POOL_DEAD)) {
+      pool_idle_event.CancelWait();
+      break;
+    }
+    pool_idle_event.Wait(key, 100);
+  }
+  if (timer_id)
+    FlowTimer::GetInstance()->Remove(timer_id);
   if (th) {
     th->join();
     delete th;
@@ -97,6 +157,11 @@ bool FlowCoroutine::Start() {
     fetch_input_func = &FlowCoroutine::ASyncFetchInputCommon;
     send_down_func = &FlowCoroutine::SendBufferDownFromDeque;
     break;
+  case Model::ASYNCLOCKFREE:
+    need_thread = true;
+    fetch_input_func = &FlowCoroutine::ASyncFetchInputLockFree;
+    send_down_func = &FlowCoroutine::SendBufferDownFromDeque;
+    break;
   case Model::ASYNCATOMIC:
     need_thread = true;
     fetch_input_func = &FlowCoroutine::ASyncFetchInputAtomic;
@@ -112,6 +177,31 @@ bool FlowCoroutine::Start() {
     return false;
   }
   in_vector.resize(in_slots.size());
+  if (timed) {
+    FlowTimer *timer = FlowTimer::GetInstance();
+    if (model == Model::ASYNCATOMIC && timer)
+      timer_id = timer->Add(&FlowCoroutine::TimerRun, this, interval,
+                            miss_policy);
+    if (timer_id) {
+      need_thread = false;
+    } else {
+      RKMEDIA_LOGW("%s: can not run on the timer, use a thread\n",
+                   name.c_str());
+      timed = false;
+    }
+  }
+  if (pooled) {
+    if (model != Model::ASYNCCOMMON && model != Model::ASYNCLOCKFREE) {
+      RKMEDIA_LOGW("%s: model %d can not run on the pool, use a thread\n",
+                   name.c_str(), (int)model);
+      pooled = false;
+    } else {
+      fetch_wait = false;
+      need_thread = false;
+      // inputs may have arrived before start
+      Schedule();
+    }
+  }
   if (need_thread) {
     th = new std::thread(func, this);
     if (!th) {
@@ -145,33 +235,94 @@ void FlowCoroutine::RunOnce() {
 #endif // RKMEDIA_TIMESTAMP_DEBUG
 
   if (flow->GetRunTimesRemaining()) {
+    AutoDuration ad;
+    is_processing = true;
+    ret = (*th_run)(flow, in_vector);
+    is_processing = false;
+    int64_t cost = ad.Get();
+    process_hist.Record(cost);
+    run_cnt.fetch_add(1, std::memory_order_relaxed);
 #ifndef NDEBUG
-    {
-      AutoDuration ad;
-#endif
-      is_processing = true;
-      ret = (*th_run)(flow, in_vector);
-      is_processing = false;
-#ifndef NDEBUG
-      if (expect_process_time > 0)
-        check_consume_time(name.c_str(), expect_process_time,
-                           (int)(ad.Get() / 1000));
-    }
+    if (expect_process_time > 0)
+      check_consume_time(name.c_str(), expect_process_time,
+                         (int)(cost / 1000));
 #endif // DEBUG
   }
 
   for (int idx : out_slots) {
     auto &fm = flow->downflowmap[idx];
-    std::list<Flow::FlowInputMap> flows;
-    fm.list_mtx.read_lock();
-    flows = fm.flows;
-    fm.list_mtx.unlock();
-    (this->*send_down_func)(fm, in_vector, flows, ret);
+    auto flows = fm.GetFlows();
+    (this->*send_down_func)(fm, in_vector, *flows, ret);
   }
   for (auto &buffer : in_vector)
     buffer.reset();
 
-  pthread_yield();
+  if (!pooled)
+    pthread_yield();
+}
+
+void FlowCoroutine::SetPoolExecutor(int prio, int cpu) {
+  pooled = true;
+  pool_priority = prio;
+  pool_cpu = cpu;
+}
+
+void FlowCoroutine::Schedule() {
+  int s = pool_state.load();
+  for (;;) {
+    if (s == POOL_IDLE) {
+      if (pool_state.compare_exchange_weak(s, POOL_SCHEDULED)) {
+        FlowExecutor::GetInstance()->Submit(&FlowCoroutine::PoolRun, this,
+                                            pool_priority, pool_cpu);
+        return;
+      }
+    } else if (s == POOL_RUNNING) {
+      // the running task will pick the new input up
+      if (pool_state.compare_exchange_weak(s, POOL_RERUN))
+        return;
+    } else {
+      return;
+    }
+  }
+}
+
+// Run a bounded batch per task so that one busy flow can not starve the
+// others sharing the same worker.
+#define POOL_RUN_BATCH 4
+
+void FlowCoroutine::PoolRun(void *arg) {
+  FlowCoroutine *c = static_cast<FlowCoroutine *>(arg);
+  Flow *flow = c->flow;
+  auto has_input = (c->model == Model::ASYNCLOCKFREE)
+                       ? &FlowCoroutine::HasLockFreeInput
+                       : &FlowCoroutine::HasCommonInput;
+  c->pool_state = POOL_RUNNING;
+  for (int i = 0; i < POOL_RUN_BATCH && !flow->quit; i++) {
+    if (!(c->*has_input)() && !c->clear_buffers_enable)
+      break;
+    c->RunOnce();
+  }
+  if (!flow->quit && (c->*has_input)()) {
+    c->pool_state = POOL_SCHEDULED;
+    FlowExecutor::GetInstance()->Submit(&FlowCoroutine::PoolRun, c,
+                                        c->pool_priority, c->pool_cpu);
+    return;
+  }
+  // Wake the destructor first: once POOL_IDLE is published it may free c,
+  // so the state change below must be the last access to c. The destructor
+  // re-checks the state after waking.
+  c->pool_idle_event.Notify();
+  int s = POOL_RUNNING;
+  if (!c->pool_state.compare_exchange_strong(s, POOL_IDLE)) {
+    // POOL_RERUN: new input arrived while running
+    if (!flow->quit) {
+      c->pool_state = POOL_SCHEDULED;
+      FlowExecutor::GetInstance()->Submit(&FlowCoroutine::PoolRun, c,
+                                          c->pool_priority, c->pool_cpu);
+      return;
+    }
+    c->pool_state = POOL_IDLE;
+  }
 }
 
 void FlowCoroutine::WhileRun() {
@@ -182,25 +333,46 @@ void FlowCoroutine::WhileRun() {
 }
 
 void FlowCoroutine::WhileRunSleep() {
-  int64_t times = 0;
-  AutoDuration ad;
+  PeriodicDeadline deadline;
   assert(interval > 0);
   prctl(PR_SET_NAME, this->name.c_str());
   RKMEDIA_LOGD("flow-name %s\n", this->name.c_str());
 
+  deadline.Start(FlowTimer::NowNs(), interval * 1000000.0, miss_policy);
   while (!flow->quit) {
-    if (times == 0)
-      ad.Reset();
+    int64_t next = deadline.Next();
+    if (next > FlowTimer::NowNs()) {
+      struct timespec ts;
+      ts.tv_sec = next / 1000000000LL;
+      ts.tv_nsec = next % 1000000000LL;
+      // absolute deadline, no drift from the sleep granularity
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) ==
+             EINTR)
+        ;
+      continue;
+    }
+    int64_t now = FlowTimer::NowNs();
+    uint32_t missed = deadline.Skip(now);
+    RecordDeadline((now - deadline.Next()) / 1000, missed);
+    deadline.Step();
     RunOnce();
-    ++times;
-    int64_t remain = interval * times - ad.Get() / 1000.0;
-    if (remain > 0)
-      msleep((int)remain);
-    if (times >= 10000)
-      times = 0;
   }
 }
 
+void FlowCoroutine::TimerRun(void *arg, int64_t late_us, uint32_t missed) {
+  FlowCoroutine *c = static_cast<FlowCoroutine *>(arg);
+  if (c->flow->quit)
+    return;
+  c->RecordDeadline(late_us, missed);
+  c->RunOnce();
+}
+
+void FlowCoroutine::RecordDeadline(int64_t late_us, uint32_t missed) {
+  late_hist.Record(late_us);
+  if (missed)
+    miss_cnt.fetch_add(missed, std::memory_order_relaxed);
+}
+
 void FlowCoroutine::SyncFetchInput(MediaBufferVector &in) {
   int i = 0;
   for (int idx : in_slots) {
@@ -228,13 +400,17 @@ void FlowCoroutine::ASyncFetchInputCommon(MediaBufferVector &in) {
       int idx = in_slots[i];
       auto &input = flow->v_input[idx];
       auto &v = input.cached_buffers;
+      AutoLockMutex _alm(input.mtx);
+      input.drop_cnt += v.size();
       v.clear();
+      input.cached_ts.clear();
+      input.mtx.notify();
     }
     clear_buffers_mtx.unlock();
     empty = true;
   }
 
-  if (empty && !flow->quit)
+  if (empty && !flow->quit && fetch_wait)
     flow->cond_mtx.wait();
   flow->cond_mtx.unlock();
 
@@ -253,6 +429,11 @@ void FlowCoroutine::ASyncFetchInputCommon(MediaBufferVector &in) {
     assert(!v.empty());
     in[i] = v.front();
     v.pop_front();
+    input.wait_hist.Record(gettimeofday() - input.cached_ts.front());
+    input.cached_ts.pop_front();
+    // slot freed, wake up the producer blocked in ASyncFullBlockingBehavior
+    if (input.mode_when_full == InputMode::BLOCKING)
+      input.mtx.notify();
   }
 }
 
@@ -268,9 +449,70 @@ void FlowCoroutine::ASyncFetchInputAtomic(MediaBufferVector &in) {
   }
 }
 
+bool FlowCoroutine::HasCommonInput() {
+  for (int idx : in_slots) {
+    auto &input = flow->v_input[idx];
+    AutoLockMutex _alm(input.mtx);
+    if (!input.cached_buffers.empty())
+      return true;
+  }
+  return false;
+}
+
+bool FlowCoroutine::HasLockFreeInput() {
+  for (int idx : in_slots) {
+    if (!flow->v_input[idx].ring->Empty())
+      return true;
+  }
+  return false;
+}
+
+void FlowCoroutine::ASyncFetchInputLockFree(MediaBufferVector &in) {
+  if (clear_buffers_enable) {
+    Flow::Input::TimedBuffer drop;
+    clear_buffers_mtx.lock();
+    clear_buffers_enable = false;
+    for (int idx : in_slots) {
+      auto &input = flow->v_input[idx];
+      while (input.ring->TryPop(drop)) {
+        drop.first.reset();
+        input.drop_cnt++;
+      }
+      input.space_event.Notify();
+    }
+    clear_buffers_mtx.unlock();
+  }
+
+  // Park only if every input is empty; producers skip the futex wake
+  // entirely while we are running.
+  if (fetch_wait && !HasLockFreeInput() && !flow->quit) {
+    uint32_t key = flow->input_event.PrepareWait();
+    if (HasLockFreeInput() || flow->quit)
+      flow->input_event.CancelWait();
+    else
+      flow->input_event.Wait(key);
+  }
+
+  for (size_t i = 0; i < in_slots.size(); i++) {
+    auto &input = flow->v_input[in_slots[i]];
+    if (input.ring->Empty())
+      continue;
+    if (!flow->enable) {
+      in.assign(in_slots.size(), nullptr);
+      break;
+    }
+    Flow::Input::TimedBuffer tb;
+    if (input.ring->TryPop(tb)) {
+      input.space_event.Notify();
+      input.wait_hist.Record(gettimeofday() - tb.second);
+      in[i] = std::move(tb.first);
+    }
+  }
+}
+
 void FlowCoroutine::SendNullBufferDown(Flow::FlowMap &fm,
                                        const MediaBufferVector &in,
-                                       std::list<Flow::FlowInputMap> &flows) {
+                                       const Flow::FlowList &flows) {
   std::shared_ptr<MediaBuffer> nullbuffer;
   if (fm.hold_input != HoldInputMode::NONE) {
     auto empty_result = std::make_shared<easymedia::MediaBuffer>();
@@ -283,7 +525,7 @@ void FlowCoroutine::SendNullBufferDown(Flow::FlowMap &fm,
 
 void FlowCoroutine::SendBufferDown(Flow::FlowMap &fm,
                                    const MediaBufferVector &in,
-                                   std::list<Flow::FlowInputMap> &flows,
+                                   const Flow::FlowList &flows,
                                    bool process_ret) {
   if (!process_ret) {
     SendNullBufferDown(fm, in, flows);
@@ -308,15 +550,33 @@ void FlowCoroutine::SendBufferDown(Flow::FlowMap &fm,
   fm.cached_buffer.reset();
 }
 
-void FlowCoroutine::SendBufferDownFromDeque(
-    Flow::FlowMap &fm, const MediaBufferVector &in,
-    std::list<Flow::FlowInputMap> &flows, bool process_ret) {
+void FlowCoroutine::SendBufferDownFromDeque(Flow::FlowMap &fm,
+                                            const MediaBufferVector &in,
+                                            const Flow::FlowList &flows,
+                                            bool process_ret) {
   if (!process_ret) {
     SendNullBufferDown(fm, in, flows);
     return;
   }
   if (fm.cached_buffers.empty())
     return;
+  bool has_sync = false;
+  for (auto &f : flows) {
+    if (f.flow->v_input[f.index_of_in].thread_model == Model::SYNC) {
+      has_sync = true;
+      break;
+    }
+  }
+  if (!has_sync) {
+    // all the outputs of this run in one go for each async flow
+    for (auto &buffer : fm.cached_buffers)
+      OutputHoldRelated(fm, buffer, in);
+    for (auto &f : flows)
+      f.flow->SendInputBatch(fm.cached_buffers, f.index_of_in);
+    fm.cached_buffers.clear();
+    return;
+  }
+  // a sync flow runs on SendInput, keep the buffer by buffer order
   for (auto &buffer : fm.cached_buffers) {
     OutputHoldRelated(fm, buffer, in);
     for (auto &f : flows) {
@@ -356,6 +616,22 @@ int FlowCoroutine::GetCachedBufferCnt() {
 
 bool FlowCoroutine::IsProcessing() { return is_processing; }
 
+void FlowCoroutine::DumpStats(std::string &json) {
+  char str[128];
+  snprintf(str, sizeof(str),
+           "{\"name\":\"%s\",\"runs\":%llu,\"process_us\":", name.c_str(),
+           (unsigned long long)run_cnt.load());
+  json.append(str);
+  json.append(process_hist.ToJson());
+  if (model == Model::ASYNCATOMIC) {
+    snprintf(str, sizeof(str), ",\"timer\":%s,\"missed\":%llu,\"late_us\":",
+             timed ? "true" : "false", (unsigned long long)miss_cnt.load());
+    json.append(str);
+    json.append(late_hist.ToJson());
+  }
+  json.append("}");
+}
+
 void FlowCoroutine::ClearCachedBuffers() {
   clear_buffers_mtx.lock();
   clear_buffers_enable = true;
@@ -375,16 +651,28 @@ Flow::Flow()
       event_handler_(nullptr), play_video_handler_(nullptr),
       play_audio_handler_(nullptr), user_handler_(nullptr),
       user_callback_(nullptr), out_handler_(nullptr), out_callback_(nullptr),
-      run_times(-1) {}
+      run_times(-1), output_cnt(0), stats_last_time(0), stats_last_in(0),
+      stats_last_out(0) {}
 
 Flow::~Flow() { StopAllThread(); }
 
 void Flow::StopAllThread() {
+  g_flow_list_mtx.lock();
+  g_flow_list.remove(this);
+  g_flow_list_mtx.unlock();
   cond_mtx.lock();
   enable = false;
   quit = true;
   cond_mtx.notify();
   cond_mtx.unlock();
+  input_event.Notify();
+  for (auto &input : v_input) {
+    input.space_event.Notify();
+    if (input.thread_model == Model::ASYNCCOMMON) {
+      AutoLockMutex _alm(input.mtx);
+      input.mtx.notify();
+    }
+  }
   for (auto &coroutine : coroutines)
     coroutine.reset();
   coroutines.clear();
@@ -396,7 +684,7 @@ bool Flow::IsAllBuffEmpty() {
 
   for (auto &input : v_input) {
     RKMEDIA_LOGI("#FLOW v_input-%d cached_buffers size:%zu\n", i,
-                 input.cached_buffers.size());
+                 input.CachedBufferSize());
     RKMEDIA_LOGI("#FLOW v_input-%d cached_buffer :%s\n", i++,
                  input.cached_buffer ? "NotNull" : "Null");
   }
@@ -417,7 +705,7 @@ bool Flow::IsAllBuffEmpty() {
 #endif
 
   for (auto &input : v_input) {
-    if (input.cached_buffers.size() || input.cached_buffer)
+    if (input.CachedBufferSize() || input.cached_buffer)
       return false;
   }
 
@@ -438,8 +726,9 @@ int Flow::GetCachedBufferNum(unsigned int &total, unsigned int &used) {
   unsigned int buf_used_cnt = 0;
   unsigned int buf_total_cnt = 0;
   for (auto &input : v_input) {
-    if (input.cached_buffers.size() > 0)
-      buf_used_cnt += input.cached_buffers.size();
+    size_t cached_size = input.CachedBufferSize();
+    if (cached_size > 0)
+      buf_used_cnt += cached_size;
     else if (input.cached_buffer)
       buf_used_cnt += 1;
 
@@ -513,6 +802,8 @@ void Flow::DumpBase(std::string &dump_info) {
       sprintf(str_line, "    ThreadMode: ASYNCATOMIC\r\n");
     else if (input.thread_model == Model::SYNC)
       sprintf(str_line, "    ThreadMode: SYNC\r\n");
+    else if (input.thread_model == Model::ASYNCLOCKFREE)
+      sprintf(str_line, "    ThreadMode: ASYNCLOCKFREE\r\n");
     else
       sprintf(str_line, "    ThreadMode: NONE\r\n");
     dump_info.append(str_line);
@@ -528,8 +819,15 @@ void Flow::DumpBase(std::string &dump_info) {
     dump_info.append(str_line);
     memset(str_line, 0, sizeof(str_line));
     sprintf(str_line, "    BufferCnt: current:%zu, max:%d\r\n",
-            input.cached_buffers.size(), input.max_cache_num);
+            input.CachedBufferSize(), input.max_cache_num);
     dump_info.append(str_line);
+    if (input.mode_when_full == InputMode::BLOCKING) {
+      memset(str_line, 0, sizeof(str_line));
+      sprintf(str_line, "    Blocked: times:%lld, total:%.2fms\r\n",
+              (long long)input.blocked_cnt.load(),
+              input.blocked_time.load() / 1000.0);
+      dump_info.append(str_line);
+    }
   }
 
   idx = 0;
@@ -545,7 +843,7 @@ void Flow::DumpBase(std::string &dump_info) {
     dump_info.append(str_line);
 
     dump_info.append("    NextFlow: ");
-    for (auto &nflow : fm.flows) {
+    for (auto &nflow : *fm.GetFlows()) {
       dump_info.append(nflow.flow->GetFlowTag());
       dump_info.append(" ");
     }
@@ -553,6 +851,118 @@ void Flow::DumpBase(std::string &dump_info) {
   }
 }
 
+static const char *model_to_string(Model m) {
+  switch (m) {
+  case Model::ASYNCCOMMON:
+    return KEY_ASYNCCOMMON;
+  case Model::ASYNCATOMIC:
+    return KEY_ASYNCATOMIC;
+  case Model::ASYNCLOCKFREE:
+    return KEY_ASYNCLOCKFREE;
+  case Model::SYNC:
+    return KEY_SYNC;
+  default:
+    return "none";
+  }
+}
+
+static const char *input_mode_to_string(InputMode m) {
+  switch (m) {
+  case InputMode::BLOCKING:
+    return KEY_BLOCKING;
+  case InputMode::DROPFRONT:
+    return KEY_DROPFRONT;
+  case InputMode::DROPCURRENT:
+    return KEY_DROPCURRENT;
+  default:
+    return "none";
+  }
+}
+
+void Flow::DumpStats(std::string &json) {
+  char str[512];
+  uint64_t total_in = 0;
+  for (auto &input : v_input)
+    total_in += input.enqueue_cnt.load(std::memory_order_relaxed);
+  uint64_t total_out = output_cnt.load(std::memory_order_relaxed);
+  double in_fps = 0, out_fps = 0;
+  stats_mtx.lock();
+  int64_t now = gettimeofday();
+  if (stats_last_time > 0 && now > stats_last_time) {
+    double sec = (now - stats_last_time) / 1000000.0;
+    in_fps = (total_in - stats_last_in) / sec;
+    out_fps = (total_out - stats_last_out) / sec;
+  }
+  stats_last_time = now;
+  stats_last_in = total_in;
+  stats_last_out = total_out;
+  stats_mtx.unlock();
+
+  snprintf(str, sizeof(str),
+           "{\"id\":\"%p\",\"tag\":\"%s\",\"in_fps\":%.2f,"
+           "\"out_fps\":%.2f,\"output\":%llu,\"inputs\":[",
+           (void *)this, GetFlowTag(), in_fps, out_fps,
+           (unsigned long long)total_out);
+  json.append(str);
+  for (size_t i = 0; i < v_input.size(); i++) {
+    auto &input = v_input[i];
+    if (!input.valid)
+      continue;
+    snprintf(str, sizeof(str),
+             "%s{\"slot\":%zu,\"model\":\"%s\",\"mode\":\"%s\","
+             "\"depth\":%zu,\"max\":%d,\"in\":%llu,\"drop\":%llu,"
+             "\"blocked_ms\":%.2f,\"wait_us\":",
+             json.back() == '[' ? "" : ",", i,
+             model_to_string(input.thread_model),
+             input_mode_to_string(input.mode_when_full),
+             input.CachedBufferSize(), input.max_cache_num,
+             (unsigned long long)input.enqueue_cnt.load(),
+             (unsigned long long)input.drop_cnt.load(),
+             input.blocked_time.load() / 1000.0);
+    json.append(str);
+    json.append(input.wait_hist.ToJson());
+    json.append("}");
+  }
+  json.append("],\"coroutines\":[");
+  for (auto &coroutine : coroutines) {
+    if (json.back() != '[')
+      json.append(",");
+    coroutine->DumpStats(json);
+  }
+  json.append("],\"outputs\":[");
+  for (size_t i = 0; i < downflowmap.size(); i++) {
+    auto &fm = downflowmap[i];
+    if (!fm.valid)
+      continue;
+    snprintf(str, sizeof(str), "%s{\"slot\":%zu,\"down\":[",
+             json.back() == '[' ? "" : ",", i);
+    json.append(str);
+    for (auto &f : *fm.GetFlows()) {
+      snprintf(str, sizeof(str),
+               "%s{\"id\":\"%p\",\"tag\":\"%s\",\"in_slot\":%d}",
+               json.back() == '[' ? "" : ",", (void *)f.flow.get(),
+               f.flow->GetFlowTag(), f.index_of_in);
+      json.append(str);
+    }
+    json.append("]}");
+  }
+  json.append("]");
+  DumpPrivateStats(json);
+  json.append("}");
+}
+
+std::string DumpFlowGraphStats() {
+  std::string json = "{\"flows\":[";
+  std::lock_guard<std::mutex> _lg(g_flow_list_mtx);
+  for (auto f : g_flow_list) {
+    if (json.back() != '[')
+      json.append(",");
+    f->DumpStats(json);
+  }
+  json.append("]}");
+  return json;
+}
+
 static bool check_slots(std::vector<int> &slots, const char *debugstr) {
   if (slots.empty())
     return true;
@@ -570,7 +980,7 @@ static bool check_slots(std::vector<int> &slots, const char *debugstr) {
   return true;
 }
 
-Flow::FlowMap::FlowMap(FlowMap &&fm) {
+Flow::FlowMap::FlowMap(FlowMap &&fm) : FlowMap() {
   if (fm.valid) {
     RKMEDIA_LOGI("Flow::FlowMap is not copyable and moveable after inited\n");
     assert(0);
@@ -580,7 +990,7 @@ Flow::FlowMap::FlowMap(FlowMap &&fm) {
 void Flow::FlowMap::Init(Model m, HoldInputMode hold_in) {
   assert(!valid);
   valid = true;
-  if (m == Model::ASYNCCOMMON)
+  if (m == Model::ASYNCCOMMON || m == Model::ASYNCLOCKFREE)
     set_output_behavior = &FlowMap::SetOutputToQueueBehavior;
   else
     set_output_behavior = &FlowMap::SetOutputBehavior;
@@ -596,7 +1006,13 @@ void Flow::FlowMap::SetOutputToQueueBehavior(
   cached_buffers.push_back(output);
 }
 
-Flow::Input::Input(Input &&in) {
+#define LOCKFREE_DEFAULT_CACHE_NUM 64
+// A blocked producer is woken by the consumer as soon as it pops a buffer.
+// The wait is sliced so that a flow disabled by SetDisable() is noticed
+// without a signal.
+#define INPUT_BLOCKING_WAIT_SLICE_MS 100
+
+Flow::Input::Input(Input &&in) : Input() {
   if (in.valid) {
     RKMEDIA_LOGI("Flow::Input is not copyable and moveable after inited\n");
     assert(0);
@@ -619,6 +1035,12 @@ void Flow::Input::Init(Flow *f, Model m, int mcn, InputMode im, bool f_block,
   case Model::ASYNCATOMIC:
     send_input_behavior = &Input::ASyncSendInputAtomicBehavior;
     break;
+  case Model::ASYNCLOCKFREE:
+    send_input_behavior = &Input::ASyncSendInputLockFreeBehavior;
+    // The ring is always bounded, max_cache_num <= 0 gets a default depth.
+    ring = std::make_shared<LockFreeQueue<TimedBuffer>>(
+        mcn > 0 ? mcn : LOCKFREE_DEFAULT_CACHE_NUM);
+    break;
   case Model::SYNC:
     send_input_behavior = &Input::SyncSendInputBehavior;
     coroutine = fc;
@@ -641,6 +1063,12 @@ void Flow::Input::Init(Flow *f, Model m, int mcn, InputMode im, bool f_block,
   }
 }
 
+size_t Flow::Input::CachedBufferSize() {
+  if (thread_model == Model::ASYNCLOCKFREE)
+    return ring->Size();
+  return cached_buffers.size();
+}
+
 bool Flow::SetAsSource(const std::vector<int> &output_slots, FunctionProcess f,
                        const std::string &mark) {
   source_start_cond_mtx = std::make_shared<ConditionLockMutex>();
@@ -704,20 +1132,20 @@ bool Flow::InstallSlotMap(SlotMap &map, const std::string &mark,
     return false;
   }
   c->Bind(in_slots, out_slots);
+  std::unique_lock<std::mutex> list_lock(g_flow_list_mtx);
   coroutines.push_back(c);
   if (!in_slots.empty()) {
     int max_idx = in_slots[in_slots.size() - 1];
     if ((int)v_input.size() <= max_idx)
       v_input.resize(max_idx + 1);
+    bool async_queue = (map.thread_model == Model::ASYNCCOMMON ||
+                        map.thread_model == Model::ASYNCLOCKFREE);
     for (size_t i = 0; i < in_slots.size(); i++) {
       v_input[in_slots[i]].Init(
           this, map.thread_model,
-          (map.thread_model == Model::ASYNCCOMMON) ? map.input_maxcachenum[i]
-                                                   : 0,
-          map.mode_when_full,
-          (map.thread_model == Model::ASYNCCOMMON && map.fetch_block.size() > i)
-              ? map.fetch_block[i]
-              : true,
+          async_queue ? map.input_maxcachenum[i] : 0, map.mode_when_full,
+          (async_queue && map.fetch_block.size() > i) ? map.fetch_block[i]
+                                                      : true,
           c);
       input_slot_num++;
     }
@@ -733,31 +1161,83 @@ bool Flow::InstallSlotMap(SlotMap &map, const std::string &mark,
       out_slot_num++;
     }
   }
+  if (std::find(g_flow_list.begin(), g_flow_list.end(), this) ==
+      g_flow_list.end())
+    g_flow_list.push_back(this);
+  list_lock.unlock();
 
   c->SetMarkName(mark);
   c->SetExpectProcessTime(exp_process_time);
+  c->SetMissPolicy(map.miss_policy);
+  if (UseTimerExecutor(map))
+    c->SetTimerExecutor();
+  if (UsePoolExecutor(map)) {
+    c->SetPoolExecutor(map.priority, map.cpu_affinity);
+    for (int i : in_slots)
+      v_input[i].pool_coroutine = c.get();
+  }
   c->Start();
+  if (!c->IsPooled()) {
+    for (int i : in_slots)
+      v_input[i].pool_coroutine = nullptr;
+  }
   return true;
 }
 
+bool Flow::UsePoolExecutor(const SlotMap &map) {
+  Executor e = map.executor;
+  if (e == Executor::DEFAULT) {
+    const char *env = getenv("RKMEDIA_FLOW_EXECUTOR");
+    e = env ? GetExecutorByString(env) : Executor::THREAD;
+  }
+  if (e != Executor::POOL)
+    return false;
+  if (map.thread_model != Model::ASYNCCOMMON &&
+      map.thread_model != Model::ASYNCLOCKFREE)
+    return false;
+  // A blocked producer would hold a pool worker while waiting for the
+  // consumer, which may need that very worker to run.
+  if (map.mode_when_full == InputMode::BLOCKING) {
+    RKMEDIA_LOGW("Flow[%s]: blocking input can not run on the pool\n",
+                 GetFlowTag());
+    return false;
+  }
+  return true;
+}
+
+bool Flow::UseTimerExecutor(const SlotMap &map) {
+  if (map.thread_model != Model::ASYNCATOMIC)
+    return false;
+  Executor e = map.executor;
+  if (e == Executor::DEFAULT) {
+    const char *env = getenv("RKMEDIA_FLOW_EXECUTOR");
+    e = env ? GetExecutorByString(env) : Executor::THREAD;
+  }
+  return e == Executor::TIMER;
+}
+
 void Flow::FlowMap::AddFlow(std::shared_ptr<Flow> flow, int index) {
   AutoLockMutex _lg(list_mtx);
+  auto new_flows = std::make_shared<FlowList>(*flows);
 
   // Same down flow and same index is not allowed
-  auto i = std::find(flows.begin(), flows.end(), flow);
-  if ((i != flows.end()) && (i->index_of_in == index)) {
+  auto i = std::find(new_flows->begin(), new_flows->end(), flow);
+  if ((i != new_flows->end()) && (i->index_of_in == index)) {
     RKMEDIA_LOGI("repeatedly add, update index\n");
-    i->index_of_in = index;
     return;
   }
 
   // TODO: sort by sync type in downflow
-  flows.emplace_back(flow, index);
+  new_flows->emplace_back(flow, index);
+  std::atomic_store(&flows, std::shared_ptr<const FlowList>(new_flows));
 }
 
 void Flow::FlowMap::RemoveFlow(std::shared_ptr<Flow> flow) {
   AutoLockMutex _lg(list_mtx);
-  flows.remove_if([&flow](FlowInputMap &fm) { return fm == flow; });
+  auto new_flows = std::make_shared<FlowList>(*flows);
+  new_flows->erase(std::remove(new_flows->begin(), new_flows->end(), flow),
+                   new_flows->end());
+  std::atomic_store(&flows, std::shared_ptr<const FlowList>(new_flows));
 }
 
 bool Flow::AddDownFlow(std::shared_ptr<Flow> down, int out_slot_index,
@@ -834,6 +1314,8 @@ void Flow::SendInput(std::shared_ptr<MediaBuffer> &input, int in_slot_index) {
     }
 
     auto &in = v_input[in_slot_index];
+    if (input)
+      in.enqueue_cnt.fetch_add(1, std::memory_order_relaxed);
 #ifdef RKMEDIA_TIMESTAMP_DEBUG
     if (input) {
       std::string node_name = std::string(GetFlowTag()) + ":SendInput";
@@ -844,6 +1326,33 @@ void Flow::SendInput(std::shared_ptr<MediaBuffer> &input, int in_slot_index) {
   }
 }
 
+void Flow::SendInputBatch(MediaBufferVector &inputs, int in_slot_index) {
+  if (in_slot_index < 0 || in_slot_index >= input_slot_num) {
+    errno = EINVAL;
+    RKMEDIA_LOGE("Input slot[%d] is vaild!\n", in_slot_index);
+    return;
+  }
+  // fps control decides buffer by buffer
+  if (fps_out == 0 || (fps_in > 0 && fps_out > 0)) {
+    for (auto &input : inputs)
+      SendInput(input, in_slot_index);
+    return;
+  }
+  if (!enable)
+    return;
+  auto &in = v_input[in_slot_index];
+  for (auto &input : inputs) {
+    if (!input)
+      continue;
+    in.enqueue_cnt.fetch_add(1, std::memory_order_relaxed);
+#ifdef RKMEDIA_TIMESTAMP_DEBUG
+    std::string node_name = std::string(GetFlowTag()) + ":SendInput";
+    input->TimeStampRecord(node_name, gettimeofday());
+#endif // RKMEDIA_TIMESTAMP_DEBUG
+  }
+  in.SendBatch(inputs);
+}
+
 bool Flow::SetOutput(const std::shared_ptr<MediaBuffer> &output,
                      int out_slot_index) {
   if (out_slot_index < 0 || out_slot_index >= out_slot_num) {
@@ -859,6 +1368,8 @@ bool Flow::SetOutput(const std::shared_ptr<MediaBuffer> &output,
 
   if (out_callback_ && output)
     out_callback_(out_handler_, output);
+  if (output)
+    output_cnt.fetch_add(1, std::memory_order_relaxed);
 
   if (enable) {
     auto &out = downflowmap[out_slot_index];
@@ -941,18 +1452,118 @@ void Flow::Input::SyncSendInputBehavior(std::shared_ptr<MediaBuffer> &input) {
 void Flow::Input::ASyncSendInputCommonBehavior(
     std::shared_ptr<MediaBuffer> &input) {
   mtx.lock();
+  bool pushed = ASyncPushCommon(input, gettimeofday());
+  mtx.unlock();
+  if (pushed)
+    ASyncWakeup();
+}
+
+// Called with mtx locked.
+bool Flow::Input::ASyncPushCommon(std::shared_ptr<MediaBuffer> &input,
+                                  int64_t ts) {
   if (max_cache_num > 0 && max_cache_num <= (int)cached_buffers.size()) {
     bool ret = (this->*async_full_behavior)(flow->enable);
-    if (!ret) {
-      mtx.unlock();
-      return;
-    }
+    if (!ret)
+      return false;
   }
   cached_buffers.push_back(input);
-  mtx.unlock();
-  AutoLockMutex _alm(flow->cond_mtx);
-  flow->cond_mtx.notify();
-  pthread_yield();
+  cached_ts.push_back(ts);
+  return true;
+}
+
+void Flow::Input::ASyncWakeup() {
+  if (pool_coroutine) {
+    pool_coroutine->Schedule();
+  } else if (thread_model == Model::ASYNCLOCKFREE) {
+    flow->input_event.Notify();
+  } else {
+    AutoLockMutex _alm(flow->cond_mtx);
+    flow->cond_mtx.notify();
+    pthread_yield();
+  }
+}
+
+void Flow::Input::ASyncSendInputLockFreeBehavior(
+    std::shared_ptr<MediaBuffer> &input) {
+  if (ASyncPushLockFree(input, gettimeofday()))
+    ASyncWakeup();
+}
+
+bool Flow::Input::ASyncPushLockFree(std::shared_ptr<MediaBuffer> &input,
+                                    int64_t ts) {
+  size_t limit = max_cache_num > 0 ? max_cache_num : ring->Capacity();
+  int64_t block_start = 0;
+  TimedBuffer tb(input, ts);
+  while (ring->Size() >= limit || !ring->TryPush(tb)) {
+    if (mode_when_full == InputMode::DROPCURRENT) {
+      RKMEDIA_LOGW("Flow[%s]: Input: drop current buffer!\n",
+                   flow ? flow->GetFlowTag() : "Name Is Null");
+      drop_cnt++;
+      return false;
+    } else if (mode_when_full == InputMode::BLOCKING) {
+      if (!block_start)
+        block_start = gettimeofday();
+      uint32_t key = space_event.PrepareWait();
+      if (ring->Size() < limit || !flow->enable)
+        space_event.CancelWait();
+      else
+        space_event.Wait(key, INPUT_BLOCKING_WAIT_SLICE_MS);
+      if (!flow->enable)
+        break;
+    } else {
+      TimedBuffer drop;
+      RKMEDIA_LOGW("Flow[%s]: Input: drop front buffer!\n",
+                   flow ? flow->GetFlowTag() : "Name is null");
+      if (ring->TryPop(drop))
+        drop_cnt++;
+    }
+  }
+  if (block_start) {
+    blocked_time += gettimeofday() - block_start;
+    blocked_cnt++;
+  }
+  return flow->enable;
+}
+
+void Flow::Input::SendBatch(MediaBufferVector &inputs) {
+  int64_t ts = gettimeofday();
+  int pending = 0;
+  if (thread_model == Model::ASYNCCOMMON) {
+    mtx.lock();
+    for (auto &input : inputs) {
+      // The coroutine must see what is queued before we block on it.
+      if (pending && mode_when_full == InputMode::BLOCKING &&
+          max_cache_num > 0 && max_cache_num <= (int)cached_buffers.size()) {
+        mtx.unlock();
+        ASyncWakeup();
+        pending = 0;
+        mtx.lock();
+      }
+      if (ASyncPushCommon(input, ts))
+        pending++;
+    }
+    mtx.unlock();
+  } else if (thread_model == Model::ASYNCLOCKFREE) {
+    size_t limit = max_cache_num > 0 ? max_cache_num : ring->Capacity();
+    for (auto &input : inputs) {
+      if (pending && mode_when_full == InputMode::BLOCKING &&
+          ring->Size() >= limit) {
+        ASyncWakeup();
+        pending = 0;
+      }
+      if (ASyncPushLockFree(input, ts))
+        pending++;
+    }
+  } else if (thread_model == Model::ASYNCATOMIC) {
+    // only the latest one is seen by the coroutine
+    if (!inputs.empty())
+      ASyncSendInputAtomicBehavior(inputs.back());
+  } else {
+    for (auto &input : inputs)
+      CALL_MEMBER_FN(*this, send_input_behavior)(input);
+  }
+  if (pending)
+    ASyncWakeup();
 }
 
 void Flow::Input::ASyncSendInputAtomicBehavior(
@@ -962,22 +1573,16 @@ void Flow::Input::ASyncSendInputAtomicBehavior(
 }
 
 bool Flow::Input::ASyncFullBlockingBehavior(volatile bool &pred) {
-#ifndef NDEBUG
   AutoDuration ad;
-#endif
-  do {
-    mtx.unlock();
-    msleep(5);
-    if (max_cache_num > (int)cached_buffers.size()) {
-      mtx.lock();
-      break;
-    }
-    mtx.lock();
-  } while (pred);
+  while (pred && max_cache_num <= (int)cached_buffers.size())
+    mtx.wait_for(INPUT_BLOCKING_WAIT_SLICE_MS);
+  int64_t cost = ad.Get();
+  blocked_time += cost;
+  blocked_cnt++;
 #ifndef NDEBUG
-  if (ad.Get() > 100000 /*ms*/)
-    RKMEDIA_LOGW("Flow[%s]: Input[block mode]: block too long(%.2fms) > 5ms\n",
-                 flow ? flow->GetFlowTag() : "Name is null", ad.Get() / 1000.0);
+  if (cost > 100000 /*us*/)
+    RKMEDIA_LOGW("Flow[%s]: Input[block mode]: block too long(%.2fms)\n",
+                 flow ? flow->GetFlowTag() : "Name is null", cost / 1000.0);
 #endif
   return pred;
 }
@@ -986,12 +1591,15 @@ bool Flow::Input::ASyncFullDropFrontBehavior(volatile bool &pred _UNUSED) {
   RKMEDIA_LOGW("Flow[%s]: Input: drop front buffer!\n",
                flow ? flow->GetFlowTag() : "Name is null");
   cached_buffers.pop_front();
+  cached_ts.pop_front();
+  drop_cnt++;
   return true;
 }
 
 bool Flow::Input::ASyncFullDropCurrentBehavior(volatile bool &pred _UNUSED) {
   RKMEDIA_LOGW("Flow[%s]: Input: drop current buffer!\n",
                flow ? flow->GetFlowTag() : "Name Is Null");
+  drop_cnt++;
   return false;
 }
 
@@ -1009,13 +1617,30 @@ Model GetModelByString(const std::string &model) {
   static std::map<std::string, Model> model_map = {
       {KEY_ASYNCCOMMON, Model::ASYNCCOMMON},
       {KEY_ASYNCATOMIC, Model::ASYNCATOMIC},
-      {KEY_SYNC, Model::SYNC}};
+      {KEY_SYNC, Model::SYNC},
+      {KEY_ASYNCLOCKFREE, Model::ASYNCLOCKFREE}};
   auto it = model_map.find(model);
   if (it != model_map.end())
     return it->second;
   return Model::NONE;
 }
 
+Executor GetExecutorByString(const std::string &executor) {
+  if (executor == KEY_EXECUTOR_POOL)
+    return Executor::POOL;
+  if (executor == KEY_EXECUTOR_THREAD)
+    return Executor::THREAD;
+  if (executor == KEY_EXECUTOR_TIMER)
+    return Executor::TIMER;
+  return Executor::DEFAULT;
+}
+
+MissPolicy GetMissPolicyByString(const std::string &policy) {
+  if (policy == KEY_MISS_CATCHUP)
+    return MissPolicy::CATCHUP;
+  return MissPolicy::SKIP;
+}
+
 InputMode GetInputModelByString(const std::string &in_model) {
   static std::map<std::string, InputMode> in_model_map = {
       {KEY_BLOCKING, InputMode::BLOCKING},
@@ -1038,6 +1663,10 @@ void ParseParamToSlotMap(std::map<std::string, std::string> &params,
   }
   sm.thread_model = GetModelByString(params[KEK_THREAD_SYNC_MODEL]);
   sm.mode_when_full = GetInputModelByString(params[KEK_INPUT_MODEL]);
+  sm.executor = GetExecutorByString(params[KEY_FLOW_EXECUTOR]);
+  sm.miss_policy = GetMissPolicyByString(params[KEY_FLOW_MISS_POLICY]);
+  GET_STRING_TO_INT(sm.priority, params, KEY_FLOW_PRIORITY, 0)
+  GET_STRING_TO_INT(sm.cpu_affinity, params, KEY_FLOW_CPU_AFFINITY, -1)
   std::string &cache_num_str = params[KEY_INPUT_CACHE_NUM];
   int cache_num = -1;
   if (!cache_num_str.empty()) {
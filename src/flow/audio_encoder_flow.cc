@@ -32,6 +32,8 @@ public:
 private:
   std::shared_ptr<AudioEncoder> enc;
   int input_size;
+  // fed after the last frame to flush the encoder, allocated once
+  std::shared_ptr<MediaBuffer> null_buffer;
 
   friend bool encode(Flow *f, MediaBufferVector &input_vector);
 };
@@ -78,11 +80,10 @@ bool encode(Flow *f, MediaBufferVector &input_vector) {
   }
 
   if (feed_null) {
-    auto null_buffer = MediaBuffer::Alloc(1, MediaBuffer::MemType::MEM_COMMON);
-    if (!null_buffer)
+    if (!af->null_buffer)
       LOG_NO_MEMORY();
     else
-      enc->SendInput(null_buffer);
+      enc->SendInput(af->null_buffer);
   }
 
   while (ret >= 0) {
@@ -163,6 +164,7 @@ AudioEncoderFlow::AudioEncoderFlow(const char *param) {
 
   enc = encoder;
   input_size = enc->GetNbSamples() * GetSampleSize(mc.aud_cfg.sample_info);
+  null_buffer = MediaBuffer::Alloc(1, MediaBuffer::MemType::MEM_COMMON);
 
   SlotMap sm;
   sm.input_slots.push_back(0);
@@ -4,6 +4,8 @@
 
 #include <assert.h>
 
+#include <mutex>
+
 #include "buffer.h"
 #include "filter.h"
 #include "flow.h"
@@ -20,6 +22,10 @@ public:
   virtual ~FilterFlow() {
     AutoPrintLine apl(__func__);
     StopAllThread();
+    // DumpStats may be running on another thread, it reports nothing once
+    // this is set, before the members it reads are destroyed.
+    std::lock_guard<std::mutex> _lg(damage_mtx);
+    damage_tracking = false;
   }
   static const char *GetFlowName() { return "filter"; }
   virtual int Control(unsigned long int request, ...) final {
@@ -36,30 +42,30 @@ public:
       case G_RGA_REGION_LUMA: {
         ImageRegionLuma *p = (ImageRegionLuma *)arg;
         if (p->priv == i)
-          ret |= filter->IoCtrl(request, arg);
+          ret |= FilterIoCtrl(filter, i, request, arg);
         break;
       }
       case S_RGA_OSD_INFO: {
         ImageOsd *osd = (ImageOsd *)arg;
         if (osd->priv == i)
-          ret |= filter->IoCtrl(request, arg);
+          ret |= FilterIoCtrl(filter, i, request, arg);
         break;
       }
       case S_RGA_SHOW:
       case S_RGA_HIDE: {
         int *chn = (int *)arg;
         if (*chn == i)
-          ret |= filter->IoCtrl(request, arg);
+          ret |= FilterIoCtrl(filter, i, request, arg);
         break;
       }
       case S_RGA_LINE_INFO: {
         ImageBorder *line = (ImageBorder *)arg;
         if (line->priv == i)
-          ret |= filter->IoCtrl(request, arg);
+          ret |= FilterIoCtrl(filter, i, request, arg);
         break;
       }
       default:
-        ret |= filter->IoCtrl(request, arg);
+        ret |= FilterIoCtrl(filter, i, request, arg);
         break;
       }
       i++;
@@ -67,7 +73,29 @@ public:
     return ret;
   }
 
+protected:
+  virtual void DumpPrivateStats(std::string &json) override;
+
 private:
+  // A control may change how a channel is drawn, so it is redrawn on the
+  // next tick. Marked before as well for the requests that wait for a tick,
+  // such as G_RGA_REGION_LUMA.
+  int FilterIoCtrl(std::shared_ptr<Filter> &filter, int i,
+                   unsigned long int request, void *arg) {
+    MarkDirty(i);
+    int ret = filter->IoCtrl(request, arg);
+    MarkDirty(i);
+    return ret;
+  }
+  void MarkDirty(int i);
+  bool FindDamage(const MediaBufferVector &input_vector,
+                  std::vector<bool> &redraw);
+  bool CopyForward(std::shared_ptr<MediaBuffer> &out_buffer);
+  void CommitDamage(const MediaBufferVector &input_vector,
+                    const std::vector<bool> &redraw,
+                    std::shared_ptr<MediaBuffer> &out_buffer);
+  void ResetDamage();
+
   std::vector<std::shared_ptr<Filter>> filters;
   bool support_async;
   Model thread_model;
@@ -75,12 +103,32 @@ private:
   ImageInfo out_img_info;
   std::shared_ptr<BufferPool> buffer_pool;
 
+  // Damage tracking of a mix of several inputs into one image: the previous
+  // output is copied forward and only the channels whose input changed are
+  // drawn again, a tick without any change outputs nothing.
+  struct Tile {
+    std::weak_ptr<MediaBuffer> last_in;
+    int64_t last_ts;
+    bool dirty;
+    uint64_t redraw_cnt;
+    uint64_t skip_cnt;
+  };
+  bool damage_tracking;
+  std::shared_ptr<MediaBuffer> last_out;
+  std::mutex damage_mtx; // Control and DumpStats come from other threads
+  std::vector<Tile> tiles;
+  uint64_t composed_cnt;
+  uint64_t unchanged_cnt;
+  uint64_t full_cnt;
+  int64_t copy_us;
+
   friend bool do_filters(Flow *f, MediaBufferVector &input_vector);
 };
 
 FilterFlow::FilterFlow(const char *param)
     : support_async(true), thread_model(Model::NONE),
-      input_pix_fmt(PIX_FMT_NONE) {
+      input_pix_fmt(PIX_FMT_NONE), damage_tracking(false), composed_cnt(0),
+      unchanged_cnt(0), full_cnt(0), copy_us(0) {
   memset(&out_img_info, 0, sizeof(out_img_info));
   out_img_info.pix_fmt = PIX_FMT_NONE;
   std::list<std::string> separate_list;
@@ -170,6 +218,18 @@ FilterFlow::FilterFlow(const char *param)
 
       buffer_pool = std::make_shared<BufferPool>(m_cnt, m_size, m_type);
     }
+    // A periodic mix re-reads the inputs it has already drawn on every tick.
+    if (thread_model == Model::ASYNCATOMIC && filters.size() > 1 &&
+        out_img_info.pix_fmt != PIX_FMT_NONE && out_img_info.vir_width > 0 &&
+        out_img_info.vir_height > 0) {
+      Tile tile;
+      tile.last_ts = 0;
+      tile.dirty = true;
+      tile.redraw_cnt = 0;
+      tile.skip_cnt = 0;
+      tiles.assign(filters.size(), tile);
+      damage_tracking = true;
+    }
   } else {
     // support async mode (one input, multi output)
     support_async = true;
@@ -177,7 +237,112 @@ FilterFlow::FilterFlow(const char *param)
   }
 }
 
-// comparing timestamp as modification?
+void FilterFlow::MarkDirty(int i) {
+  std::lock_guard<std::mutex> _lg(damage_mtx);
+  if (damage_tracking)
+    tiles[i].dirty = true;
+}
+
+// Sets redraw for the inputs which are not what their tile shows: another
+// buffer, or the same one with a new timestamp. Returns false if there is
+// nothing to draw.
+bool FilterFlow::FindDamage(const MediaBufferVector &input_vector,
+                            std::vector<bool> &redraw) {
+  bool damaged = false;
+  std::lock_guard<std::mutex> _lg(damage_mtx);
+  redraw.assign(input_vector.size(), false);
+  for (size_t i = 0; i < input_vector.size(); i++) {
+    auto &in = input_vector[i];
+    auto &tile = tiles[i];
+    if (!in)
+      continue;
+    bool same = !tile.last_in.owner_before(in) &&
+                !in.owner_before(tile.last_in) &&
+                tile.last_ts == in->GetUSTimeStamp();
+    if (!last_out || tile.dirty || !same) {
+      // a control from now on marks it again for the next tick
+      tile.dirty = false;
+      redraw[i] = true;
+      damaged = true;
+    }
+  }
+  if (!damaged)
+    unchanged_cnt++;
+  return damaged;
+}
+
+// Starts out_buffer as a copy of the previous output. Returns false if there
+// is none, then every channel is drawn.
+bool FilterFlow::CopyForward(std::shared_ptr<MediaBuffer> &out_buffer) {
+  if (!last_out)
+    return false;
+  size_t size = last_out->GetValidSize();
+  if (!out_buffer->GetPtr() || !last_out->GetPtr() || !size ||
+      size > out_buffer->GetSize())
+    return false;
+  AutoDuration ad;
+  last_out->BeginCPUAccess(true);
+  out_buffer->BeginCPUAccess(false);
+  memcpy(out_buffer->GetPtr(), last_out->GetPtr(), size);
+  out_buffer->EndCPUAccess(false);
+  last_out->EndCPUAccess(true);
+  out_buffer->SetValidSize(size);
+  // the filters only ever move the timestamp forward
+  out_buffer->SetUSTimeStamp(last_out->GetUSTimeStamp());
+  std::lock_guard<std::mutex> _lg(damage_mtx);
+  copy_us += ad.Get();
+  return true;
+}
+
+void FilterFlow::CommitDamage(const MediaBufferVector &input_vector,
+                              const std::vector<bool> &redraw,
+                              std::shared_ptr<MediaBuffer> &out_buffer) {
+  std::lock_guard<std::mutex> _lg(damage_mtx);
+  bool full = true;
+  for (size_t i = 0; i < input_vector.size(); i++) {
+    auto &tile = tiles[i];
+    if (!redraw[i]) {
+      if (input_vector[i]) {
+        tile.skip_cnt++;
+        full = false;
+      }
+      continue;
+    }
+    tile.last_in = input_vector[i];
+    tile.last_ts = input_vector[i]->GetUSTimeStamp();
+    tile.redraw_cnt++;
+  }
+  if (full)
+    full_cnt++;
+  composed_cnt++;
+  last_out = out_buffer;
+}
+
+void FilterFlow::ResetDamage() {
+  std::lock_guard<std::mutex> _lg(damage_mtx);
+  last_out.reset();
+}
+
+void FilterFlow::DumpPrivateStats(std::string &json) {
+  char str[128];
+  std::lock_guard<std::mutex> _lg(damage_mtx);
+  if (!damage_tracking)
+    return;
+  snprintf(str, sizeof(str),
+           ",\"damage\":{\"composed\":%llu,\"full\":%llu,\"unchanged\":%llu,"
+           "\"copy_us\":%lld,\"tiles\":[",
+           (unsigned long long)composed_cnt, (unsigned long long)full_cnt,
+           (unsigned long long)unchanged_cnt, (long long)copy_us);
+  json.append(str);
+  for (size_t i = 0; i < tiles.size(); i++) {
+    snprintf(str, sizeof(str), "%s{\"chn\":%zu,\"redraw\":%llu,\"skip\":%llu}",
+             i ? "," : "", i, (unsigned long long)tiles[i].redraw_cnt,
+             (unsigned long long)tiles[i].skip_cnt);
+    json.append(str);
+  }
+  json.append("]}");
+}
+
 bool do_filters(Flow *f, MediaBufferVector &input_vector) {
   FilterFlow *flow = static_cast<FilterFlow *>(f);
   int i = 0;
@@ -192,6 +357,9 @@ bool do_filters(Flow *f, MediaBufferVector &input_vector) {
   }
   if (!has_valid_input)
     return false;
+  std::vector<bool> redraw;
+  if (flow->damage_tracking && !flow->FindDamage(input_vector, redraw))
+    return false;
   std::shared_ptr<MediaBuffer> out_buffer;
   if (!flow->support_async) {
     const auto &info = flow->out_img_info;
@@ -201,6 +369,11 @@ bool do_filters(Flow *f, MediaBufferVector &input_vector) {
       if (info.vir_width > 0 && info.vir_height > 0) {
         if (flow->buffer_pool) {
           auto mb = flow->buffer_pool->GetBuffer(false);
+          if (!mb && flow->last_out) {
+            // the previous output may hold the last buffer of the pool
+            flow->ResetDamage();
+            mb = flow->buffer_pool->GetBuffer(false);
+          }
           if (!mb) {
             RKMEDIA_LOGE("%s: buffer_pool get null buffer!\n",
                          flow->GetFlowTag());
@@ -223,9 +396,13 @@ bool do_filters(Flow *f, MediaBufferVector &input_vector) {
       }
     }
   }
+  if (flow->damage_tracking && !flow->CopyForward(out_buffer)) {
+    for (size_t j = 0; j < input_vector.size(); j++)
+      redraw[j] = (input_vector[j] != nullptr);
+  }
   for (auto &filter : flow->filters) {
     auto &in = input_vector[i];
-    if (!in) {
+    if (!in || (flow->damage_tracking && !redraw[i])) {
       i++;
       continue;
     }
@@ -253,8 +430,11 @@ bool do_filters(Flow *f, MediaBufferVector &input_vector) {
       if (ret == -EAGAIN)
         flow->SendInput(in, i);
     } else {
-      if (filter->Process(in, out_buffer))
+      if (filter->Process(in, out_buffer)) {
+        if (flow->damage_tracking)
+          flow->ResetDamage();
         return false;
+      }
 #ifdef RKMEDIA_TIMESTAMP_DEBUG
       // Pass TsNodeInfo to new buffer.
       if (in && out_buffer)
@@ -265,6 +445,8 @@ bool do_filters(Flow *f, MediaBufferVector &input_vector) {
   }
   bool ret = false;
   if (!flow->support_async) {
+    if (flow->damage_tracking)
+      flow->CommitDamage(input_vector, redraw, out_buffer);
     ret = flow->SetOutput(out_buffer, 0);
   } else {
     // flow->thread_model == Model::SYNC;
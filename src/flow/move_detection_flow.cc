@@ -2,11 +2,9 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 #include <assert.h>
-#include <chrono>             // std::chrono::seconds
-#include <condition_variable> // std::condition_variable, std::cv_status
+#include <inttypes.h>
 #include <math.h>
 #include <mutex> // std::mutex, std::unique_lock
-#include <inttypes.h>
 
 #include <move_detect/move_detection.h>
 
@@ -25,6 +23,9 @@
 
 /* Upper limit of the result stored in the list */
 #define MD_RESULT_MAX_CNT 10
+/* The time stamps of images acquired by multiple image acquisition
+ * channels at the same time cannot exceed 1 ms. */
+#define MD_RESULT_CLOCK_DELTA 1000
 
 enum {
   MD_UPDATE_NONE = 0x00,
@@ -225,62 +226,27 @@ bool md_process(Flow *f, MediaBufferVector &input_vector) {
 
 std::shared_ptr<MediaBuffer>
 MoveDetectionFlow::LookForMdResult(int64_t atomic_clock, int timeout_us) {
-  std::shared_ptr<MediaBuffer> right_result = NULL;
-  std::shared_ptr<MediaBuffer> last_restult = NULL;
-  int clk_delta = 0;
-  int clk_delta_min = 0;
-  int64_t start_ts = gettimeofday();
-  int left_time = 0;
+  int64_t clk_delta = 0;
 #ifndef NDBUEG
   AutoDuration ad;
 #endif
 
   RKMEDIA_LOGD("#LookForMdResult, target:%.1f, timeout:%.1f\n",
                atomic_clock / 1000.0, timeout_us / 1000.0);
-  do {
-    // Step1: Lookfor mdinfo first.
-    md_results_mtx.lock();
-    for (auto &tmp : md_results) {
-      clk_delta = abs(atomic_clock - tmp->GetAtomicClock());
-      RKMEDIA_LOGD("...Compare vs :%.1f\n", tmp->GetAtomicClock() / 1000.0);
-      // The time stamps of images acquired by multiple image
-      // acquisition channels at the same time cannot exceed 1 ms.
-      if (clk_delta <= 1000) {
-        RKMEDIA_LOGD(">>> MD get right result\n");
-        right_result = tmp;
-        break;
-      }
-      // Find the closest value.
-      if ((!clk_delta_min || (clk_delta <= clk_delta_min))) {
-        clk_delta_min = clk_delta;
-        last_restult = tmp;
-      }
-    }
-    md_results_mtx.unlock();
-
-    // Step2: wait for new mdinfo, then lookup again.
-    // If no new mdinfo is received within the remaining time,
-    // timeout processing: directly use the closest mdinfo as
-    // the result.
-    left_time = timeout_us - (gettimeofday() - start_ts);
-    if ((md_results.size() > 0) && !right_result && (left_time > 0)) {
-      std::unique_lock<std::mutex> lck(md_results_mtx);
-      if (con_var.wait_for(lck, std::chrono::microseconds(left_time)) ==
-          std::cv_status::timeout) {
-        RKMEDIA_LOGW("MD get closest result, deltaTime=%.1fms.\n",
-                     clk_delta_min / 1000.0);
-        right_result = last_restult;
-        break; // stop while
-      }
-#ifndef NDEBUG
-      else {
-        RKMEDIA_LOGD("#RetryLookForMdResult target:%.1f\n",
-                     atomic_clock / 1000.0);
-      }
-#endif
-    } else
-      break; // stop while
-  } while (1);
+  // Wait for the result of this frame, or of a later one, after which no
+  // new result can be closer. If none comes within timeout_us, use the
+  // closest one.
+  md_results.WaitFor(atomic_clock, MD_RESULT_CLOCK_DELTA, timeout_us);
+  auto right_result =
+      md_results.Find(atomic_clock, MD_RESULT_CLOCK_DELTA, &clk_delta);
+  if (right_result) {
+    RKMEDIA_LOGD(">>> MD get right result\n");
+  } else {
+    right_result = md_results.Find(atomic_clock, INT64_MAX, &clk_delta);
+    if (right_result)
+      RKMEDIA_LOGW("MD get closest result, deltaTime=%.1fms.\n",
+                   clk_delta / 1000.0);
+  }
 
 #ifndef NDBUEG
   RKMEDIA_LOGD("#%s cost:%dms\n", __func__, (int)(ad.Get() / 1000));
@@ -290,16 +256,11 @@ MoveDetectionFlow::LookForMdResult(int64_t atomic_clock, int timeout_us) {
 }
 
 void MoveDetectionFlow::InsertMdResult(std::shared_ptr<MediaBuffer> &buffer) {
-  md_results_mtx.lock();
-  while (md_results.size() > MD_RESULT_MAX_CNT)
-    md_results.pop_front();
-
-  md_results.push_back(buffer);
-  md_results_mtx.unlock();
-  con_var.notify_all();
+  md_results.Push(buffer->GetAtomicClock(), buffer);
 }
 
-MoveDetectionFlow::MoveDetectionFlow(const char *param) {
+MoveDetectionFlow::MoveDetectionFlow(const char *param)
+    : md_results(MD_RESULT_MAX_CNT) {
   md_ctx = NULL;
   std::list<std::string> separate_list;
   std::map<std::string, std::string> params;
@@ -441,9 +402,7 @@ MoveDetectionFlow::~MoveDetectionFlow() {
   if (roi_in)
     free(roi_in);
 
-  std::list<std::shared_ptr<MediaBuffer>>::iterator it;
-  for (it = md_results.begin(); it != md_results.end();)
-    it = md_results.erase(it);
+  md_results.Clear();
 }
 
 int MoveDetectionFlow::Control(unsigned long int request, ...) {
@@ -14,6 +14,7 @@
 
 #include "buffer.h"
 #include "media_type.h"
+#include "side_data_ring.h"
 
 namespace easymedia {
 
@@ -44,9 +45,7 @@ private:
   // orignal width, orignal height
   int ori_width, ori_height;
   int ds_width, ds_height;
-  std::mutex md_results_mtx;
-  std::condition_variable con_var;
-  std::list<std::shared_ptr<MediaBuffer>> md_results;
+  SideDataRing<MediaBuffer> md_results;
   friend bool md_process(Flow *f, MediaBufferVector &input_vector);
 };
 
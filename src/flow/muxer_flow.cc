@@ -2,7 +2,10 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <errno.h>
 #include <inttypes.h>
+#include <string.h>
+#include <sys/prctl.h>
 #include <sys/time.h>
 
 #include "buffer.h"
@@ -54,7 +57,11 @@ static int muxer_buffer_callback(void *handler, uint8_t *buf, int buf_size) {
 MuxerFlow::MuxerFlow(const char *param)
     : video_recorder(nullptr), video_in(false), audio_in(false),
       file_duration(-1), file_index(-1), last_ts(0), file_time_en(false),
-      enable_streaming(true), file_name_cb(nullptr), file_name_handle(nullptr) {
+      enable_streaming(true), file_name_cb(nullptr), file_name_handle(nullptr),
+      write_queue_max(0), write_thread(nullptr), write_queue_full(0),
+      write_quit(false), segment_open(false), preopen_failed(false),
+      pre_record_us(0), pre_record_max_size(8 << 20), pre_record_size(0),
+      pre_record_vid_ts(0), pre_record_aud_ts(0) {
   std::list<std::string> separate_list;
   std::map<std::string, std::string> params;
 
@@ -117,7 +124,24 @@ MuxerFlow::MuxerFlow(const char *param)
     else
       enable_streaming = true;
   }
-  RKMEDIA_LOGI("Muxer:: enable_streaming is %d\n", enable_streaming);
+  RKMEDIA_LOGI("Muxer:: enable_streaming is %d\n", enable_streaming.load());
+
+  std::string write_queue_s = params[KEY_MUXER_WRITE_QUEUE];
+  if (!write_queue_s.empty() && std::stoi(write_queue_s) > 0) {
+    write_queue_max = std::stoi(write_queue_s);
+    RKMEDIA_LOGI("Muxer:: write behind with %d packets queue\n",
+                 (int)write_queue_max);
+  }
+
+  std::string pre_record_s = params[KEY_MUXER_PRE_RECORD_TIME];
+  if (!pre_record_s.empty() && std::stoi(pre_record_s) > 0) {
+    pre_record_us = std::stoll(pre_record_s) * 1000000;
+    std::string &size_s = params[KEY_MUXER_PRE_RECORD_SIZE];
+    if (!size_s.empty() && std::stoll(size_s) > 0)
+      pre_record_max_size = std::stoll(size_s);
+    RKMEDIA_LOGI("Muxer:: pre-record %s sec, at most %d bytes\n",
+                 pre_record_s.c_str(), (int)pre_record_max_size);
+  }
 
   ffmpeg_avdictionary = params[KEY_MUXER_FFMPEG_AVDICTIONARY];
 
@@ -166,11 +190,25 @@ MuxerFlow::MuxerFlow(const char *param)
     return;
   }
   SetFlowTag("MuxerFlow");
+
+  if (write_queue_max > 0)
+    write_thread = new std::thread(&MuxerFlow::WriteThreadRun, this);
 }
 
-MuxerFlow::~MuxerFlow() { StopAllThread(); }
+MuxerFlow::~MuxerFlow() {
+  StopAllThread();
+  if (write_thread) {
+    write_mtx.lock();
+    write_quit = true;
+    write_cond.notify_one();
+    write_mtx.unlock();
+    write_thread->join();
+    delete write_thread;
+  }
+}
 
-std::shared_ptr<VideoRecorder> MuxerFlow::NewRecorder(const char *path) {
+std::shared_ptr<VideoRecorder> MuxerFlow::NewRecorder(const char *path,
+                                                      bool start) {
   std::string param = std::string(muxer_param);
   std::shared_ptr<VideoRecorder> vrecorder = nullptr;
   PARAM_STRING_APPEND(param, KEY_OUTPUTDATATYPE, output_format.c_str());
@@ -191,6 +229,8 @@ std::shared_ptr<VideoRecorder> MuxerFlow::NewRecorder(const char *path) {
   } else {
     RKMEDIA_LOGI("Ready to recod new video file path:[%s]\n", path);
   }
+  if (start)
+    vrecorder->Start();
 
   return vrecorder;
 }
@@ -309,8 +349,293 @@ void MuxerFlow::StopStream() {
   enable_streaming = false;
 }
 
+void MuxerFlow::UpdateVideoExtra(std::shared_ptr<MediaBuffer> &vid_buffer) {
+  if (video_extra || !(vid_buffer->GetUserFlag() & MediaBuffer::kIntra))
+    return;
+  CodecType c_type = vid_enc_config.vid_cfg.image_cfg.codec_type;
+  int extra_size = 0;
+  void *extra_ptr = NULL;
+  if (c_type == CODEC_TYPE_H264)
+    extra_ptr = GetSpsPpsFromBuffer(vid_buffer, extra_size, c_type);
+  else if (c_type == CODEC_TYPE_H265)
+    extra_ptr = GetVpsSpsPpsFromBuffer(vid_buffer, extra_size, c_type);
+
+  if (extra_ptr && (extra_size > 0)) {
+    video_extra = MediaBuffer::Alloc(extra_size);
+    if (!video_extra) {
+      LOG_NO_MEMORY();
+      return;
+    }
+    memcpy(video_extra->GetPtr(), extra_ptr, extra_size);
+    video_extra->SetValidSize(extra_size);
+  } else
+    RKMEDIA_LOGE("Muxer Flow: Intra Frame without sps pps\n");
+}
+
+void MuxerFlow::PushPacket(PacketCmd cmd, std::shared_ptr<MediaBuffer> buffer,
+                           const std::string &path) {
+  MuxerPacket pkt = {cmd, buffer, video_extra, path};
+  std::unique_lock<std::mutex> lock(write_mtx);
+  if (write_queue.size() >= write_queue_max) {
+    write_queue_full++;
+    while (write_queue.size() >= write_queue_max && !write_quit)
+      write_room_cond.wait(lock);
+  }
+  write_queue.push_back(pkt);
+  write_cond.notify_one();
+}
+
+bool MuxerFlow::IsPreRecordKey(std::shared_ptr<MediaBuffer> &buffer) {
+  if (!video_in)
+    return true;
+  return buffer->GetType() == Type::Video &&
+         (buffer->GetUserFlag() & MediaBuffer::kIntra);
+}
+
+void MuxerFlow::PreRecordPush(MediaBufferVector &input_vector) {
+  if (pre_record_us <= 0)
+    return;
+  // same order as they are written: audio first
+  if (audio_in && input_vector[1])
+    PreRecordPushOne(input_vector[1]);
+  if (video_in && input_vector[0])
+    PreRecordPushOne(input_vector[0]);
+}
+
+void MuxerFlow::PreRecordPushOne(std::shared_ptr<MediaBuffer> &buffer) {
+  bool is_video = buffer->GetType() == Type::Video;
+  int64_t &stream_ts = is_video ? pre_record_vid_ts : pre_record_aud_ts;
+  int64_t ts = buffer->GetUSTimeStamp();
+  if (ts < stream_ts) {
+    // the encoder restarted, what is kept can not be followed by this
+    RKMEDIA_LOGW("Muxer:: pre-record timestamp goes back, drop %d packets\n",
+                 (int)pre_record.size());
+    TakePreRecord();
+  }
+  if (pre_record.empty() && !IsPreRecordKey(buffer))
+    return;
+  // do not hold the encoder hardware buffers for seconds
+  auto pkt = buffer->IsHwBuffer() ? MediaBuffer::Clone(*buffer) : buffer;
+  if (!pkt)
+    return;
+  pre_record.push_back(pkt);
+  pre_record_size += pkt->GetValidSize();
+  stream_ts = ts;
+  PreRecordTrim();
+}
+
+// Drop whole GOPs from the front: while the ring is over the size limit, or
+// while the GOPs behind the first one still cover pre_record_us.
+void MuxerFlow::PreRecordTrim() {
+  while (!pre_record.empty()) {
+    size_t next = 1;
+    while (next < pre_record.size() && !IsPreRecordKey(pre_record[next]))
+      next++;
+    bool over_size = pre_record_size > pre_record_max_size;
+    bool over_time =
+        next < pre_record.size() &&
+        pre_record.back()->GetUSTimeStamp() -
+                pre_record[next]->GetUSTimeStamp() >=
+            pre_record_us;
+    if (!over_size && !over_time)
+      break;
+    for (; next > 0; next--) {
+      pre_record_size -= pre_record.front()->GetValidSize();
+      pre_record.pop_front();
+    }
+  }
+  if (pre_record.empty())
+    pre_record_vid_ts = pre_record_aud_ts = 0;
+}
+
+std::deque<std::shared_ptr<MediaBuffer>> MuxerFlow::TakePreRecord() {
+  std::deque<std::shared_ptr<MediaBuffer>> ring;
+  ring.swap(pre_record);
+  pre_record_size = 0;
+  pre_record_vid_ts = pre_record_aud_ts = 0;
+  return ring;
+}
+
+// Same decisions as the synchronous path of save_buffer, but the writes and
+// the file rotation are queued to the write thread.
+bool MuxerFlow::SaveBufferBehind(MediaBufferVector &input_vector) {
+  if (!enable_streaming) {
+    if (segment_open) {
+      segment_open = false;
+      PushPacket(MUXER_PACKET_STOP, nullptr);
+    }
+    PreRecordPush(input_vector);
+    return true;
+  }
+
+  auto vid_buffer = video_in ? input_vector[0] : nullptr;
+  auto aud_buffer = audio_in ? input_vector[1] : nullptr;
+  bool cut = !segment_open;
+  if (segment_open && file_duration > 0 && last_ts != 0 && vid_buffer &&
+      (vid_buffer->GetUserFlag() & MediaBuffer::kIntra) &&
+      vid_buffer->GetUSTimeStamp() - last_ts >= file_duration * 1000000) {
+    cut = true;
+    video_extra = nullptr;
+  }
+  if (cut && !pre_record.empty()) {
+    // recording starts, the new file begins with the pre-recorded GOPs
+    auto ring = TakePreRecord();
+    video_extra = nullptr;
+    UpdateVideoExtra(ring.front());
+    last_ts = 0;
+    segment_open = true;
+    PushPacket(MUXER_PACKET_CUT, nullptr, GenFilePath());
+    for (auto &buffer : ring) {
+      if (buffer->GetType() == Type::Video) {
+        UpdateVideoExtra(buffer);
+        if (last_ts == 0 || buffer->GetUSTimeStamp() < last_ts)
+          last_ts = buffer->GetUSTimeStamp();
+      }
+      PushPacket(MUXER_PACKET_WRITE, buffer);
+    }
+    cut = false;
+  }
+  if (vid_buffer)
+    UpdateVideoExtra(vid_buffer);
+  if (cut) {
+    last_ts = 0;
+    segment_open = true;
+    PushPacket(MUXER_PACKET_CUT, nullptr, GenFilePath());
+  }
+
+  if (aud_buffer)
+    PushPacket(MUXER_PACKET_WRITE, aud_buffer);
+  if (vid_buffer) {
+    PushPacket(MUXER_PACKET_WRITE, vid_buffer);
+    if (last_ts == 0 || vid_buffer->GetUSTimeStamp() < last_ts)
+      last_ts = vid_buffer->GetUSTimeStamp();
+  }
+  return true;
+}
+
+// Open the next file and write its header while the write thread is idle,
+// so that the cut on the IDR frame only swaps the recorders. The name of the
+// file is only known at the cut, where the time and the file name callback
+// are taken on the flow thread as in the synchronous path, so it is opened
+// under a temporary name next to the current file and renamed at the cut.
+bool MuxerFlow::NeedPreOpen() {
+  return file_duration > 0 && !is_use_customio && enable_streaming &&
+         video_recorder && video_recorder->IsPrepared() && !next_recorder &&
+         !preopen_failed;
+}
+
+void MuxerFlow::PreOpenRecorder() {
+  std::string path = video_recorder->GetPath() + ".next";
+  auto recorder = NewRecorder(path.c_str(), false);
+  if (!recorder || !recorder->Prepare(this, segment_extra)) {
+    RKMEDIA_LOGW("Muxer:: pre-open %s failed, open it on cut\n",
+                 path.c_str());
+    recorder.reset();
+    unlink(path.c_str());
+    preopen_failed = true;
+    return;
+  }
+  next_recorder = recorder;
+}
+
+// The pre-opened file was never reported to the user, remove it.
+void MuxerFlow::DiscardPreOpened() {
+  if (!next_recorder)
+    return;
+  std::string path = next_recorder->GetPath();
+  next_recorder.reset();
+  unlink(path.c_str());
+}
+
+void MuxerFlow::ProcessPacket(MuxerPacket &pkt) {
+  switch (pkt.cmd) {
+  case MUXER_PACKET_CUT: {
+    // stream parameters changed, open the file with the new ones
+    if (next_recorder && !next_recorder->SameExtra(pkt.extra))
+      DiscardPreOpened();
+    // closed first, the file may be replaced in single file mode
+    video_recorder.reset();
+    if (next_recorder && !next_recorder->Rename(pkt.path))
+      DiscardPreOpened();
+    if (next_recorder) {
+      video_recorder = next_recorder;
+      next_recorder.reset();
+      video_recorder->Start();
+    } else {
+      video_recorder = NewRecorder(pkt.path.c_str());
+      if (!video_recorder)
+        enable_streaming = false;
+    }
+    preopen_failed = false;
+  } break;
+  case MUXER_PACKET_STOP: {
+    DiscardPreOpened();
+    preopen_failed = false;
+    if (!video_recorder)
+      break;
+    video_recorder.reset();
+    if (event_callback_) {
+      MuxerEvent muxer_event;
+      memset(&muxer_event, 0, sizeof(MuxerEvent));
+      muxer_event.type = MUX_EVENT_STREAM_STOP;
+      event_callback_(event_handler2_, (void *)&muxer_event);
+    }
+  } break;
+  case MUXER_PACKET_WRITE: {
+    if (!video_recorder)
+      break;
+    segment_extra = pkt.extra;
+    if (!video_recorder->Write(this, pkt.buffer, pkt.extra)) {
+      video_recorder.reset();
+      enable_streaming = false;
+    }
+  } break;
+  }
+}
+
+void MuxerFlow::WriteThreadRun() {
+  prctl(PR_SET_NAME, "muxer_write");
+  std::unique_lock<std::mutex> lock(write_mtx);
+  while (true) {
+    if (write_queue.empty()) {
+      if (write_quit)
+        break;
+      if (NeedPreOpen()) {
+        lock.unlock();
+        PreOpenRecorder();
+        lock.lock();
+        continue;
+      }
+      write_cond.wait(lock);
+      continue;
+    }
+    MuxerPacket pkt = write_queue.front();
+    write_queue.pop_front();
+    unsigned int depth = write_queue.size() + 1;
+    unsigned int full = write_queue_full;
+    write_queue_full = 0;
+    lock.unlock();
+    write_room_cond.notify_one();
+
+    if (video_recorder) {
+      MuxerWriteStat &stat = video_recorder->GetStat();
+      if (depth > stat.queue_max)
+        stat.queue_max = depth;
+      stat.queue_full += full;
+    }
+    ProcessPacket(pkt);
+    lock.lock();
+  }
+  lock.unlock();
+  DiscardPreOpened();
+  video_recorder.reset();
+}
+
 bool save_buffer(Flow *f, MediaBufferVector &input_vector) {
   MuxerFlow *flow = static_cast<MuxerFlow *>(f);
+  if (flow->write_thread)
+    return flow->SaveBufferBehind(input_vector);
+
   auto &&recorder = flow->video_recorder;
   int64_t duration_us = flow->file_duration;
 
@@ -326,6 +651,7 @@ bool save_buffer(Flow *f, MediaBufferVector &input_vector) {
         flow->event_callback_(flow->event_handler2_, (void *)&muxer_event);
       }
     }
+    flow->PreRecordPush(input_vector);
     return true;
   }
 
@@ -355,6 +681,22 @@ bool save_buffer(Flow *f, MediaBufferVector &input_vector) {
     flow->last_ts = 0;
     if (recorder == nullptr)
       flow->enable_streaming = false;
+    else if (!flow->pre_record.empty()) {
+      // the new file begins with the pre-recorded GOPs
+      flow->video_extra = nullptr;
+      for (auto &buffer : flow->TakePreRecord()) {
+        if (buffer->GetType() == Type::Video) {
+          flow->UpdateVideoExtra(buffer);
+          if (flow->last_ts == 0 || buffer->GetUSTimeStamp() < flow->last_ts)
+            flow->last_ts = buffer->GetUSTimeStamp();
+        }
+        if (!recorder->Write(flow, buffer)) {
+          recorder.reset();
+          flow->enable_streaming = false;
+          return true;
+        }
+      }
+    }
   }
 
   // process audio stream here
@@ -388,27 +730,7 @@ bool save_buffer(Flow *f, MediaBufferVector &input_vector) {
       break;
     }
 
-    if (!flow->video_extra &&
-        (vid_buffer->GetUserFlag() & MediaBuffer::kIntra)) {
-      CodecType c_type = flow->vid_enc_config.vid_cfg.image_cfg.codec_type;
-      int extra_size = 0;
-      void *extra_ptr = NULL;
-      if (c_type == CODEC_TYPE_H264)
-        extra_ptr = GetSpsPpsFromBuffer(vid_buffer, extra_size, c_type);
-      else if (c_type == CODEC_TYPE_H265)
-        extra_ptr = GetVpsSpsPpsFromBuffer(vid_buffer, extra_size, c_type);
-
-      if (extra_ptr && (extra_size > 0)) {
-        flow->video_extra = MediaBuffer::Alloc(extra_size);
-        if (!flow->video_extra) {
-          LOG_NO_MEMORY();
-          break;
-        }
-        memcpy(flow->video_extra->GetPtr(), extra_ptr, extra_size);
-        flow->video_extra->SetValidSize(extra_size);
-      } else
-        RKMEDIA_LOGE("Muxer Flow: Intra Frame without sps pps\n");
-    }
+    flow->UpdateVideoExtra(vid_buffer);
 
     if (!recorder->Write(flow, vid_buffer)) {
       recorder.reset();
@@ -431,7 +753,9 @@ const char *FACTORY(MuxerFlow)::OutPutDataType() { return ""; }
 
 VideoRecorder::VideoRecorder(const char *param, Flow *f, const char *rpath,
                              int customio)
-    : vid_stream_id(-1), aud_stream_id(-1), muxer_flow(f), record_path(rpath) {
+    : vid_stream_id(-1), aud_stream_id(-1), muxer_flow(f), record_path(rpath),
+      started(false), write_total_us(0) {
+  memset(&stat, 0, sizeof(stat));
   muxer =
       easymedia::REFLECTOR(Muxer)::Create<easymedia::Muxer>("ffmpeg", param);
   if (!muxer) {
@@ -440,8 +764,21 @@ VideoRecorder::VideoRecorder(const char *param, Flow *f, const char *rpath,
   }
   if (muxer_flow && customio)
     muxer->SetWriteCallback(muxer_flow, &muxer_buffer_callback);
+}
 
+bool VideoRecorder::Rename(const std::string &path) {
+  if (rename(record_path.c_str(), path.c_str())) {
+    RKMEDIA_LOGW("Muxer:: rename %s to %s failed: %s\n", record_path.c_str(),
+                 path.c_str(), strerror(errno));
+    return false;
+  }
+  record_path = path;
+  return true;
+}
+
+void VideoRecorder::Start() {
   MuxerFlow *muxer_flow_ptr = static_cast<MuxerFlow *>(muxer_flow);
+  started = true;
   ProcessEvent(MUX_EVENT_FILE_BEGIN, (int)muxer_flow_ptr->file_duration);
 }
 
@@ -453,7 +790,8 @@ VideoRecorder::~VideoRecorder() {
     muxer->Write(buffer, vid_stream_id);
   }
   MuxerFlow *muxer_flow_ptr = static_cast<MuxerFlow *>(muxer_flow);
-  ProcessEvent(MUX_EVENT_FILE_END, (int)muxer_flow_ptr->file_duration);
+  if (started)
+    ProcessEvent(MUX_EVENT_FILE_END, (int)muxer_flow_ptr->file_duration);
 
   if (muxer) {
     muxer.reset();
@@ -470,6 +808,11 @@ void VideoRecorder::ProcessEvent(MuxerEventType event_type, int value) {
              strlen(record_path.c_str()));
       muxer_event.value = value;
     }
+    if (event_type == MUX_EVENT_FILE_END) {
+      if (stat.write_count)
+        stat.write_avg_us = write_total_us / stat.write_count;
+      muxer_event.stat = stat;
+    }
     if (muxer_flow->event_callback_)
       muxer_flow->event_callback_(muxer_flow->event_handler2_,
                                   (void *)&muxer_event);
@@ -481,36 +824,57 @@ void VideoRecorder::ClearStream() {
   aud_stream_id = -1;
 }
 
-bool VideoRecorder::Write(MuxerFlow *f, std::shared_ptr<MediaBuffer> buffer) {
-  MuxerFlow *flow = static_cast<MuxerFlow *>(f);
-  if (flow->video_in && flow->video_extra && vid_stream_id == -1) {
-    if (!muxer->NewMuxerStream(flow->vid_enc_config, flow->video_extra,
-                               vid_stream_id)) {
-      RKMEDIA_LOGE("NewMuxerStream failed for video\n");
-      ProcessEvent(MUX_EVENT_ERR_CREATE_FILE_FAIL, -1);
+bool VideoRecorder::SameExtra(std::shared_ptr<MediaBuffer> &extra) {
+  if (!stream_extra || !extra)
+    return false;
+  return stream_extra->GetValidSize() == extra->GetValidSize() &&
+         !memcmp(stream_extra->GetPtr(), extra->GetPtr(),
+                 extra->GetValidSize());
+}
+
+bool VideoRecorder::Prepare(MuxerFlow *f, std::shared_ptr<MediaBuffer> extra) {
+  if (!extra)
+    return false;
+  stream_extra = extra;
+  if (!muxer->NewMuxerStream(f->vid_enc_config, extra, vid_stream_id)) {
+    RKMEDIA_LOGE("NewMuxerStream failed for video\n");
+    ProcessEvent(MUX_EVENT_ERR_CREATE_FILE_FAIL, -1);
+  } else {
+    RKMEDIA_LOGI("Video: create video stream finished!\n");
+  }
+
+  if (f->audio_in) {
+    if (!muxer->NewMuxerStream(f->aud_enc_config, nullptr, aud_stream_id)) {
+      RKMEDIA_LOGE("NewMuxerStream failed for audio\n");
+      ProcessEvent(MUX_EVENT_ERR_CREATE_FILE_FAIL, -2);
     } else {
-      RKMEDIA_LOGI("Video: create video stream finished!\n");
+      RKMEDIA_LOGI("Audio: create audio stream finished!\n");
     }
+  }
 
-    if (flow->audio_in) {
-      if (!muxer->NewMuxerStream(flow->aud_enc_config, nullptr,
-                                 aud_stream_id)) {
-        RKMEDIA_LOGE("NewMuxerStream failed for audio\n");
-        ProcessEvent(MUX_EVENT_ERR_CREATE_FILE_FAIL, -2);
-      } else {
-        RKMEDIA_LOGI("Audio: create audio stream finished!\n");
-      }
-    }
+  auto header = muxer->WriteHeader(vid_stream_id);
+  if (!header) {
+    RKMEDIA_LOGI("WriteHeader on video stream return nullptr\n");
+    ClearStream();
+    ProcessEvent(MUX_EVENT_ERR_WRITE_FILE_FAIL, 0);
+    return false;
+  }
+  return true;
+}
 
-    auto header = muxer->WriteHeader(vid_stream_id);
-    if (!header) {
-      RKMEDIA_LOGI("WriteHeader on video stream return nullptr\n");
-      ClearStream();
-      ProcessEvent(MUX_EVENT_ERR_WRITE_FILE_FAIL, 0);
+bool VideoRecorder::Write(MuxerFlow *f, std::shared_ptr<MediaBuffer> buffer) {
+  return Write(f, buffer, f->video_extra);
+}
+
+bool VideoRecorder::Write(MuxerFlow *f, std::shared_ptr<MediaBuffer> buffer,
+                          std::shared_ptr<MediaBuffer> extra) {
+  MuxerFlow *flow = static_cast<MuxerFlow *>(f);
+  if (flow->video_in && extra && vid_stream_id == -1) {
+    if (!Prepare(flow, extra))
       return false;
-    }
   }
 
+  int64_t begin_us = easymedia::gettimeofday();
   if (buffer->GetType() == Type::Video && vid_stream_id != -1) {
     if (nullptr == muxer->Write(buffer, vid_stream_id)) {
       RKMEDIA_LOGE("Write on video stream return nullptr\n");
@@ -525,8 +889,16 @@ bool VideoRecorder::Write(MuxerFlow *f, std::shared_ptr<MediaBuffer> buffer) {
       ProcessEvent(MUX_EVENT_ERR_WRITE_FILE_FAIL, -2);
       return false;
     }
+  } else {
+    return true;
   }
 
+  int64_t cost_us = easymedia::gettimeofday() - begin_us;
+  write_total_us += cost_us;
+  stat.write_count++;
+  if (cost_us > stat.write_max_us)
+    stat.write_max_us = cost_us;
+
   return true;
 }
 
@@ -7,6 +7,12 @@
 
 #include <sys/time.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #include "buffer.h"
 #include "flow.h"
 #include "muxer.h"
@@ -40,10 +46,38 @@ public:
   void StopStream();
 
 private:
-  std::shared_ptr<VideoRecorder> NewRecorder(const char *path);
+  std::shared_ptr<VideoRecorder> NewRecorder(const char *path,
+                                             bool start = true);
+  void UpdateVideoExtra(std::shared_ptr<MediaBuffer> &vid_buffer);
   friend bool save_buffer(Flow *f, MediaBufferVector &input_vector);
   friend int muxer_buffer_callback(void *handler, uint8_t *buf, int buf_size);
 
+  // write-behind mode: save_buffer only queues the packets, the io thread
+  // writes them and does the file rotation.
+  enum PacketCmd { MUXER_PACKET_WRITE, MUXER_PACKET_CUT, MUXER_PACKET_STOP };
+  struct MuxerPacket {
+    PacketCmd cmd;
+    std::shared_ptr<MediaBuffer> buffer;
+    std::shared_ptr<MediaBuffer> extra; // video extra data when queued
+    std::string path;                   // file of a cut, named when queued
+  };
+  bool SaveBufferBehind(MediaBufferVector &input_vector);
+  void PushPacket(PacketCmd cmd, std::shared_ptr<MediaBuffer> buffer,
+                  const std::string &path = std::string());
+  void WriteThreadRun();
+  void ProcessPacket(MuxerPacket &pkt);
+  bool NeedPreOpen();
+  void PreOpenRecorder();
+  void DiscardPreOpened();
+
+  // pre-record ring: while streaming is off, keep the last GOPs in memory
+  // and write them at the head of the next file.
+  bool IsPreRecordKey(std::shared_ptr<MediaBuffer> &buffer);
+  void PreRecordPush(MediaBufferVector &input_vector);
+  void PreRecordPushOne(std::shared_ptr<MediaBuffer> &buffer);
+  void PreRecordTrim();
+  std::deque<std::shared_ptr<MediaBuffer>> TakePreRecord();
+
 private:
   std::shared_ptr<MediaBuffer> video_extra;
   std::string muxer_param;
@@ -62,10 +96,34 @@ private:
   bool file_time_en;
   bool is_use_customio;
   std::string GenFilePath();
-  bool enable_streaming;
+  // set by Control and cleared by the write thread on a write error
+  std::atomic<bool> enable_streaming;
   // get file name frome callback
   GET_FILE_NAMES_CB file_name_cb;
   void *file_name_handle;
+
+  size_t write_queue_max; // 0: write in the flow thread
+  std::thread *write_thread;
+  std::mutex write_mtx;
+  std::condition_variable write_cond;      // packet queued or quit
+  std::condition_variable write_room_cond; // packet popped
+  std::deque<MuxerPacket> write_queue;
+  unsigned int write_queue_full;
+  bool write_quit;
+  bool segment_open; // flow thread view, a cut has been queued
+  // the io thread owns the following
+  std::shared_ptr<MediaBuffer> segment_extra;
+  // opened under a temporary name, renamed to the path of the cut
+  std::shared_ptr<VideoRecorder> next_recorder;
+  bool preopen_failed;
+
+  int64_t pre_record_us; // 0: no pre-record
+  size_t pre_record_max_size;
+  // starts with a video key frame, oldest first
+  std::deque<std::shared_ptr<MediaBuffer>> pre_record;
+  size_t pre_record_size;
+  int64_t pre_record_vid_ts; // last timestamp of each stream in the ring
+  int64_t pre_record_aud_ts;
 };
 
 class VideoRecorder {
@@ -73,8 +131,20 @@ public:
   VideoRecorder(const char *param, Flow *f, const char *rpath, int customio);
   ~VideoRecorder();
 
+  // Send MUX_EVENT_FILE_BEGIN, a recorder not started ends silently.
+  void Start();
   bool Write(MuxerFlow *f, std::shared_ptr<MediaBuffer> buffer);
+  bool Write(MuxerFlow *f, std::shared_ptr<MediaBuffer> buffer,
+             std::shared_ptr<MediaBuffer> extra);
+  // Create the streams and write the header ahead of the first packet.
+  bool Prepare(MuxerFlow *f, std::shared_ptr<MediaBuffer> extra);
+  bool IsPrepared() { return vid_stream_id != -1; }
+  bool SameExtra(std::shared_ptr<MediaBuffer> &extra);
+  // Move the file of a recorder not started yet to path.
+  bool Rename(const std::string &path);
   void ProcessEvent(MuxerEventType type, int value);
+  const std::string &GetPath() { return record_path; }
+  MuxerWriteStat &GetStat() { return stat; }
 
 private:
   std::shared_ptr<Muxer> muxer;
@@ -83,6 +153,10 @@ private:
   void ClearStream();
   Flow *muxer_flow;
   std::string record_path;
+  std::shared_ptr<MediaBuffer> stream_extra;
+  bool started;
+  MuxerWriteStat stat;
+  int64_t write_total_us;
 };
 } // namespace easymedia
 
@@ -0,0 +1,144 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "flow_executor.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/prctl.h>
+
+#include "utils.h"
+
+namespace easymedia {
+
+static thread_local int tls_worker_index = -1;
+
+FlowExecutor *FlowExecutor::GetInstance() {
+  static FlowExecutor *executor = nullptr;
+  static std::once_flag once;
+  std::call_once(once, []() {
+    int num = std::thread::hardware_concurrency();
+    const char *env = getenv("RKMEDIA_FLOW_EXECUTOR_THREADS");
+    if (env && atoi(env) > 0)
+      num = atoi(env);
+    if (num <= 0)
+      num = 2;
+    // Never destroyed: flows may still be alive during static destruction.
+    executor = new FlowExecutor(num);
+  });
+  return executor;
+}
+
+FlowExecutor::FlowExecutor(int num) : next_worker(0), quit(false) {
+  RKMEDIA_LOGI("FlowExecutor: start %d workers\n", num);
+  for (int i = 0; i < num; i++)
+    workers.emplace_back(new Worker());
+  for (int i = 0; i < num; i++)
+    workers[i]->th = new std::thread(&FlowExecutor::WorkerRun, this, i);
+}
+
+FlowExecutor::~FlowExecutor() {
+  quit = true;
+  idle_event.Notify();
+  for (auto &w : workers) {
+    w->th->join();
+    delete w->th;
+  }
+}
+
+bool FlowExecutor::InWorker() { return tls_worker_index >= 0; }
+
+void FlowExecutor::Submit(TaskFunc func, void *arg, int priority, int cpu) {
+  int num = (int)workers.size();
+  int index;
+  bool pinned = false;
+  if (cpu >= 0) {
+    index = cpu % num;
+    pinned = true;
+  } else if (tls_worker_index >= 0) {
+    // keep the downstream work on the producer's core, others may steal it
+    index = tls_worker_index;
+  } else {
+    index = next_worker++ % num;
+  }
+  int level = priority > 0 ? PRIORITY_HIGH
+                           : (priority < 0 ? PRIORITY_LOW : PRIORITY_NORMAL);
+  Worker *w = workers[index].get();
+  w->mtx.lock();
+  w->queues[level].push_back({func, arg, pinned});
+  w->mtx.unlock();
+  idle_event.Notify();
+}
+
+bool FlowExecutor::PopTask(int index, Task &task) {
+  Worker *w = workers[index].get();
+  std::lock_guard<std::mutex> _lg(w->mtx);
+  for (int i = 0; i < PRIORITY_NUM; i++) {
+    auto &q = w->queues[i];
+    if (!q.empty()) {
+      task = q.front();
+      q.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FlowExecutor::StealTask(int thief, Task &task) {
+  int num = (int)workers.size();
+  for (int i = 0; i < PRIORITY_NUM; i++) {
+    for (int j = 1; j < num; j++) {
+      Worker *w = workers[(thief + j) % num].get();
+      std::lock_guard<std::mutex> _lg(w->mtx);
+      auto &q = w->queues[i];
+      for (auto it = q.begin(); it != q.end(); it++) {
+        if (it->pinned)
+          continue;
+        task = *it;
+        q.erase(it);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void FlowExecutor::WorkerRun(int index) {
+  char name[16];
+  snprintf(name, sizeof(name), "flow_exec%d", index);
+  prctl(PR_SET_NAME, name);
+  tls_worker_index = index;
+
+  int ncpu = std::thread::hardware_concurrency();
+  if (ncpu > 0 && (int)workers.size() <= ncpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+      RKMEDIA_LOGW("%s: fail to bind cpu %d\n", name, index);
+  }
+
+  Task task;
+  while (!quit) {
+    if (PopTask(index, task) || StealTask(index, task)) {
+      task.func(task.arg);
+      continue;
+    }
+    // Re-check after announcing ourselves, a Submit() in between bumps the
+    // event epoch so Wait() returns at once.
+    uint32_t key = idle_event.PrepareWait();
+    if (PopTask(index, task) || StealTask(index, task)) {
+      idle_event.CancelWait();
+      task.func(task.arg);
+      continue;
+    }
+    if (quit) {
+      idle_event.CancelWait();
+      break;
+    }
+    idle_event.Wait(key);
+  }
+}
+
+} // namespace easymedia
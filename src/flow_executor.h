@@ -0,0 +1,68 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_FLOW_EXECUTOR_H_
+#define EASYMEDIA_FLOW_EXECUTOR_H_
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lock.h"
+
+namespace easymedia {
+
+// A fixed size pool of worker threads shared by all flows which install
+// their slot map with Executor::POOL. One worker per core by default
+// (env RKMEDIA_FLOW_EXECUTOR_THREADS overrides). Each worker owns a queue,
+// idle workers steal from the others, so a burst on one flow spreads over
+// all cores.
+class FlowExecutor {
+public:
+  typedef void (*TaskFunc)(void *arg);
+  enum { PRIORITY_HIGH = 0, PRIORITY_NORMAL, PRIORITY_LOW, PRIORITY_NUM };
+
+  static FlowExecutor *GetInstance();
+  ~FlowExecutor();
+
+  // priority: > 0 high, 0 normal, < 0 low.
+  // cpu: >= 0 means the task should run on the worker bound to this cpu,
+  //      it is never stolen by other workers.
+  void Submit(TaskFunc func, void *arg, int priority = 0, int cpu = -1);
+  int GetWorkerNum() { return (int)workers.size(); }
+  // Return true if the calling thread is one of the pool workers.
+  static bool InWorker();
+
+private:
+  struct Task {
+    TaskFunc func;
+    void *arg;
+    bool pinned;
+  };
+  struct Worker {
+    std::mutex mtx;
+    std::deque<Task> queues[PRIORITY_NUM];
+    std::thread *th;
+  };
+
+  FlowExecutor(int num);
+  FlowExecutor(const FlowExecutor &) = delete;
+  FlowExecutor &operator=(const FlowExecutor &) = delete;
+
+  void WorkerRun(int index);
+  bool PopTask(int index, Task &task);
+  bool StealTask(int thief, Task &task);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<unsigned> next_worker;
+  EventCount idle_event;
+  volatile bool quit;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_FLOW_EXECUTOR_H_
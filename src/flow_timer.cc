@@ -0,0 +1,190 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "flow_timer.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+namespace easymedia {
+
+void PeriodicDeadline::Start(int64_t now_ns, double period_ns, MissPolicy p) {
+  start = now_ns;
+  period = period_ns;
+  index = 0;
+  policy = p;
+}
+
+uint32_t PeriodicDeadline::Skip(int64_t now_ns) {
+  if (Next() > now_ns)
+    return 0;
+  // the latest period whose deadline has passed
+  uint64_t last = (uint64_t)((now_ns - start) / period);
+  if (last > index && start + (int64_t)(last * period) > now_ns)
+    last--;
+  uint64_t due = last - index + 1;
+  uint64_t keep = (policy == MissPolicy::CATCHUP) ? kMaxCatchUp : 1;
+  if (due <= keep)
+    return 0;
+  index += due - keep;
+  return (uint32_t)(due - keep);
+}
+
+int64_t FlowTimer::NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+FlowTimer *FlowTimer::GetInstance() {
+  static FlowTimer *timer = nullptr;
+  static std::once_flag once;
+  std::call_once(once, []() {
+    // Never destroyed: flows may still be alive during static destruction.
+    timer = new FlowTimer();
+    if (!timer->Init()) {
+      delete timer;
+      timer = nullptr;
+    }
+  });
+  return timer;
+}
+
+FlowTimer::FlowTimer()
+    : running_id(0), next_id(1), timer_fd(-1), event_fd(-1), epoll_fd(-1),
+      th(nullptr), quit(false) {}
+
+FlowTimer::~FlowTimer() {
+  if (th) {
+    quit = true;
+    Wakeup();
+    th->join();
+    delete th;
+  }
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+  if (event_fd >= 0)
+    close(event_fd);
+  if (timer_fd >= 0)
+    close(timer_fd);
+}
+
+bool FlowTimer::Init() {
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (timer_fd < 0 || event_fd < 0 || epoll_fd < 0) {
+    RKMEDIA_LOGE("FlowTimer: fail to create fds, %m\n");
+    return false;
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = timer_fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev))
+    return false;
+  ev.data.fd = event_fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev))
+    return false;
+  th = new std::thread(&FlowTimer::Run, this);
+  return true;
+}
+
+int FlowTimer::Add(TaskFunc func, void *arg, float interval_ms,
+                   MissPolicy policy) {
+  if (!func || interval_ms <= 0)
+    return 0;
+  Task t;
+  t.func = func;
+  t.arg = arg;
+  t.deadline.Start(NowNs(), interval_ms * 1000000.0, policy);
+  std::unique_lock<std::mutex> lk(mtx);
+  t.id = next_id++;
+  tasks.push_back(t);
+  lk.unlock();
+  Wakeup();
+  return t.id;
+}
+
+void FlowTimer::Remove(int id) {
+  std::unique_lock<std::mutex> lk(mtx);
+  for (auto it = tasks.begin(); it != tasks.end(); it++) {
+    if (it->id == id) {
+      tasks.erase(it);
+      break;
+    }
+  }
+  // A task removing itself from its own callback must not wait.
+  if (std::this_thread::get_id() == th->get_id())
+    return;
+  while (running_id == id)
+    idle_cond.wait(lk);
+}
+
+void FlowTimer::Wakeup() {
+  uint64_t one = 1;
+  if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    RKMEDIA_LOGW("FlowTimer: write eventfd failed, %m\n");
+}
+
+void FlowTimer::ArmTimer(int64_t deadline_ns) {
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  // it_value all zero disarms the timer
+  if (deadline_ns > 0) {
+    its.it_value.tv_sec = deadline_ns / 1000000000LL;
+    its.it_value.tv_nsec = deadline_ns % 1000000000LL;
+  }
+  if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, nullptr))
+    RKMEDIA_LOGW("FlowTimer: timerfd_settime failed, %m\n");
+}
+
+void FlowTimer::Run() {
+  prctl(PR_SET_NAME, "flow_timer");
+  std::unique_lock<std::mutex> lk(mtx);
+  while (!quit) {
+    // The task list is a handful of flows, a linear scan is enough.
+    Task *due = nullptr;
+    for (auto &t : tasks) {
+      if (!due || t.deadline.Next() < due->deadline.Next())
+        due = &t;
+    }
+    int64_t now = NowNs();
+    if (due && due->deadline.Next() <= now) {
+      int id = due->id;
+      TaskFunc func = due->func;
+      void *arg = due->arg;
+      uint32_t missed = due->deadline.Skip(now);
+      int64_t late_us = (now - due->deadline.Next()) / 1000;
+      due->deadline.Step();
+      running_id = id;
+      lk.unlock();
+      func(arg, late_us, missed);
+      lk.lock();
+      running_id = 0;
+      idle_cond.notify_all();
+      continue;
+    }
+    ArmTimer(due ? due->deadline.Next() : 0);
+    lk.unlock();
+    struct epoll_event events[2];
+    int n = epoll_wait(epoll_fd, events, 2, -1);
+    for (int i = 0; i < n; i++) {
+      uint64_t cnt;
+      if (read(events[i].data.fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+        RKMEDIA_LOGW("FlowTimer: read fd failed, %m\n");
+    }
+    lk.lock();
+  }
+}
+
+} // namespace easymedia
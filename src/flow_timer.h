@@ -0,0 +1,94 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EASYMEDIA_FLOW_TIMER_H_
+#define EASYMEDIA_FLOW_TIMER_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "flow.h"
+
+namespace easymedia {
+
+// Drift free deadlines of a periodic task: the n-th deadline is always
+// start + n * period, whatever the lateness of the previous runs.
+class PeriodicDeadline {
+public:
+  PeriodicDeadline()
+      : start(0), period(0), index(0), policy(MissPolicy::SKIP) {}
+  void Start(int64_t now_ns, double period_ns, MissPolicy p);
+  int64_t Next() const { return start + (int64_t)(index * period); }
+  // Called once Next() has passed, before the run. Gives up the overdue
+  // periods the policy does not keep (all but the latest for SKIP, all but
+  // kMaxCatchUp for CATCHUP) and returns their number.
+  uint32_t Skip(int64_t now_ns);
+  // Called after the run.
+  void Step() { index++; }
+
+  static const uint32_t kMaxCatchUp = 4;
+
+private:
+  int64_t start;
+  double period;
+  uint64_t index;
+  MissPolicy policy;
+};
+
+// One thread dispatching all the periodic (ASYNCATOMIC) coroutines which
+// install their slot map with Executor::TIMER. It sleeps on a timerfd armed
+// with the earliest absolute deadline, an eventfd wakes it up when a task
+// is added or removed. Tasks run on the timer thread one after another, so
+// they must be short compared to their period.
+class FlowTimer {
+public:
+  // late_us: start time minus deadline; missed: periods given up before
+  typedef void (*TaskFunc)(void *arg, int64_t late_us, uint32_t missed);
+
+  static FlowTimer *GetInstance();
+  ~FlowTimer();
+
+  // Returns an id > 0, or 0 on failure.
+  int Add(TaskFunc func, void *arg, float interval_ms, MissPolicy policy);
+  // Once returned, the task is not running and will never run again.
+  void Remove(int id);
+
+  static int64_t NowNs();
+
+private:
+  struct Task {
+    int id;
+    TaskFunc func;
+    void *arg;
+    PeriodicDeadline deadline;
+  };
+
+  FlowTimer();
+  FlowTimer(const FlowTimer &) = delete;
+  FlowTimer &operator=(const FlowTimer &) = delete;
+
+  bool Init();
+  void Run();
+  void Wakeup();
+  void ArmTimer(int64_t deadline_ns);
+
+  std::mutex mtx;
+  std::condition_variable idle_cond;
+  std::vector<Task> tasks;
+  int running_id; // task being run by the timer thread, 0 if none
+  int next_id;
+  int timer_fd;
+  int event_fd;
+  int epoll_fd;
+  std::thread *th;
+  volatile bool quit;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_FLOW_TIMER_H_
@@ -0,0 +1,71 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "histogram.h"
+
+#include <stdio.h>
+
+namespace easymedia {
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0), max(0) {
+  for (int i = 0; i < kBucketNum; i++)
+    buckets[i].store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::BucketIndex(uint64_t v) {
+  if (v < (uint64_t)kLinearNum)
+    return (int)v;
+  if (v > 0xFFFFFFFFULL)
+    v = 0xFFFFFFFFULL;
+  int e = 63 - __builtin_clzll(v); // >= kSubBits + 1
+  int sub = (int)(v >> (e - kSubBits)) & ((1 << kSubBits) - 1);
+  return kLinearNum + (e - kSubBits - 1) * (1 << kSubBits) + sub;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(int index) {
+  if (index < kLinearNum)
+    return index;
+  int k = index - kLinearNum;
+  int e = k / (1 << kSubBits) + kSubBits + 1;
+  uint64_t sub = k % (1 << kSubBits);
+  uint64_t lower = ((1ULL << kSubBits) + sub) << (e - kSubBits);
+  return lower + (1ULL << (e - kSubBits)) - 1;
+}
+
+double LatencyHistogram::GetMean() const {
+  uint64_t n = GetCount();
+  return n ? (double)sum.load(std::memory_order_relaxed) / n : 0.0;
+}
+
+int64_t LatencyHistogram::GetPercentile(double p) const {
+  uint64_t n = GetCount();
+  if (!n)
+    return 0;
+  uint64_t target = (uint64_t)(n * p / 100.0 + 0.5);
+  if (target < 1)
+    target = 1;
+  uint64_t acc = 0;
+  for (int i = 0; i < kBucketNum; i++) {
+    acc += buckets[i].load(std::memory_order_relaxed);
+    if (acc >= target) {
+      int64_t upper = (int64_t)BucketUpperBound(i);
+      int64_t m = GetMax();
+      return upper < m ? upper : m;
+    }
+  }
+  return GetMax();
+}
+
+std::string LatencyHistogram::ToJson() const {
+  char str[256];
+  snprintf(str, sizeof(str),
+           "{\"count\":%llu,\"mean\":%.1f,\"p50\":%lld,\"p90\":%lld,"
+           "\"p99\":%lld,\"max\":%lld}",
+           (unsigned long long)GetCount(), GetMean(),
+           (long long)GetPercentile(50), (long long)GetPercentile(90),
+           (long long)GetPercentile(99), (long long)GetMax());
+  return str;
+}
+
+} // namespace easymedia
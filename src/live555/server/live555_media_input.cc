@@ -5,7 +5,9 @@
 #include "live555_media_input.hh"
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -17,38 +19,22 @@
 namespace easymedia {
 // A common "FramedSource" subclass, used for reading from a cached buffer list:
 
+#define MAX_CACHE_NUMBER 60
+
 Live555MediaInput::Live555MediaInput(UsageEnvironment &env)
-    : Medium(env), connecting(false), video_callback(nullptr),
-      audio_callback(nullptr), m_max_idr_size(0) {}
+    : Medium(env),
+      video_ring(std::make_shared<FanoutRing>(MAX_CACHE_NUMBER, true)),
+      audio_ring(std::make_shared<FanoutRing>(MAX_CACHE_NUMBER, false)),
+      muxer_ring(std::make_shared<FanoutRing>(MAX_CACHE_NUMBER, false)),
+      connecting(false), video_callback(nullptr), audio_callback(nullptr),
+      m_max_idr_size(0) {
+  if (!video_ring->Init() || !audio_ring->Init() || !muxer_ring->Init())
+    RKMEDIA_LOGE("Live555MediaInput: fail to init fanout rings\n");
+}
 
+// The rings are held by the subscribers still alive.
 Live555MediaInput::~Live555MediaInput() {
   LOG_FILE_FUNC_LINE();
-  video_list.remove_if([](Source *s) {
-    if (s->GetReadFdStatus()) {
-      delete s;
-      return true;
-    } else {
-      return false;
-    }
-  });
-
-  audio_list.remove_if([](Source *s) {
-    if (s->GetReadFdStatus()) {
-      delete s;
-      return true;
-    } else {
-      return false;
-    }
-  });
-
-  muxer_list.remove_if([](Source *s) {
-    if (s->GetReadFdStatus()) {
-      delete s;
-      return true;
-    } else {
-      return false;
-    }
-  });
   connecting = false;
 }
 
@@ -67,173 +53,55 @@ Live555MediaInput *Live555MediaInput::createNew(UsageEnvironment &env) {
   return new Live555MediaInput(env);
 }
 
-#define MAX_CACHE_NUMBER 60
-static void common_reduction(void *userdata,
-                             std::list<std::shared_ptr<MediaBuffer>> &mb_list) {
-  Source *source = (Source *)userdata;
-  if (mb_list.size() > source->GetCachedBufSize()) {
-    for (unsigned i = 0; i < source->GetCachedBufSize() / 2; i++) {
-      mb_list.pop_front();
-      if (source) {
-        int j = 0;
-        ssize_t read_size = (ssize_t)sizeof(j);
-        ssize_t ret = read(source->GetReadFd(), &j, sizeof(j));
-        if (ret != read_size) {
-          RKMEDIA_LOGI("%s:%d, read from pipe error, %m\n", __func__, __LINE__);
-        }
-      }
-    }
-    RKMEDIA_LOGI("call common_reduction.\n");
-  }
-}
-
-static void
-h264_packet_reduction(void *userdata _UNUSED,
-                      std::list<std::shared_ptr<MediaBuffer>> &mb_list) {
-  if (mb_list.size() < MAX_CACHE_NUMBER)
-    return;
-  // only remain one I frame
-  auto i = mb_list.rbegin();
-  for (; i != mb_list.rend(); ++i) {
-    auto &b = *i;
-    if (b->GetUserFlag() & MediaBuffer::kIntra)
-      break;
-  }
-  if (i == mb_list.rend())
-    return;
-  auto iter = mb_list.begin();
-  for (; iter != mb_list.end(); ++iter) {
-    auto &b = *iter;
-    if (!(b->GetUserFlag() & MediaBuffer::kExtraIntra))
-      break;
-  }
-  RKMEDIA_LOGI("h264 reduction before, num: %d \n", (int)mb_list.size());
-  mb_list.erase(iter, (++i).base());
-  RKMEDIA_LOGI("h264 reduction after, num: %d \n", (int)mb_list.size());
-}
-
 FramedSource *Live555MediaInput::videoSource(CodecType c_type) {
-  // if (!video_source)
-  Source *source = new Source();
-  if (!source)
-    return nullptr;
-  ListReductionPtr func;
   if (c_type == CODEC_TYPE_JPEG)
-    func = common_reduction;
-  else
-    func = h264_packet_reduction;
-  if (!source->Init(func)) {
-    delete source;
-    return nullptr;
-  }
-  video_list.push_back(source);
-  if (c_type == CODEC_TYPE_JPEG) {
-    return new CommonFramedSource(envir(), *source);
-  } else {
-    VideoFramedSource *video_source = new VideoFramedSource(envir(), *source);
-    video_source->SetCodecType(c_type);
-    return video_source;
-  }
+    return new CommonFramedSource(envir(), video_ring);
+  VideoFramedSource *video_source = new VideoFramedSource(envir(), video_ring);
+  video_source->SetCodecType(c_type);
+  return video_source;
 }
 
 FramedSource *Live555MediaInput::audioSource() {
-  Source *source = new Source();
-  if (!source)
-    return nullptr;
-  if (!source->Init(common_reduction)) {
-    delete source;
-    return nullptr;
-  }
-  audio_list.push_back(source);
-  ListSource *audio_source = new CommonFramedSource(envir(), *source);
-  return audio_source;
+  return new CommonFramedSource(envir(), audio_ring);
 }
 
 FramedSource *Live555MediaInput::muxerSource() {
-  Source *source = new Source();
-  if (!source)
-    return nullptr;
-  if (!source->Init(common_reduction)) {
-    delete source;
-    return nullptr;
-  }
-  muxer_list.push_back(source);
-  ListSource *muxer_source = new CommonFramedSource(envir(), *source);
-  return muxer_source;
+  return new CommonFramedSource(envir(), muxer_ring);
 }
-#if 0
-static void printErr(UsageEnvironment& env, char const* str = NULL) {
-  if (str != NULL)
-    env << str;
-  env << ": " << strerror(env.getErrno()) << "\n";
-}
-#endif
 
 void Live555MediaInput::PushNewVideo(std::shared_ptr<MediaBuffer> &buffer) {
   if (!buffer)
     return;
+  UpdateMaxIdrSize(buffer);
+  video_ring->Push(buffer);
+}
+
+bool Live555MediaInput::HasSubscriber() {
+  return video_ring->GetSubscriberNum() > 0 ||
+         audio_ring->GetSubscriberNum() > 0 ||
+         muxer_ring->GetSubscriberNum() > 0;
+}
+
+void Live555MediaInput::UpdateMaxIdrSize(std::shared_ptr<MediaBuffer> &buffer) {
   if ((buffer->GetUserFlag() & MediaBuffer::kIntra)) {
     if (m_max_idr_size < buffer->GetValidSize())
       m_max_idr_size = buffer->GetValidSize();
   }
-  video_list.remove_if([](Source *s) {
-    if (s->GetReadFdStatus()) {
-      delete s;
-      return true;
-    } else {
-      return false;
-    }
-  });
-
-  for (auto video : video_list) {
-    if (video) {
-      if (!video->GetReadFdStatus()) {
-        video->Push(buffer);
-      }
-    }
-  }
 }
 
 void Live555MediaInput::PushNewAudio(std::shared_ptr<MediaBuffer> &buffer) {
   if (!buffer)
     return;
-  audio_list.remove_if([](Source *s) {
-    if (s->GetReadFdStatus()) {
-      delete s;
-      return true;
-    } else {
-      return false;
-    }
-  });
-  for (auto audio : audio_list) {
-    if (audio) {
-      if (!audio->GetReadFdStatus()) {
-        audio->Push(buffer);
-      }
-    }
-  }
+  audio_ring->Push(buffer);
 }
 
 void Live555MediaInput::PushNewMuxer(std::shared_ptr<MediaBuffer> &buffer) {
   if (!buffer)
     return;
-  muxer_list.remove_if([](Source *s) {
-    if (s->GetReadFdStatus()) {
-      delete s;
-      return true;
-    } else {
-      return false;
-    }
-  });
-  for (auto muxer : muxer_list) {
-    if (muxer) {
-      if (!muxer->GetReadFdStatus()) {
-        muxer->SetCachedBufSize(buffer->GetValidSize());
-        muxer->Push(buffer);
-      }
-    }
-  }
+  muxer_ring->SetCachedBufSize(buffer->GetValidSize());
+  muxer_ring->Push(buffer);
 }
+
 void Live555MediaInput::SetStartVideoStreamCallback(
     const StartStreamCallback &cb) {
   AutoLockMutex _alm(video_callback_mtx);
@@ -256,98 +124,208 @@ StartStreamCallback Live555MediaInput::GetStartAudioStreamCallback() {
 unsigned Live555MediaInput::getMaxIdrSize() {
   return (m_max_idr_size * 13 / 10) * 3 * 2 / 25;
 }
-Source::Source()
-    : reduction(nullptr), m_cached_buffers_size(MAX_CACHE_NUMBER),
-      m_read_fd_status(false) {
-  wakeFds[0] = wakeFds[1] = -1;
-  RKMEDIA_LOGI("Source :: %p wakeFds[0] = %d, wakeFds[1]= %d.\n", this,
-               wakeFds[0], wakeFds[1]);
+FanoutRing::FanoutRing(size_t capacity, bool gop)
+    : slots(capacity), gop_aware(gop), head(0), tail(0),
+      max_cached(capacity), gop_start(0), has_gop(false), last_extra(false),
+      event_fd(-1), scheduler(nullptr), subscriber_num(0), dispatching(false) {}
+
+FanoutRing::~FanoutRing() {
+  if (event_fd >= 0)
+    ::close(event_fd);
 }
 
-void Source::CloseReadFd() {
-  if (wakeFds[0] >= 0) {
-    m_read_fd_status = true;
+bool FanoutRing::Init() {
+  event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd < 0) {
+    RKMEDIA_LOGI("eventfd failed: %m\n");
+    return false;
   }
+  return true;
 }
 
-Source::~Source() {
-  if (wakeFds[0] >= 0) {
-    ::close(wakeFds[0]);
-    wakeFds[0] = -1;
+void FanoutRing::Push(std::shared_ptr<MediaBuffer> &buffer) {
+  // Nobody to read it, do not hold it.
+  if (subscriber_num == 0)
+    return;
+  uint32_t flag = buffer->GetUserFlag();
+  mtx.lock();
+  if (gop_aware) {
+    // A gop starts at its first parameter set, or at the intra frame.
+    bool extra = flag & MediaBuffer::kExtraIntra;
+    if ((extra || (flag & MediaBuffer::kIntra)) && !last_extra) {
+      gop_start = head;
+      has_gop = true;
+    }
+    last_extra = extra;
   }
-  if (wakeFds[1] >= 0) {
-    ::close(wakeFds[1]);
-    wakeFds[1] = -1;
+  slots[head % slots.size()] = buffer;
+  head++;
+  if (head - tail > max_cached)
+    Release(head - max_cached);
+  mtx.unlock();
+  Kick();
+}
+
+void FanoutRing::SetCachedBufSize(size_t one_buf_size) {
+  // max: 5 M/s
+  if (one_buf_size == 0)
+    return;
+  size_t num = 1024 * 1024 * 5 / one_buf_size;
+  std::lock_guard<std::mutex> _lg(mtx);
+  max_cached = std::max<size_t>(1, std::min(num, slots.size()));
+}
+
+void FanoutRing::Release(uint64_t end) {
+  for (; tail < end; tail++)
+    slots[tail % slots.size()].reset();
+}
+
+void FanoutRing::Trim() {
+  uint64_t end = head;
+  for (auto sub : subscribers) {
+    if (sub && sub->cursor < end)
+      end = sub->cursor;
   }
-  RKMEDIA_LOGI("~Source::%p remain %d buffers, will auto release\n", this,
-               (int)cached_buffers.size());
+  // While anybody watches, keep the current gop for the next one to join,
+  // max_cached still bounds it.
+  if (subscriber_num > 0 && gop_aware && has_gop && gop_start < end)
+    end = gop_start;
+  Release(end);
 }
 
-bool Source::Init(ListReductionPtr func) {
-  // create pipe fds
-  int ret = pipe2(wakeFds, O_CLOEXEC);
-  if (ret) {
-    RKMEDIA_LOGI("pipe2 failed: %m\n");
-    return false;
+void FanoutRing::Kick() {
+  uint64_t one = 1;
+  if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    RKMEDIA_LOGI("write eventfd failed: %m\n");
+}
+
+void FanoutRing::Attach(ListSource *sub, TaskScheduler &sched) {
+  if (event_fd < 0)
+    return;
+  if (subscribers.empty()) {
+    scheduler = &sched;
+    scheduler->turnOnBackgroundReadHandling(
+        event_fd, (TaskScheduler::BackgroundHandlerProc *)&ReadableHandler,
+        this);
   }
-  assert(wakeFds[0] >= 0 && wakeFds[1] >= 0);
-  reduction = func;
-  return true;
+  subscribers.push_back(sub);
+  subscriber_num++;
 }
 
-void Source::Push(std::shared_ptr<MediaBuffer> &buffer) {
-  AutoLockMutex _alm(mtx);
-  if (reduction)
-    reduction(this, cached_buffers);
-  cached_buffers.push_back(buffer);
-  // mtx.notify();
-  int i = 0;
-  ssize_t count = write(wakeFds[1], &i, sizeof(i));
-  if (count < 0) {
-    RKMEDIA_LOGI("write failed: %s, %p, fd = %d\n", strerror(errno), this,
-                 wakeFds[1]);
+void FanoutRing::Detach(ListSource *sub) {
+  auto it = std::find(subscribers.begin(), subscribers.end(), sub);
+  if (it == subscribers.end())
+    return;
+  subscriber_num--;
+  // Dispatch() walks the vector by index, compact it afterwards.
+  if (dispatching)
+    *it = nullptr;
+  else
+    subscribers.erase(it);
+  mtx.lock();
+  Trim();
+  mtx.unlock();
+  if (subscriber_num == 0 && scheduler) {
+    scheduler->turnOffBackgroundReadHandling(event_fd);
+    scheduler = nullptr;
+    if (!dispatching)
+      subscribers.clear();
   }
 }
 
-std::shared_ptr<MediaBuffer> Source::Pop() {
-  AutoLockMutex _alm(mtx);
-  if (cached_buffers.empty())
+uint64_t FanoutRing::JoinCursor() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (gop_aware && has_gop && gop_start >= tail)
+    return gop_start;
+  return head;
+}
+
+bool FanoutRing::HasData(uint64_t cursor) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  return cursor < head;
+}
+
+std::shared_ptr<MediaBuffer> FanoutRing::Read(uint64_t &cursor,
+                                              uint64_t &dropped,
+                                              uint64_t &lag) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (cursor >= head)
     return nullptr;
-  auto buffer = cached_buffers.front();
-  cached_buffers.pop_front();
-  return std::move(buffer);
+  if (cursor < tail) {
+    // released, skip to the latest gop if still kept
+    uint64_t next = tail;
+    if (gop_aware && has_gop && gop_start >= tail)
+      next = gop_start;
+    dropped += next - cursor;
+    cursor = next;
+  }
+  lag = head - cursor - 1;
+  auto buffer = slots[cursor++ % slots.size()];
+  Trim();
+  return buffer;
 }
 
-void Source::SetCachedBufSize(size_t one_buf_size) {
-  // max: 5 M/s
-  if (one_buf_size > 0)
-    m_cached_buffers_size = 1024 * 1024 * 5 / one_buf_size;
+void FanoutRing::ReadableHandler(FanoutRing *ring, int /*mask*/) {
+  ring->Dispatch();
 }
+
+void FanoutRing::Dispatch() {
+  uint64_t cnt;
+  if (read(event_fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+    RKMEDIA_LOGI("read eventfd failed: %m\n");
+  dispatching = true;
+  for (size_t i = 0; i < subscribers.size(); i++) {
+    ListSource *sub = subscribers[i];
+    if (sub && sub->waiting && HasData(sub->cursor))
+      sub->Deliver();
+  }
+  dispatching = false;
+  subscribers.erase(std::remove(subscribers.begin(), subscribers.end(),
+                                (ListSource *)nullptr),
+                    subscribers.end());
+}
+
+ListSource::ListSource(UsageEnvironment &env, std::shared_ptr<FanoutRing> ring)
+    : FramedSource(env), fRing(ring), waiting(false), delivered(0),
+      dropped(0), max_lag(0) {
+  cursor = fRing->JoinCursor();
+  fRing->Attach(this, envir().taskScheduler());
+}
+
+ListSource::~ListSource() {
+  fRing->Detach(this);
+  RKMEDIA_LOGI("ListSource %p: delivered %llu, dropped %llu, max lag %llu\n",
+               this, (unsigned long long)delivered,
+               (unsigned long long)dropped, (unsigned long long)max_lag);
+}
+
+std::shared_ptr<MediaBuffer> ListSource::Pop() {
+  uint64_t lag = 0;
+  auto buffer = fRing->Read(cursor, dropped, lag);
+  if (buffer) {
+    delivered++;
+    if (lag > max_lag)
+      max_lag = lag;
+  }
+  return buffer;
+}
+
 void ListSource::doGetNextFrame() {
-  assert(fSource.GetReadFd() >= 0);
-  // Await the next incoming data on our FID:
-  envir().taskScheduler().turnOnBackgroundReadHandling(
-      fSource.GetReadFd(),
-      (TaskScheduler::BackgroundHandlerProc *)&incomingDataHandler, this);
+  waiting = true;
+  // Already behind: no push will come to wake us, kick the ring ourselves.
+  if (fRing->HasData(cursor))
+    fRing->Kick();
 }
 
 void ListSource::doStopGettingFrames() {
   LOG_FILE_FUNC_LINE();
+  waiting = false;
   FramedSource::doStopGettingFrames();
 }
 
-void ListSource::incomingDataHandler(ListSource *source, int /*mask*/) {
-  source->incomingDataHandler1();
-}
-
-void ListSource::incomingDataHandler1() {
-  // Read the data from our file into the client's buffer:
+void ListSource::Deliver() {
+  waiting = false;
   readFromList();
-
-  assert(fSource.GetReadFd() >= 0);
-  // Stop handling any more input, until we're ready again:
-  envir().taskScheduler().turnOffBackgroundReadHandling(fSource.GetReadFd());
-
   // Tell our client that we have new data:
   afterGetting(this);
 }
@@ -360,10 +338,9 @@ void ListSource::flush() {
   fNumTruncatedBytes = 0;
 }
 
-VideoFramedSource::VideoFramedSource(UsageEnvironment &env, Source &source)
-    : ListSource(env, source), got_iframe(false) {
-  // fReadFd = input.vs->GetReadFd();
-}
+VideoFramedSource::VideoFramedSource(UsageEnvironment &env,
+                                     std::shared_ptr<FanoutRing> ring)
+    : ListSource(env, ring), got_iframe(false) {}
 
 VideoFramedSource::~VideoFramedSource() {
   LOG_FILE_FUNC_LINE();
@@ -375,17 +352,9 @@ bool VideoFramedSource::readFromList(bool flush _UNUSED) {
   fprintf(stderr, "$$$$ %s, %d\n", __func__, __LINE__);
 #endif
   std::shared_ptr<MediaBuffer> buffer;
-  int i = 0;
-  ssize_t read_size = (ssize_t)sizeof(i);
-  ssize_t ret = read(fSource.GetReadFd(), &i, sizeof(i));
-  if (ret != read_size) {
-    RKMEDIA_LOGI("video %s:%d, fd = %d. read from pipe error, %m\n", __func__,
-                 __LINE__, fSource.GetReadFd());
-    envir() << __LINE__ << " read from pipe error: " << errno << "\n";
-    goto err;
-  }
+  ssize_t read_size;
 
-  buffer = fSource.Pop();
+  buffer = Pop();
   if (buffer) {
     if (!got_iframe) {
       got_iframe = buffer->GetUserFlag() & MediaBuffer::kIntra;
@@ -442,10 +411,9 @@ err:
   return false;
 }
 
-CommonFramedSource::CommonFramedSource(UsageEnvironment &env, Source &source)
-    : ListSource(env, source) {
-  // fReadFd = input.as->GetReadFd();
-}
+CommonFramedSource::CommonFramedSource(UsageEnvironment &env,
+                                       std::shared_ptr<FanoutRing> ring)
+    : ListSource(env, ring) {}
 
 CommonFramedSource::~CommonFramedSource() {
   LOG_FILE_FUNC_LINE();
@@ -463,17 +431,7 @@ bool CommonFramedSource::readFromList(bool flush _UNUSED) {
   std::shared_ptr<MediaBuffer> buffer;
   uint8_t *p;
 
-  int i = 0;
-  ssize_t read_size = (ssize_t)sizeof(i);
-  ssize_t ret = read(fSource.GetReadFd(), &i, sizeof(i));
-  if (ret != read_size) {
-    RKMEDIA_LOGI("common %s:%d, fd = %d. read from pipe error, %m\n", __func__,
-                 __LINE__, fSource.GetReadFd());
-    envir() << __LINE__ << " read from pipe error: " << errno << "\n";
-    goto err;
-  }
-
-  buffer = fSource.Pop();
+  buffer = Pop();
   if (buffer) {
     p = (uint8_t *)buffer->GetPtr();
     fPresentationTime = buffer->GetTimeVal();
@@ -509,7 +467,6 @@ bool CommonFramedSource::readFromList(bool flush _UNUSED) {
     return true;
   }
 
-err:
   fFrameSize = 0;
   fNumTruncatedBytes = 0;
   return false;
@@ -5,10 +5,13 @@
 #ifndef EASYMEDIA_LIVE555_MEDIA_INPUT_HH_
 #define EASYMEDIA_LIVE555_MEDIA_INPUT_HH_
 
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
-#include <list>
 #include <memory>
-#include <type_traits>
+#include <mutex>
+#include <vector>
 
 #include <liveMedia/MediaSink.hh>
 
@@ -18,35 +21,63 @@
 namespace easymedia {
 
 class MediaBuffer;
-class VideoFramedSource;
-class CommonFramedSource;
-using ListReductionPtr = std::add_pointer<void(
-    void *userdata, std::list<std::shared_ptr<MediaBuffer>> &mb_list)>::type;
+class ListSource;
 
 // using StartStreamCallback = std::add_pointer<void(void)>::type;
 typedef std::function<void()> StartStreamCallback;
 
-class Source {
+// The recent buffers of one channel (video, audio or muxer), shared by all
+// its rtsp subscribers. The flow thread pushes, each subscriber reads with
+// its own cursor from the live555 event loop; a push costs one eventfd
+// write whatever the number of subscribers. The buffers may be references
+// to encoder hardware buffers, so only the ones some subscriber has not
+// read yet and, on gop aware rings, the current gop are kept, and nothing
+// without subscribers. A subscriber which falls a whole ring behind skips
+// to the latest gop start (gop aware rings) or to the oldest buffer, a new
+// one starts at the latest gop start if it is still kept.
+class FanoutRing {
 public:
-  Source();
-  ~Source();
-  bool Init(ListReductionPtr func = nullptr);
-  void Push(std::shared_ptr<easymedia::MediaBuffer> &);
-  std::shared_ptr<MediaBuffer> Pop();
-  int GetReadFd() { return wakeFds[0]; }
-  int GetWriteFd() { return wakeFds[1]; }
-  Boolean GetReadFdStatus() { return m_read_fd_status; }
-  void CloseReadFd();
-  unsigned GetCachedBufSize() { return m_cached_buffers_size; }
+  FanoutRing(size_t capacity, bool gop_aware);
+  ~FanoutRing();
+  bool Init();
+  void Push(std::shared_ptr<MediaBuffer> &buffer);
+  // Limits the buffers kept to about 5MB/s of buffers of one_buf_size.
   void SetCachedBufSize(size_t one_buf_size);
+  int GetSubscriberNum() { return subscriber_num; }
+
+  // Following are for the live555 event loop thread only.
+  void Attach(ListSource *sub, TaskScheduler &scheduler);
+  void Detach(ListSource *sub);
+  uint64_t JoinCursor();
+  bool HasData(uint64_t cursor);
+  // Next buffer after cursor, dropped is increased by the skipped ones.
+  std::shared_ptr<MediaBuffer> Read(uint64_t &cursor, uint64_t &dropped,
+                                    uint64_t &lag);
+  void Kick();
 
 private:
-  std::list<std::shared_ptr<MediaBuffer>> cached_buffers;
-  ConditionLockMutex mtx;
-  ListReductionPtr reduction;
-  int wakeFds[2]; // Live555's EventTrigger is poor for multithread, use fds
-  unsigned m_cached_buffers_size;
-  Boolean m_read_fd_status;
+  static void ReadableHandler(FanoutRing *ring, int mask);
+  void Dispatch();
+  // Drops the buffers before sequence end, with mtx held.
+  void Release(uint64_t end);
+  // Drops the buffers all the subscribers have read, but not the current
+  // gop while there are subscribers, with mtx held.
+  void Trim();
+
+  std::vector<std::shared_ptr<MediaBuffer>> slots;
+  bool gop_aware;
+  uint64_t head; // sequence of the next push
+  uint64_t tail; // sequence of the oldest buffer kept
+  size_t max_cached;
+  uint64_t gop_start;
+  bool has_gop;
+  bool last_extra;
+  std::mutex mtx;
+  int event_fd;
+  TaskScheduler *scheduler;
+  std::vector<ListSource *> subscribers;
+  std::atomic<int> subscriber_num;
+  bool dispatching;
 };
 
 class Live555MediaInput : public Medium {
@@ -61,6 +92,9 @@ public:
   void PushNewVideo(std::shared_ptr<MediaBuffer> &buffer);
   void PushNewAudio(std::shared_ptr<MediaBuffer> &buffer);
   void PushNewMuxer(std::shared_ptr<MediaBuffer> &buffer);
+  // Whether any rtsp client reads one of the channels.
+  bool HasSubscriber();
+  void UpdateMaxIdrSize(std::shared_ptr<MediaBuffer> &buffer);
 
   void SetStartVideoStreamCallback(const StartStreamCallback &cb);
   StartStreamCallback GetStartVideoStreamCallback();
@@ -75,9 +109,9 @@ protected:
 private:
   Live555MediaInput(UsageEnvironment &env);
 
-  std::list<Source *> video_list;
-  std::list<Source *> audio_list;
-  std::list<Source *> muxer_list;
+  std::shared_ptr<FanoutRing> video_ring;
+  std::shared_ptr<FanoutRing> audio_ring;
+  std::shared_ptr<FanoutRing> muxer_ring;
   volatile bool connecting;
 
   StartStreamCallback video_callback;
@@ -92,32 +126,39 @@ private:
 };
 
 class ListSource : public FramedSource {
+public:
+  uint64_t GetDeliveredNum() { return delivered; }
+  uint64_t GetDroppedNum() { return dropped; }
+  uint64_t GetMaxLag() { return max_lag; }
+
 protected:
-  ListSource(UsageEnvironment &env, Source &source)
-      : FramedSource(env), fSource(source) {}
-  virtual ~ListSource() {
-    if (fSource.GetReadFd() >= 0)
-      envir().taskScheduler().turnOffBackgroundReadHandling(
-          fSource.GetReadFd());
-    fSource.CloseReadFd();
-  }
+  ListSource(UsageEnvironment &env, std::shared_ptr<FanoutRing> ring);
+  virtual ~ListSource();
 
   virtual bool readFromList(bool flush = false) = 0;
   virtual void flush();
+  std::shared_ptr<MediaBuffer> Pop();
 
-  Source &fSource;
+  std::shared_ptr<FanoutRing> fRing;
 
 private: // redefined virtual functions:
   virtual void doGetNextFrame();
   virtual void doStopGettingFrames();
 
-  static void incomingDataHandler(ListSource *source, int mask);
-  void incomingDataHandler1();
+  friend class FanoutRing;
+  void Deliver();
+
+  uint64_t cursor;
+  bool waiting;
+  // statistics
+  uint64_t delivered;
+  uint64_t dropped;
+  uint64_t max_lag;
 };
 
 class VideoFramedSource : public ListSource {
 public:
-  VideoFramedSource(UsageEnvironment &env, Source &source);
+  VideoFramedSource(UsageEnvironment &env, std::shared_ptr<FanoutRing> ring);
   virtual ~VideoFramedSource();
 
   void SetCodecType(CodecType type) { codec_type = type; }
@@ -131,7 +172,7 @@ protected: // redefined virtual functions:
 
 class CommonFramedSource : public ListSource {
 public:
-  CommonFramedSource(UsageEnvironment &env, Source &source);
+  CommonFramedSource(UsageEnvironment &env, std::shared_ptr<FanoutRing> ring);
   virtual ~CommonFramedSource();
 
 protected: // redefined virtual functions:
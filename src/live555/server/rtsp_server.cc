@@ -6,6 +6,7 @@
 
 #include <time.h>
 
+#include <atomic>
 #include <mutex>
 
 #include <BasicUsageEnvironment/BasicUsageEnvironment.hh>
@@ -52,35 +53,67 @@ private:
   std::string channel_name;
   std::string video_type;
   std::string audio_type;
+  // zero-copy of hardware buffers, see KEY_HW_BUFFER_BUDGET
+  int hw_buffer_budget;
+  std::shared_ptr<std::atomic<int>> hw_buffer_inflight;
+  std::shared_ptr<MediaBuffer> RefHwBuffer(std::shared_ptr<MediaBuffer> &src);
   friend bool SendMediaToServer(Flow *f, MediaBufferVector &input_vector);
   void CallPlayVideoHandler();
   void CallPlayAudioHandler();
 };
 
+// Share the hardware buffer with all the rtsp sources instead of copying it.
+// The returned buffer keeps the source alive and gives its budget back when
+// the last rtsp client is done with it. Return nullptr if over budget.
+std::shared_ptr<MediaBuffer>
+RtspServerFlow::RefHwBuffer(std::shared_ptr<MediaBuffer> &src) {
+  auto inflight = hw_buffer_inflight;
+  if (inflight->fetch_add(1) >= hw_buffer_budget) {
+    inflight->fetch_sub(1);
+    return nullptr;
+  }
+  auto ref = std::make_shared<MediaBuffer>(*src);
+  std::shared_ptr<void> hold(src.get(), [src, inflight](void *) mutable {
+    src.reset();
+    inflight->fetch_sub(1);
+  });
+  ref->SetRelatedSPtr(hold);
+  return ref;
+}
+
 bool SendMediaToServer(Flow *f, MediaBufferVector &input_vector) {
   RtspServerFlow *rtsp_flow = (RtspServerFlow *)f;
 
   for (auto &buffer : input_vector) {
     if (!buffer)
       continue;
-    if (buffer && buffer->IsHwBuffer()) {
-      // hardware buffer is limited, copy it
-      auto new_buffer = MediaBuffer::Clone(*buffer.get());
-      new_buffer->SetType(buffer->GetType());
+    if (buffer->IsHwBuffer() && !rtsp_flow->server_input->HasSubscriber()) {
+      // No rtsp client, neither copy nor hold the hardware buffer. The
+      // idr size is still needed by the next client's sdp.
+      rtsp_flow->server_input->UpdateMaxIdrSize(buffer);
+      continue;
+    }
+    if (buffer->IsHwBuffer()) {
+      std::shared_ptr<MediaBuffer> new_buffer;
+      if (rtsp_flow->hw_buffer_budget > 0)
+        new_buffer = rtsp_flow->RefHwBuffer(buffer);
+      if (!new_buffer) {
+        // hardware buffer is limited, copy it
+        new_buffer = MediaBuffer::Clone(*buffer.get());
+        if (!new_buffer)
+          continue;
+        new_buffer->SetType(buffer->GetType());
+      }
       buffer = new_buffer;
     }
 
     if ((buffer->GetUserFlag() & MediaBuffer::kIntra)) {
       std::list<std::shared_ptr<easymedia::MediaBuffer>> spspps;
-      if (rtsp_flow->video_type == VIDEO_H264) {
-        spspps = split_h264_separate((const uint8_t *)buffer->GetPtr(),
-                                     buffer->GetValidSize(),
-                                     buffer->GetUSTimeStamp());
-      } else if (rtsp_flow->video_type == VIDEO_H265) {
-        spspps = split_h265_separate((const uint8_t *)buffer->GetPtr(),
-                                     buffer->GetValidSize(),
-                                     buffer->GetUSTimeStamp());
-      }
+      // Views into buffer, the nal index is kept for the rtsp sources.
+      if (rtsp_flow->video_type == VIDEO_H264)
+        spspps = split_h26x_separate(buffer, CODEC_TYPE_H264);
+      else if (rtsp_flow->video_type == VIDEO_H265)
+        spspps = split_h26x_separate(buffer, CODEC_TYPE_H265);
       // Independently send vps, sps, pps packets to live555.
       for (auto &buf : spspps)
         rtsp_flow->server_input->PushNewVideo(buf);
@@ -100,7 +133,9 @@ bool SendMediaToServer(Flow *f, MediaBufferVector &input_vector) {
   return true;
 }
 
-RtspServerFlow::RtspServerFlow(const char *param) {
+RtspServerFlow::RtspServerFlow(const char *param)
+    : server_input(nullptr), hw_buffer_budget(0),
+      hw_buffer_inflight(std::make_shared<std::atomic<int>>(0)) {
   std::list<std::string> input_data_types;
   std::map<std::string, std::string> params;
   if (!parse_media_param_map(param, params)) {
@@ -135,6 +170,10 @@ RtspServerFlow::RtspServerFlow(const char *param) {
   if (!value.empty())
     bitrate = std::stoi(value);
 
+  value = params[KEY_HW_BUFFER_BUDGET];
+  if (!value.empty())
+    hw_buffer_budget = std::stoi(value);
+
   if (rtspConnection) {
     int in_idx = 0;
     std::string markname;
@@ -4,7 +4,13 @@
 
 #include "lock.h"
 
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
 #include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
 namespace easymedia {
 
@@ -41,6 +47,10 @@ void ConditionLockMutex::unlock() {
 }
 void ConditionLockMutex::wait() { cond.wait(mtx); }
 void ConditionLockMutex::notify() { cond.notify_all(); }
+bool ConditionLockMutex::wait_for(int ms) {
+  return cond.wait_for(mtx, std::chrono::milliseconds(ms)) ==
+         std::cv_status::no_timeout;
+}
 
 ReadWriteLockMutex::ReadWriteLockMutex() : valid(true) {
   int ret = pthread_rwlock_init(&rwlock, NULL);
@@ -81,4 +91,53 @@ void SpinLockMutex::unlock() {
   flag.clear(std::memory_order_release);
 }
 
+static inline long futex(std::atomic<uint32_t> *uaddr, int op, uint32_t val,
+                         const struct timespec *timeout) {
+  return syscall(SYS_futex, reinterpret_cast<uint32_t *>(uaddr), op, val,
+                 timeout, nullptr, 0);
+}
+
+uint32_t EventCount::PrepareWait() {
+  waiters.fetch_add(1, std::memory_order_seq_cst);
+  return epoch.load(std::memory_order_seq_cst);
+}
+
+void EventCount::CancelWait() {
+  waiters.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+bool EventCount::Wait(uint32_t key, int timeout_ms) {
+  bool ret = true;
+  struct timespec ts;
+  struct timespec *pts = nullptr;
+  if (timeout_ms >= 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    pts = &ts;
+  }
+  while (epoch.load(std::memory_order_acquire) == key) {
+    if (futex(&epoch, FUTEX_WAIT_PRIVATE, key, pts) < 0) {
+      if (errno == ETIMEDOUT) {
+        ret = false;
+        break;
+      }
+      if (errno == EAGAIN)
+        break;
+      // EINTR: a relative timeout restarts, which is good enough here.
+    }
+  }
+  waiters.fetch_sub(1, std::memory_order_seq_cst);
+  return ret;
+}
+
+void EventCount::Notify() {
+  // Pairs with the seq_cst increment in PrepareWait: either the waiter sees
+  // the new state when it re-checks, or we see the waiter here.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiters.load(std::memory_order_seq_cst) == 0)
+    return;
+  epoch.fetch_add(1, std::memory_order_seq_cst);
+  futex(&epoch, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+}
+
 } // namespace easymedia
@@ -0,0 +1,167 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "luma.h"
+
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace easymedia {
+
+// Sum 16 bytes at a time, min/max too if asked. The scalar loop does the
+// tail and the whole line without NEON/SSE2.
+template <bool kMinMax>
+static uint64_t sum_line(const uint8_t *p, int n, uint8_t &mn, uint8_t &mx) {
+  uint64_t sum = 0;
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  uint8x16_t vmin = vdupq_n_u8(0xFF);
+  uint8x16_t vmax = vdupq_n_u8(0);
+  while (n - i >= 16) {
+    // a u32 lane gets at most 1020 per block, flush it long before overflow
+    int block_end = i + (n - i < (1 << 20) ? n - i : (1 << 20));
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; block_end - i >= 16; i += 16) {
+      uint8x16_t v = vld1q_u8(p + i);
+      acc = vpadalq_u16(acc, vpaddlq_u8(v));
+      if (kMinMax) {
+        vmin = vminq_u8(vmin, v);
+        vmax = vmaxq_u8(vmax, v);
+      }
+    }
+    uint64x2_t acc64 = vpaddlq_u32(acc);
+    sum += vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1);
+  }
+  if (kMinMax && i > 0) {
+    uint8_t lane_min[16], lane_max[16];
+    vst1q_u8(lane_min, vmin);
+    vst1q_u8(lane_max, vmax);
+    for (int k = 0; k < 16; k++) {
+      mn = lane_min[k] < mn ? lane_min[k] : mn;
+      mx = lane_max[k] > mx ? lane_max[k] : mx;
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = _mm_setzero_si128();
+  __m128i vmin = _mm_set1_epi8((char)0xFF);
+  __m128i vmax = _mm_setzero_si128();
+  for (; n - i >= 16; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    if (kMinMax) {
+      vmin = _mm_min_epu8(vmin, v);
+      vmax = _mm_max_epu8(vmax, v);
+    }
+  }
+  uint64_t acc64[2];
+  _mm_storeu_si128((__m128i *)acc64, acc);
+  sum = acc64[0] + acc64[1];
+  if (kMinMax && i > 0) {
+    uint8_t lane_min[16], lane_max[16];
+    _mm_storeu_si128((__m128i *)lane_min, vmin);
+    _mm_storeu_si128((__m128i *)lane_max, vmax);
+    for (int k = 0; k < 16; k++) {
+      mn = lane_min[k] < mn ? lane_min[k] : mn;
+      mx = lane_max[k] > mx ? lane_max[k] : mx;
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    sum += p[i];
+    if (kMinMax) {
+      mn = p[i] < mn ? p[i] : mn;
+      mx = p[i] > mx ? p[i] : mx;
+    }
+  }
+  return sum;
+}
+
+uint64_t LumaSumLine(const uint8_t *p, int n) {
+  uint8_t mn = 0xFF, mx = 0;
+  return sum_line<false>(p, n, mn, mx);
+}
+
+static bool region_valid(const ImageRect &r, int width, int height) {
+  return r.x >= 0 && r.y >= 0 && r.w > 0 && r.h > 0 && r.x + r.w <= width &&
+         r.y + r.h <= height;
+}
+
+void CalculateRegionLuma(const uint8_t *plane, int stride, int width,
+                         int height, const ImageRect *regions, int num,
+                         LumaStat *stats, int flags, int step) {
+  if (!plane || !regions || !stats || num <= 0)
+    return;
+  if (step < 1)
+    step = 1;
+  bool minmax = flags & LUMA_STAT_MINMAX;
+  bool histogram = flags & LUMA_STAT_HISTOGRAM;
+
+  // Sample the grid x % step == 0 && y % step == 0 of the plane, so that
+  // overlapped regions see the same pixels.
+  int y_begin = height, y_end = 0;
+  for (int i = 0; i < num; i++) {
+    LumaStat &s = stats[i];
+    s.sum = 0;
+    s.count = 0;
+    s.min = 0xFF;
+    s.max = 0;
+    if (histogram && s.hist)
+      memset(s.hist, 0, 256 * sizeof(uint32_t));
+    const ImageRect &r = regions[i];
+    if (!region_valid(r, width, height))
+      continue;
+    y_begin = r.y < y_begin ? r.y : y_begin;
+    y_end = r.y + r.h > y_end ? r.y + r.h : y_end;
+  }
+  y_begin = (y_begin + step - 1) / step * step;
+
+  for (int y = y_begin; y < y_end; y += step) {
+    const uint8_t *line = plane + (size_t)y * stride;
+    for (int i = 0; i < num; i++) {
+      const ImageRect &r = regions[i];
+      if (y < r.y || y >= r.y + r.h || !region_valid(r, width, height))
+        continue;
+      LumaStat &s = stats[i];
+      if (step == 1) {
+        const uint8_t *p = line + r.x;
+        s.sum += minmax ? sum_line<true>(p, r.w, s.min, s.max)
+                        : sum_line<false>(p, r.w, s.min, s.max);
+        s.count += r.w;
+        if (histogram && s.hist) {
+          for (int x = 0; x < r.w; x++)
+            s.hist[p[x]]++;
+        }
+        continue;
+      }
+      int x_begin = (r.x + step - 1) / step * step;
+      int x_end = r.x + r.w;
+      uint32_t sum = 0;
+      for (int x = x_begin; x < x_end; x += step)
+        sum += line[x];
+      s.sum += sum;
+      s.count += (x_end - x_begin + step - 1) / step;
+      if (minmax || (histogram && s.hist)) {
+        for (int x = x_begin; x < x_end; x += step) {
+          uint8_t v = line[x];
+          s.min = v < s.min ? v : s.min;
+          s.max = v > s.max ? v : s.max;
+          if (histogram && s.hist)
+            s.hist[v]++;
+        }
+      }
+    }
+  }
+  if (!minmax) {
+    for (int i = 0; i < num; i++)
+      stats[i].min = stats[i].max = 0;
+  }
+}
+
+} // namespace easymedia
@@ -6,6 +6,7 @@
 
 #include <sstream>
 #include <strings.h>
+#include <thread>
 
 #include "encoder.h"
 #include "key_string.h"
@@ -144,6 +145,9 @@ bool ParseMediaConfigFromMap(std::map<std::string, std::string> &params,
     GET_STRING_TO_INT(vid_cfg.full_range, params, KEY_FULL_RANGE, 0)
     GET_STRING_TO_INT(vid_cfg.ref_frm_cfg, params, KEY_REF_FRM_CFG, 0)
     GET_STRING_TO_INT(vid_cfg.rotation, params, KEY_ROTATION, 0)
+    vid_cfg.codec_threads = ParseCodecThreads(params[KEY_CODEC_THREADS]);
+    vid_cfg.codec_thread_type =
+        ParseCodecThreadType(params[KEY_CODEC_THREAD_TYPE]);
 
     if (ParseMediaConfigFps(params, vid_cfg) < 0)
       return false;
@@ -165,6 +169,34 @@ bool ParseMediaConfigFromMap(std::map<std::string, std::string> &params,
   return true;
 }
 
+int ParseCodecThreads(const std::string &s) {
+  if (s.empty())
+    return 0;
+  if (!strcasecmp(s.c_str(), KEY_AUTO))
+    return CODEC_THREADS_AUTO;
+  int threads = std::atoi(s.c_str());
+  return threads > 0 ? threads : 0;
+}
+
+int ParseCodecThreadType(const std::string &s) {
+  int type = 0;
+  if (s.find(KEY_THREAD_FRAME) != s.npos)
+    type |= CODEC_THREAD_FRAME;
+  if (s.find(KEY_THREAD_SLICE) != s.npos)
+    type |= CODEC_THREAD_SLICE;
+  return type;
+}
+
+int GetCodecThreads(int codec_threads) {
+  // libavcodec does not use more than 16 threads for one context
+  static const int kMaxThreads = 16;
+  if (codec_threads == CODEC_THREADS_AUTO)
+    codec_threads = std::thread::hardware_concurrency();
+  if (codec_threads <= 0)
+    return 1;
+  return codec_threads < kMaxThreads ? codec_threads : kMaxThreads;
+}
+
 // roi_regions:(x,x,x,x,x,x,x,x,x)(x,x,x,x,x,x,x,x,x)...
 std::vector<EncROIRegion> StringToRoiRegions(const std::string &str_regions) {
   std::vector<EncROIRegion> ret;
@@ -268,6 +300,18 @@ std::string to_param_string(const VideoConfig &vid_cfg) {
   PARAM_STRING_APPEND_TO(ret, KEY_FULL_RANGE, vid_cfg.full_range);
   PARAM_STRING_APPEND_TO(ret, KEY_REF_FRM_CFG, vid_cfg.ref_frm_cfg);
   PARAM_STRING_APPEND_TO(ret, KEY_ROTATION, vid_cfg.rotation);
+  if (vid_cfg.codec_threads > 0)
+    PARAM_STRING_APPEND_TO(ret, KEY_CODEC_THREADS, vid_cfg.codec_threads);
+  else if (vid_cfg.codec_threads == CODEC_THREADS_AUTO)
+    PARAM_STRING_APPEND(ret, KEY_CODEC_THREADS, KEY_AUTO);
+  if (vid_cfg.codec_thread_type) {
+    std::string type;
+    if (vid_cfg.codec_thread_type & CODEC_THREAD_FRAME)
+      type.append(KEY_THREAD_FRAME);
+    if (vid_cfg.codec_thread_type & CODEC_THREAD_SLICE)
+      type.append(type.empty() ? "" : "_").append(KEY_THREAD_SLICE);
+    PARAM_STRING_APPEND(ret, KEY_CODEC_THREAD_TYPE, type);
+  }
   return ret;
 }
 
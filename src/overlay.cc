@@ -0,0 +1,317 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "overlay.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace easymedia {
+
+int OverlayInitImage(OverlayImage &image, PixelFormat pix_fmt, uint8_t *data,
+                     int width, int height, int vir_width, int vir_height) {
+  memset(&image, 0, sizeof(image));
+  if (!data || width <= 0 || height <= 0 || vir_width < width ||
+      vir_height < height)
+    return -EINVAL;
+  image.pix_fmt = pix_fmt;
+  image.width = width;
+  image.height = height;
+  image.planes[0] = data;
+  switch (pix_fmt) {
+  case PIX_FMT_NONE:
+    image.strides[0] = vir_width;
+    break;
+  case PIX_FMT_NV12:
+  case PIX_FMT_NV21:
+    image.strides[0] = image.strides[1] = vir_width;
+    image.planes[1] = data + vir_width * vir_height;
+    break;
+  case PIX_FMT_YUV420P:
+    image.strides[0] = vir_width;
+    image.strides[1] = image.strides[2] = vir_width / 2;
+    image.planes[1] = data + vir_width * vir_height;
+    image.planes[2] = image.planes[1] + vir_width / 2 * vir_height / 2;
+    break;
+  case PIX_FMT_RGB565:
+  case PIX_FMT_BGR565:
+    image.strides[0] = vir_width * 2;
+    break;
+  case PIX_FMT_RGB888:
+  case PIX_FMT_BGR888:
+    image.strides[0] = vir_width * 3;
+    break;
+  case PIX_FMT_ARGB8888:
+  case PIX_FMT_ABGR8888:
+    image.strides[0] = vir_width * 4;
+    break;
+  default:
+    return -EINVAL;
+  }
+  return 0;
+}
+
+static inline uint8_t clip_u8(int v) {
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+uint32_t OverlayColor(PixelFormat pix_fmt, uint8_t r, uint8_t g, uint8_t b,
+                      uint8_t a) {
+  switch (pix_fmt) {
+  case PIX_FMT_NV12:
+  case PIX_FMT_NV21:
+  case PIX_FMT_YUV420P: {
+    // 16.16 fixed point
+    int y = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+    int u = ((-11059 * r - 21709 * g + 32768 * b + 32768) >> 16) + 128;
+    int v = ((32768 * r - 27439 * g - 5329 * b + 32768) >> 16) + 128;
+    return (clip_u8(y) << 16) | (clip_u8(u) << 8) | clip_u8(v);
+  }
+  default:
+    return ((uint32_t)a << 24) | (r << 16) | (g << 8) | b;
+  }
+}
+
+// A box in the coordinates of one plane, clipped, x1 and y1 exclusive,
+// with the width of its left, right, top and bottom borders, 0 if filled.
+typedef struct {
+  int x0, y0, x1, y1;
+  int l, r, t, b;
+  uint32_t pixel;
+} PlaneBox;
+
+// A plane of the image, its bytes per pixel and subsampling.
+typedef struct {
+  uint8_t *data;
+  int stride;
+  int bpp;
+  int shift; // 1 for the half size chroma planes
+} PlaneDesc;
+
+static int get_planes(const OverlayImage &image, PlaneDesc *planes) {
+  for (int i = 0; i < 3; i++) {
+    planes[i].data = image.planes[i];
+    planes[i].stride = image.strides[i];
+    planes[i].bpp = 1;
+    planes[i].shift = i ? 1 : 0;
+  }
+  switch (image.pix_fmt) {
+  case PIX_FMT_NONE:
+    return 1;
+  case PIX_FMT_NV12:
+  case PIX_FMT_NV21:
+    planes[1].bpp = 2;
+    return 2;
+  case PIX_FMT_YUV420P:
+    return 3;
+  case PIX_FMT_RGB565:
+  case PIX_FMT_BGR565:
+    planes[0].bpp = 2;
+    return 1;
+  case PIX_FMT_RGB888:
+  case PIX_FMT_BGR888:
+    planes[0].bpp = 3;
+    return 1;
+  case PIX_FMT_ARGB8888:
+  case PIX_FMT_ABGR8888:
+    planes[0].bpp = 4;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static uint32_t swap_rb(uint32_t c) {
+  return (c & 0xFF00FF00) | ((c >> 16) & 0xFF) | ((c & 0xFF) << 16);
+}
+
+// The bytes of color on plane, in memory order from the lowest.
+static uint32_t plane_pixel(PixelFormat pix_fmt, int plane, uint32_t color) {
+  uint32_t y = (color >> 16) & 0xFF, u = (color >> 8) & 0xFF, v = color & 0xFF;
+  switch (pix_fmt) {
+  case PIX_FMT_NONE:
+    return color & 0xFF;
+  case PIX_FMT_NV12:
+    return plane ? (u | (v << 8)) : y;
+  case PIX_FMT_NV21:
+    return plane ? (v | (u << 8)) : y;
+  case PIX_FMT_YUV420P:
+    return plane == 0 ? y : (plane == 1 ? u : v);
+  case PIX_FMT_BGR565:
+    color = swap_rb(color);
+  // fall through
+  case PIX_FMT_RGB565:
+    return ((color >> 8) & 0xF800) | ((color >> 5) & 0x07E0) |
+           ((color >> 3) & 0x001F);
+  case PIX_FMT_BGR888:
+  case PIX_FMT_ABGR8888:
+    return swap_rb(color);
+  default:
+    // RGB888 is b, g, r in memory and ARGB8888 b, g, r, a
+    return color;
+  }
+}
+
+void OverlayFillSpan(uint8_t *dst, int n, uint32_t pixel, int bpp) {
+  if (n <= 0)
+    return;
+  if (bpp == 1) {
+    memset(dst, pixel, n);
+    return;
+  }
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  if (bpp == 2) {
+    uint16x8_t v = vdupq_n_u16(pixel);
+    for (; n - i >= 8; i += 8)
+      vst1q_u8(dst + i * 2, vreinterpretq_u8_u16(v));
+  } else if (bpp == 3) {
+    uint8x16x3_t v;
+    v.val[0] = vdupq_n_u8(pixel);
+    v.val[1] = vdupq_n_u8(pixel >> 8);
+    v.val[2] = vdupq_n_u8(pixel >> 16);
+    for (; n - i >= 16; i += 16)
+      vst3q_u8(dst + i * 3, v);
+  } else if (bpp == 4) {
+    uint32x4_t v = vdupq_n_u32(pixel);
+    for (; n - i >= 4; i += 4)
+      vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(v));
+  }
+#elif defined(__SSE2__)
+  if (bpp == 2) {
+    __m128i v = _mm_set1_epi16((short)pixel);
+    for (; n - i >= 8; i += 8)
+      _mm_storeu_si128((__m128i *)(dst + i * 2), v);
+  } else if (bpp == 4) {
+    __m128i v = _mm_set1_epi32((int)pixel);
+    for (; n - i >= 4; i += 4)
+      _mm_storeu_si128((__m128i *)(dst + i * 4), v);
+  }
+#endif
+  uint8_t *p = dst + i * bpp;
+  int left = n - i;
+  if (bpp == 3 && left > 16) {
+    // the pixels written so far are copied over the rest, doubling
+    for (int k = 0; k < 3; k++)
+      p[k] = pixel >> (k * 8);
+    int done = 3, total = left * 3;
+    while (done < total) {
+      int c = std::min(done, total - done);
+      memcpy(p + done, p, c);
+      done += c;
+    }
+    return;
+  }
+  for (; left > 0; left--, p += bpp) {
+    for (int k = 0; k < bpp; k++)
+      p[k] = pixel >> (k * 8);
+  }
+}
+
+static void fill_row(uint8_t *row, const PlaneBox &b, int y, int bpp) {
+  int w = b.x1 - b.x0;
+  if (!b.l || b.l + b.r >= w || y < b.y0 + b.t || y >= b.y1 - b.b) {
+    OverlayFillSpan(row + b.x0 * bpp, w, b.pixel, bpp);
+    return;
+  }
+  OverlayFillSpan(row + b.x0 * bpp, b.l, b.pixel, bpp);
+  OverlayFillSpan(row + (b.x1 - b.r) * bpp, b.r, b.pixel, bpp);
+}
+
+// Widths on a plane subsampled by shift of the borders of thick on a0..a1,
+// a sample is drawn if any of the full size ones it stands for is.
+static void get_bands(int a0, int a1, int thick, int shift, int &lo,
+                      int &hi) {
+  lo = ((std::min(a0 + thick, a1) - 1) >> shift) - (a0 >> shift) + 1;
+  hi = ((a1 - 1) >> shift) - (std::max(a1 - thick, a0) >> shift) + 1;
+}
+
+static bool by_top(const PlaneBox *a, const PlaneBox *b) {
+  return a->y0 < b->y0;
+}
+
+// One pass from the top of the first box to the bottom of the last, the
+// lines between the boxes are skipped.
+static void draw_plane(const PlaneDesc &plane, std::vector<PlaneBox> &boxes) {
+  std::vector<const PlaneBox *> sorted;
+  sorted.reserve(boxes.size());
+  for (auto &b : boxes)
+    sorted.push_back(&b);
+  std::sort(sorted.begin(), sorted.end(), by_top);
+  std::vector<const PlaneBox *> active;
+  size_t next = 0;
+  int y = sorted.empty() ? 0 : sorted[0]->y0;
+  while (next < sorted.size() || !active.empty()) {
+    if (active.empty() && sorted[next]->y0 > y)
+      y = sorted[next]->y0;
+    bool added = false;
+    while (next < sorted.size() && sorted[next]->y0 <= y) {
+      active.push_back(sorted[next++]);
+      added = true;
+    }
+    // by address, which is the order of the boxes, so the later one wins
+    if (added)
+      std::sort(active.begin(), active.end());
+    uint8_t *row = plane.data + (size_t)y * plane.stride;
+    for (auto b : active)
+      fill_row(row, *b, y, plane.bpp);
+    y++;
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [y](const PlaneBox *b) { return b->y1 <= y; }),
+                 active.end());
+  }
+}
+
+int OverlayDrawBoxes(const OverlayImage &image, const OverlayBox *boxes,
+                     int num) {
+  PlaneDesc planes[3];
+  int plane_num = get_planes(image, planes);
+  if (!plane_num || !boxes || num <= 0)
+    return 0;
+  std::vector<PlaneBox> plane_boxes;
+  plane_boxes.reserve(num);
+  int drawn = 0;
+  for (int p = 0; p < plane_num; p++) {
+    if (!planes[p].data)
+      return 0;
+    int s = planes[p].shift;
+    plane_boxes.clear();
+    for (int i = 0; i < num; i++) {
+      const ImageRect &r = boxes[i].rect;
+      if (r.w <= 0 || r.h <= 0)
+        continue;
+      int x0 = std::max(r.x, 0), x1 = std::min(r.x + r.w, image.width);
+      int y0 = std::max(r.y, 0), y1 = std::min(r.y + r.h, image.height);
+      if (x0 >= x1 || y0 >= y1)
+        continue;
+      PlaneBox b;
+      b.x0 = x0 >> s;
+      b.y0 = y0 >> s;
+      b.x1 = ((x1 - 1) >> s) + 1;
+      b.y1 = ((y1 - 1) >> s) + 1;
+      b.l = b.r = b.t = b.b = 0;
+      if (boxes[i].thick > 0) {
+        get_bands(x0, x1, boxes[i].thick, s, b.l, b.r);
+        get_bands(y0, y1, boxes[i].thick, s, b.t, b.b);
+      }
+      b.pixel = plane_pixel(image.pix_fmt, p, boxes[i].color);
+      plane_boxes.push_back(b);
+    }
+    draw_plane(planes[p], plane_boxes);
+    if (p == 0)
+      drawn = plane_boxes.size();
+  }
+  return drawn;
+}
+
+} // namespace easymedia
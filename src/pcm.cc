@@ -0,0 +1,414 @@
+// Copyright 2021 Fuzhou Rockchip Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "pcm.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace easymedia {
+
+static inline int16_t clip_s16(int32_t v) {
+  return v < -32768 ? -32768 : (v > 32767 ? 32767 : (int16_t)v);
+}
+
+// The SIMD loops below do 8 frames at a time, the scalar loops the tail.
+static int deinterleave_stereo16(int16_t *l, int16_t *r, const int16_t *src,
+                                 int frames) {
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; frames - i >= 8; i += 8) {
+    int16x8x2_t v = vld2q_s16(src + 2 * i);
+    vst1q_s16(l + i, v.val[0]);
+    vst1q_s16(r + i, v.val[1]);
+  }
+#elif defined(__SSE2__)
+  for (; frames - i >= 8; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 8));
+    __m128i va = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    __m128i vb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    _mm_storeu_si128((__m128i *)(l + i), _mm_packs_epi32(va, vb));
+    va = _mm_srai_epi32(a, 16);
+    vb = _mm_srai_epi32(b, 16);
+    _mm_storeu_si128((__m128i *)(r + i), _mm_packs_epi32(va, vb));
+  }
+#else
+  UNUSED(l);
+  UNUSED(r);
+  UNUSED(src);
+  UNUSED(frames);
+#endif
+  return i;
+}
+
+static int interleave_stereo16(int16_t *dst, const int16_t *l,
+                               const int16_t *r, int frames) {
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; frames - i >= 8; i += 8) {
+    int16x8x2_t v;
+    v.val[0] = vld1q_s16(l + i);
+    v.val[1] = vld1q_s16(r + i);
+    vst2q_s16(dst + 2 * i, v);
+  }
+#elif defined(__SSE2__)
+  for (; frames - i >= 8; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(l + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(r + i));
+    _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi16(a, b));
+    _mm_storeu_si128((__m128i *)(dst + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+  }
+#else
+  UNUSED(dst);
+  UNUSED(l);
+  UNUSED(r);
+  UNUSED(frames);
+#endif
+  return i;
+}
+
+static int deinterleave_stereo32(uint32_t *l, uint32_t *r, const uint32_t *src,
+                                 int frames) {
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; frames - i >= 4; i += 4) {
+    uint32x4x2_t v = vld2q_u32(src + 2 * i);
+    vst1q_u32(l + i, v.val[0]);
+    vst1q_u32(r + i, v.val[1]);
+  }
+#elif defined(__SSE2__)
+  for (; frames - i >= 4; i += 4) {
+    __m128 a = _mm_loadu_ps((const float *)(src + 2 * i));
+    __m128 b = _mm_loadu_ps((const float *)(src + 2 * i + 4));
+    _mm_storeu_ps((float *)(l + i), _mm_shuffle_ps(a, b, 0x88));
+    _mm_storeu_ps((float *)(r + i), _mm_shuffle_ps(a, b, 0xDD));
+  }
+#else
+  UNUSED(l);
+  UNUSED(r);
+  UNUSED(src);
+  UNUSED(frames);
+#endif
+  return i;
+}
+
+static int interleave_stereo32(uint32_t *dst, const uint32_t *l,
+                               const uint32_t *r, int frames) {
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; frames - i >= 4; i += 4) {
+    uint32x4x2_t v;
+    v.val[0] = vld1q_u32(l + i);
+    v.val[1] = vld1q_u32(r + i);
+    vst2q_u32(dst + 2 * i, v);
+  }
+#elif defined(__SSE2__)
+  for (; frames - i >= 4; i += 4) {
+    __m128 a = _mm_loadu_ps((const float *)(l + i));
+    __m128 b = _mm_loadu_ps((const float *)(r + i));
+    _mm_storeu_ps((float *)(dst + 2 * i), _mm_unpacklo_ps(a, b));
+    _mm_storeu_ps((float *)(dst + 2 * i + 4), _mm_unpackhi_ps(a, b));
+  }
+#else
+  UNUSED(dst);
+  UNUSED(l);
+  UNUSED(r);
+  UNUSED(frames);
+#endif
+  return i;
+}
+
+template <typename T>
+static void deinterleave(T *const *planes, const T *src, int channels,
+                         int frames, int begin) {
+  for (int i = begin; i < frames; i++)
+    for (int c = 0; c < channels; c++)
+      planes[c][i] = src[i * channels + c];
+}
+
+template <typename T>
+static void interleave(T *dst, const T *const *planes, int channels,
+                       int frames, int begin) {
+  for (int i = begin; i < frames; i++)
+    for (int c = 0; c < channels; c++)
+      dst[i * channels + c] = planes[c][i];
+}
+
+void PcmDeinterleave(void *const *planes, const void *src, int sample_bytes,
+                     int channels, int frames) {
+  int i = 0;
+  switch (sample_bytes) {
+  case 1:
+    deinterleave((uint8_t *const *)planes, (const uint8_t *)src, channels,
+                 frames, 0);
+    break;
+  case 2:
+    if (channels == 2)
+      i = deinterleave_stereo16((int16_t *)planes[0], (int16_t *)planes[1],
+                                (const int16_t *)src, frames);
+    deinterleave((int16_t *const *)planes, (const int16_t *)src, channels,
+                 frames, i);
+    break;
+  case 4:
+    if (channels == 2)
+      i = deinterleave_stereo32((uint32_t *)planes[0], (uint32_t *)planes[1],
+                                (const uint32_t *)src, frames);
+    deinterleave((uint32_t *const *)planes, (const uint32_t *)src, channels,
+                 frames, i);
+    break;
+  default:
+    RKMEDIA_LOGE("PcmDeinterleave: sample bytes %d not supported\n",
+                 sample_bytes);
+    break;
+  }
+}
+
+void PcmInterleave(void *dst, const void *const *planes, int sample_bytes,
+                   int channels, int frames) {
+  int i = 0;
+  switch (sample_bytes) {
+  case 1:
+    interleave((uint8_t *)dst, (const uint8_t *const *)planes, channels,
+               frames, 0);
+    break;
+  case 2:
+    if (channels == 2)
+      i = interleave_stereo16((int16_t *)dst, (const int16_t *)planes[0],
+                              (const int16_t *)planes[1], frames);
+    interleave((int16_t *)dst, (const int16_t *const *)planes, channels,
+               frames, i);
+    break;
+  case 4:
+    if (channels == 2)
+      i = interleave_stereo32((uint32_t *)dst, (const uint32_t *)planes[0],
+                              (const uint32_t *)planes[1], frames);
+    interleave((uint32_t *)dst, (const uint32_t *const *)planes, channels,
+               frames, i);
+    break;
+  default:
+    RKMEDIA_LOGE("PcmInterleave: sample bytes %d not supported\n",
+                 sample_bytes);
+    break;
+  }
+}
+
+void PcmPickChannelS16(int16_t *dst, const int16_t *src, int channels, int ch,
+                       int frames) {
+  int i = 0;
+  // dst[i..i+8) is written after src[2i..2i+16) is read, so dst may be src
+  if (channels == 2) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; frames - i >= 8; i += 8) {
+      int16x8x2_t v = vld2q_s16(src + 2 * i);
+      vst1q_s16(dst + i, ch ? v.val[1] : v.val[0]);
+    }
+#elif defined(__SSE2__)
+    for (; frames - i >= 8; i += 8) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+      __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 8));
+      if (!ch) {
+        a = _mm_slli_epi32(a, 16);
+        b = _mm_slli_epi32(b, 16);
+      }
+      a = _mm_srai_epi32(a, 16);
+      b = _mm_srai_epi32(b, 16);
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+    }
+#endif
+  }
+  for (; i < frames; i++)
+    dst[i] = src[i * channels + ch];
+}
+
+void PcmS16ToFlt(float *dst, const int16_t *src, int n) {
+  const float scale = 1.0f / (1 << 15);
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; n - i >= 8; i += 8) {
+    int16x8_t v = vld1q_s16(src + i);
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+    vst1q_f32(dst + i, vmulq_n_f32(lo, scale));
+    vst1q_f32(dst + i + 4, vmulq_n_f32(hi, scale));
+  }
+#elif defined(__SSE2__)
+  const __m128 vscale = _mm_set1_ps(scale);
+  for (; n - i >= 8; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = src[i] * scale;
+}
+
+void PcmFltToS16(int16_t *dst, const float *src, int n) {
+  const float scale = 1 << 15;
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  const float32x4_t vmin = vdupq_n_f32(-32768.0f);
+  const float32x4_t vmax = vdupq_n_f32(32767.0f);
+  for (; n - i >= 8; i += 8) {
+    float32x4_t lo = vmulq_n_f32(vld1q_f32(src + i), scale);
+    float32x4_t hi = vmulq_n_f32(vld1q_f32(src + i + 4), scale);
+    lo = vminq_f32(vmaxq_f32(lo, vmin), vmax);
+    hi = vminq_f32(vmaxq_f32(hi, vmin), vmax);
+#if defined(__aarch64__)
+    int32x4_t ilo = vcvtnq_s32_f32(lo);
+    int32x4_t ihi = vcvtnq_s32_f32(hi);
+#else
+    // no round to nearest conversion on armv7, round half away from zero
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    float32x4_t hlo = vreinterpretq_f32_u32(vorrq_u32(
+        vreinterpretq_u32_f32(half),
+        vandq_u32(vreinterpretq_u32_f32(lo), sign)));
+    float32x4_t hhi = vreinterpretq_f32_u32(vorrq_u32(
+        vreinterpretq_u32_f32(half),
+        vandq_u32(vreinterpretq_u32_f32(hi), sign)));
+    int32x4_t ilo = vcvtq_s32_f32(vaddq_f32(lo, hlo));
+    int32x4_t ihi = vcvtq_s32_f32(vaddq_f32(hi, hhi));
+#endif
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(ilo), vqmovn_s32(ihi)));
+  }
+#elif defined(__SSE2__)
+  const __m128 vscale = _mm_set1_ps(scale);
+  const __m128 vmin = _mm_set1_ps(-32768.0f);
+  const __m128 vmax = _mm_set1_ps(32767.0f);
+  for (; n - i >= 8; i += 8) {
+    __m128 lo = _mm_mul_ps(_mm_loadu_ps(src + i), vscale);
+    __m128 hi = _mm_mul_ps(_mm_loadu_ps(src + i + 4), vscale);
+    lo = _mm_min_ps(_mm_max_ps(lo, vmin), vmax);
+    hi = _mm_min_ps(_mm_max_ps(hi, vmin), vmax);
+    // rounds to nearest even by the default MXCSR, as lrintf
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+  }
+#endif
+  for (; i < n; i++) {
+    float v = src[i] * scale;
+    v = v < -32768.0f ? -32768.0f : (v > 32767.0f ? 32767.0f : v);
+    dst[i] = (int16_t)lrintf(v);
+  }
+}
+
+void PcmS16ToS32(int32_t *dst, const int16_t *src, int n) {
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; n - i >= 8; i += 8) {
+    int16x8_t v = vld1q_s16(src + i);
+    vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(v), 16));
+    vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; n - i >= 8; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(zero, v));
+    _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(zero, v));
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = (int32_t)((uint32_t)(uint16_t)src[i] << 16);
+}
+
+void PcmS32ToS16(int16_t *dst, const int32_t *src, int n) {
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; n - i >= 8; i += 8) {
+    int16x4_t lo = vshrn_n_s32(vld1q_s32(src + i), 16);
+    int16x4_t hi = vshrn_n_s32(vld1q_s32(src + i + 4), 16);
+    vst1q_s16(dst + i, vcombine_s16(lo, hi));
+  }
+#elif defined(__SSE2__)
+  for (; n - i >= 8; i += 8) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i hi = _mm_loadu_si128((const __m128i *)(src + i + 4));
+    lo = _mm_srai_epi32(lo, 16);
+    hi = _mm_srai_epi32(hi, 16);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = (int16_t)(src[i] >> 16);
+}
+
+void PcmGainS16(int16_t *dst, const int16_t *src, int n, float gain) {
+  long q = lrintf(gain * (1 << 12));
+  const int16_t g = q < -32768 ? -32768 : (q > 32767 ? 32767 : (int16_t)q);
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  const int16x4_t vg = vdup_n_s16(g);
+  for (; n - i >= 8; i += 8) {
+    int16x8_t v = vld1q_s16(src + i);
+    int16x4_t lo = vqrshrn_n_s32(vmull_s16(vget_low_s16(v), vg), 12);
+    int16x4_t hi = vqrshrn_n_s32(vmull_s16(vget_high_s16(v), vg), 12);
+    vst1q_s16(dst + i, vcombine_s16(lo, hi));
+  }
+#elif defined(__SSE2__)
+  const __m128i vg = _mm_set1_epi16(g);
+  const __m128i round = _mm_set1_epi32(1 << 11);
+  for (; n - i >= 8; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i pl = _mm_mullo_epi16(v, vg);
+    __m128i ph = _mm_mulhi_epi16(v, vg);
+    __m128i lo = _mm_add_epi32(_mm_unpacklo_epi16(pl, ph), round);
+    __m128i hi = _mm_add_epi32(_mm_unpackhi_epi16(pl, ph), round);
+    lo = _mm_srai_epi32(lo, 12);
+    hi = _mm_srai_epi32(hi, 12);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = clip_s16((src[i] * g + (1 << 11)) >> 12);
+}
+
+void PcmMixS16(int16_t *dst, const int16_t *const *srcs, int num, int n) {
+  if (num <= 0) {
+    memset(dst, 0, n * sizeof(int16_t));
+    return;
+  }
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; n - i >= 8; i += 8) {
+    int32x4_t lo = vdupq_n_s32(0);
+    int32x4_t hi = vdupq_n_s32(0);
+    for (int k = 0; k < num; k++) {
+      int16x8_t v = vld1q_s16(srcs[k] + i);
+      lo = vaddw_s16(lo, vget_low_s16(v));
+      hi = vaddw_s16(hi, vget_high_s16(v));
+    }
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+  }
+#elif defined(__SSE2__)
+  for (; n - i >= 8; i += 8) {
+    __m128i lo = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    for (int k = 0; k < num; k++) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(srcs[k] + i));
+      lo = _mm_add_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+      hi = _mm_add_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    }
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+  }
+#endif
+  for (; i < n; i++) {
+    int32_t sum = 0;
+    for (int k = 0; k < num; k++)
+      sum += srcs[k][i];
+    dst[i] = clip_s16(sum);
+  }
+}
+
+} // namespace easymedia
@@ -9,20 +9,16 @@
 #include "filter.h"
 #include "lock.h"
 #include "media_config.h"
+#include "overlay.h"
 #ifdef USE_ROCKX
 #include "rknn_user.h"
 #endif
-#define YUV_PIXEL_RED ((0x4C << 16) | (0x54 << 8) | 0xFF)
 
 namespace easymedia {
 
-static void draw_rect(std::shared_ptr<ImageBuffer> &buffer, Rect &rect,
-                      int thick);
-static int draw_nv12_rect(uint8_t *data, int img_w, int img_h, Rect &rect,
-                          int thick, int yuv_color);
 static Rect combine_rect(std::vector<Rect> &rect);
-static void hw_draw_rect(uint8_t *data, int img_w, Rect &rect, int thick,
-                         int palette_index);
+static void get_result_rects(std::list<RknnResult> &nn_result,
+                             std::vector<Rect> &rects);
 
 class DrawFilter : public Filter {
 public:
@@ -33,7 +29,6 @@ public:
                       std::shared_ptr<MediaBuffer> &output) override;
   virtual int IoCtrl(unsigned long int request, ...) override;
 
-  void DoDrawRect(std::shared_ptr<ImageBuffer> &buffer, Rect &rect);
   void DoDraw(std::shared_ptr<ImageBuffer> &buffer,
               std::list<RknnResult> &nn_result);
 
@@ -52,6 +47,11 @@ private:
   float offset_y_;
   ReadWriteLockMutex draw_mtx_;
   RknnHandler draw_handler_;
+  // reused from frame to frame
+  std::vector<Rect> rects_;
+  std::vector<OverlayBox> boxes_;
+  // the boxes of the osd region the encoder has, none if it is disabled
+  std::vector<Rect> hw_rects_;
 };
 
 DrawFilter::DrawFilter(const char *param)
@@ -99,26 +99,21 @@ DrawFilter::DrawFilter(const char *param)
     enable_ = std::stoi(enable_str);
 }
 
-void DrawFilter::DoDrawRect(std::shared_ptr<ImageBuffer> &buffer, Rect &rect) {
-  draw_rect(buffer, rect, draw_rect_thick_);
-}
-
 void DrawFilter::DoHwDrawRect(OsdRegionData *region_data, int enable) {
   Flow *flow = (Flow *)draw_handler_;
   if (region_data->enable &&
       ((region_data->width % 16) || (region_data->height % 16))) {
     RKMEDIA_LOGE("osd region size must be a multiple of 16x16.");
+    if (enable)
+      free(region_data);
     return;
   }
   if (enable) {
-    int buffer_size = region_data->width * region_data->height;
-    OsdRegionData *rdata =
-        (OsdRegionData *)malloc(sizeof(OsdRegionData) + buffer_size);
-    memcpy((void *)rdata, (void *)region_data, sizeof(OsdRegionData));
-    rdata->buffer = (uint8_t *)rdata + sizeof(OsdRegionData);
-    memcpy(rdata->buffer, region_data->buffer, buffer_size);
+    // region_data is malloc'ed with the bitmap behind it by DoHwDraw, the
+    // encoder frees it
     auto pbuff = std::make_shared<ParameterBuffer>(0);
-    pbuff->SetPtr(rdata, sizeof(OsdRegionData) + buffer_size);
+    pbuff->SetPtr(region_data, sizeof(OsdRegionData) +
+                                   region_data->width * region_data->height);
     flow->Control(VideoEncoder::kOSDDataChange, pbuff);
   } else {
     region_data->enable = enable;
@@ -130,6 +125,11 @@ void DrawFilter::DoHwDrawRect(OsdRegionData *region_data, int enable) {
   }
 }
 
+static bool same_rects(const std::vector<Rect> &a, const std::vector<Rect> &b) {
+  return a.size() == b.size() &&
+         (a.empty() || !memcmp(a.data(), b.data(), a.size() * sizeof(Rect)));
+}
+
 void DrawFilter::DoHwDraw(std::list<RknnResult> &nn_result) {
   int color_index = 0x23;
   OsdRegionData osd_region_data;
@@ -137,85 +137,86 @@ void DrawFilter::DoHwDraw(std::list<RknnResult> &nn_result) {
   osd_region_data.enable = 1;
   osd_region_data.region_id = 7;
 
-  std::vector<Rect> rects;
-  for (auto info : nn_result) {
-    Rect rect;
-#ifdef USE_ROCKFACE
-    if (info.type == NNRESULT_TYPE_FACE) {
-      rockface_det_t face_det = info.face_info.base;
-      rect.left = UPALIGNTO16(face_det.box.left);
-      rect.right = DOWNALIGNTO16(face_det.box.right);
-      rect.top = UPALIGNTO16(face_det.box.top);
-      rect.bottom = DOWNALIGNTO16(face_det.box.bottom);
-      rects.push_back(rect);
-    }
-#endif
-#ifdef USE_ROCKX
-    if (info.type == NNRESULT_TYPE_OBJECT_DETECT) {
-      Rect object_det_box = info.object_info.box;
-      rect.left = UPALIGNTO16(object_det_box.left);
-      rect.right = DOWNALIGNTO16(object_det_box.right);
-      rect.top = UPALIGNTO16(object_det_box.top);
-      rect.bottom = DOWNALIGNTO16(object_det_box.bottom);
-      rects.push_back(rect);
-    }
-#endif
+  get_result_rects(nn_result, rects_);
+  size_t num = 0;
+  for (auto &rect : rects_) {
+    rect.left = UPALIGNTO16(rect.left);
+    rect.right = DOWNALIGNTO16(rect.right);
+    rect.top = UPALIGNTO16(rect.top);
+    rect.bottom = DOWNALIGNTO16(rect.bottom);
+    if (rect.right > rect.left && rect.bottom > rect.top)
+      rects_[num++] = rect;
   }
-  Rect combine = combine_rect(rects);
-  for (auto &rect : rects) {
-    rect.left = rect.left - combine.left;
-    rect.right = rect.right - combine.left;
-    rect.top = rect.top - combine.top;
-    rect.bottom = rect.bottom - combine.top;
+  rects_.resize(num);
+  // The encoder keeps the region until it is told otherwise, so it is not
+  // sent again while the boxes stay where they are.
+  if (same_rects(rects_, hw_rects_))
+    return;
+  if (rects_.empty()) {
+    DoHwDrawRect(&osd_region_data, 0);
+    hw_rects_.clear();
+    return;
   }
-
+  Rect combine = combine_rect(rects_);
   osd_region_data.pos_x = combine.left;
   osd_region_data.pos_y = combine.top;
   osd_region_data.width = combine.right - combine.left;
   osd_region_data.height = combine.bottom - combine.top;
   int buffer_size = osd_region_data.width * osd_region_data.height;
-#ifdef DRAW_HW_BUFFER
-  auto mb = easymedia::MediaBuffer::Alloc(
-      buffer_size, easymedia::MediaBuffer::MemType::MEM_HARD_WARE);
-  osd_region_data.buffer = mb->GetPtr();
-#else
-  osd_region_data.buffer = static_cast<uint8_t *>(malloc(buffer_size));
-#endif
-  if (!osd_region_data.buffer) {
+
+  // The encoder frees what it is given, so the bitmap is drawn right into
+  // that allocation instead of being drawn aside and copied.
+  OsdRegionData *rdata =
+      (OsdRegionData *)malloc(sizeof(OsdRegionData) + buffer_size);
+  if (!rdata)
     return;
+  memcpy((void *)rdata, (void *)&osd_region_data, sizeof(OsdRegionData));
+  rdata->buffer = (uint8_t *)rdata + sizeof(OsdRegionData);
+  memset(rdata->buffer, 0xFF, buffer_size);
+  OverlayImage image;
+  OverlayInitImage(image, PIX_FMT_NONE, rdata->buffer, rdata->width,
+                   rdata->height, rdata->width, rdata->height);
+  boxes_.clear();
+  for (auto &rect : rects_) {
+    OverlayBox box;
+    box.rect.x = rect.left - combine.left;
+    box.rect.y = rect.top - combine.top;
+    box.rect.w = rect.right - rect.left;
+    box.rect.h = rect.bottom - rect.top;
+    box.thick = draw_rect_thick_;
+    box.color = color_index;
+    boxes_.push_back(box);
   }
-  memset(osd_region_data.buffer, 0xFF, buffer_size);
-  for (auto &rect : rects) {
-    hw_draw_rect(osd_region_data.buffer, osd_region_data.width, rect,
-                 draw_rect_thick_, color_index);
-  }
-  DoHwDrawRect(&osd_region_data);
-
-#ifndef DRAW_HW_BUFFER
-  free(osd_region_data.buffer);
-#endif
+  OverlayDrawBoxes(image, boxes_.data(), boxes_.size());
+  DoHwDrawRect(rdata);
+  hw_rects_ = rects_;
 }
 
 void DrawFilter::DoDraw(std::shared_ptr<ImageBuffer> &buffer,
                         std::list<RknnResult> &nn_result) {
-  for (auto info_result : nn_result) {
-#ifdef USE_ROCKFACE
-    if (info_result.type == NNRESULT_TYPE_FACE) {
-      rockface_det_t face_det = info_result.face_info.base;
-      Rect rect_face = {face_det.box.left, face_det.box.top, face_det.box.right,
-                        face_det.box.bottom};
-      DoDrawRect(buffer, rect_face);
-    }
-#endif
-#ifdef USE_ROCKX
-    if (info_result.type == NNRESULT_TYPE_OBJECT_DETECT) {
-      Rect object_det_box = info_result.object_info.box;
-      Rect rect_rockx = {object_det_box.left, object_det_box.top,
-                         object_det_box.right, object_det_box.bottom};
-      DoDrawRect(buffer, rect_rockx);
-    }
-#endif
+  OverlayImage image;
+  if (OverlayInitImage(image, buffer->GetPixelFormat(),
+                       (uint8_t *)buffer->GetPtr(), buffer->GetWidth(),
+                       buffer->GetHeight(), buffer->GetVirWidth(),
+                       buffer->GetVirHeight())) {
+    RKMEDIA_LOGI("RockFaceDebug:can't draw rect on this format yet!\n");
+    return;
+  }
+  uint32_t color = OverlayColor(image.pix_fmt, 0xFF, 0, 0);
+  get_result_rects(nn_result, rects_);
+  boxes_.clear();
+  for (auto &rect : rects_) {
+    OverlayBox box;
+    box.rect.x = rect.left;
+    box.rect.y = rect.top;
+    box.rect.w = rect.right - rect.left;
+    box.rect.h = rect.bottom - rect.top;
+    box.thick = draw_rect_thick_;
+    box.color = color;
+    boxes_.push_back(box);
   }
+  // all the boxes in one pass over the lines they are on
+  OverlayDrawBoxes(image, boxes_.data(), boxes_.size());
 }
 
 void DrawFilter::ConvertRect(std::list<RknnResult> &nn_list) {
@@ -263,8 +264,12 @@ int DrawFilter::Process(std::shared_ptr<MediaBuffer> input,
   auto dst = std::static_pointer_cast<easymedia::ImageBuffer>(output);
 
   std::list<RknnResult> &written_list = src->GetRknnResult();
-  if (written_list.empty())
+  if (written_list.empty()) {
+    // the boxes went away, take them off the encoder region once
+    if (draw_handler_ && need_hw_draw_ && !hw_rects_.empty())
+      DoHwDraw(written_list);
     return 0;
+  }
   ConvertRect(written_list);
 
   input->BeginCPUAccess(false);
@@ -318,65 +323,23 @@ const char *FACTORY(DrawFilter)::ExpectedInputDataType() {
 }
 const char *FACTORY(DrawFilter)::OutPutDataType() { return TYPE_ANYTHING; }
 
-void draw_rect(std::shared_ptr<ImageBuffer> &buffer, Rect &rect, int thick) {
-  ImageInfo info = buffer->GetImageInfo();
-  uint8_t *img_data = (uint8_t *)buffer->GetPtr();
-  int img_w = buffer->GetWidth();
-  int img_h = buffer->GetHeight();
-
-  if (rect.right > img_w - thick) {
-    // RKMEDIA_LOGI("draw_rect right > img_w\n");
-    rect.right = img_w - thick;
-  }
-  if (rect.left < 0) {
-    // RKMEDIA_LOGI("draw_rect letf < 0\n");
-    rect.left = 0;
-  }
-  if (rect.bottom > img_h - thick) {
-    // RKMEDIA_LOGI("draw_rect bottom > img_h\n");
-    rect.bottom = img_h - thick;
-  }
-  if (rect.top < 0) {
-    // RKMEDIA_LOGI("draw_rect top < 0\n");
-    rect.top = 0;
-  }
-
-  if (info.pix_fmt == PIX_FMT_NV12) {
-    draw_nv12_rect(img_data, img_w, img_h, rect, thick, YUV_PIXEL_RED);
-  } else {
-    RKMEDIA_LOGI("RockFaceDebug:can't draw rect on this format yet!\n");
-  }
-}
-
-int draw_nv12_rect(uint8_t *data, int img_w, int img_h, Rect &rect, int thick,
-                   int yuv_color) {
-  int j, k;
-  int uv_offset = img_w * img_h;
-  int y_offset, u_offset, v_offset;
-  int rect_x, rect_y, rect_w, rect_h;
-  rect_x = rect.left;
-  rect_y = rect.top;
-  rect_w = rect.right - rect.left;
-  rect_h = rect.bottom - rect.top;
-
-  int y = (yuv_color >> 16) & 0xFF;
-  int u = (yuv_color >> 8) & 0xFF;
-  int v = (yuv_color >> 0) & 0xFF;
-
-  for (j = rect_y; j <= rect_y + rect_h; j++) {
-    for (k = rect_x; k <= rect_x + rect_w; k++) {
-      if (k <= (rect_x + thick) || k >= (rect_x + rect_w - thick) ||
-          j <= (rect_y + thick) || j >= (rect_y + rect_h - thick)) {
-        y_offset = j * img_w + k;
-        u_offset = (j >> 1) * img_w + k - k % 2 + uv_offset;
-        v_offset = u_offset + 1;
-        data[y_offset] = y;
-        data[u_offset] = u;
-        data[v_offset] = v;
-      }
+void get_result_rects(std::list<RknnResult> &nn_result,
+                      std::vector<Rect> &rects) {
+  rects.clear();
+  for (auto &info : nn_result) {
+#ifdef USE_ROCKFACE
+    if (info.type == NNRESULT_TYPE_FACE) {
+      rockface_det_t &face_det = info.face_info.base;
+      Rect rect = {face_det.box.left, face_det.box.top, face_det.box.right,
+                   face_det.box.bottom};
+      rects.push_back(rect);
     }
+#endif
+#ifdef USE_ROCKX
+    if (info.type == NNRESULT_TYPE_OBJECT_DETECT)
+      rects.push_back(info.object_info.box);
+#endif
   }
-  return 0;
 }
 
 Rect combine_rect(std::vector<Rect> &rect) {
@@ -398,17 +361,4 @@ Rect combine_rect(std::vector<Rect> &rect) {
   return combine;
 }
 
-void hw_draw_rect(uint8_t *data, int img_w, Rect &rect, int thick, int index) {
-  int j, k, offset;
-  for (j = rect.top; j < rect.bottom; j++) {
-    for (k = rect.left; k < rect.right; k++) {
-      if (k < (rect.left + thick) || k > (rect.right - thick) ||
-          j < (rect.top + thick) || j > (rect.bottom - thick)) {
-        offset = j * img_w + k;
-        data[offset] = index;
-      }
-    }
-  }
-}
-
 } // namespace easymedia
@@ -10,6 +10,7 @@
 #include "filter.h"
 #include "lock.h"
 #include "media_config.h"
+#include "side_data_ring.h"
 
 namespace easymedia {
 
@@ -20,7 +21,7 @@ public:
   static const char *GetFilterName() { return "nn_result_input"; }
 
   void PushResult(std::list<RknnResult> &results);
-  std::list<RknnResult> PopResult(int64_t atomic_clock);
+  std::shared_ptr<std::list<RknnResult>> PopResult(int64_t atomic_clock);
 
   virtual int Process(std::shared_ptr<MediaBuffer> input,
                       std::shared_ptr<MediaBuffer> &output) override;
@@ -33,11 +34,10 @@ private:
   uint32_t cache_size_;
   uint32_t clock_delta_ms_; // millisecond
 
-  std::mutex mutex_;
-  std::condition_variable cond_;
   ReadWriteLockMutex result_mutex_;
 
-  std::deque<std::list<RknnResult>> nn_cache_;
+  // keyed by the timeval of the first result of each list
+  SideDataRing<std::list<RknnResult>> nn_cache_;
   std::deque<std::shared_ptr<ImageBuffer>> image_pool_;
 };
 
@@ -64,35 +64,23 @@ NNResultInput::NNResultInput(const char *param) {
   const std::string &enable_str = params[KEY_ENABLE];
   if (!enable_str.empty())
     enable_ = std::stoi(enable_str);
+
+  nn_cache_.SetCapacity(cache_size_);
 }
 
 void NNResultInput::PushResult(std::list<RknnResult> &results) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (nn_cache_.size() > cache_size_)
-    nn_cache_.pop_front();
-  nn_cache_.push_back(results);
+  // an empty list has no timeval to be found by
+  if (results.empty())
+    return;
+  int64_t timeval = results.front().timeval;
+  auto cached = std::make_shared<std::list<RknnResult>>();
+  cached->swap(results);
+  nn_cache_.Push(timeval, cached);
 }
 
-std::list<RknnResult> NNResultInput::PopResult(int64_t atomic_clock) {
-  std::unique_lock<std::mutex> lock(mutex_);
-
-  int64_t min_delta = 10000000LL;
-  std::list<RknnResult> result;
-
-  for (auto &iter : nn_cache_) {
-    for (RknnResult &tmp : iter) {
-      int64_t delta = std::llabs(tmp.timeval - atomic_clock);
-      if (delta < min_delta) {
-        min_delta = delta;
-        result = iter;
-      }
-      break;
-    }
-  }
-  int64_t clock_delta = clock_delta_ms_ * 1000;
-  if (!result.empty() && clock_delta < min_delta)
-    result.clear();
-  return std::move(result);
+std::shared_ptr<std::list<RknnResult>>
+NNResultInput::PopResult(int64_t atomic_clock) {
+  return nn_cache_.Find(atomic_clock, clock_delta_ms_ * 1000LL);
 }
 
 int NNResultInput::Process(std::shared_ptr<MediaBuffer> input,
@@ -115,10 +103,10 @@ int NNResultInput::Process(std::shared_ptr<MediaBuffer> input,
     image_pool_.pop_front();
 
     auto tobe_input_result = PopResult(output_image->GetAtomicClock());
-    if (!tobe_input_result.empty()) {
+    if (tobe_input_result) {
       auto &nn_results = output_image->GetRknnResult();
-      for (auto &iter : tobe_input_result)
-        nn_results.push_back(iter);
+      nn_results.insert(nn_results.end(), tobe_input_result->begin(),
+                        tobe_input_result->end());
     }
     output = output_image;
   }
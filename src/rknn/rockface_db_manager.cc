@@ -3,25 +3,35 @@
 // found in the LICENSE file.
 
 #include <string.h>
+#include <unistd.h>
 
 #include "rockface_db_manager.h"
 #include "utils.h"
 
 namespace easymedia {
 
-FaceDBManager::FaceDBManager(std::string path) {
+#define FACE_INDEX_SUFFIX ".idx"
+
+FaceDBManager::FaceDBManager(std::string path)
+    : path_(path), sqlite_(nullptr), index_path_(path + FACE_INDEX_SUFFIX),
+      index_ready_(false), index_dirty_(false), feature_version_(0) {
   int ret = sqlite3_open(path.c_str(), &sqlite_);
   if (ret) {
     RKMEDIA_LOGI("sqlite3_open %s failed.\n", path.c_str());
     return;
   }
-  if (sqlite_)
+  if (sqlite_) {
     CreateTable();
+    LoadIndex();
+  }
 }
 
 FaceDBManager::~FaceDBManager() {
-  if (sqlite_)
+  if (sqlite_) {
+    if (index_dirty_)
+      SaveIndex();
     sqlite3_close(sqlite_);
+  }
 }
 
 int FaceDBManager::AddUser(rockface_feature_t *feature) {
@@ -30,10 +40,11 @@ int FaceDBManager::AddUser(rockface_feature_t *feature) {
   face_db.user_id = GetMaxUserId() + 1;
   memcpy(&face_db.feature, feature, sizeof(rockface_feature_t));
   int ret = InsertFaceDb(&face_db);
-  if (ret < 0) {
+  if (ret != SQLITE_OK) {
     RKMEDIA_LOGI("insert feature failed.\n");
     return -1;
   }
+  AddToIndex(face_db);
   return face_db.user_id;
 }
 
@@ -49,6 +60,8 @@ int FaceDBManager::DeleteUser(int user_id) {
     RKMEDIA_LOGI("sqlite3_exec failed, error = %s\n", error);
     return -1;
   }
+  index_.Remove(user_id);
+  MarkIndexDirty();
   return 0;
 }
 
@@ -64,6 +77,9 @@ void FaceDBManager::ClearDb(void) {
   }
   if (sqlite_)
     CreateTable();
+  index_.Reset();
+  index_ready_ = true;
+  MarkIndexDirty();
 }
 
 void FaceDBManager::CreateTable(void) {
@@ -123,11 +139,9 @@ exit:
   return max_user;
 }
 
-std::vector<FaceDb> FaceDBManager::GetAllFaceDb(void) {
-  std::lock_guard<std::mutex> lock(mutex_);
-
+void FaceDBManager::ForEachFaceDb(
+    const std::function<void(const FaceDb &)> &fn) {
   sqlite3_stmt *stmt;
-  std::vector<FaceDb> face_db;
   char sq_buffer[SQ_BUFFER_LEN] = "SELECT * FROM FACE;";
 
   int ret = sqlite3_prepare_v2(sqlite_, sq_buffer, -1, &stmt, nullptr);
@@ -147,12 +161,47 @@ std::vector<FaceDb> FaceDBManager::GetAllFaceDb(void) {
     face.feature.version = feature_version;
     face.feature.len = feature_len;
     memcpy(face.feature.feature, feature, feature_len);
-    face_db.push_back(face);
+    fn(face);
     ret = sqlite3_step(stmt);
   }
 exit:
   sqlite3_finalize(stmt);
-  return std::move(face_db);
+}
+
+std::vector<FaceDb> FaceDBManager::GetAllFaceDb(void) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<FaceDb> face_db;
+  ForEachFaceDb([&face_db](const FaceDb &face) { face_db.push_back(face); });
+  return face_db;
+}
+
+std::vector<FaceDb>
+FaceDBManager::GetCandidateFaceDb(rockface_feature_t *feature, int k) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<FaceDb> face_db;
+  int dim = index_.GetDim();
+  if (!index_ready_ || dim <= 0 ||
+      feature->len != (int)(dim * sizeof(float))) {
+    ForEachFaceDb([&face_db](const FaceDb &face) { face_db.push_back(face); });
+    return face_db;
+  }
+
+  std::vector<float> query(dim);
+  memcpy(query.data(), feature->feature, feature->len);
+  std::vector<FeatureMatch> matches(k);
+  // an orthogonal feature is far beyond any similarity threshold
+  int num = index_.Search(query.data(), k, 0.0f, matches.data());
+  std::vector<float> row(dim);
+  for (int i = 0; i < num; i++) {
+    FaceDb face;
+    face.user_id = matches[i].id;
+    face.feature.version = feature_version_;
+    face.feature.len = feature->len;
+    index_.GetFeature(matches[i].row, row.data());
+    memcpy(face.feature.feature, row.data(), feature->len);
+    face_db.push_back(face);
+  }
+  return face_db;
 }
 
 int FaceDBManager::InsertFaceDb(FaceDb *face_db) {
@@ -183,4 +232,96 @@ error:
   return ret;
 }
 
+// A cheap summary of the FACE table, the snapshot is only used if it was
+// saved for the same one. AUTOINCREMENT ids only grow, so any insert moves
+// MAX(ID) and any delete COUNT(*).
+uint64_t FaceDBManager::GetDbTag(int *feature_version) {
+  sqlite3_stmt *stmt;
+  char sq_buffer[SQ_BUFFER_LEN] =
+      "SELECT COUNT(*), MAX(ID), MAX(FEATURE_VERSION) FROM FACE;";
+
+  uint64_t tag = 0;
+  int ret = sqlite3_prepare_v2(sqlite_, sq_buffer, -1, &stmt, nullptr);
+  if (ret != SQLITE_OK) {
+    RKMEDIA_LOGI("sqlite3_prepare_v2 failed, ret = %d\n", ret);
+    goto exit;
+  }
+  ret = sqlite3_step(stmt);
+  if (ret != SQLITE_ROW) {
+    RKMEDIA_LOGI("sqlite3_step failed. ret = %d\n", ret);
+    goto exit;
+  }
+  tag = ((uint64_t)(uint32_t)sqlite3_column_int(stmt, 1) << 32) |
+        (uint32_t)sqlite3_column_int(stmt, 0);
+  if (feature_version)
+    *feature_version = sqlite3_column_int(stmt, 2);
+exit:
+  sqlite3_finalize(stmt);
+  return tag;
+}
+
+void FaceDBManager::LoadIndex(void) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t tag = GetDbTag(&feature_version_);
+  index_ready_ = true;
+  if (!index_.LoadSnapshot(index_path_.c_str(), tag)) {
+    RKMEDIA_LOGI("face index: %d features from %s\n", index_.GetCount(),
+                 index_path_.c_str());
+    return;
+  }
+
+  AutoDuration ad;
+  index_.Reset();
+  ForEachFaceDb([this](const FaceDb &face) { AddToIndex(face); });
+  RKMEDIA_LOGI("face index: %d features from %s in %dms\n",
+               index_.GetCount(), path_.c_str(), (int)(ad.Get() / 1000));
+  if (index_ready_)
+    SaveIndex();
+}
+
+void FaceDBManager::SaveIndex(void) {
+  if (!index_ready_ || index_.GetDim() <= 0)
+    return;
+  if (!index_.SaveSnapshot(index_path_.c_str(), GetDbTag(nullptr)))
+    index_dirty_ = false;
+}
+
+// The snapshot is removed at the first change, so that a process killed
+// before the next SaveIndex leaves no stale snapshot behind.
+void FaceDBManager::MarkIndexDirty(void) {
+  if (index_dirty_)
+    return;
+  index_dirty_ = true;
+  unlink(index_path_.c_str());
+}
+
+void FaceDBManager::AddToIndex(const FaceDb &face_db) {
+  if (!index_ready_)
+    return;
+  const rockface_feature_t &feature = face_db.feature;
+  int dim = feature.len / sizeof(float);
+  if (index_.GetCount() == 0 && dim > 0 &&
+      feature.len == (int)(dim * sizeof(float))) {
+    index_.Reset(dim);
+    feature_version_ = feature.version;
+  }
+  if (dim != index_.GetDim() || feature.version != feature_version_ ||
+      feature.len != (int)(dim * sizeof(float))) {
+    RKMEDIA_LOGI("face index: feature %d/%d of user %d does not fit, "
+                 "matching goes through sqlite\n",
+                 feature.version, feature.len, face_db.user_id);
+    index_.Reset();
+    index_ready_ = false;
+    MarkIndexDirty();
+    return;
+  }
+  std::vector<float> row(dim);
+  memcpy(row.data(), feature.feature, feature.len);
+  if (index_.Add(face_db.user_id, row.data()) < 0) {
+    index_.Reset();
+    index_ready_ = false;
+  }
+  MarkIndexDirty();
+}
+
 } // namespace easymedia
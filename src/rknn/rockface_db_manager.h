@@ -2,12 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <functional>
 #include <mutex>
 #include <rockface/rockface.h>
 #include <sqlite3.h>
 #include <string>
 #include <vector>
 
+#include "feature_index.h"
+
 namespace easymedia {
 
 typedef struct FaceDb {
@@ -24,6 +27,9 @@ public:
   int DeleteUser(int user_id);
 
   std::vector<FaceDb> GetAllFaceDb(void);
+  // The k features most like feature, from the in-memory index. All the
+  // features if the index can not be used for this db.
+  std::vector<FaceDb> GetCandidateFaceDb(rockface_feature_t *feature, int k);
   void ClearDb(void);
 
 #define SQ_BUFFER_LEN (1024)
@@ -34,11 +40,26 @@ protected:
 
   int GetMaxUserId(void);
   int InsertFaceDb(FaceDb *face_db);
+  void ForEachFaceDb(const std::function<void(const FaceDb &)> &fn);
+
+  uint64_t GetDbTag(int *feature_version);
+  void LoadIndex(void);
+  void SaveIndex(void);
+  void AddToIndex(const FaceDb &face_db);
+  void MarkIndexDirty(void);
 
 private:
   std::string path_;
   std::mutex mutex_;
   sqlite3 *sqlite_;
+
+  // features of the FACE table, kept in step with it by AddUser, DeleteUser
+  // and ClearDb, and saved next to the db file as a snapshot
+  FeatureIndex index_;
+  std::string index_path_;
+  bool index_ready_;
+  bool index_dirty_;
+  int feature_version_;
 };
 
 } // namespace easymedia
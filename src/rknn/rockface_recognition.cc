@@ -107,6 +107,7 @@ protected:
 
 private:
   static unsigned int kMaxCacheSize;
+  static int kMatchCandidates;
   static float kFaceSimilarityThreshod;
 
   bool enable_;
@@ -141,6 +142,7 @@ static void ThrFunc(void *param) {
 }
 
 unsigned int RockFaceRecognize::kMaxCacheSize = 3;
+int RockFaceRecognize::kMatchCandidates = 3;
 float RockFaceRecognize::kFaceSimilarityThreshod = 0.7;
 
 RockFaceRecognize::RockFaceRecognize(const char *param)
@@ -290,7 +292,10 @@ std::shared_ptr<MediaBuffer> RockFaceRecognize::FetchOutput() {
 
 int RockFaceRecognize::MatchFeature(rockface_feature_t *feature,
                                     float *out_similarity) {
-  std::vector<FaceDb> vec = db_manager_->GetAllFaceDb();
+  // the index ranks the whole db, rockface gives the similarity of the few
+  // best ones
+  std::vector<FaceDb> vec =
+      db_manager_->GetCandidateFaceDb(feature, kMatchCandidates);
   if (vec.empty())
     return -1;
 
@@ -308,6 +313,8 @@ int RockFaceRecognize::MatchFeature(rockface_feature_t *feature,
       out = &iter;
     }
   }
+  if (!out)
+    return -1;
   return (*out_similarity - kFaceSimilarityThreshod < 0 ? out->user_id : -1);
 }
 
@@ -10,6 +10,7 @@
 
 #include "buffer.h"
 #include "filter.h"
+#include "luma.h"
 #include "media_config.h"
 
 #include <rga/im2d.h>
@@ -491,22 +492,19 @@ int rga_blit(std::shared_ptr<ImageBuffer> src, std::shared_ptr<ImageBuffer> dst,
       h = dst->GetHeight();
     }
     memset(region_luma->luma_data, 0, sizeof(region_luma->luma_data));
-    for (unsigned int i = 0; i < region_luma->region_num; i++) {
-      if (region_luma->region[i].x + region_luma->region[i].w > w ||
-          region_luma->region[i].y + region_luma->region[i].h > h)
-        continue;
-      int line_size = dst->GetVirWidth();
-      int rx = x + region_luma->region[i].x;
-      int ry = y + region_luma->region[i].y;
-      int rw = region_luma->region[i].w;
-      int rh = region_luma->region[i].h;
-      char *rect_start = (char *)dst->GetPtr() + ry * line_size + rx;
-      for (int k = 0; k < rh; k++) {
-        char *line_start = rect_start + k * line_size;
-        for (int j = 0; j < rw; j++)
-          region_luma->luma_data[i] += *(line_start + j);
-      }
-    }
+    LumaStat stats[REGION_LUMA_MAX];
+    int num = region_luma->region_num < REGION_LUMA_MAX
+                  ? region_luma->region_num
+                  : REGION_LUMA_MAX;
+    for (int i = 0; i < num; i++)
+      stats[i].hist = nullptr;
+    int line_size = dst->GetVirWidth();
+    const uint8_t *start = (const uint8_t *)dst->GetPtr() + y * line_size + x;
+    // regions out of the w x h window are left 0
+    CalculateRegionLuma(start, line_size, w, h, region_luma->region, num,
+                        stats);
+    for (int i = 0; i < num; i++)
+      region_luma->luma_data[i] = stats[i].sum;
   }
 
   return ret;
@@ -7,16 +7,22 @@
 #include <assert.h>
 #include <errno.h>
 
+#include <vector>
+
 #include "../rk_audio.h"
 #include "alsa_utils.h"
 #include "alsa_volume.h"
 #include "buffer.h"
 #include "buffer.h"
 #include "media_type.h"
+#include "pcm.h"
 #include "utils.h"
 
 namespace easymedia {
 
+// Periods recycled by the capture, more are allocated while all are in use.
+static const int kAlsaBufferNum = 8;
+
 class AlsaCaptureStream : public Stream {
 public:
   AlsaCaptureStream(const char *param);
@@ -39,6 +45,7 @@ public:
 private:
   size_t Readi(void *ptr, size_t size, size_t nmemb);
   size_t Readn(void *ptr, size_t size, size_t nmemb);
+  size_t ReadiToPlanar(void *ptr, size_t size, size_t nmemb);
 
 private:
   SampleInfo alsa_sample_info;   // for capture
@@ -47,9 +54,13 @@ private:
   snd_pcm_t *alsa_handle;
   size_t frame_size;
   int interleaved;
+  int alsa_interleaved; // the device access, may differ from interleaved
+  std::vector<uint8_t> convert_buffer;
   int64_t buffer_time;
   int buffer_duration;
   AI_LAYOUT_E layout;
+  // periods on their way downstream, sized at Open
+  std::shared_ptr<BufferPool> buffer_pool;
 
 #ifdef AUDIO_ALGORITHM_ENABLE
   // for audio process, like aec/anr
@@ -60,8 +71,8 @@ private:
 };
 
 AlsaCaptureStream::AlsaCaptureStream(const char *param)
-    : alsa_handle(NULL), frame_size(0), buffer_time(-1), buffer_duration(-1),
-      layout(AI_LAYOUT_NORMAL)
+    : alsa_handle(NULL), frame_size(0), alsa_interleaved(1), buffer_time(-1),
+      buffer_duration(-1), layout(AI_LAYOUT_NORMAL)
 #ifdef AUDIO_ALGORITHM_ENABLE
       ,
       bVqeEnable(false), pstVqeHandle(NULL)
@@ -117,6 +128,8 @@ AlsaCaptureStream::~AlsaCaptureStream() {
 size_t AlsaCaptureStream::Read(void *ptr, size_t size, size_t nmemb) {
   if (interleaved)
     return Readi(ptr, size, nmemb);
+  else if (alsa_interleaved)
+    return ReadiToPlanar(ptr, size, nmemb);
   else
     return Readn(ptr, size, nmemb);
 }
@@ -157,7 +170,7 @@ size_t AlsaCaptureStream::Readi(void *vptr, size_t size, size_t nmemb) {
 }
 
 size_t AlsaCaptureStream::Readn(void *ptr, size_t size, size_t nmemb) {
-  uint8_t *bufs[32];
+  uint8_t *bufs[ALSA_MAX_CHANNELS];
   int channels = alsa_sample_info.channels;
   size_t sample_size = frame_size / channels;
   size_t buffer_len = size * nmemb;
@@ -198,13 +211,40 @@ size_t AlsaCaptureStream::Readn(void *ptr, size_t size, size_t nmemb) {
   return gotten * frame_size / size;
 }
 
+// Planar output of a device which only does interleaved access, the planes
+// are laid out as Readn does.
+size_t AlsaCaptureStream::ReadiToPlanar(void *ptr, size_t size, size_t nmemb) {
+  uint8_t *planes[ALSA_MAX_CHANNELS];
+  int channels = alsa_sample_info.channels;
+  size_t sample_size = frame_size / channels;
+  size_t buffer_len = size * nmemb;
+  int nb_samples = (size == frame_size ? nmemb : buffer_len / frame_size);
+
+  if (convert_buffer.size() < buffer_len)
+    convert_buffer.resize(buffer_len);
+  size_t ret = Readi(convert_buffer.data(), size, nmemb);
+  for (int channel = 0; channel < channels; channel++)
+    planes[channel] = (uint8_t *)ptr + nb_samples * sample_size * channel;
+  PcmDeinterleave((void *const *)planes, convert_buffer.data(), sample_size,
+                  channels, ret * size / frame_size);
+  return ret;
+}
+
 std::shared_ptr<MediaBuffer> AlsaCaptureStream::Read() {
   int buffer_size = frame_size * alsa_sample_info.nb_samples;
   int read_cnt = -1;
   int output_frame_size = frame_size;
 
-  auto sample_buffer = std::make_shared<easymedia::SampleBuffer>(
-      MediaBuffer::Alloc2(buffer_size), alsa_sample_info);
+  std::shared_ptr<SampleBuffer> sample_buffer;
+  if (buffer_pool && buffer_pool->GetBufferSize() >= buffer_size) {
+    sample_buffer = buffer_pool->GetSampleBuffer(alsa_sample_info);
+    if (sample_buffer)
+      sample_buffer->SetSize(buffer_size);
+  }
+  // all the periods are held downstream, do not stall the capture
+  if (!sample_buffer)
+    sample_buffer = std::make_shared<easymedia::SampleBuffer>(
+        MediaBuffer::Alloc2(buffer_size), alsa_sample_info);
 
   if (!sample_buffer) {
     RKMEDIA_LOGI("Alloc audio frame buffer failed:%d,%zu!\n", buffer_size,
@@ -244,22 +284,14 @@ read_one_frame:
   if (read_cnt > 0 &&
       (layout == AI_LAYOUT_MIC_REF && output_sample_info.channels == 1)) {
     int16_t *in = (int16_t *)sample_buffer->GetPtr();
-    int16_t *out = in;
-    for (int j = 0; j < read_cnt; j++) {
-      *out++ = *in++;
-      in++;
-    }
+    PcmPickChannelS16(in, in, 2, 0, read_cnt);
     sample_buffer->SetChannels(1);
     output_frame_size = frame_size / 2;
     sample_buffer->SetSize(buffer_size / 2); // fix for AAC
   } else if (read_cnt > 0 && (layout == AI_LAYOUT_REF_MIC &&
                               output_sample_info.channels == 1)) {
     int16_t *in = (int16_t *)sample_buffer->GetPtr();
-    int16_t *out = in;
-    for (int j = 0; j < read_cnt; j++) {
-      in++;
-      *out++ = *in++;
-    }
+    PcmPickChannelS16(in, in, 2, 1, read_cnt);
     sample_buffer->SetChannels(1);
     output_frame_size = frame_size / 2;
     sample_buffer->SetSize(buffer_size / 2); // fix for AAC
@@ -278,6 +310,12 @@ int AlsaCaptureStream::Open() {
   snd_pcm_hw_params_t *hwparams = NULL;
   if (!Readable())
     return -1;
+  if (alsa_sample_info.channels <= 0 ||
+      alsa_sample_info.channels > ALSA_MAX_CHANNELS) {
+    RKMEDIA_LOGE("unsupported channels %d, at most %d\n",
+                 alsa_sample_info.channels, ALSA_MAX_CHANNELS);
+    return -1;
+  }
   int status = snd_pcm_hw_params_malloc(&hwparams);
   if (status < 0) {
     RKMEDIA_LOGI("snd_pcm_hw_params_malloc failed\n");
@@ -312,9 +350,17 @@ int AlsaCaptureStream::Open() {
   /* Switch to blocking mode for capture */
   // snd_pcm_nonblock(pcm_handle, 0);
 
+  alsa_interleaved = AlsaHwParamsInterleaved(hwparams);
+  if (!interleaved && alsa_interleaved)
+    RKMEDIA_LOGI("ALSA: planar capture over interleaved access\n");
   snd_pcm_hw_params_free(hwparams);
   frame_size = snd_pcm_frames_to_bytes(pcm_handle, 1);
   alsa_handle = pcm_handle;
+  if (!buffer_pool || buffer_pool->GetBufferSize() <
+                          (int)frame_size * alsa_sample_info.nb_samples)
+    buffer_pool = std::make_shared<BufferPool>(
+        kAlsaBufferNum, frame_size * alsa_sample_info.nb_samples,
+        MediaBuffer::MemType::MEM_COMMON);
   return 0;
 
 err:
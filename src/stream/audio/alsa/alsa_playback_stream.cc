@@ -7,11 +7,14 @@
 #include <assert.h>
 #include <errno.h>
 
+#include <vector>
+
 #include "../rk_audio.h"
 #include "alsa_utils.h"
 #include "alsa_volume.h"
 #include "buffer.h"
 #include "media_type.h"
+#include "pcm.h"
 #include "utils.h"
 
 namespace easymedia {
@@ -42,6 +45,7 @@ public:
 private:
   size_t Writei(const void *ptr, size_t size, size_t nmemb);
   size_t Writen(const void *ptr, size_t size, size_t nmemb);
+  size_t WriteiFromPlanar(const void *ptr, size_t size, size_t nmemb);
 
 private:
   SampleInfo sample_info;
@@ -49,6 +53,8 @@ private:
   snd_pcm_t *alsa_handle;
   size_t frame_size;
   int interleaved;
+  int alsa_interleaved; // the device access, may differ from interleaved
+  std::vector<uint8_t> convert_buffer;
   AI_LAYOUT_E layout;
 
 #ifdef AUDIO_ALGORITHM_ENABLE
@@ -64,7 +70,7 @@ const int AlsaPlayBackStream::kPresetSampleRate =
     48000; // the same to asound.conf
 const int AlsaPlayBackStream::kPresetMinBufferSize = 8192;
 AlsaPlayBackStream::AlsaPlayBackStream(const char *param)
-    : alsa_handle(NULL), frame_size(0)
+    : alsa_handle(NULL), frame_size(0), alsa_interleaved(1)
 #ifdef AUDIO_ALGORITHM_ENABLE
       ,
       bVqeEnable(false), pstVqeHandle(NULL)
@@ -97,6 +103,8 @@ AlsaPlayBackStream::~AlsaPlayBackStream() {
 size_t AlsaPlayBackStream::Write(const void *ptr, size_t size, size_t nmemb) {
   if (interleaved)
     return Writei(ptr, size, nmemb);
+  else if (alsa_interleaved)
+    return WriteiFromPlanar(ptr, size, nmemb);
   else
     return Writen(ptr, size, nmemb);
 }
@@ -136,7 +144,7 @@ out:
 }
 
 size_t AlsaPlayBackStream::Writen(const void *ptr, size_t size, size_t nmemb) {
-  uint8_t *bufs[32];
+  uint8_t *bufs[ALSA_MAX_CHANNELS];
   int channels = sample_info.channels;
   size_t sample_size = frame_size / channels;
   size_t buffer_len = size * nmemb;
@@ -177,6 +185,25 @@ out:
   return (buffer_len - frames * frame_size) / size;
 }
 
+// Planar input to a device which only does interleaved access, the planes
+// are laid out as Writen takes them.
+size_t AlsaPlayBackStream::WriteiFromPlanar(const void *ptr, size_t size,
+                                            size_t nmemb) {
+  const uint8_t *planes[ALSA_MAX_CHANNELS];
+  int channels = sample_info.channels;
+  size_t sample_size = frame_size / channels;
+  size_t buffer_len = size * nmemb;
+  int frames = (size == frame_size ? nmemb : buffer_len / frame_size);
+
+  if (convert_buffer.size() < buffer_len)
+    convert_buffer.resize(buffer_len);
+  for (int channel = 0; channel < channels; channel++)
+    planes[channel] = (const uint8_t *)ptr + frames * sample_size * channel;
+  PcmInterleave(convert_buffer.data(), (const void *const *)planes,
+                sample_size, channels, frames);
+  return Writei(convert_buffer.data(), size, nmemb);
+}
+
 bool AlsaPlayBackStream::Write(std::shared_ptr<MediaBuffer> mb) {
   if (mb->IsValid()) {
 #ifdef AUDIO_ALGORITHM_ENABLE
@@ -325,6 +352,11 @@ int AlsaPlayBackStream::Open() {
   uint32_t frames;
   if (!Writeable())
     return -1;
+  if (sample_info.channels <= 0 || sample_info.channels > ALSA_MAX_CHANNELS) {
+    RKMEDIA_LOGE("unsupported channels %d, at most %d\n", sample_info.channels,
+                 ALSA_MAX_CHANNELS);
+    return -1;
+  }
   int status = snd_pcm_hw_params_malloc(&hwparams);
   if (status < 0) {
     RKMEDIA_LOGI("snd_pcm_hw_params_malloc failed\n");
@@ -382,6 +414,9 @@ int AlsaPlayBackStream::Open() {
   /* Switch to blocking mode for playback */
   // snd_pcm_nonblock(pcm_handle, 0);
 
+  alsa_interleaved = AlsaHwParamsInterleaved(hwparams);
+  if (!interleaved && alsa_interleaved)
+    RKMEDIA_LOGI("ALSA: planar playback over interleaved access\n");
   snd_pcm_hw_params_free(hwparams);
   snd_pcm_sw_params_free(swparams);
   alsa_handle = pcm_handle;
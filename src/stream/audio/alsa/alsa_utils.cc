@@ -180,12 +180,17 @@ snd_pcm_t *AlsaCommonOpenSetHwParams(const char *device,
   }
 #endif
 
-  if (interleaved)
+  if (interleaved) {
     status = snd_pcm_hw_params_set_access(pcm_handle, hwparams,
                                           SND_PCM_ACCESS_RW_INTERLEAVED);
-  else
+  } else {
     status = snd_pcm_hw_params_set_access(pcm_handle, hwparams,
                                           SND_PCM_ACCESS_RW_NONINTERLEAVED);
+    // many devices only take interleaved frames, the stream converts
+    if (status < 0)
+      status = snd_pcm_hw_params_set_access(pcm_handle, hwparams,
+                                            SND_PCM_ACCESS_RW_INTERLEAVED);
+  }
   if (status < 0) {
     RKMEDIA_LOGI("Couldn't set access type: %s\n", snd_strerror(status));
     goto err;
@@ -232,3 +237,10 @@ err:
   }
   return NULL;
 }
+
+int AlsaHwParamsInterleaved(snd_pcm_hw_params_t *hwparams) {
+  snd_pcm_access_t access;
+  if (snd_pcm_hw_params_get_access(hwparams, &access) < 0)
+    return 0;
+  return access == SND_PCM_ACCESS_RW_INTERLEAVED;
+}
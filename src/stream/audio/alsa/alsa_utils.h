@@ -32,6 +32,9 @@ typedef enum rk_AI_LAYOUT_E {
   TYPENEAR(AUDIO_G711A)                                                        \
   TYPENEAR(AUDIO_G711U)
 
+// Most channels of a stream, the size of the per plane pointer arrays.
+#define ALSA_MAX_CHANNELS 32
+
 snd_pcm_format_t SampleFormatToAlsaFormat(SampleFormat fmt);
 int SampleFormatToInterleaved(SampleFormat fmt);
 void ShowAlsaAvailableFormats(snd_pcm_t *handle, snd_pcm_hw_params_t *params);
@@ -49,5 +52,8 @@ snd_pcm_t *AlsaCommonOpenSetHwParams(const char *device,
                                      snd_pcm_stream_t stream, int mode,
                                      SampleInfo &sample_info,
                                      snd_pcm_hw_params_t *hwparams);
+// 1 if hwparams got SND_PCM_ACCESS_RW_INTERLEAVED, which
+// AlsaCommonOpenSetHwParams falls back to for planar formats too.
+int AlsaHwParamsInterleaved(snd_pcm_hw_params_t *hwparams);
 
 #endif // EASYMEDIA_ALSA_UTILS_H_
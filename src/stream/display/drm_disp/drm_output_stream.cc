@@ -2,8 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <poll.h>
+
+#include <map>
+#include <mutex>
+
 #include "buffer.h"
 #include "control.h"
+#include "display_backend.h"
 #include "drm_stream.h"
 
 namespace easymedia {
@@ -26,88 +32,44 @@ struct plane_property_ids {
 
 #define USING_AYNC_COMMIT 1
 
-class DRMDisplayBuffer {
-public:
-  DRMDisplayBuffer(std::shared_ptr<ImageBuffer> buffer,
-                   const std::shared_ptr<DRMDevice> &dev, uint32_t drm_fmt,
-                   int num = 1, int den = 1)
-      : ib(buffer), drm_dev(dev), drm_fd(dev->GetDeviceFd()), handle(0),
-        fb_id(0) {
-    int fd = buffer->GetFD();
-    int ret = drmPrimeFDToHandle(drm_fd, fd, &handle);
-    if (ret) {
-      RKMEDIA_LOGI("Fail to drmPrimeFDToHandle, ret=%d, %m\n", ret);
-      return;
-    }
-    int w = buffer->GetVirWidth() * num / den;
-    int h = buffer->GetVirHeight();
-    uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
-    switch (drm_fmt) {
-    case DRM_FORMAT_NV12:
-    case DRM_FORMAT_NV16:
-      handles[0] = handle;
-      pitches[0] = w;
-      offsets[0] = 0;
-      handles[1] = handle;
-      pitches[1] = pitches[0];
-      offsets[1] = pitches[0] * h;
-      break;
-    case DRM_FORMAT_RGB332:
-      handles[0] = handle;
-      pitches[0] = w;
-      offsets[0] = 0;
-      break;
-    case DRM_FORMAT_RGB565:
-    case DRM_FORMAT_BGR565:
-      handles[0] = handle;
-      pitches[0] = w * 2;
-      offsets[0] = 0;
-      break;
-    case DRM_FORMAT_RGB888:
-    case DRM_FORMAT_BGR888:
-      handles[0] = handle;
-      pitches[0] = w * 3;
-      offsets[0] = 0;
-      break;
-    case DRM_FORMAT_ARGB8888:
-    case DRM_FORMAT_ABGR8888:
-      handles[0] = handle;
-      pitches[0] = w * 4;
-      offsets[0] = 0;
-      break;
-    default:
-      RKMEDIA_LOGI("TODO format for drm %c%c%c%c\n", DUMP_FOURCC(drm_fmt));
-      return;
-    }
-    ret = drmModeAddFB2(drm_fd, w, h, drm_fmt, handles, pitches, offsets,
-                        &fb_id, 0);
-    if (ret) {
-      RKMEDIA_LOGI("Fail to drmModeAddFB2, ret=%d, %m\n", ret);
-      RKMEDIA_LOGI("num/den=%d/%d, w=%d, h=%d, drm_fmt=%c%c%c%c\n", num, den, w,
-                   h, DUMP_FOURCC(drm_fmt));
-    }
-  }
-  ~DRMDisplayBuffer() {
-    if (fb_id > 0)
-      drmModeRmFB(drm_fd, fb_id);
-    if (handle > 0) {
-      struct drm_mode_destroy_dumb data = {
-          .handle = handle,
-      };
-      int ret = drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &data);
-      if (ret)
-        RKMEDIA_LOGI("Fail to free drm handle <%d>: %m\n", handle);
-    }
+static bool get_fb_info(const std::shared_ptr<ImageBuffer> &buffer,
+                        uint32_t drm_fmt, int num, int den,
+                        DisplayFBInfo *info) {
+  int w = buffer->GetVirWidth() * num / den;
+  int h = buffer->GetVirHeight();
+  memset(info, 0, sizeof(*info));
+  info->fd = buffer->GetFD();
+  info->format = drm_fmt;
+  info->width = w;
+  info->height = h;
+  switch (drm_fmt) {
+  case DRM_FORMAT_NV12:
+  case DRM_FORMAT_NV16:
+    info->pitches[0] = w;
+    info->pitches[1] = w;
+    info->offsets[1] = w * h;
+    break;
+  case DRM_FORMAT_RGB332:
+    info->pitches[0] = w;
+    break;
+  case DRM_FORMAT_RGB565:
+  case DRM_FORMAT_BGR565:
+    info->pitches[0] = w * 2;
+    break;
+  case DRM_FORMAT_RGB888:
+  case DRM_FORMAT_BGR888:
+    info->pitches[0] = w * 3;
+    break;
+  case DRM_FORMAT_ARGB8888:
+  case DRM_FORMAT_ABGR8888:
+    info->pitches[0] = w * 4;
+    break;
+  default:
+    RKMEDIA_LOGI("TODO format for drm %c%c%c%c\n", DUMP_FOURCC(drm_fmt));
+    return false;
   }
-  uint32_t GetFBID() { return fb_id; }
-
-private:
-  std::shared_ptr<ImageBuffer> ib;
-  std::shared_ptr<DRMDevice> drm_dev;
-  int drm_fd;
-  uint32_t handle;
-  uint32_t fb_id;
-};
+  return true;
+}
 
 class DRMOutPutStream : public DRMStream {
 public:
@@ -126,7 +88,8 @@ private:
   bool support_scale;
 
   bool plane_set;
-  std::shared_ptr<DRMDisplayBuffer> disp_buffer;
+  std::shared_ptr<DisplayFBCache> fb_cache;
+  std::shared_ptr<DisplayFlipQueue> flip_queue;
   ImageRect src_rect;
   ImageRect dst_rect;
   ConditionLockMutex rect_mtx;
@@ -171,6 +134,201 @@ DRMOutPutStream::DRMOutPutStream(const char *param)
     RKMEDIA_LOGI("Fail to atomic commit, ret=%d, %m\n", ret);                  \
   drmModeAtomicFree(req);
 
+// Flips of one plane through atomic commits that do not wait for vblank,
+// the page flip event on the device fd tells when the new fb is on screen.
+class DRMDisplayBackend : public DisplayBackend {
+public:
+  DRMDisplayBackend(const std::shared_ptr<DRMDevice> &dev, uint32_t crtc,
+                    uint32_t plane, const struct plane_property_ids &ids);
+  virtual ~DRMDisplayBackend();
+  virtual int GetBufferKey(int fd, uint64_t &key) override;
+  virtual uint32_t AddFB(const DisplayFBInfo &info) override;
+  virtual void RemoveFB(uint32_t fb_id) override;
+  virtual int Commit(const DisplayPlaneState &state, uint32_t cookie) override;
+  virtual int HandleEvents(int timeout_ms,
+                           const DisplayFlipCallback &done) override;
+
+private:
+  static void PageFlipHandler(int fd, unsigned int sequence,
+                              unsigned int tv_sec, unsigned int tv_usec,
+                              void *user_data);
+  void ReleaseHandle(uint32_t handle);
+
+  std::shared_ptr<DRMDevice> drm_dev;
+  int fd;
+  uint32_t crtc_id;
+  uint32_t plane_id;
+  struct plane_property_ids plane_prop_ids;
+  // allocated once and rewound for every commit, only the fb is set again
+  // while the rects stay the same
+  drmModeAtomicReq *req;
+  bool state_valid;
+  DisplayPlaneState last_state;
+
+  std::mutex mtx;
+  // a dma-buf imported twice has the same handle, it is closed with its
+  // last fb
+  std::map<uint32_t, uint32_t> fb_handles;
+  std::map<uint32_t, int> handle_refs;
+  uint32_t commit_cookie;
+  bool flip_done;
+  uint32_t done_cookie;
+  int64_t done_us;
+};
+
+DRMDisplayBackend::DRMDisplayBackend(const std::shared_ptr<DRMDevice> &dev,
+                                     uint32_t crtc, uint32_t plane,
+                                     const struct plane_property_ids &ids)
+    : drm_dev(dev), fd(dev->GetDeviceFd()), crtc_id(crtc), plane_id(plane),
+      plane_prop_ids(ids), req(drmModeAtomicAlloc()), state_valid(false),
+      commit_cookie(0), flip_done(false), done_cookie(0), done_us(0) {
+  memset(&last_state, 0, sizeof(last_state));
+  if (!req)
+    LOG_NO_MEMORY();
+}
+
+DRMDisplayBackend::~DRMDisplayBackend() {
+  while (!fb_handles.empty())
+    RemoveFB(fb_handles.begin()->first);
+  if (req)
+    drmModeAtomicFree(req);
+}
+
+// The gem handle: the kernel imports a dma-buf once per device fd, all its
+// fds get the same handle. A handle not used by an fb yet is a cache miss,
+// the AddFB that follows takes it over.
+int DRMDisplayBackend::GetBufferKey(int fd, uint64_t &key) {
+  uint32_t handle = 0;
+  int ret = drmPrimeFDToHandle(this->fd, fd, &handle);
+  if (ret) {
+    RKMEDIA_LOGI("Fail to drmPrimeFDToHandle, ret=%d, %m\n", ret);
+    return ret;
+  }
+  key = handle;
+  return 0;
+}
+
+uint32_t DRMDisplayBackend::AddFB(const DisplayFBInfo &info) {
+  uint32_t handle = 0;
+  int ret = drmPrimeFDToHandle(fd, info.fd, &handle);
+  if (ret) {
+    RKMEDIA_LOGI("Fail to drmPrimeFDToHandle, ret=%d, %m\n", ret);
+    return 0;
+  }
+  std::lock_guard<std::mutex> _lg(mtx);
+  handle_refs[handle]++;
+  uint32_t handles[4] = {0};
+  for (int i = 0; i < 4; i++)
+    handles[i] = info.pitches[i] ? handle : 0;
+  uint32_t fb_id = 0;
+  ret = drmModeAddFB2(fd, info.width, info.height, info.format, handles,
+                      info.pitches, info.offsets, &fb_id, 0);
+  if (ret) {
+    RKMEDIA_LOGI("Fail to drmModeAddFB2, ret=%d, %m\n", ret);
+    RKMEDIA_LOGI("w=%d, h=%d, drm_fmt=%c%c%c%c\n", info.width, info.height,
+                 DUMP_FOURCC(info.format));
+    ReleaseHandle(handle);
+    return 0;
+  }
+  fb_handles[fb_id] = handle;
+  return fb_id;
+}
+
+void DRMDisplayBackend::ReleaseHandle(uint32_t handle) {
+  if (--handle_refs[handle] > 0)
+    return;
+  handle_refs.erase(handle);
+  struct drm_mode_destroy_dumb data = {
+      .handle = handle,
+  };
+  int ret = drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &data);
+  if (ret)
+    RKMEDIA_LOGI("Fail to free drm handle <%d>: %m\n", handle);
+}
+
+void DRMDisplayBackend::RemoveFB(uint32_t fb_id) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  auto it = fb_handles.find(fb_id);
+  if (it == fb_handles.end())
+    return;
+  drmModeRmFB(fd, fb_id);
+  ReleaseHandle(it->second);
+  fb_handles.erase(it);
+}
+
+int DRMDisplayBackend::Commit(const DisplayPlaneState &state,
+                              uint32_t cookie) {
+  if (!req)
+    return -ENOMEM;
+  int ret = 0;
+  drmModeAtomicSetCursor(req, 0);
+  if (!state_valid || memcmp(&state.src, &last_state.src, sizeof(ImageRect)) ||
+      memcmp(&state.dst, &last_state.dst, sizeof(ImageRect))) {
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.crtc_id, crtc_id);
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.crtc_x, state.dst.x);
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.crtc_y, state.dst.y);
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.crtc_w, state.dst.w);
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.crtc_h, state.dst.h);
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.src_x, state.src.x << 16);
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.src_y, state.src.y << 16);
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.src_w, state.src.w << 16);
+    DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.src_h, state.src.h << 16);
+  }
+  DRM_ATOMIC_ADD_PROP(plane_id, plane_prop_ids.fb_id, state.fb_id);
+  mtx.lock();
+  commit_cookie = cookie;
+  mtx.unlock();
+  ret = drmModeAtomicCommit(
+      fd, req, DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK, this);
+  if (ret) {
+    state_valid = false;
+    return ret;
+  }
+  last_state = state;
+  state_valid = true;
+  return 0;
+}
+
+void DRMDisplayBackend::PageFlipHandler(int fd _UNUSED,
+                                        unsigned int sequence _UNUSED,
+                                        unsigned int tv_sec,
+                                        unsigned int tv_usec,
+                                        void *user_data) {
+  DRMDisplayBackend *backend = static_cast<DRMDisplayBackend *>(user_data);
+  std::lock_guard<std::mutex> _lg(backend->mtx);
+  backend->flip_done = true;
+  backend->done_cookie = backend->commit_cookie;
+  backend->done_us = tv_sec * 1000000LL + tv_usec;
+}
+
+int DRMDisplayBackend::HandleEvents(int timeout_ms,
+                                    const DisplayFlipCallback &done) {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int ret = poll(&pfd, 1, timeout_ms);
+  if (ret < 0)
+    return errno == EINTR ? 0 : -errno;
+  if (ret == 0)
+    return 0;
+  drmEventContext ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.version = 2;
+  ctx.page_flip_handler = PageFlipHandler;
+  if (drmHandleEvent(fd, &ctx))
+    return -EIO;
+  std::unique_lock<std::mutex> lock(mtx);
+  if (!flip_done)
+    return 0;
+  flip_done = false;
+  uint32_t cookie = done_cookie;
+  int64_t us = done_us;
+  lock.unlock();
+  done(cookie, us);
+  return 1;
+}
+
 int DRMOutPutStream::Open() {
   if (data_type.empty())
     data_type = PixFmtToString(defaultPixFmt);
@@ -258,6 +416,11 @@ int DRMOutPutStream::Open() {
     return -1;
   }
 
+  auto backend = std::make_shared<DRMDisplayBackend>(dev, crtc_id, plane_id,
+                                                     plane_prop_ids);
+  fb_cache = std::make_shared<DisplayFBCache>(backend);
+  flip_queue = std::make_shared<DisplayFlipQueue>(backend, fb_cache);
+
 #if USING_ASYNC_COMMIT
   // set aync commit
   uint32_t async_commit = 1;
@@ -278,9 +441,10 @@ int DRMOutPutStream::Open() {
 }
 
 int DRMOutPutStream::Close() {
-  int ret = DRMStream::Close();
-  disp_buffer = nullptr;
-  return ret;
+  // the queue goes first, it holds fbs of the cache
+  flip_queue = nullptr;
+  fb_cache = nullptr;
+  return DRMStream::Close();
 }
 
 int DRMOutPutStream::IoCtrl(unsigned long int request, ...) {
@@ -403,54 +567,13 @@ bool DRMOutPutStream::Write(std::shared_ptr<MediaBuffer> input) {
     return false;
   }
 
-  uint32_t disp_fb_id = 0;
-  auto disp =
-      std::make_shared<DRMDisplayBuffer>(input_img, dev, drm_fmt, num, den);
-  if (!disp || (disp_fb_id = disp->GetFBID()) == 0)
+  DisplayFBInfo info;
+  if (!flip_queue || !get_fb_info(input_img, drm_fmt, num, den, &info))
     return false;
-  int ret = 0;
-
-#if USING_ASYNC_COMMIT
-  uint32_t flags = 0;
-  ret = drmModeSetPlane(
-      fd, plane_id, crtc_id, disp_fb_id, flags, dst_rect_tmp.x, dst_rect_tmp.y,
-      dst_rect_tmp.w, dst_rect_tmp.h, src_rect_tmp.x << 16,
-      src_rect_tmp.y << 16, src_rect_tmp.w << 16, src_rect_tmp.h << 16);
-  /* Wait VBlank.*/
-  drmVBlank vbl;
-  memset(&vbl, 0, sizeof(vbl));
-  vbl.request.type = DRM_VBLANK_RELATIVE;
-  vbl.request.sequence = 1;
-  int vbl_ret = drmWaitVBlank(fd, &vbl);
-  if (vbl_ret != 0)
-    RKMEDIA_LOGE("drmWaitVBlank (relative) failed ret: %i\n", ret);
-#else
-  drmModeAtomicReq *req = drmModeAtomicAlloc();
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.crtc_id, crtc_id);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.fb_id, disp_fb_id);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.crtc_x,
-                           dst_rect_tmp.x);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.crtc_y,
-                           dst_rect_tmp.y);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.crtc_w,
-                           dst_rect_tmp.w);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.crtc_h,
-                           dst_rect_tmp.h);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.src_x,
-                           src_rect_tmp.x << 16);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.src_y,
-                           src_rect_tmp.y << 16);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.src_w,
-                           src_rect_tmp.w << 16);
-  drmModeAtomicAddProperty(req, plane_id, plane_prop_ids.src_h,
-                           src_rect_tmp.h << 16);
-  ret = drmModeAtomicCommit(fd, req, 0, NULL);
-  drmModeAtomicFree(req);
-#endif
-  if (!ret) {
-    disp_buffer = disp;
+  // the frame is on screen from the next vblank, or dropped if a newer one
+  // comes before it was committed
+  if (flip_queue->Push(input_img, info, src_rect_tmp, dst_rect_tmp))
     return true;
-  }
   RKMEDIA_LOGE("DrmDisp: %d:%d::Imgbuf<%d,%d,%d,%d> display with "
                "<%d,%d,%d,%d> failed!\n",
                crtc_id, plane_id, src_rect_tmp.x, src_rect_tmp.y,